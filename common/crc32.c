@@ -2362,6 +2362,55 @@ extent len;               /* number of bytes in buf[] */
     return REV_BE(c) ^ 0xffffffffL; /* (instead of ~c for 64-bit machines) */
 }
 #endif /* !ASM_CRC */
+
+/* =========================================================================
+ * CRC of a run of zero bytes without touching memory.  Feeding n zeros
+ * through the register multiplies it by x^(8n) modulo p, and x^(8n) is
+ * built from the powers x^(2^k) by square-and-multiply, so the cost is
+ * O(log n).  This is how holes in sparse files are checksummed.
+ */
+
+#define CRC_POLY 0xedb88320L /* p(x), reflected */
+
+local z_uint4 multmodp OF((z_uint4 a, z_uint4 b));
+
+local z_uint4 multmodp(a, b) /* a(x) * b(x) modulo p(x) */
+z_uint4 a;
+z_uint4 b;
+{
+    z_uint4 m = (z_uint4)1 << 31;
+    z_uint4 prod = 0;
+
+    for (;;) {
+        if (a & m) {
+            prod ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC_POLY : b >> 1;
+    }
+    return prod;
+}
+
+ulg crc32_zeros(crc, len)
+ulg crc;    /* crc shift register */
+zoff_t len; /* number of zero bytes */
+/* Return the crc after len zero bytes have been run through it. */
+{
+    z_uint4 xp = (z_uint4)1 << 23; /* x^8:  one zero byte */
+    z_uint4 c = (z_uint4)crc ^ 0xffffffffL;
+
+    while (len > 0) {
+        if (len & 1)
+            c = multmodp(xp, c);
+        len >>= 1;
+        if (len)
+            xp = multmodp(xp, xp);
+    }
+    return (ulg)c ^ 0xffffffffL;
+}
+
 #endif /* !CRC_TABLE_ONLY */
 #endif /* !USE_ZLIB */
 #endif /* !USE_ZLIB || USE_OWN_CRCTAB */
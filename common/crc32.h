@@ -37,6 +37,7 @@ ZCONST ulg near* get_crc_table OF((void));
 #endif
 #else  /* !(USE_ZLIB || CRC_TABLE_ONLY) */
 ulg crc32 OF((ulg crc, ZCONST uch* buf, extent len));
+ulg crc32_zeros OF((ulg crc, zoff_t len));
 #endif /* ?(USE_ZLIB || CRC_TABLE_ONLY) */
 
 #ifndef CRC_32_TAB
@@ -0,0 +1,630 @@
+/*
+  Copyright (c) 1990-2009 Info-ZIP.  All rights reserved.
+
+  See the accompanying file LICENSE, version 2009-Jan-02 or later
+  (the contents of which are also included in zip.h) for terms of use.
+  If, for some reason, all these files are missing, the Info-ZIP license
+  also may be found at:  ftp://ftp.info-zip.org/pub/infozip/license.html
+*/
+/* glob.c -- sets of wildcard patterns compiled for matching in one pass
+ *
+ * Zip and UnZip used to match a name against each -x/-i pattern or
+ * filespec in turn with a recursive matcher that backtracks on '*'.  A
+ * globset instead compiles all of its patterns once:
+ *
+ *  - each pattern is split into tokens (character, '?', '*', [list]),
+ *    with "\x" escapes, -ws "**" and case folding resolved up front;
+ *  - its leading and trailing single characters and the length its
+ *    fixed tokens need make a prefilter that most names fail at once;
+ *    patterns are hashed on their leading characters, so a name is only
+ *    prefiltered against those whose leading characters it starts with;
+ *  - a pattern that is only characters, or characters around one '*'
+ *    ("*.o", "README*"), is decided by the prefilter alone;
+ *  - the rest become one nondeterministic automaton whose states are
+ *    "this many tokens of that pattern matched".  The states of all
+ *    patterns live side by side in one bit vector and advance together,
+ *    a machine word at a time, over a single pass through the name.
+ *
+ * glob_match() returns the first pattern, in the order they were added,
+ * that matches, as a scan of the patterns would.  Matching is by byte.
+ *
+ * glob_prefix() runs the tokens of each pattern over the start of a name
+ * instead, to tell whether every name that continues it matches (the
+ * pattern ends in a '*' that the start has reached) or whether some name
+ * could.  zip -r asks it of each directory, to leave out those whose
+ * contents its -x and -i patterns exclude without reading them.
+ */
+
+#define __GLOB_C /* identifies this source module */
+
+#include "zip.h"
+#include "glob.h"
+
+#include <string.h>
+
+/* token types */
+#define GT_CHAR 0   /* one given character */
+#define GT_ANY 1    /* '?' */
+#define GT_ANYND 2  /* '?' that does not match '/' */
+#define GT_CLASS 3  /* [list] */
+#define GT_STAR 4   /* '*' */
+#define GT_STARND 5 /* '*' that does not match '/' */
+#define GT_FAIL 6   /* bad syntax: nothing matches */
+
+/* pattern kinds */
+#define GP_LITERAL 0 /* characters only: the prefilter decides */
+#define GP_AFFIX 1   /* characters, one '*', characters: the prefilter decides */
+#define GP_NFA 2     /* run through the automaton */
+#define GP_NEVER 3   /* contains GT_FAIL */
+
+#define GLOB_BITS (8 * sizeof(ulg))
+#define BIT(v, n) ((v)[(n) / GLOB_BITS] & ((ulg)1 << ((n) % GLOB_BITS)))
+#define SETBIT(v, n) ((v)[(n) / GLOB_BITS] |= (ulg)1 << ((n) % GLOB_BITS))
+#define CBIT(v, n) ((v)[(n) >> 3] & (1 << ((n) & 7))) /* byte bitmaps */
+#define CSET(v, n) ((v)[(n) >> 3] |= (uch)(1 << ((n) & 7)))
+
+#define FOLD(g, c) ((g)->fold ? (g)->fold[(uch)(c)] : (uch)(c))
+#define ISSTAR(t) ((t)->op == GT_STAR || (t)->op == GT_STARND)
+
+local int glob_grow OF((zvoid * *p, unsigned* max, unsigned need, extent size));
+local int glob_token OF((globset * g, int op, int c));
+local int glob_class OF((globset * g, ZCONST char** pp));
+local int glob_takes OF((globset * g, globtok * t, int b));
+local int glob_prefilter OF((globset * g, globpat * p, ZCONST char* s, extent len));
+local unsigned glob_candidates OF((globset * g, ZCONST char* s, extent len));
+local int glob_ucmp OF((ZCONST zvoid * a, ZCONST zvoid * b));
+
+/* FNV-1a, a byte at a time */
+#define HASH_INIT 2166136261U
+#define HASH_BYTE(h, c) (((h) ^ (unsigned)(c)) * 16777619U)
+
+/* Make room for need elements of size bytes in *p, which has *max. */
+local int glob_grow(p, max, need, size)
+zvoid** p;
+unsigned* max;
+unsigned need;
+extent size;
+{
+    unsigned n;
+    zvoid* q;
+
+    if (need <= *max)
+        return 0;
+    for (n = *max ? *max : 16; n < need; n <<= 1)
+        ;
+    if ((q = realloc(*p, n * size)) == NULL)
+        return 1;
+    *p = q;
+    *max = n;
+    return 0;
+}
+
+local int glob_token(g, op, c)
+globset* g;
+int op;
+int c;
+{
+    globtok* t;
+
+    if (glob_grow((zvoid**)&g->toks, &g->maxtoks, g->ntoks + 1, sizeof(globtok)))
+        return 1;
+    t = &g->toks[g->ntoks++];
+    t->op = (uch)op;
+    t->c = (uch)c;
+    t->cls = 0;
+    return 0;
+}
+
+/* Compile the [list] that *pp points just past the '[' of into a bitmap
+   token, leaving *pp after the ']', or a GT_FAIL token if there is no ']'.
+   A leading '!' or '^' inverts the list, a leading '-' is taken as is,
+   and "\x" stands for x. */
+local int glob_class(g, pp)
+globset* g;
+ZCONST char** pp;
+{
+    ZCONST uch* p = (ZCONST uch*)*pp;
+    ZCONST uch* q;
+    uch raw[32], fset[32];
+    uch* bits;
+    int inv, esc, prev, b, lo, hi;
+
+    inv = (*p == '!' || *p == '^');
+    p += inv;
+    for (q = p, esc = 0; *q; q++)
+        if (esc)
+            esc = 0;
+        else if (*q == '\\')
+            esc = 1;
+        else if (*q == ']')
+            break;
+    if (*q != ']') {
+        *pp += strlen(*pp);
+        return glob_token(g, GT_FAIL, 0);
+    }
+
+    memset(raw, 0, sizeof(raw));
+    for (esc = (*p == '-'), prev = -1; p < q; p++) {
+        if (!esc && *p == '\\') {
+            esc = 1;
+            continue;
+        }
+        if (!esc && *p == '-' && prev >= 0 && p + 1 < q) {
+            lo = prev;
+            hi = *++p;
+            if (lo > hi) {
+                b = lo;
+                lo = hi;
+                hi = b;
+            }
+            for (b = lo; b <= hi; b++)
+                CSET(raw, b);
+            prev = -1;
+            continue;
+        }
+        CSET(raw, *p);
+        prev = *p;
+        esc = 0;
+    }
+    *pp = (ZCONST char*)q + 1;
+
+    if (glob_grow((zvoid**)&g->cls, &g->maxcls, g->ncls + 1, sizeof(*g->cls)) || glob_token(g, GT_CLASS, 0))
+        return 1;
+    g->toks[g->ntoks - 1].cls = g->ncls;
+    bits = g->cls[g->ncls++];
+    memset(bits, 0, 32);
+    /* a byte is in the class if it folds like a member does */
+    memset(fset, 0, sizeof(fset));
+    for (b = 0; b < 256; b++)
+        if (CBIT(raw, b))
+            CSET(fset, FOLD(g, b));
+    for (b = 1; b < 256; b++)
+        if ((CBIT(fset, FOLD(g, b)) != 0) != inv)
+            CSET(bits, b);
+    return 0;
+}
+
+/* Return true if the one-character token t matches byte b. */
+local int glob_takes(g, t, b)
+globset* g;
+globtok* t;
+int b;
+{
+    switch (t->op) {
+    case GT_CHAR:
+        return FOLD(g, b) == t->c;
+    case GT_ANY:
+        return b != 0;
+    case GT_ANYND:
+        return b != 0 && b != '/';
+    case GT_CLASS:
+        return CBIT(g->cls[t->cls], b) != 0;
+    }
+    return 0;
+}
+
+/* glob_init
+ *
+ * Start an empty set.  flags are GLOB_xxx; fold, if not NULL, maps each
+ * byte to the one it compares as (for case-insensitive matching) and must
+ * outlive the set.
+ */
+void glob_init(g, flags, fold)
+globset* g;
+int flags;
+ZCONST uch* fold;
+{
+    memset(g, 0, sizeof(globset));
+    g->flags = flags;
+    g->fold = fold;
+}
+
+/* glob_add
+ *
+ * Add pattern pat to set g, which must not be built yet.  Return its index
+ * (0 for the first one), or -1 if out of memory.
+ */
+int glob_add(g, pat)
+globset* g;
+ZCONST char* pat;
+{
+    globpat* p;
+    globtok* t;
+    unsigned i;
+    int nowild = g->flags & GLOB_NOWILD;
+    int c, op;
+
+    if (glob_grow((zvoid**)&g->pats, &g->maxpats, g->npats + 1, sizeof(globpat)))
+        return -1;
+    p = &g->pats[g->npats];
+    memset(p, 0, sizeof(globpat));
+    p->tok = g->ntoks;
+
+    while ((c = (uch)*pat++) != 0) {
+        if (c == '?')
+            op = (g->flags & GLOB_STOPDIR) ? GT_ANYND : GT_ANY;
+        else if (c == '*' && !nowild) {
+            op = GT_STAR;
+            if (g->flags & GLOB_STOPDIR) {
+                if (*pat == '*')
+                    pat++; /* "**" crosses directories */
+                else
+                    op = GT_STARND;
+            }
+            /* runs of stars are one star, crossing if any of them does */
+            if (g->ntoks > p->tok && ISSTAR(&g->toks[g->ntoks - 1])) {
+                if (op == GT_STAR)
+                    g->toks[g->ntoks - 1].op = GT_STAR;
+                continue;
+            }
+        }
+        else if (c == '[' && (g->flags & GLOB_BRACKETS) && !nowild) {
+            if (glob_class(g, &pat))
+                return -1;
+            continue;
+        }
+        else {
+            if (c == '\\' && !nowild && (c = (uch)*pat++) == 0) {
+                pat--;
+                op = GT_FAIL; /* trailing '\' */
+            }
+            else
+                op = GT_CHAR;
+            c = FOLD(g, c);
+        }
+        if (glob_token(g, op, c))
+            return -1;
+    }
+    p->ntok = g->ntoks - p->tok;
+
+    /* classify, and measure what the prefilter can check */
+    t = g->toks + p->tok;
+    for (i = 0; i < p->ntok; i++)
+        if (t[i].op == GT_FAIL)
+            break;
+        else if (ISSTAR(&t[i]))
+            p->stars++;
+        else
+            p->minlen++;
+    for (p->npre = 0; p->npre < p->ntok && t[p->npre].op == GT_CHAR; p->npre++)
+        ;
+    for (p->nsuf = 0; p->nsuf < p->ntok - p->npre && t[p->ntok - 1 - p->nsuf].op == GT_CHAR; p->nsuf++)
+        ;
+    if (i < p->ntok)
+        p->kind = GP_NEVER;
+    else if (p->npre == p->ntok)
+        p->kind = GP_LITERAL;
+    else if (p->stars == 1 && p->npre + 1 + p->nsuf == p->ntok)
+        p->kind = GP_AFFIX;
+    else
+        p->kind = GP_NFA;
+    return (int)g->npats++;
+}
+
+/* glob_build
+ *
+ * Compile the automaton for the patterns of g.  Return 0, or 1 if out of
+ * memory, in which case the set cannot be used for matching.
+ */
+int glob_build(g)
+globset* g;
+{
+    unsigned i, j, k, n, w, h, size;
+    int b;
+    globpat *p, *q;
+    globtok* t;
+
+    /* chain the patterns with the same leading characters, in order */
+    for (size = 16; size < 2 * g->npats; size <<= 1)
+        ;
+    g->slot = (unsigned*)calloc(size, sizeof(unsigned));
+    g->plens = (unsigned*)malloc((g->npats + 1) * sizeof(unsigned));
+    g->cand = (unsigned*)malloc((g->npats + 1) * sizeof(unsigned));
+    if (g->slot == NULL || g->plens == NULL || g->cand == NULL)
+        return 1;
+    g->mask = size - 1;
+    for (i = g->npats; i-- > 0;) {
+        p = &g->pats[i];
+        if (p->kind == GP_NEVER)
+            continue;
+        if (p->npre == 0) {
+            p->next = g->bare;
+            g->bare = i + 1;
+            continue;
+        }
+        t = g->toks + p->tok;
+        for (h = HASH_INIT, j = 0; j < p->npre; j++)
+            h = HASH_BYTE(h, t[j].c);
+        for (h &= g->mask; g->slot[h]; h = (h + 1) & g->mask) {
+            q = &g->pats[g->slot[h] - 1];
+            if (q->npre == p->npre) {
+                for (j = 0; j < p->npre && g->toks[q->tok + j].c == t[j].c; j++)
+                    ;
+                if (j == p->npre)
+                    break;
+            }
+        }
+        p->next = g->slot[h];
+        g->slot[h] = i + 1;
+        for (k = 0; k < g->nplens && g->plens[k] != p->npre; k++)
+            ;
+        if (k == g->nplens)
+            g->plens[g->nplens++] = p->npre;
+    }
+    qsort((char*)g->plens, g->nplens, sizeof(unsigned), glob_ucmp);
+
+    for (n = 0, i = 0; i < g->npats; i++) {
+        p = &g->pats[i];
+        if (p->kind == GP_NFA) {
+            p->state = n;
+            n += p->ntok + 1; /* the last state accepts */
+        }
+    }
+    if (n == 0)
+        return 0;
+    w = g->words = (n + GLOB_BITS - 1) / GLOB_BITS;
+    g->cons = (ulg*)calloc(256 * (extent)w, sizeof(ulg));
+    g->stay = (ulg*)calloc(256 * (extent)w, sizeof(ulg));
+    g->star = (ulg*)calloc(w, sizeof(ulg));
+    g->cur = (ulg*)calloc(2 * (extent)w, sizeof(ulg));
+    if (g->cons == NULL || g->stay == NULL || g->star == NULL || g->cur == NULL)
+        return 1;
+
+    for (i = 0; i < g->npats; i++) {
+        p = &g->pats[i];
+        if (p->kind != GP_NFA)
+            continue;
+        for (j = 0; j < p->ntok; j++) {
+            t = &g->toks[p->tok + j];
+            n = p->state + j;
+            if (ISSTAR(t)) {
+                SETBIT(g->star, n);
+                for (b = 1; b < 256; b++)
+                    if (t->op == GT_STAR || b != '/')
+                        SETBIT(g->stay + b * w, n);
+            }
+            else
+                for (b = 1; b < 256; b++)
+                    if (glob_takes(g, t, b))
+                        SETBIT(g->cons + b * w, n);
+        }
+    }
+    return 0;
+}
+
+/* Return true if s, of length len, passes the checks of p that need no
+   automaton; for GP_LITERAL and GP_AFFIX that decides the match. */
+local int glob_prefilter(g, p, s, len)
+globset* g;
+globpat* p;
+ZCONST char* s;
+extent len;
+{
+    globtok* t = g->toks + p->tok;
+    ZCONST char* e;
+    unsigned i;
+
+    if (len < p->minlen || (p->stars == 0 && len != p->minlen))
+        return 0;
+    for (i = 0; i < p->npre; i++)
+        if (FOLD(g, s[i]) != t[i].c)
+            return 0;
+    e = s + len - p->nsuf;
+    t += p->ntok - p->nsuf;
+    for (i = 0; i < p->nsuf; i++)
+        if (FOLD(g, e[i]) != t[i].c)
+            return 0;
+    if (p->kind == GP_AFFIX && g->toks[p->tok + p->npre].op == GT_STARND && memchr(s + p->npre, '/', len - p->npre - p->nsuf) != NULL)
+        return 0;
+    return 1;
+}
+
+local int glob_ucmp(a, b)
+ZCONST zvoid* a;
+ZCONST zvoid* b;
+{
+    unsigned x = *(ZCONST unsigned*)a, y = *(ZCONST unsigned*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Put the patterns that s, of length len, has the leading characters of
+   (all of them for those with none) into g->cand in order, and return
+   how many there are. */
+local unsigned glob_candidates(g, s, len)
+globset* g;
+ZCONST char* s;
+extent len;
+{
+    unsigned i, j, k, n = 0, h = HASH_INIT, slot, lists = 0;
+    globpat* p;
+
+    for (j = g->bare; j; j = g->pats[j - 1].next)
+        g->cand[n++] = j - 1;
+    lists = n > 0;
+    for (i = 0, k = 0; k < g->nplens && g->plens[k] <= len; k++) {
+        for (; i < g->plens[k]; i++)
+            h = HASH_BYTE(h, FOLD(g, s[i]));
+        for (slot = h & g->mask; g->slot[slot]; slot = (slot + 1) & g->mask) {
+            p = &g->pats[g->slot[slot] - 1];
+            if (p->npre != i)
+                continue;
+            for (j = 0; j < i && g->toks[p->tok + j].c == FOLD(g, s[j]); j++)
+                ;
+            if (j < i)
+                continue;
+            for (j = g->slot[slot]; j; j = g->pats[j - 1].next)
+                g->cand[n++] = j - 1;
+            lists++;
+            break;
+        }
+    }
+    if (lists > 1)
+        qsort((char*)g->cand, n, sizeof(unsigned), glob_ucmp);
+    return n;
+}
+
+/* glob_match
+ *
+ * Return the index of the first pattern of the built set g that matches
+ * all of s, or -1 if none does.
+ */
+int glob_match(g, s)
+globset* g;
+ZCONST char* s;
+{
+    extent len = strlen(s);
+    unsigned i, k, n, w, lo = 0, hi = 0, limit = g->npats;
+    int seeded = 0, any;
+    globpat* p;
+    ulg *cur, *nxt, *tmp, *cons, *stay, t, carry;
+    ZCONST uch* q;
+
+    cur = g->cur;
+    nxt = g->cur + g->words;
+    n = glob_candidates(g, s, len);
+    for (k = 0; k < n; k++) {
+        i = g->cand[k];
+        p = &g->pats[i];
+        if (!glob_prefilter(g, p, s, len))
+            continue;
+        if (p->kind != GP_NFA) {
+            limit = i; /* no later pattern can come first */
+            break;
+        }
+        if (!seeded++)
+            lo = p->state / GLOB_BITS;
+        hi = (p->state + p->ntok) / GLOB_BITS;
+        SETBIT(cur, p->state);
+    }
+    if (!seeded)
+        return limit < g->npats ? (int)limit : -1;
+
+    /* entering a '*' state also enters the one after it */
+    for (carry = 0, w = lo; w <= hi; w++) {
+        t = cur[w] & g->star[w];
+        cur[w] |= (t << 1) | carry;
+        carry = t >> (GLOB_BITS - 1);
+    }
+    for (q = (ZCONST uch*)s, any = 1; *q && any; q++) {
+        cons = g->cons + *q * g->words;
+        stay = g->stay + *q * g->words;
+        for (carry = 0, w = lo; w <= hi; w++) {
+            t = cur[w] & cons[w];
+            nxt[w] = (t << 1) | carry | (cur[w] & stay[w]);
+            carry = t >> (GLOB_BITS - 1);
+        }
+        for (carry = 0, any = 0, w = lo; w <= hi; w++) {
+            t = nxt[w] & g->star[w];
+            nxt[w] |= (t << 1) | carry;
+            carry = t >> (GLOB_BITS - 1);
+            any |= nxt[w] != 0;
+        }
+        tmp = cur;
+        cur = nxt;
+        nxt = tmp;
+    }
+
+    for (k = 0; k < n && (i = g->cand[k]) < limit; k++) {
+        p = &g->pats[i];
+        if (p->kind == GP_NFA && !*q && BIT(cur, p->state + p->ntok)) {
+            limit = i;
+            break;
+        }
+    }
+    memset(g->cur + lo, 0, (hi - lo + 1) * sizeof(ulg));
+    memset(g->cur + g->words + lo, 0, (hi - lo + 1) * sizeof(ulg));
+    return limit < g->npats ? (int)limit : -1;
+}
+
+/* glob_prefix
+ *
+ * Return the index of the first pattern of the built set g that matches
+ * every name which begins with s and is longer (how GLOB_ALL), or that
+ * some such name may match (GLOB_SOME), or -1 if there is none.  Unlike
+ * glob_match() it leaves g as it is, so that several threads can ask at
+ * once.  Out of memory, it answers -1 to GLOB_ALL and 0 to GLOB_SOME.
+ */
+int glob_prefix(g, s, how)
+globset* g;
+ZCONST char* s;
+int how;
+{
+    unsigned i, j, n = 0;
+    int r = -1, live;
+    globpat* p;
+    globtok* t;
+    uch *cur, *nxt, *tmp;
+    ZCONST uch* q;
+
+    for (i = 0; i < g->npats; i++)
+        if (g->pats[i].ntok > n)
+            n = g->pats[i].ntok;
+    if ((cur = (uch*)malloc(2 * (extent)(n + 1))) == NULL)
+        return how == GLOB_ALL ? -1 : 0;
+    tmp = cur;
+    nxt = cur + n + 1;
+
+    for (i = 0; i < g->npats && r < 0; i++) {
+        p = &g->pats[i];
+        t = g->toks + p->tok;
+        if (p->kind == GP_NEVER || p->ntok == 0)
+            continue;
+        memset(cur, 0, p->ntok + 1);
+        cur[0] = 1;
+        for (q = (ZCONST uch*)s;; q++) {
+            /* entering a '*' state also enters the one after it; the
+               last state, all tokens taken, has no way on */
+            for (live = 0, j = 0; j < p->ntok; j++) {
+                if (cur[j] && ISSTAR(&t[j]))
+                    cur[j + 1] = 1;
+                live |= cur[j];
+            }
+            if (!*q || !live)
+                break;
+            memset(nxt, 0, p->ntok + 1);
+            for (j = 0; j < p->ntok; j++)
+                if (!cur[j])
+                    continue;
+                else if (ISSTAR(&t[j])) {
+                    if (t[j].op == GT_STAR || *q != '/')
+                        nxt[j] = 1;
+                }
+                else if (glob_takes(g, &t[j], *q))
+                    nxt[j + 1] = 1;
+            tmp = cur;
+            cur = nxt;
+            nxt = tmp;
+        }
+        if (how == GLOB_ALL ? live && cur[p->ntok - 1] && t[p->ntok - 1].op == GT_STAR : live)
+            r = (int)i;
+    }
+    free(cur < nxt ? cur : nxt);
+    return r;
+}
+
+void glob_free(g)
+globset* g;
+{
+    if (g->pats != NULL)
+        free(g->pats);
+    if (g->toks != NULL)
+        free(g->toks);
+    if (g->cls != NULL)
+        free(g->cls);
+    if (g->cons != NULL)
+        free(g->cons);
+    if (g->stay != NULL)
+        free(g->stay);
+    if (g->star != NULL)
+        free(g->star);
+    if (g->cur != NULL)
+        free(g->cur);
+    if (g->slot != NULL)
+        free(g->slot);
+    if (g->plens != NULL)
+        free(g->plens);
+    if (g->cand != NULL)
+        free(g->cand);
+    memset(g, 0, sizeof(globset));
+}
@@ -0,0 +1,84 @@
+/*
+  Copyright (c) 1990-2009 Info-ZIP.  All rights reserved.
+
+  See the accompanying file LICENSE, version 2009-Jan-02 or later
+  (the contents of which are also included in zip.h) for terms of use.
+  If, for some reason, all these files are missing, the Info-ZIP license
+  also may be found at:  ftp://ftp.info-zip.org/pub/infozip/license.html
+*/
+/* glob.h -- sets of wildcard patterns compiled for matching in one pass
+ */
+
+#ifndef __glob_h
+#define __glob_h /* identifies this source module */
+
+/* This header should be read AFTER zip.h resp. unzip.h
+ * (the latter with UNZIP_INTERNAL defined...).
+ */
+
+#ifndef OF
+#define OF(a) a
+#endif
+#ifndef ZCONST
+#define ZCONST const
+#endif
+
+/* glob_init() flags */
+#define GLOB_STOPDIR 1  /* '?' and '*' do not match '/', "**" does */
+#define GLOB_BRACKETS 2 /* [list] matches one character of the list */
+#define GLOB_NOWILD 4   /* '*', '[' and '\' are plain characters */
+
+/* glob_prefix() questions */
+#define GLOB_ALL 0  /* does a pattern match every name that continues s? */
+#define GLOB_SOME 1 /* could a pattern match a name that continues s? */
+
+typedef struct globtok { /* one pattern element */
+    uch op;              /* GT_xxx in glob.c */
+    uch c;               /* GT_CHAR: the (folded) character */
+    unsigned cls;        /* GT_CLASS: index of its bitmap */
+} globtok;
+
+typedef struct globpat { /* one pattern of a set */
+    unsigned tok;        /* its first token */
+    unsigned ntok;       /* number of tokens */
+    unsigned state;      /* its first automaton state (GP_NFA only) */
+    unsigned npre;       /* leading single characters */
+    unsigned nsuf;       /* trailing single characters */
+    unsigned minlen;     /* bytes taken by the tokens other than '*' */
+    int stars;           /* number of '*' tokens */
+    int kind;            /* GP_xxx in glob.c */
+    unsigned next;       /* 1 + next pattern with the same prefix (or with
+                            none, after bare), or 0 */
+} globpat;
+
+typedef struct globset {
+    int flags;
+    ZCONST uch* fold;    /* case map to compare through, NULL for exact */
+    globpat* pats;
+    unsigned npats, maxpats;
+    globtok* toks;
+    unsigned ntoks, maxtoks;
+    uch (*cls)[32];      /* character class bitmaps */
+    unsigned ncls, maxcls;
+    /* built by glob_build() */
+    unsigned* slot;      /* 1 + first pattern with a given prefix, or 0 */
+    unsigned mask;       /* number of slots - 1 */
+    unsigned* plens;     /* the prefix lengths there are, ascending */
+    unsigned nplens;
+    unsigned bare;       /* 1 + first pattern without a prefix, or 0 */
+    unsigned* cand;      /* [npats]: patterns a name has the prefix of */
+    unsigned words;      /* ulg words per state vector */
+    ulg* cons;           /* [256][words]: states whose token takes the byte */
+    ulg* stay;           /* [256][words]: '*' states that take the byte */
+    ulg* star;           /* [words]: '*' states */
+    ulg* cur;            /* [2 * words]: current and next state vectors */
+} globset;
+
+void glob_init OF((globset * g, int flags, ZCONST uch* fold));
+int glob_add OF((globset * g, ZCONST char* pat));
+int glob_build OF((globset * g));
+int glob_match OF((globset * g, ZCONST char* s));
+int glob_prefix OF((globset * g, ZCONST char* s, int how));
+void glob_free OF((globset * g));
+
+#endif /* !__glob_h */
@@ -186,6 +186,24 @@ with open(out, "wb") as f:
 PY
 }
 
+py_same_deflate(){ # args: zip_path file level; member data is what zlib makes
+  "$PYTHON_BIN" - "$@" <<'PY'
+import struct, sys, zipfile, zlib
+zip_path, path, level = sys.argv[1], sys.argv[2], int(sys.argv[3])
+with zipfile.ZipFile(zip_path) as z:
+    info = z.infolist()[0]
+with open(zip_path, "rb") as f:
+    f.seek(info.header_offset)
+    h = f.read(30)
+    f.seek(struct.unpack("<HH", h[26:30])[0] + struct.unpack("<HH", h[26:30])[1], 1)
+    data = f.read(info.compress_size)
+c = zlib.compressobj(level, zlib.DEFLATED, -15, 8)
+ref = c.compress(open(path, "rb").read()) + c.flush()
+if data != ref:
+    raise SystemExit(f"-{level}: {len(data)} bytes, zlib makes {len(ref)}; ")
+PY
+}
+
 # ----- expected bytes for shell-level checks -----
 mkexp "$EXPECT/hello.txt"   $'hello world\n'
 mkexp "$EXPECT/nested.txt"  $'nested file\n'
@@ -353,7 +371,497 @@ Z4(){
   fi
 }
 
-Z1; Z2; Z3; Z4
+Z5(){
+  local zs="$ART/zip-stdout.zip" zw="$ART/zip-wb.zip" zn="$ART/zip-nowb.zip"
+  rm -f "$zs" "$zw" "$zn"
+  ( cd "$SRC/zip-rec" && "$ZIP_BIN" -X -q -r - "root.txt" "dir" | cat > "$zs" )
+  ( cd "$SRC/zip-rec" && "$ZIP_BIN" -X -q -r "$zw" "root.txt" "dir" )
+  ( cd "$SRC/zip-rec" && "$ZIP_BIN" -X -q -r -wb- "$zn" "root.txt" "dir" )
+  if py_expect_subset "$zs" "root.txt" "dir/keep.txt" "dir/sub/inner.txt"; then
+    ok "zip - streamed archive through a pipe"
+  else
+    err "zip - to pipe produced a bad archive"
+  fi
+  if cmp -s "$zw" "$zn"; then
+    ok "zip write-behind output matches -wb-"
+  else
+    err "zip write-behind output differs from -wb-"
+  fi
+}
+
+Z6(){
+  rm -rf "$SRC/zip-link"; mkdir -p "$SRC/zip-link"
+  printf 'one\n' > "$SRC/zip-link/one.txt"
+  printf 'two\n' > "$SRC/zip-link/two.txt"
+  ( cd "$SRC/zip-link" && "$ZIP_BIN" -X -q a.zip one.txt && ln -f a.zip b.zip \
+    && "$ZIP_BIN" -X -q a.zip two.txt )
+  if py_expect_subset "$SRC/zip-link/b.zip" "one.txt" "two.txt"; then
+    ok "zip update kept hard-linked archive in sync"
+  else
+    err "zip update broke hard link to archive"
+  fi
+  if compgen -G "$SRC/zip-link/zi*" >/dev/null; then
+    err "zip left temp files behind"; ls "$SRC/zip-link"
+  else
+    ok "zip left no temp files"
+  fi
+}
+
+Z7(){
+  local d="$SRC/sparse"
+  rm -rf "$d"; mkdir -p "$d/out"
+  # 64 MiB file that is all hole except a little data in the middle and end
+  truncate -s 64M "$d/img"
+  printf 'middle' | dd of="$d/img" bs=1 seek=$((20 << 20)) conv=notrunc status=none
+  printf 'end' | dd of="$d/img" bs=1 seek=$(((64 << 20) - 3)) conv=notrunc status=none
+  ( cd "$d" && "$ZIP_BIN" -X -q s.zip img )
+  ( cd "$d/out" && "$UNZIP_BIN" -q --sparse ../s.zip )
+  if cmp -s "$d/img" "$d/out/img"; then
+    ok "sparse file round-trips through zip and unzip --sparse"
+  else
+    err "sparse round-trip content mismatch"
+  fi
+  if (( $(stat -c %b "$d/out/img") * 512 < (1 << 20) )); then
+    ok "unzip --sparse left holes in the output"
+  else
+    err "unzip --sparse wrote the zeros out"; stat "$d/out/img"
+  fi
+  # zeros written out as data get no shortcut:  deflate as zlib does
+  local l out=""
+  for l in 1 2 3; do
+    printf 'text between runs of zeros %d\n' "$l" >> "$d/dense"
+    head -c $((l * 3000)) /dev/zero >> "$d/dense"
+    head -c 2000 "$ZIP_BIN" >> "$d/dense"
+  done
+  for l in 1 6 9; do
+    rm -f "$d/d.zip"; ( cd "$d" && "$ZIP_BIN" -X -q -$l d.zip dense )
+    out+="$(py_same_deflate "$d/d.zip" "$d/dense" $l 2>&1 || true)"
+  done
+  if [[ -z "$out" ]]; then
+    ok "zeros in file data compress as without the hole shortcut"
+  else
+    err "zeros in file data compress differently: $out"
+  fi
+}
+
+Z8(){
+  local d="$SRC/stream"
+  rm -rf "$d"; mkdir -p "$d/in/sub" "$d/out" "$d/sel"
+  seq 1 200000 > "$d/in/seq"
+  head -c 300000 /dev/urandom > "$d/in/sub/rnd"
+  : > "$d/in/empty"
+  # zip to a pipe writes data descriptors; unzip reads it from a pipe too
+  ( cd "$d" && "$ZIP_BIN" -q -r - in | cat > p.zip )
+  ( cd "$d/out" && cat ../p.zip | "$UNZIP_BIN" -q - )
+  if diff -r "$d/in" "$d/out/in" >/dev/null; then
+    ok "unzip - extracts a piped zip - archive"
+  else
+    err "streamed extraction differs"
+  fi
+  ( cd "$d/sel" && cat ../p.zip | "$UNZIP_BIN" -q - 'in/sub/*' )
+  if cmp -s "$d/in/sub/rnd" "$d/sel/in/sub/rnd" && [[ ! -e "$d/sel/in/seq" ]]; then
+    ok "unzip - skips unselected entries of unknown size"
+  else
+    err "streamed selection failed"
+  fi
+  if [[ "$(cat "$d/p.zip" | "$UNZIP_BIN" -p - in/seq | md5sum)" == "$(md5sum < "$d/in/seq")" ]]; then
+    ok "unzip -p - writes the member to stdout"
+  else
+    err "unzip -p - output mismatch"
+  fi
+}
+
+Z9(){
+  local d="$SRC/pipeout"
+  rm -rf "$d"; mkdir -p "$d"
+  head -c 3000000 /dev/urandom > "$d/rnd"
+  seq 1 300000 > "$d/seq"
+  ( cd "$d" && "$ZIP_BIN" -q -X p.zip rnd seq )
+  # -p to a pipe, to a file and with -a text conversion
+  if [[ "$("$UNZIP_BIN" -p "$d/p.zip" rnd seq | cat | md5sum)" == "$(cat "$d/rnd" "$d/seq" | md5sum)" ]]; then
+    ok "unzip -p writes members to a pipe"
+  else
+    err "unzip -p pipe output mismatch"
+  fi
+  "$UNZIP_BIN" -p "$d/p.zip" seq > "$d/seq.out"
+  "$UNZIP_BIN" -p -a "$d/p.zip" seq > "$d/seq.txt"
+  if cmp -s "$d/seq" "$d/seq.out" && cmp -s "$d/seq" "$d/seq.txt"; then
+    ok "unzip -p writes members to a file"
+  else
+    err "unzip -p file output mismatch"
+  fi
+}
+
+Z10(){
+  local d="$SRC/nameidx" i
+  rm -rf "$d"; mkdir -p "$d/t"
+  for i in $(seq 1 200); do echo "f$i" > "$d/t/f$i"; done
+  ( cd "$d" && "$ZIP_BIN" -q -r -ni n.zip t )
+  # literal names go through the index, misses and wildcards do not
+  if [[ "$("$UNZIP_BIN" -p "$d/n.zip" t/f7 t/f150)" == $'f150\nf7' ]] &&
+     [[ "$("$UNZIP_BIN" -l "$d/n.zip" 't/f1?' | tail -1 | awk '{print $2}')" == 10 ]] &&
+     ! "$UNZIP_BIN" -p "$d/n.zip" t/f7 t/nothere > /dev/null 2>&1; then
+    ok "unzip finds named members through the name index"
+  else
+    err "unzip name index lookup wrong"
+  fi
+  # kept on update, dropped by -ni-, read past when streamed
+  ( cd "$d" && "$ZIP_BIN" -q -d n.zip t/f7 && "$ZIP_BIN" -q n.zip t/f7 )
+  if grep -q IZNX "$d/n.zip" && [[ "$("$UNZIP_BIN" -p "$d/n.zip" t/f7)" == f7 ]] &&
+     [[ "$( cd "$d" && "$ZIP_BIN" -q -ni - t/f1 t/f2 | "$UNZIP_BIN" -p - t/f2)" == f2 ]] &&
+     ( cd "$d" && "$ZIP_BIN" -q -ni- n.zip t/f1 ) && ! grep -q IZNX "$d/n.zip"; then
+    ok "zip keeps the name index on update until -ni-"
+  else
+    err "zip name index not kept or not dropped"
+  fi
+}
+
+Z11(){
+  local d="$SRC/specs" i out
+  rm -rf "$d"; mkdir -p "$d/t"
+  for i in $(seq 1 300); do echo "f$i" > "$d/t/f$i"; done
+  ( cd "$d" && "$ZIP_BIN" -q -r s.zip t )
+  # many literal names mixed with a wildcard, an exclude, -C and a miss
+  out="$("$UNZIP_BIN" -C -l "$d/s.zip" $(seq -f 't/f%g' 1 2 300) 'T/F2?' -x t/f21 t/F3 nothere 2>&1)"
+  if [[ "$(echo "$out" | grep -c ' t/f')" == 153 ]] && ! echo "$out" | grep -q ' t/f21$' &&
+     [[ "$("$UNZIP_BIN" -t "$d/s.zip" t/f1 nothere 2>&1)" == *"not matched:  nothere"* ]]; then
+    ok "unzip selects members from many literal filespecs"
+  else
+    err "unzip literal filespec selection wrong"
+  fi
+}
+
+Z12(){
+  local d="$SRC/globs" out
+  rm -rf "$d"; mkdir -p "$d/t/s/u"
+  touch "$d/t/a.o" "$d/t/b.c" "$d/t/s/c.o" "$d/t/s/u/d.o" "$d/t/s/u/e.h"
+  # -ws: '*' stops at '/', "**" does not; several lists in one run
+  out="$( cd "$d" && "$ZIP_BIN" -sf -ws -r n.zip t -x 't/*.o' 't/**/u/*.h' 'nothing*' )"
+  if [[ "$out" == *t/s/c.o* && "$out" == *t/s/u/d.o* && "$out" != *t/a.o* && "$out" != *e.h* ]] &&
+     ( cd "$d" && "$ZIP_BIN" -q -r g.zip t ) &&
+     [[ "$("$UNZIP_BIN" -l "$d/g.zip" 't/[as]*.[oh]' 't/s/u/?.h' -x '*/d.*' | awk '$4 ~ /^t\// {print $4}' | sort | tr '\n' ' ')" == "t/a.o t/s/c.o t/s/u/e.h " ]]; then
+    ok "zip and unzip match compiled pattern lists"
+  else
+    err "compiled pattern lists matched wrong"
+  fi
+}
+
+Z13(){
+  local d="$SRC/dups" i
+  rm -rf "$d"; mkdir -p "$d/a" "$d/b"
+  for i in $(seq 1 500); do echo "$i" > "$d/a/f$i"; done
+  echo b > "$d/b/f1"
+  # names given twice are added once; update finds every existing entry
+  ( cd "$d" && { seq -f 'a/f%g' 1 500; seq -f 'a/f%g' 500 -1 1; } | "$ZIP_BIN" -q u.zip -@ )
+  echo new > "$d/a/f250"
+  if [[ "$("$UNZIP_BIN" -l "$d/u.zip" | tail -1 | awk '{print $2}')" == 500 ]] &&
+     ( cd "$d" && "$ZIP_BIN" -q u.zip a/f250 a/f1 a/f250 ) &&
+     [[ "$("$UNZIP_BIN" -l "$d/u.zip" | tail -1 | awk '{print $2}')" == 500 ]] &&
+     [[ "$("$UNZIP_BIN" -p "$d/u.zip" a/f250)" == new ]]; then
+    ok "zip drops repeated names and replaces existing entries"
+  else
+    err "zip duplicate or update lookup wrong"
+  fi
+  if ! ( cd "$d" && "$ZIP_BIN" -q -j j.zip a/f1 a/f2 b/f1 ) > /dev/null 2>&1; then
+    ok "zip rejects names repeated in the archive"
+  else
+    err "zip accepted a repeated name"
+  fi
+}
+
+Z14(){
+  local d="$SRC/bulkcd" out
+  rm -rf "$d"; mkdir -p "$d/t"
+  ( cd "$d/t" && seq -f 'f%g' 1 3000 | xargs touch )
+  ( cd "$d" && "$ZIP_BIN" -q -r b.zip t && echo x > t/f1 )
+  # the whole directory is read at once and every entry survives an update
+  out="$( cd "$d" && "$ZIP_BIN" -sd b.zip t/f1 2>&1 )"
+  if [[ "$out" == *"Read 3001 entries"*"bytes of central directory in one read"* && "$out" != *"(0 bytes"* ]] &&
+     [[ "$("$UNZIP_BIN" -l "$d/b.zip" | tail -1 | awk '{print $2}')" == 3001 ]] &&
+     [[ "$("$UNZIP_BIN" -p "$d/b.zip" t/f1)" == x ]]; then
+    ok "zip reads the central directory in one piece"
+  else
+    err "zip bulk central directory read wrong"
+  fi
+}
+
+Z15(){
+  local d="$SRC/arena" out
+  rm -rf "$d"; mkdir -p "$d/t/a/b" "$d/t/c"
+  touch "$d/t/a/b/x" "$d/t/a/y" "$d/t/c/z"
+  # entries come from the arena; -m still cuts names back to their dirs
+  out="$( cd "$d" && "$ZIP_BIN" -sd -q -m -r m.zip t 2>&1 )"
+  if [[ "$out" == *"bytes in the arena"* ]] && [[ ! -e "$d/t" ]] &&
+     [[ "$("$UNZIP_BIN" -l "$d/m.zip" | awk '$4 ~ /^t\// {print $4}' | sort | tr '\n' ' ')" == "t/ t/a/ t/a/b/ t/a/b/x t/a/y t/c/ t/c/z " ]] &&
+     ( cd "$d" && "$ZIP_BIN" -q -d m.zip t/c/z && "$ZIP_BIN" -q -c m.zip t/a/y <<< "note" ) &&
+     [[ "$("$UNZIP_BIN" -l "$d/m.zip" | tail -1 | awk '{print $2}')" == 6 ]]; then
+    ok "zip keeps entry data in an arena"
+  else
+    err "zip arena entries wrong"
+  fi
+}
+
+Z16(){
+  local d="$SRC/cdload" i out
+  rm -rf "$d"; mkdir -p "$d/t"
+  for i in $(seq 1 300); do echo "$i" > "$d/t/f$i"; done
+  ( cd "$d" && "$ZIP_BIN" -q -r c.zip t && "$ZIP_BIN" -q -c c.zip t/f7 <<< "seven" )
+  # more entries than one block of the directory, and a prefix to skip
+  { printf 'junk'; cat "$d/c.zip"; } > "$d/j.zip"
+  out="$("$UNZIP_BIN" --stats -q -o "$d/c.zip" -d "$d/x" 2>&1)"
+  if [[ "$out" == *"301 entries"*"bytes of heap"* ]] &&
+     diff -r "$d/t" "$d/x/t" >/dev/null &&
+     { "$UNZIP_BIN" -q -o "$d/j.zip" -d "$d/y" >/dev/null 2>&1 || [[ $? == 1 ]]; } &&
+     diff -r "$d/t" "$d/y/t" >/dev/null &&
+     [[ "$("$UNZIP_BIN" -v "$d/j.zip" 2>/dev/null | grep -c seven)" == 1 ]]; then
+    ok "unzip reads the central directory in one piece"
+  else
+    err "unzip central directory load wrong"
+  fi
+}
+
+Z17(){
+  local d="$SRC/listing" out
+  rm -rf "$d"; mkdir -p "$d/t"
+  printf 'hello hello hello hello\n' > "$d/t/a"; : > "$d/t/b"
+  touch -t 202001020304 "$d/t/a" "$d/t/b"
+  ( cd "$d" && "$ZIP_BIN" -q -X -r l.zip t/a t/b )
+  out="$(TZ=UTC "$UNZIP_BIN" -v "$d/l.zip" | grep ' t/a$')"
+  if [[ "$("$UNZIP_BIN" --names "$d/l.zip")" == $'t/a\nt/b' ]] &&
+     [[ "$("$UNZIP_BIN" --names "$d/l.zip" 't/b')" == "t/b" ]] &&
+     [[ "$out" =~ ^\ {6}24\ \ Defl:N\ {7}[0-9]+\ +[0-9]+%\ 01-02-2020\ 03:04\ [0-9a-f]{8}\ \ t/a$ ]] &&
+     [[ "$(TZ=UTC "$UNZIP_BIN" -l "$d/l.zip" | grep ' t/b$')" == "        0  01-02-2020 03:04   t/b" ]]; then
+    ok "unzip lists entries and names only"
+  else
+    err "unzip listing wrong"
+  fi
+}
+
+Z18(){
+  local d="$SRC/fixfix"
+  rm -rf "$d"; mkdir -p "$d"
+  printf 'first\n' > "$d/a"; head -c 300000 /dev/urandom > "$d/b"; printf 'third\n' > "$d/c"
+  ( cd "$d" && "$ZIP_BIN" -q -0 - a b c | cat > s.zip )
+  printf 'XXXX' | dd of="$d/s.zip" bs=1 seek=0 conv=notrunc 2>/dev/null
+  if "$ZIP_BIN" -FF "$d/s.zip" --out "$d/r.zip" </dev/null >/dev/null 2>&1 &&
+     "$UNZIP_BIN" -tq "$d/r.zip" >/dev/null 2>&1 &&
+     [[ "$("$UNZIP_BIN" --names "$d/r.zip")" == $'b\nc' ]] &&
+     [[ "$("$UNZIP_BIN" -p "$d/r.zip" b | cmp - "$d/b" && echo same)" == "same" ]]; then
+    ok "zip -FF recovers entries after a damaged header"
+  else
+    err "zip -FF recovery wrong"
+  fi
+}
+
+Z19(){
+  local d="$SRC/walk" a b
+  rm -rf "$d"; mkdir -p "$d/t/b/y" "$d/t/a"
+  for f in t/z t/b/y/2 t/b/y/1 t/b/x t/a/q t/m; do printf '%s\n' "$f" > "$d/$f"; done
+  ( cd "$d" && "$ZIP_BIN" -q -r -wt 4 s.zip t && "$ZIP_BIN" -q -r -wt 0 --readdir-order r.zip t )
+  a="$("$UNZIP_BIN" --names "$d/s.zip" | tr '\n' ' ')"
+  b="$("$UNZIP_BIN" --names "$d/r.zip" | sort | tr '\n' ' ')"
+  if [[ "$a" == "t/ t/a/ t/a/q t/b/ t/b/x t/b/y/ t/b/y/1 t/b/y/2 t/m t/z " ]] &&
+     [[ "$b" == "$("$UNZIP_BIN" --names "$d/s.zip" | sort | tr '\n' ' ')" ]]; then
+    ok "zip -r walks directories in sorted order"
+  else
+    err "zip -r order wrong: $a"
+  fi
+}
+
+Z20(){
+  local d="$SRC/statonce" pid
+  rm -rf "$d"; mkdir -p "$d"
+  mkfifo "$d/p"; printf 'old\n' > "$d/b"; touch -t 202001020304 "$d/b"
+  # zip stops at the FIFO after its scan; b changes meanwhile
+  ( cd "$d" && "$ZIP_BIN" -q -FI o.zip p b ) & pid=$!
+  sleep 1; printf 'new and longer\n' > "$d/b"; printf 'fifo\n' > "$d/p"
+  wait "$pid"
+  if [[ "$("$UNZIP_BIN" -p "$d/o.zip" b)" == "new and longer" ]] &&
+     "$UNZIP_BIN" -tq "$d/o.zip" >/dev/null 2>&1 &&
+     ! "$UNZIP_BIN" -l "$d/o.zip" b | grep -q '2020'; then
+    ok "zip describes a file that changed after the scan as it is"
+  else
+    err "zip used stale file information"
+  fi
+}
+
+Z21(){
+  local d="$SRC/prune" a sd
+  rm -rf "$d"; mkdir -p "$d/t/x/deep" "$d/t/k/x"
+  for f in t/a t/x/b t/x/deep/c t/k/x/e t/k/f; do printf '%s\n' "$f" > "$d/$f"; done
+  sd="$(cd "$d" && "$ZIP_BIN" -r -sd o.zip t -x 't/x/*' 2>&1)"
+  a="$("$UNZIP_BIN" --names "$d/o.zip" | tr '\n' ' ')"
+  if [[ "$a" == "t/ t/a t/k/ t/k/f t/k/x/ t/k/x/e " ]] &&
+     grep -q 'Not reading t/x/' <<<"$sd" && ! grep -q 'Not reading t/k/' <<<"$sd"; then
+    ok "zip -r leaves excluded directories unread"
+  else
+    err "zip -r pruning wrong: $a"
+  fi
+}
+
+Z22(){
+  local d="$SRC/streamadd" a b
+  rm -rf "$d"; mkdir -p "$d/t/s"
+  for f in t/b t/s/c t/a; do printf '%s\n' "$f" > "$d/$f"; done
+  # the second -@ name only comes once the archive is being written
+  ( cd "$d" && { echo t/a; for i in $(seq 50); do [[ -e o.zip ]] && break; sleep 0.1; done
+                 [[ -e o.zip ]] && echo t/b; } | "$ZIP_BIN" -q --stream-add o.zip -@ )
+  ( cd "$d" && "$ZIP_BIN" -q -r n.zip t t/a && "$ZIP_BIN" -q -r --stream-add s.zip t t/a )
+  a="$("$UNZIP_BIN" --names "$d/o.zip" | tr '\n' ' ')"
+  b="$("$UNZIP_BIN" --names "$d/s.zip" | tr '\n' ' ')"
+  if [[ "$a" == "t/a t/b " && "$b" == "$("$UNZIP_BIN" --names "$d/n.zip" | tr '\n' ' ')" ]] &&
+     "$UNZIP_BIN" -tq "$d/s.zip" >/dev/null 2>&1; then
+    ok "zip --stream-add zips names as they are found"
+  else
+    err "zip --stream-add wrong: $a / $b"
+  fi
+}
+
+Z23(){
+  local d="$SRC/dircache" i out
+  rm -rf "$d"; mkdir -p "$d/t/a/b/c/d/e" "$d/x"
+  for i in $(seq 1 200); do echo "$i" > "$d/t/a/b/c/d/e/f$i"; done
+  ( cd "$d" && "$ZIP_BIN" -q -r c.zip t )
+  echo old > "$d/x/t"
+  # each directory is looked at once, not again for every file in it
+  out="$("$UNZIP_BIN" --stats -q -o "$d/c.zip" -d "$d/y" 2>&1)"
+  if [[ "$out" == *"200 files created with "*" calls, "[1-6].*" per file"* ]] &&
+     diff -r "$d/t" "$d/y/t" >/dev/null &&
+     ! "$UNZIP_BIN" -q -o "$d/c.zip" -d "$d/x" >/dev/null 2>&1 &&
+     [[ "$(cat "$d/x/t")" == old ]]; then
+    ok "unzip remembers the directories it made"
+  else
+    err "unzip directory cache wrong: $out"
+  fi
+}
+
+Z24(){
+  local d="$SRC/attribs" a b
+  rm -rf "$d"; mkdir -p "$d/t/s"
+  echo f > "$d/t/s/f"; echo g > "$d/t/g"
+  chmod 750 "$d/t/s"; chmod 604 "$d/t/g"
+  touch -d '2001-02-03 04:05:06' "$d/t/s/f" "$d/t/s"; touch -d '2011-12-13 14:15:16' "$d/t/g" "$d/t"
+  ( cd "$d" && "$ZIP_BIN" -q -r a.zip t )
+  "$UNZIP_BIN" -q "$d/a.zip" -d "$d/x" >/dev/null 2>&1
+  a="$(cd "$d" && stat -c '%n %a %Y' t t/g t/s t/s/f)"
+  b="$(cd "$d/x" && stat -c '%n %a %Y' t t/g t/s t/s/f)"
+  if [[ "$a" == "$b" ]]; then
+    ok "unzip restores times and modes of files and directories"
+  else
+    err "unzip attributes wrong: $b"
+  fi
+}
+
+Z25(){
+  local d="$SRC/asyncclose" i a b
+  rm -rf "$d"; mkdir -p "$d/t"
+  # large enough to be handed to the closing threads
+  for i in 1 2 3 4 5; do head -c 300000 /dev/urandom > "$d/t/big$i"; echo "$i" > "$d/t/s$i"; done
+  chmod 640 "$d/t/big2"; touch -d '2001-02-03 04:05:06' "$d/t/big3"
+  ( cd "$d" && "$ZIP_BIN" -q -r a.zip t )
+  "$UNZIP_BIN" -q --async-close=2 --fsync "$d/a.zip" -d "$d/x" >/dev/null 2>&1
+  i=$?
+  a="$(cd "$d" && stat -c '%n %a %Y' t/*)"
+  b="$(cd "$d/x" && stat -c '%n %a %Y' t/*)"
+  if [[ $i == 0 && "$a" == "$b" ]] && diff -r "$d/t" "$d/x/t" >/dev/null; then
+    ok "unzip --async-close finishes files in the background"
+  else
+    err "unzip --async-close wrong: $i $b"
+  fi
+}
+
+Z26(){
+  local d="$SRC/durable" i out
+  rm -rf "$d"; mkdir -p "$d/t/a" "$d/t/b"
+  for i in 1 2 3; do echo "$i" > "$d/t/a/f$i"; echo "$i" > "$d/t/b/f$i"; done
+  ( cd "$d" && "$ZIP_BIN" -q -r c.zip t )
+  out="$("$UNZIP_BIN" --durable --stats -q "$d/c.zip" -d "$d/x" 2>&1)"
+  i=$?
+  if [[ $i == 0 && "$out" == *"--durable sync took "*" calls"* ]] && diff -r "$d/t" "$d/x/t" >/dev/null; then
+    ok "unzip --durable syncs once at the end"
+  else
+    err "unzip --durable wrong: $i $out"
+  fi
+}
+
+Z27(){
+  local d="$SRC/snapshot" i a b c
+  rm -rf "$d"; mkdir -p "$d/t/s" "$d/x/t/s"
+  for i in 1 2 3 4; do echo "new$i" > "$d/t/s/f$i"; done
+  touch -d '2001-02-03 04:05:06' "$d/t/s/f1"
+  ( cd "$d" && "$ZIP_BIN" -q -r a.zip t )
+  echo old1 > "$d/x/t/s/f1"; echo old2 > "$d/x/t/s/f2"; ln -s nowhere "$d/x/t/s/f3"
+  # existing names come from one reading of their directory
+  "$UNZIP_BIN" -q -n "$d/a.zip" -d "$d/x" >/dev/null 2>&1
+  a="$(cd "$d/x/t/s" && cat f1 f2 f4; readlink f3)"
+  "$UNZIP_BIN" -q -uo "$d/a.zip" -d "$d/x" >/dev/null 2>&1
+  b="$(cd "$d/x/t/s" && cat f1 f2 f3 f4)"
+  "$UNZIP_BIN" -q -o "$d/a.zip" -d "$d/x" >/dev/null 2>&1
+  c="$(cd "$d/x/t/s" && cat f1 f2 f3 f4)"
+  if [[ "$a" == $'old1\nold2\nnew4\nnowhere' && "$b" == $'old1\nold2\nnew3\nnew4' &&
+        "$c" == $'new1\nnew2\nnew3\nnew4' ]]; then
+    ok "unzip -n, -u and -o see what is already there"
+  else
+    err "unzip existing files wrong: $a / $b / $c"
+  fi
+}
+
+Z28(){
+  local d="$SRC/skipsame" a b out
+  rm -rf "$d"; mkdir -p "$d/t"
+  head -c 100000 /dev/urandom > "$d/t/a"; head -c 100000 /dev/urandom > "$d/t/b"; echo c > "$d/t/c"
+  ( cd "$d" && "$ZIP_BIN" -q -r s.zip t )
+  "$UNZIP_BIN" -q "$d/s.zip" -d "$d/x" >/dev/null 2>&1
+  printf 'X' | dd of="$d/x/t/b" bs=1 seek=500 conv=notrunc 2>/dev/null
+  echo cc > "$d/x/t/c"
+  a="$(stat -c %i "$d/x/t/a")"
+  # only the changed files are written again
+  out="$("$UNZIP_BIN" --stats -q -o --skip-identical "$d/s.zip" -d "$d/x" 2>&1)"
+  b="$(stat -c %i "$d/x/t/a")"
+  if [[ "$a" == "$b" && "$out" == *"1 files already as in the archive, 100000 bytes not written"* ]] &&
+     diff -r "$d/t" "$d/x/t" >/dev/null; then
+    ok "unzip --skip-identical writes only what changed"
+  else
+    err "unzip --skip-identical wrong: $out"
+  fi
+}
+
+Z29(){
+  local d="$SRC/linkdups" i out own=""
+  rm -rf "$d"; mkdir -p "$d/t/a" "$d/t/b"
+  for i in 1 2 3; do head -c 50000 /dev/urandom > "$d/t/a/f$i"; cp -p "$d/t/a/f$i" "$d/t/b/f$i"; done
+  cp "$d/t/a/f1" "$d/t/b/old"; touch -d '2001-02-03 04:05:06' "$d/t/b/old"
+  # the same DOS time, a second apart
+  head -c 50000 /dev/urandom > "$d/t/a/sec"; cp "$d/t/a/sec" "$d/t/b/sec"
+  touch -d '2001-02-03 10:00:01' "$d/t/a/sec"; touch -d '2001-02-03 10:00:02' "$d/t/b/sec"
+  ln -s libfoo.so.1 "$d/t/a/libfoo.so"; ln -s libfoo.so.1 "$d/t/b/libfoo.so"
+  ( cd "$d" && "$ZIP_BIN" -q -r -y l.zip t )
+  out="$("$UNZIP_BIN" --stats -q --link-duplicates=hard "$d/l.zip" -d "$d/x" 2>&1)"
+  # with -X a copy of another owner gets that owner as without linking
+  if [[ "$(id -u)" == 0 ]]; then
+    mkdir -p "$d/o/a" "$d/o/b"; head -c 50000 /dev/urandom > "$d/o/a/own"; cp -p "$d/o/a/own" "$d/o/b/own"
+    chown 1234:1234 "$d/o/b/own"
+    ( cd "$d" && "$ZIP_BIN" -q -r o.zip o )
+    "$UNZIP_BIN" -q -X "$d/o.zip" -d "$d/y" >/dev/null 2>&1
+    "$UNZIP_BIN" -q -X --link-duplicates=hard "$d/o.zip" -d "$d/x" >/dev/null 2>&1
+    own="$(stat -c %u:%g "$d/y/o/b/own")"
+  fi
+  # a copy with other times or owner is written on its own, symlinks stay
+  if [[ "$out" == *"3 duplicate members hard-linked, 150000 bytes not decoded"* ]] &&
+     diff -r --no-dereference "$d/t" "$d/x/t" >/dev/null &&
+     [[ -L "$d/x/t/a/libfoo.so" && -L "$d/x/t/b/libfoo.so" &&
+        "$(stat -c %i "$d/x/t/a/f2")" == "$(stat -c %i "$d/x/t/b/f2")" &&
+        "$(stat -c %h "$d/x/t/b/old")" == 1 &&
+        "$(stat -c %Y "$d/x/t/b/old")" == "$(stat -c %Y "$d/t/b/old")" &&
+        "$(stat -c %Y "$d/x/t/b/sec")" == "$(stat -c %Y "$d/t/b/sec")" &&
+        ( -z "$own" || "$(stat -c %u:%g "$d/x/o/b/own")" == "$own" ) ]]; then
+    ok "unzip --link-duplicates links the later copies"
+  else
+    err "unzip --link-duplicates wrong: $out"
+  fi
+}
+
+Z1; Z2; Z3; Z4; Z5; Z6; Z7; Z8; Z9; Z10; Z11; Z12; Z13; Z14; Z15; Z16; Z17; Z18; Z19; Z20; Z21; Z22; Z23; Z24; Z25; Z26; Z27; Z28; Z29
 
 # ----- performance: zip and unzip -----
 PERF_SIZE_MB="${PERF_SIZE_MB:-256}"
@@ -0,0 +1,317 @@
+/*
+  Copyright (c) 1990-2009 Info-ZIP.  All rights reserved.
+
+  See the accompanying file LICENSE, version 2009-Jan-02 or later
+  (the contents of which are also included in unzip.h) for terms of use.
+  If, for some reason, all these files are missing, the Info-ZIP license
+  also may be found at:  ftp://ftp.info-zip.org/pub/infozip/license.html
+*/
+/*---------------------------------------------------------------------------
+
+  cdload.c
+
+  The central directory read in one piece.  Listing and extraction used to
+  read it through the 8K input buffer, a block of DIR_BLKSIZ entries at a
+  time, and after extracting each block seek back to where the directory
+  left off and read that buffer again.  Instead cdl_load() reads the whole
+  directory with a single read, checks that every entry lies within it,
+  and keeps:
+
+      heap     each entry's header without its signature, followed by its
+               name, extra field and comment, packed end to end
+      ent[]    a fixed-size record per entry, its offset in the heap
+
+  While the directory is walked, cdl_sig() stands in for reading the next
+  signature:  it points the input buffer at the next entry in the heap, so
+  that read_cdir_entry() and do_string() process it exactly as they would
+  from the file, and cdl_done() hands the buffer back to the zipfile before
+  any member is read.  The file input is left where it was throughout, so
+  nothing needs to seek back to the directory.  If the directory cannot be
+  loaded (out of memory, short read, an entry running past its end), the
+  caller reads it from the file as always.
+
+  With --link-duplicates, cdl_dups() also looks through the loaded
+  directory for members that hold the same content (equal CRC, sizes and
+  method), so that extraction can link later copies to the first instead
+  of decoding them again.
+
+  Contains:  cdl_load()
+             cdl_sig()
+             cdl_done()
+             cdl_free()
+             cdl_dups()
+             cdl_dup()
+             cdl_dups_free()
+
+  ---------------------------------------------------------------------------*/
+
+#define __CDLOAD_C /* identifies this source module */
+#define UNZIP_INTERNAL
+#include "unzip.h"
+
+/* bytes per read() call; some systems refuse larger counts */
+#define CDL_READ 0x40000000L
+
+static int Cdecl dup_cmp OF((ZCONST zvoid* a, ZCONST zvoid* b));
+
+static ZCONST char Far CdlStats[] = "%s:  central directory read in one piece, %lu entries:  %lu bytes of records, %lu bytes of heap\n";
+
+/*************************/
+/* Function cdl_load() */
+/*************************/
+
+int cdl_load(__G) /* return TRUE if the directory is now in G.cdl */
+    __GDEF {
+    cdload* c;
+    uch* buf = NULL;
+    uch* h;
+    cdlent* ent = NULL;
+    cdlent* more;
+    zoff_t start = G.cur_zipfile_bufstart + (G.inptr - G.inbuf); /* where the walk starts */
+    zusz_t want = G.ecrec.size_central_directory + 4;           /* and the signature after */
+    ulg got = 0, p = 0, w = 0, num = 0, max, len;
+    long n;
+
+    cdl_free(__G);
+    if (G.stream || G.ecrec.total_entries_central_dir == 0 || G.ecrec.number_this_disk != G.ecrec.num_disk_start_cdir ||
+        want != (zusz_t)(extent)want || want != (zusz_t)(ulg)want || (buf = (uch*)malloc((extent)want)) == NULL)
+        return FALSE;
+
+#ifdef USE_STRM_INPUT
+    if (zfseeko(G.zipfd, start, SEEK_SET) == 0)
+        while (got < (ulg)want && (n = (long)fread((char*)buf + got, 1, (extent)MIN((ulg)want - got, CDL_READ), G.zipfd)) > 0)
+            got += n;
+#else
+    if (zlseek(G.zipfd, start, SEEK_SET) == start)
+        while (got < (ulg)want && (n = (long)read(G.zipfd, (char*)buf + got, (unsigned)MIN((ulg)want - got, CDL_READ))) > 0)
+            got += n;
+#endif
+
+    /* Pack the entries down over their signatures, in place.  The record
+     * array starts at the size the end record gives and grows if it lied.
+     */
+    max = (ulg)MIN(G.ecrec.total_entries_central_dir, (zucn_t)(got / (4 + CREC_SIZE) + 1));
+    if ((ent = (cdlent*)malloc(max * sizeof(cdlent))) == NULL)
+        goto done;
+    while (p + 4 <= got && memcmp(buf + p, central_hdr_sig, 4) == 0) {
+        h = buf + p + 4;
+        if (p + 4 + CREC_SIZE > got)
+            goto done;
+        len = CREC_SIZE + (ulg)makeword(h + C_FILENAME_LENGTH) + makeword(h + C_EXTRA_FIELD_LENGTH) + makeword(h + C_FILE_COMMENT_LENGTH);
+        if (p + 4 + len > got)
+            goto done; /* the directory is larger than the end record says */
+        if (num == max) {
+            max *= 2;
+            if ((more = (cdlent*)realloc(ent, max * sizeof(cdlent))) == NULL)
+                goto done;
+            ent = more;
+        }
+        memmove(buf + w, h, len);
+        ent[num++].hdr = w;
+        w += len;
+        p += 4 + len;
+    }
+    if (p + 4 > got && got == (ulg)want)
+        goto done; /* the last entry ran into what should be the end record */
+
+    if ((c = (cdload*)malloc(sizeof(cdload))) == NULL)
+        goto done;
+    c->endlen = (int)MIN(got - p, 4);
+    memcpy(c->endsig, buf + p, c->endlen);
+    /* give back the signatures and whatever followed the last entry */
+    if ((c->heap = (uch*)realloc(buf, w ? w : 1)) == NULL)
+        c->heap = buf;
+    if ((c->ent = (cdlent*)realloc(ent, (num ? num : 1) * sizeof(cdlent))) == NULL)
+        c->ent = ent;
+    c->heapsz = w;
+    c->num = num;
+    c->next = 0;
+    c->in = FALSE;
+    G.cdl = c;
+    buf = NULL;
+    ent = NULL;
+
+    if (uO.stats)
+        Info(slide, 1, ((char*)slide, LoadFarString(CdlStats), G.zipfn, num, num * (ulg)sizeof(cdlent), w));
+
+done:
+    if (ent != NULL)
+        free(ent);
+    if (buf != NULL)
+        free(buf);
+
+    /* the file position goes back to just after what the input buffer holds */
+#ifdef USE_STRM_INPUT
+    zfseeko(G.zipfd, G.cur_zipfile_bufstart + (G.inptr - G.inbuf) + G.incnt, SEEK_SET);
+#else
+    zlseek(G.zipfd, G.cur_zipfile_bufstart + (G.inptr - G.inbuf) + G.incnt, SEEK_SET);
+#endif
+    return G.cdl != NULL;
+
+} /* end function cdl_load() */
+
+/************************/
+/* Function cdl_sig() */
+/************************/
+
+unsigned cdl_sig(__G) /* return number of signature bytes put in G.sig */
+    __GDEF {
+    cdload* c = G.cdl;
+    uch* h;
+
+    cdl_done(__G);
+    if (c->next == c->num) {
+        memcpy(G.sig, c->endsig, c->endlen);
+        return (unsigned)c->endlen;
+    }
+
+    /* the rest of the entry is the input until cdl_done() */
+    h = c->heap + c->ent[c->next++].hdr;
+    c->inptr = G.inptr;
+    c->incnt = G.incnt;
+    c->in = TRUE;
+    G.inptr = h;
+    G.incnt = CREC_SIZE + makeword(h + C_FILENAME_LENGTH) + makeword(h + C_EXTRA_FIELD_LENGTH) + makeword(h + C_FILE_COMMENT_LENGTH);
+    memcpy(G.sig, central_hdr_sig, 4);
+    return 4;
+
+} /* end function cdl_sig() */
+
+/*************************/
+/* Function cdl_done() */
+/*************************/
+
+void cdl_done(__G) /* give the input buffer back to the zipfile */
+    __GDEF {
+    cdload* c = G.cdl;
+
+    if (c != NULL && c->in) {
+        G.inptr = c->inptr;
+        G.incnt = c->incnt;
+        c->in = FALSE;
+    }
+
+} /* end function cdl_done() */
+
+/*************************/
+/* Function cdl_free() */
+/*************************/
+
+void cdl_free(__G) __GDEF {
+    if (G.cdl != NULL) {
+        cdl_done(__G);
+        free(G.cdl->heap);
+        free(G.cdl->ent);
+        free(G.cdl);
+        G.cdl = NULL;
+    }
+
+} /* end function cdl_free() */
+
+/*************************/
+/* Function dup_cmp() */
+/*************************/
+
+static int Cdecl dup_cmp(a, b) /* used by qsort():  order by content */
+ZCONST zvoid *a, *b;
+{
+    ZCONST dupkey* x = (ZCONST dupkey*)a;
+    ZCONST dupkey* y = (ZCONST dupkey*)b;
+
+    if (x->crc != y->crc)
+        return x->crc < y->crc ? -1 : 1;
+    if (x->size != y->size)
+        return x->size < y->size ? -1 : 1;
+    if (x->csize != y->csize)
+        return x->csize < y->csize ? -1 : 1;
+    return (int)x->method - (int)y->method;
+
+} /* end function dup_cmp() */
+
+/*************************/
+/* Function cdl_dups() */
+/*************************/
+
+void cdl_dups(__G) /* find the contents more than one member holds */
+    __GDEF {
+    cdload* c = G.cdl;
+    dupkey *k, *t;
+    ulg i, n = 0, ngroups = 0, size;
+    uch* h;
+
+    cdl_dups_free(__G);
+    if (c == NULL || c->num < 2 || (k = (dupkey*)malloc(c->num * sizeof(dupkey))) == NULL)
+        return;
+
+    /* empty members need no linking; Zip64 sizes are not looked for */
+    for (i = 0; i < c->num; i++) {
+        h = c->heap + c->ent[i].hdr;
+        k[n].size = makelong(h + C_UNCOMPRESSED_SIZE);
+        k[n].csize = makelong(h + C_COMPRESSED_SIZE);
+        if (k[n].size == 0 || k[n].size == 0xFFFFFFFFL || k[n].csize == 0xFFFFFFFFL)
+            continue;
+        k[n].crc = makelong(h + C_CRC32);
+        k[n].method = makeword(h + C_COMPRESSION_METHOD);
+        n++;
+    }
+    qsort((char*)k, n, sizeof(dupkey), dup_cmp);
+    for (i = 1; i < n; i++)
+        if (dup_cmp(k + i - 1, k + i) == 0 && (i == 1 || dup_cmp(k + i - 2, k + i - 1) != 0))
+            ngroups++;
+
+    /* one slot per group, the table at most half full */
+    for (size = 16; size < 2 * ngroups; size *= 2)
+        ;
+    if (ngroups == 0 || (t = (dupkey*)calloc(size, sizeof(dupkey))) == NULL) {
+        free(k);
+        return;
+    }
+    for (i = 1; i < n; i++)
+        if (dup_cmp(k + i - 1, k + i) == 0 && (i == 1 || dup_cmp(k + i - 2, k + i - 1) != 0)) {
+            ulg j = (k[i].crc ^ (ulg)k[i].size) & (size - 1);
+
+            while (t[j].size != 0)
+                j = (j + 1) & (size - 1);
+            t[j] = k[i];
+            t[j].first = NULL;
+        }
+    free(k);
+    G.dups = t;
+    G.dupmask = size - 1;
+
+} /* end function cdl_dups() */
+
+/*************************/
+/* Function cdl_dup() */
+/*************************/
+
+dupkey* cdl_dup(__G) /* return the group of the current member, or NULL */
+    __GDEF {
+    dupkey* d;
+    ulg j;
+
+    if (G.dups == NULL || G.pInfo->uncompr_size == 0)
+        return (dupkey*)NULL;
+    for (j = (G.pInfo->crc ^ (ulg)G.pInfo->uncompr_size) & G.dupmask; (d = G.dups + j)->size != 0; j = (j + 1) & G.dupmask)
+        if (d->crc == G.pInfo->crc && d->size == G.pInfo->uncompr_size && d->csize == G.pInfo->compr_size && d->method == G.lrec.compression_method)
+            return d;
+    return (dupkey*)NULL;
+
+} /* end function cdl_dup() */
+
+/******************************/
+/* Function cdl_dups_free() */
+/******************************/
+
+void cdl_dups_free(__G) __GDEF {
+    ulg j;
+
+    if (G.dups != NULL) {
+        for (j = 0; j <= G.dupmask; j++)
+            if (G.dups[j].first != NULL)
+                free(G.dups[j].first);
+        free(G.dups);
+        G.dups = NULL;
+    }
+
+} /* end function cdl_dups_free() */
@@ -15,10 +15,16 @@
   explode.c, inflate.c, unreduce.c and unshrink.c.
 
   Contains:  extract_or_test_files()
+             read_cdir_entry()
              store_info()
              find_compr_idx()
              extract_or_test_entrylist()
              extract_or_test_member()
+             want_entry()
+             stream_local_hdr()       (not SFX)
+             stream_peek()            (not SFX)
+             stream_entry_end()       (not SFX)
+             stream_skip_entry()      (not SFX)
              TestExtraField()
              test_compr_eb()
              memextract()
@@ -77,6 +83,14 @@
         }                                                  \
     }
 
+#ifndef SFX
+/* A streamed entry whose compressed size is only known once it has been
+   decoded: bit 3 is set and its local header sizes are zero. */
+#define STREAM_SIZELESS ((G.lrec.general_purpose_bit_flag & 8) != 0 && G.lrec.compression_method != STORED)
+/* G.csize for such an entry, so that the decoder is never cut short */
+#define STREAM_CSIZE ((zoff_t)1 << (8 * sizeof(zoff_t) - 2))
+#endif
+
 static int store_info OF((__GPRO));
 #ifdef SET_DIR_ATTRIB
 static int extract_or_test_entrylist OF((__GPRO__ unsigned numchunk, ulg* pfilnum, ulg* pnum_bad_pwd, zoff_t* pold_extra_bytes, unsigned* pnum_dirs, direntry** pdirlist, int error_in_archive));
@@ -84,7 +98,12 @@ static int extract_or_test_entrylist OF((__GPRO__ unsigned numchunk, ulg* pfilnu
 static int extract_or_test_entrylist OF((__GPRO__ unsigned numchunk, ulg* pfilnum, ulg* pnum_bad_pwd, zoff_t* pold_extra_bytes, int error_in_archive));
 #endif
 static int extract_or_test_member OF((__GPRO));
+static int want_entry OF((__GPRO__ int* fn_matched, int* xn_matched));
 #ifndef SFX
+static int stream_local_hdr OF((__GPRO__ ulg entry, int* pend));
+static int stream_peek OF((__GPRO__ int n));
+static int stream_entry_end OF((__GPRO));
+static int stream_skip_entry OF((__GPRO));
 static int TestExtraField OF((__GPRO__ uch * ef, unsigned ef_len));
 static int test_compr_eb OF((__GPRO__ uch * eb, unsigned eb_size, unsigned compr_offset, int (*test_uc_ebdata)(__GPRO__ uch* eb, unsigned eb_size, uch* eb_ucptr, ulg eb_ucsize)));
 #endif
@@ -151,10 +170,17 @@ static ZCONST char Far LocalHdrSig[] = "local header sig";
 static ZCONST char Far BadLocalHdr[] = "file #%lu:  bad local header\n";
 static ZCONST char Far AttemptRecompensate[] = "  (attempting to re-compensate)\n";
 #ifndef SFX
+static ZCONST char Far StreamNoLocalHdr[] = "error:  file #%lu:  no local header where the streamed archive continues\n";
+static ZCONST char Far StreamNoCentral[] = "warning:  streamed archive ends without a central directory\n";
+static ZCONST char Far StreamNoSize[] = "error:  %s:  %s data of unknown size cannot be streamed\n";
+static ZCONST char Far StreamBadDesc[] = "error:  %s:  bad or missing data descriptor\n";
+static ZCONST char Far StreamLost[] = "error:  %s:  cannot find the end of the entry data, giving up\n";
 static ZCONST char Far BackslashPathSep[] = "warning:  %s appears to use backslashes as path separators\n";
 #endif
 static ZCONST char Far AbsolutePathWarning[] = "warning:  stripped absolute path spec from %s\n";
 static ZCONST char Far SkipVolumeLabel[] = "   skipping: %-22s  %svolume label\n";
+static ZCONST char Far LinkStats[] = "%s:  %lu duplicate members %s, %s bytes not decoded\n";
+static ZCONST char Far SameStats[] = "%s:  %lu files already as in the archive, %s bytes not written\n";
 
 #ifdef SET_DIR_ATTRIB /* messages of code for setting directory attributes */
 static ZCONST char Far DirlistEntryNoMem[] = "warning:  cannot alloc memory for dir times/permissions/UID/GID\n";
@@ -359,6 +385,8 @@ int extract_or_test_files(__G) /* return PK-type error code */
     int reached_end;
 #ifndef SFX
     int no_endsig_found;
+    zoff_t* ndx = NULL; /* central headers found through the name index */
+    ulg ndx_num = 0, ndx_next = 0;
 #endif
     int error, error_in_archive = PK_COOL;
     int *fn_matched = NULL, *xn_matched = NULL;
@@ -388,27 +416,30 @@ int extract_or_test_files(__G) /* return PK-type error code */
 #endif /* !SFX || SFX_EXDIR */
 
     /* ---- Bomb/overlap cover initialization ---- */
-    if (G.cover == NULL) {
-        G.cover = malloc(sizeof(cover_t));
+    /* (a streamed archive is read once, front to back, and cannot overlap) */
+    if (!G.stream) {
         if (G.cover == NULL) {
+            G.cover = malloc(sizeof(cover_t));
+            if (G.cover == NULL) {
+                Info(slide, 0x401, ((char*)slide, LoadFarString(NotEnoughMemCover)));
+                return PK_MEM;
+            }
+            ((cover_t*)G.cover)->span = NULL;
+            ((cover_t*)G.cover)->max = 0;
+        }
+        ((cover_t*)G.cover)->num = 0;
+
+        /* Central directory span */
+        if (cover_add((cover_t*)G.cover, G.extra_bytes + G.ecrec.offset_start_central_directory, G.extra_bytes + G.ecrec.offset_start_central_directory + G.ecrec.size_central_directory) != 0) {
             Info(slide, 0x401, ((char*)slide, LoadFarString(NotEnoughMemCover)));
             return PK_MEM;
         }
-        ((cover_t*)G.cover)->span = NULL;
-        ((cover_t*)G.cover)->max = 0;
-    }
-    ((cover_t*)G.cover)->num = 0;
-
-    /* Central directory span */
-    if (cover_add((cover_t*)G.cover, G.extra_bytes + G.ecrec.offset_start_central_directory, G.extra_bytes + G.ecrec.offset_start_central_directory + G.ecrec.size_central_directory) != 0) {
-        Info(slide, 0x401, ((char*)slide, LoadFarString(NotEnoughMemCover)));
-        return PK_MEM;
-    }
-    /* leading extra bytes, Zip64 EoCD (if any), and EoCD */
-    if ((G.extra_bytes != 0 && cover_add((cover_t*)G.cover, (bound_t)0, (bound_t)G.extra_bytes) != 0) ||
-        (G.ecrec.have_ecr64 && cover_add((cover_t*)G.cover, G.ecrec.ec64_start, G.ecrec.ec64_end) != 0) || cover_add((cover_t*)G.cover, G.ecrec.ec_start, G.ecrec.ec_end) != 0) {
-        Info(slide, 0x401, ((char*)slide, LoadFarString(OverlappedComponents)));
-        return PK_BOMB;
+        /* leading extra bytes, Zip64 EoCD (if any), and EoCD */
+        if ((G.extra_bytes != 0 && cover_add((cover_t*)G.cover, (bound_t)0, (bound_t)G.extra_bytes) != 0) ||
+            (G.ecrec.have_ecr64 && cover_add((cover_t*)G.cover, G.ecrec.ec64_start, G.ecrec.ec64_end) != 0) || cover_add((cover_t*)G.cover, G.ecrec.ec_start, G.ecrec.ec_end) != 0) {
+            Info(slide, 0x401, ((char*)slide, LoadFarString(OverlappedComponents)));
+            return PK_BOMB;
+        }
     }
 
     /* ---- General state ---- */
@@ -434,6 +465,20 @@ int extract_or_test_files(__G) /* return PK-type error code */
                 xn_matched[i] = FALSE;
     }
 
+#ifndef SFX
+    /* Literal names only:  a zip -ni name index leads straight to them. */
+    if (!G.stream)
+        ndx_find(__G__ &ndx, &ndx_num);
+    /* Otherwise the whole directory, read in one piece if it fits. */
+    if (!G.stream && ndx == NULL)
+        cdl_load(__G);
+#ifdef UNIX
+    /* --link-duplicates:  the contents more than one member holds */
+    if (uO.linkdups && !uO.tflag && !uO.cflag)
+        cdl_dups(__G);
+#endif
+#endif
+
     /* ===================== Central directory block loop ===================== */
     members_processed = 0;
 #ifndef SFX
@@ -444,11 +489,104 @@ int extract_or_test_files(__G) /* return PK-type error code */
     while (!reached_end) {
         j = 0;
 
+#ifndef SFX
+        /* -------- Streaming: the next local header is the next entry -------- */
+        if (G.stream) {
+            G.pInfo = &G.info[0];
+            error = stream_local_hdr(__G__ members_processed + 1, &reached_end);
+            if (error != PK_COOL) {
+                if (error > error_in_archive)
+                    error_in_archive = error;
+                if (error > PK_WARN) {
+                    reached_end = FALSE; /* signal premature stop */
+                    break;
+                }
+            }
+            if (reached_end)
+                break;
+            if (want_entry(__G__ fn_matched, xn_matched)) {
+                if (store_info(__G))
+                    ++j;
+                else
+                    ++num_skipped;
+            }
+            members_processed++;
+
+            error = extract_or_test_entrylist(__G__ j, &filnum, &num_bad_pwd, &old_extra_bytes
+#ifdef SET_DIR_ATTRIB
+                                              ,
+                                              &num_dirs, &dirlist
+#endif
+                                              ,
+                                              error_in_archive);
+            if (error > error_in_archive)
+                error_in_archive = error;
+            if (G.disk_full > 1 || error_in_archive == IZ_CTRLC || error == PK_BOMB)
+                break; /* premature stop, reached_end is FALSE */
+
+            /* pass over whatever of the entry was not extracted */
+            if (G.stream_data && (error = stream_skip_entry(__G)) != PK_COOL) {
+                if (error > error_in_archive)
+                    error_in_archive = error;
+                if (error > PK_WARN)
+                    break;
+            }
+            ++blknum;
+            continue;
+        }
+
+        /* -------- Name index: just the central headers it found -------- */
+        if (ndx != NULL) {
+            while (j < DIR_BLKSIZ && ndx_next < ndx_num) {
+                G.pInfo = &G.info[j];
+                if (seek_zipf(__G__ ndx[ndx_next++] - G.extra_bytes) != PK_OK || readbuf(__G__ G.sig, 4) != 4 ||
+                    memcmp(G.sig, central_hdr_sig, 4) != 0) {
+                    Info(slide, 0x401, ((char*)slide, LoadFarString(CentSigMsg), ndx_next));
+                    error_in_archive = PK_BADERR;
+                    break;
+                }
+                error = read_cdir_entry(__G);
+                if (error != PK_COOL) {
+                    if (error > error_in_archive)
+                        error_in_archive = error;
+                    if (error > PK_WARN)
+                        break;
+                }
+                if (want_entry(__G__ fn_matched, xn_matched)) {
+                    if (store_info(__G))
+                        ++j;
+                    else
+                        ++num_skipped;
+                }
+                members_processed++;
+            }
+            if (error_in_archive > PK_WARN)
+                break; /* premature stop, reached_end is FALSE */
+            reached_end = (ndx_next == ndx_num);
+
+            error = extract_or_test_entrylist(__G__ j, &filnum, &num_bad_pwd, &old_extra_bytes
+#ifdef SET_DIR_ATTRIB
+                                              ,
+                                              &num_dirs, &dirlist
+#endif
+                                              ,
+                                              error_in_archive);
+            if (error > error_in_archive)
+                error_in_archive = error;
+            if (G.disk_full > 1 || error_in_archive == IZ_CTRLC || error == PK_BOMB) {
+                reached_end = FALSE; /* signal premature stop */
+                break;
+            }
+            ++blknum;
+            continue;
+        }
+#endif /* !SFX */
+
         /* -------- Read a block of central directory entries -------- */
         while (j < DIR_BLKSIZ) {
             G.pInfo = &G.info[j];
 
-            if (readbuf(__G__ G.sig, 4) == 0) {
+            if ((G.cdl != NULL ? cdl_sig(__G) : readbuf(__G__ G.sig, 4)) == 0) {
                 error_in_archive = PK_EOF;
                 reached_end = TRUE;
                 break;
@@ -473,93 +611,30 @@ int extract_or_test_files(__G) /* return PK-type error code */
                 break;
             }
 
-            /* Parse and validate this CD file header. */
-            error = process_cdir_file_hdr(__G);
-            if (error != PK_COOL) {
-                error_in_archive = error; /* PK_EOF only here */
-                reached_end = TRUE;
-                break;
-            }
-
-            /* Filename */
-            error = do_string(__G__ G.crec.filename_length, DS_FN);
-            if (error != PK_COOL) {
-                if (error > error_in_archive)
-                    error_in_archive = error;
-                if (error > PK_WARN) { /* fatal */
-                    Info(slide, 0x401, ((char*)slide, LoadFarString(FilNamMsg), FnFilter1(G.filename), "central"));
-                    reached_end = TRUE;
-                    break;
-                }
-            }
-
-            /* Extra field(s) */
-            G.pInfo->zip64 = FALSE;
-            error = do_string(__G__ G.crec.extra_field_length, EXTRA_FIELD);
-            if (error != PK_COOL) {
-                if (error > error_in_archive)
-                    error_in_archive = error;
-                if (error > PK_WARN) { /* fatal */
-                    Info(slide, 0x401, ((char*)slide, LoadFarString(ExtFieldMsg), FnFilter1(G.filename), "central"));
-                    reached_end = TRUE;
-                    break;
-                }
-            }
-
-            /* Comment (skip unless Amiga filenotes requested) */
-            error = do_string(__G__ G.crec.file_comment_length, SKIP);
+            /* Header, name, extra field and comment of this CD entry */
+            error = read_cdir_entry(__G);
             if (error != PK_COOL) {
                 if (error > error_in_archive)
                     error_in_archive = error;
                 if (error > PK_WARN) { /* fatal */
-                    Info(slide, 0x421, ((char*)slide, LoadFarString(BadFileCommLength), FnFilter1(G.filename)));
                     reached_end = TRUE;
                     break;
                 }
             }
 
             /* Selection logic */
-            if (G.process_all_files) {
+            if (want_entry(__G__ fn_matched, xn_matched)) {
                 if (store_info(__G))
                     ++j;
                 else
                     ++num_skipped;
             }
-            else {
-                int do_this_file = (G.filespecs == 0);
-
-                if (!do_this_file) {
-                    for (i = 0; i < G.filespecs; i++) {
-                        if (match(G.filename, G.pfnames[i], uO.C_flag WISEP)) {
-                            do_this_file = TRUE;
-                            if (fn_matched)
-                                fn_matched[i] = TRUE;
-                            break;
-                        }
-                    }
-                }
-                if (do_this_file) {
-                    for (i = 0; i < G.xfilespecs; i++) {
-                        if (match(G.filename, G.pxnames[i], uO.C_flag WISEP)) {
-                            do_this_file = FALSE;
-                            if (xn_matched)
-                                xn_matched[i] = TRUE;
-                            break;
-                        }
-                    }
-                }
-                if (do_this_file) {
-                    if (store_info(__G))
-                        ++j;
-                    else
-                        ++num_skipped;
-                }
-            }
 
             members_processed++;
         } /* (collect CD entries into current block) */
 
         /* Save CD position to resume after extracting the block. */
+        cdl_done(__G);
         cd_bufstart = G.cur_zipfile_bufstart;
         cd_inptr = G.inptr;
         cd_incnt = G.incnt;
@@ -584,6 +659,11 @@ int extract_or_test_files(__G) /* return PK-type error code */
         }
 
         /* -------- Restore CD input buffer for next batch -------- */
+        /* (a loaded directory is read from memory and was never left) */
+        if (G.cdl != NULL) {
+            ++blknum;
+            continue;
+        }
 #ifdef USE_STRM_INPUT
         if (zfseeko(G.zipfd, cd_bufstart, SEEK_SET) != 0) {
             error_in_archive = (error_in_archive > PK_ERR) ? error_in_archive : PK_ERR;
@@ -617,6 +697,17 @@ int extract_or_test_files(__G) /* return PK-type error code */
 #endif
     } /* while blocks */
 
+#ifndef SFX
+    if (ndx != NULL)
+        free((zvoid*)ndx);
+#endif
+
+#ifdef UNIX
+    /* every member is on disk, with its error counted, before the links */
+    if ((error = close_wait(__G__ TRUE)) > error_in_archive)
+        error_in_archive = error;
+#endif
+
     /* ===================== Deferred symlink completion ===================== */
 #ifdef SYMLINKS
     if (G.slink_last != NULL) {
@@ -679,6 +770,24 @@ int extract_or_test_files(__G) /* return PK-type error code */
     }
 #endif /* SET_DIR_ATTRIB */
 
+    if (uO.stats && uO.skipsame)
+        Info(slide, 1, ((char*)slide, LoadFarString(SameStats), G.zipfn, G.samefiles, FmZofft(G.samebytes, NULL, "u")));
+    G.samefiles = 0;
+    G.samebytes = 0;
+#if (defined(UNIX) && !defined(SFX))
+    if (uO.stats && uO.linkdups)
+        Info(slide, 1, ((char*)slide, LoadFarString(LinkStats), G.zipfn, G.linkfiles, uO.linkdups == LINKDUP_HARD ? "hard-linked" : "cloned", FmZofft(G.linkbytes, NULL, "u")));
+    G.linkfiles = 0;
+    G.linkbytes = 0;
+    cdl_dups_free(__G);
+#endif
+
+#ifdef UNIX
+    /* the next archive may name other things there */
+    if ((error = dir_done(__G)) > error_in_archive)
+        error_in_archive = error;
+#endif
+
     /* ===================== Report unmatched patterns (if completed) ===================== */
     if (fn_matched) {
         if (reached_end) {
@@ -771,6 +880,57 @@ int extract_or_test_files(__G) /* return PK-type error code */
     return error_in_archive;
 } /* extract_or_test_files() */
 
+/********************************/
+/*  Function read_cdir_entry()  */
+/********************************/
+
+int read_cdir_entry(__G) /* return PK-type error code */
+    __GDEF {
+    /* Read the central header whose signature was just read, with its
+     * name and extra field; the comment is skipped.  Errors above PK_WARN
+     * have been reported and end the central directory.
+     */
+    int error, error_in_entry = PK_COOL;
+
+    /* Parse and validate this CD file header. */
+    if ((error = process_cdir_file_hdr(__G)) != PK_COOL)
+        return error; /* PK_EOF only here */
+
+    /* Filename */
+    error = do_string(__G__ G.crec.filename_length, DS_FN);
+    if (error != PK_COOL) {
+        if (error > PK_WARN) { /* fatal */
+            Info(slide, 0x401, ((char*)slide, LoadFarString(FilNamMsg), FnFilter1(G.filename), "central"));
+            return error;
+        }
+        error_in_entry = error;
+    }
+
+    /* Extra field(s) */
+    G.pInfo->zip64 = FALSE;
+    error = do_string(__G__ G.crec.extra_field_length, EXTRA_FIELD);
+    if (error != PK_COOL) {
+        if (error > PK_WARN) { /* fatal */
+            Info(slide, 0x401, ((char*)slide, LoadFarString(ExtFieldMsg), FnFilter1(G.filename), "central"));
+            return error;
+        }
+        if (error > error_in_entry)
+            error_in_entry = error;
+    }
+
+    /* Comment (skip unless Amiga filenotes requested) */
+    error = do_string(__G__ G.crec.file_comment_length, SKIP);
+    if (error != PK_COOL) {
+        if (error > PK_WARN) { /* fatal */
+            Info(slide, 0x421, ((char*)slide, LoadFarString(BadFileCommLength), FnFilter1(G.filename)));
+            return error;
+        }
+        if (error > error_in_entry)
+            error_in_entry = error;
+    }
+    return error_in_entry;
+} /* end function read_cdir_entry() */
+
 /***************************/
 /*  Function store_info()  */
 /***************************/
@@ -987,13 +1147,17 @@ direntry** pdirlist;
 int error_in_archive;
 {
     unsigned i;
-    int renamed, query;
+    int renamed = FALSE, query, exists;
     int skip_entry;
-    zoff_t bufstart, inbuf_offset, request;
+    int linked; /* made from an earlier copy by --link-duplicates */
+#if (defined(UNIX) && !defined(SFX))
+    dupkey* dup;
+#endif
+    zoff_t bufstart, inbuf_offset, request = 0;
     int error, errcode;
 
     /* skip_entry states */
-    enum { SKIP_NO = 0, SKIP_Y_EXISTING = 1, SKIP_Y_NONEXIST = 2 };
+    enum { SKIP_NO = 0, SKIP_Y_EXISTING = 1, SKIP_Y_NONEXIST = 2, SKIP_Y_IDENTICAL = 3 };
 
     /* ------------------------------
        Process each entry in the chunk
@@ -1002,6 +1166,12 @@ int error_in_archive;
         (*pfilnum)++;
         G.pInfo = &G.info[i];
 
+#ifndef SFX
+        /* Streaming: the local header has just been read, data follows. */
+        if (G.stream)
+            goto stream_data_follows;
+#endif
+
         /* Compute absolute request offset into the zip stream. */
         request = G.pInfo->offset + G.extra_bytes;
 
@@ -1125,6 +1295,7 @@ int error_in_archive;
         }
 
 #ifndef SFX
+    stream_data_follows:
         /* Now that UTF-8 name extra (if any) is applied, ensure name matches central. */
         if (G.pInfo->cfilname != (char Far*)NULL) {
             if (zfstrcmp(G.pInfo->cfilname, G.filename) != 0) {
@@ -1254,8 +1425,12 @@ int error_in_archive;
                 continue;
             }
 
-            /* Overwrite policy / freshness checks */
-            switch (check_for_newer(__G__ G.filename)) {
+            /* Overwrite policy / freshness checks; again from the disk when
+               open_outfile() finds the name its directory listing missed */
+        recheck:
+            query = FALSE;
+            skip_entry = SKIP_NO;
+            switch (exists = check_for_newer(__G__ G.filename)) {
                 case DOES_NOT_EXIST:
                     if (uO.fflag && !renamed) /* freshen only */
                         skip_entry = SKIP_Y_NONEXIST;
@@ -1293,6 +1468,19 @@ int error_in_archive;
                     break;
             }
 
+            /* --skip-identical: a file that already holds what the member
+               would write is neither asked about nor written again */
+            if (uO.skipsame && exists != DOES_NOT_EXIST && skip_entry == SKIP_NO && !G.pInfo->textmode &&
+#ifdef SYMLINKS
+                !G.pInfo->symlink &&
+#endif
+                same_as_member(__G__ G.filename)) {
+                skip_entry = SKIP_Y_IDENTICAL;
+                query = FALSE;
+                G.samefiles++;
+                G.samebytes += G.pInfo->uncompr_size;
+            }
+
             if (query) {
                 extent fnlen;
             reprompt:
@@ -1344,15 +1532,51 @@ int error_in_archive;
         } /* end: to-disk path */
 
         G.disk_full = 0;
-        if ((error = extract_or_test_member(__G)) != PK_COOL) {
+        linked = FALSE;
+#if (defined(UNIX) && !defined(SFX))
+        /* --link-duplicates:  content already extracted is not decoded again */
+        dup = (uO.tflag || uO.cflag) ? (dupkey*)NULL : cdl_dup(__G);
+        if (dup != NULL && (error = link_dup(__G__ dup)) == OPEN_AGAIN)
+            goto recheck;
+        if (dup != NULL && error >= 0) {
+            linked = TRUE;
+            if (error > error_in_archive)
+                error_in_archive = error;
+            if (error == PK_OK) {
+                if (QCOND2)
+                    Info(slide, 0, ((char*)slide, LoadFarString(ExtractMsg), uO.linkdups == LINKDUP_HARD ? "link" : "clon", FnFilter1(G.filename), "", "\n"));
+                G.linkfiles++;
+                G.linkbytes += G.pInfo->uncompr_size;
+            }
+        }
+#endif
+        if (linked)
+            ; /* its data is passed over */
+        else if ((error = extract_or_test_member(__G)) != PK_COOL) {
+            if (error == OPEN_AGAIN)
+                goto recheck; /* nothing of it is read yet */
             if (error > error_in_archive)
                 error_in_archive = error;
             if (G.disk_full > 1)
                 return error_in_archive;
         }
+#if (defined(UNIX) && !defined(SFX))
+        else if (dup != NULL)
+            dup_seen(__G__ dup);
+#endif
+#ifdef UNIX
+        /* files the closing threads are through with */
+        if ((error = close_wait(__G__ FALSE)) > error_in_archive)
+            error_in_archive = error;
+#endif
+
+#ifndef SFX
+        if (G.stream)
+            continue;
+#endif
 
         /* Record consumed span for bomb detection. */
-        error = cover_add((cover_t*)G.cover, request, G.cur_zipfile_bufstart + (G.inptr - G.inbuf));
+        error = cover_add((cover_t*)G.cover, request, G.cur_zipfile_bufstart + (G.inptr - G.inbuf) + (linked ? G.pInfo->compr_size : 0));
         if (error < 0) {
             Info(slide, 0x401, ((char*)slide, LoadFarString(NotEnoughMemCover)));
             return PK_MEM;
@@ -1405,15 +1629,23 @@ static int extract_or_test_member(__G) /* return PK-type error code */
     else {
         if (uO.cflag) {
             G.outfile = stdout;
+#ifdef UNIX
+            if (G.pipe_out == 0)
+                G.pipe_out = stdout_direct(__G) ? 1 : -1;
+#endif
 #define NEWLINE "\n"
         }
-        else if (open_outfile(__G)) {
-            return PK_DISK;
+        else if ((r = open_outfile(__G)) != 0) {
+            return (r == OPEN_AGAIN) ? OPEN_AGAIN : PK_DISK;
         }
     }
 
     /* prepare input stream state */
     defer_leftover_input(__G);
+#ifndef SFX
+    if (G.stream)
+        G.stream_data = 2; /* reading the data now */
+#endif
 
     switch (G.lrec.compression_method) {
         case STORED: {
@@ -1495,6 +1727,27 @@ static int extract_or_test_member(__G) /* return PK-type error code */
 #define UZinflate inflate
 #endif
             r = UZinflate(__G__(G.lrec.compression_method == ENHDEFLATED));
+#if (!defined(SFX) && !defined(USE_ZLIB))
+            /* Without a size, inflate() was not stopped at the end of the entry
+               and its bit buffer can hold a few bytes past the end of the
+               deflate data.  Put them back; they are the data descriptor. */
+            if (r == 0 && G.stream && STREAM_SIZELESS && G.bk >= 8) {
+                unsigned n = G.bk >> 3;
+                unsigned k;
+
+                if ((unsigned)(G.inptr - G.inbuf) < n) {
+                    /* they came from the previous buffer; inbuf has 4 bytes
+                       to spare for this */
+                    memmove(G.inbuf + n, G.inptr, G.incnt);
+                    G.inptr = G.inbuf + n;
+                }
+                G.inptr -= n;
+                G.incnt += n;
+                for (k = 0; k < n; k++)
+                    G.inptr[k] = (uch)(G.bb >> ((G.bk & 7) + 8 * k));
+                G.bk &= 7;
+            }
+#endif
             if (r != 0) {
                 if (r < PK_DISK)
                     Info(slide, 0x401,
@@ -1543,6 +1796,14 @@ static int extract_or_test_member(__G) /* return PK-type error code */
         return error;
     }
 
+    undefer_input(__G);
+
+#ifndef SFX
+    /* streaming: the CRC may only now follow the data */
+    if (G.stream && (r = stream_entry_end(__G)) != PK_COOL)
+        return r;
+#endif
+
     /* CRC verification and test-mode messaging */
     if (G.crc32val != G.lrec.crc32) {
         if ((uO.tflag && uO.qflag) || (!uO.tflag && !QCOND2))
@@ -1567,10 +1828,8 @@ static int extract_or_test_member(__G) /* return PK-type error code */
             Info(slide, 0, ((char*)slide, "\n"));
     }
 
-    undefer_input(__G);
-
     /* skip optional data descriptor */
-    if ((G.lrec.general_purpose_bit_flag & 8) != 0) {
+    if ((G.lrec.general_purpose_bit_flag & 8) != 0 && !G.stream) {
 #define SIG 0x08074b50
         uch peek[24];
         int len = 0;
@@ -1623,6 +1882,246 @@ static int extract_or_test_member(__G) /* return PK-type error code */
     return error;
 } /* end function extract_or_test_member */
 
+/***************************/
+/*  Function want_entry()  */
+/***************************/
+
+static int want_entry(__G__ fn_matched, xn_matched) /* return TRUE to process */
+__GDEF
+int* fn_matched;
+int* xn_matched;
+{
+    /* Match G.filename against the include and exclude filespecs, noting
+     * in fn_matched/xn_matched (if not NULL) which patterns were used.
+     */
+    int i;
+
+    if (G.process_all_files)
+        return TRUE;
+
+    if (G.filespecs > 0) {
+        if ((i = spec_find(&G.fnset, G.pfnames, G.filespecs, G.filename, uO.C_flag WISEP)) < 0)
+            return FALSE;
+        if (fn_matched)
+            fn_matched[i] = TRUE;
+    }
+    if (G.xfilespecs > 0 && (i = spec_find(&G.xnset, G.pxnames, G.xfilespecs, G.filename, uO.C_flag WISEP)) >= 0) {
+        if (xn_matched)
+            xn_matched[i] = TRUE;
+        return FALSE;
+    }
+    return TRUE;
+} /* end function want_entry() */
+
+#ifndef SFX
+
+/*********************************/
+/*  Function stream_local_hdr()  */
+/*********************************/
+
+static int stream_local_hdr(__G__ entry, pend) /* return PK-type error code */
+__GDEF
+ulg entry;
+int* pend;
+{
+    /* Read the local header, name and extra field of the next entry of a
+     * streamed archive, leaving the input at the start of its data.  Sets
+     * *pend when the central directory (or the end of the input) comes
+     * instead.
+     */
+    int error;
+
+    if (G.stream_sig)
+        G.stream_sig = FALSE; /* read by stream_entry_end() already */
+    else if (readbuf(__G__ G.sig, 4) < 4) {
+        Info(slide, 0x401, ((char*)slide, LoadFarString(StreamNoCentral)));
+        *pend = TRUE;
+        return PK_WARN;
+    }
+    if (memcmp(G.sig, central_hdr_sig, 4) == 0 || memcmp(G.sig, end_central_sig, 4) == 0 || memcmp(G.sig, end_central64_sig, 4) == 0 ||
+        memcmp(G.sig, name_index_sig, 4) == 0) {
+        *pend = TRUE;
+        return PK_COOL;
+    }
+    if (memcmp(G.sig, local_hdr_sig, 4) != 0) {
+        Info(slide, 0x401, ((char*)slide, LoadFarString(StreamNoLocalHdr), entry));
+        return PK_BADERR;
+    }
+
+    if ((error = process_stream_file_hdr(__G)) != PK_COOL) {
+        Info(slide, 0x421, ((char*)slide, LoadFarString(BadLocalHdr), entry));
+        return error;
+    }
+    G.stream_data = 1;
+
+    if ((error = do_string(__G__ G.lrec.filename_length, DS_FN_L)) != PK_COOL && error > PK_WARN) {
+        Info(slide, 0x401, ((char*)slide, LoadFarString(FilNamMsg), FnFilter1(G.filename), "local"));
+        return error;
+    }
+    G.pInfo->zip64 = FALSE;
+    if (G.extra_field != (uch*)NULL) {
+        free(G.extra_field);
+        G.extra_field = (uch*)NULL;
+    }
+    if ((error = do_string(__G__ G.lrec.extra_field_length, EXTRA_FIELD)) != PK_COOL && error > PK_WARN) {
+        Info(slide, 0x401, ((char*)slide, LoadFarString(ExtFieldMsg), FnFilter1(G.filename), "local"));
+        return error;
+    }
+
+    if ((G.lrec.general_purpose_bit_flag & 9) == 9) {
+        /* Encrypted data are decrypted a buffer at a time, so they must not
+           run into the next entry, and zip's local header sizes for them
+           leave out the encryption header: the size is really unknown. */
+        Info(slide, 0x401, ((char*)slide, LoadFarString(StreamNoSize), FnFilter1(G.filename), "encrypted"));
+        return PK_BADERR;
+    }
+    if (STREAM_SIZELESS) {
+        /* Only inflate and bunzip2 know where their data end. */
+        if (G.lrec.compression_method != DEFLATED && G.lrec.compression_method != ENHDEFLATED && G.lrec.compression_method != BZIPPED) {
+            Info(slide, 0x401, ((char*)slide, LoadFarString(StreamNoSize), FnFilter1(G.filename), "compressed"));
+            return PK_BADERR;
+        }
+        G.csize = STREAM_CSIZE;
+    }
+    else if ((G.lrec.general_purpose_bit_flag & 8) && G.lrec.csize == 0) {
+        /* Stored with a descriptor: zip puts the sizes in the local header
+           anyway, so zero is an empty file, followed straight away by its
+           descriptor (with or without signature, CRC 0).  Other writers may
+           leave the size to the descriptor, which cannot be streamed. */
+        if (!stream_peek(__G__ 4) || (makelong(G.inptr) != 0x08074b50L && makelong(G.inptr) != 0L)) {
+            Info(slide, 0x401, ((char*)slide, LoadFarString(StreamNoSize), FnFilter1(G.filename), "stored"));
+            return PK_BADERR;
+        }
+    }
+    return PK_COOL;
+} /* end function stream_local_hdr() */
+
+/****************************/
+/*  Function stream_peek()  */
+/****************************/
+
+static int stream_peek(__G__ n) /* return TRUE if n bytes are at G.inptr */
+__GDEF
+int n;
+{
+    /* Make sure the next n (a few) bytes of a streamed archive are in the
+     * input buffer, moving what is left to its start to read more.
+     */
+    int r;
+
+    if (G.incnt < 0)
+        G.incnt = 0;
+    while (G.incnt < n) {
+        if (G.inptr != G.inbuf) {
+            memmove(G.inbuf, G.inptr, G.incnt);
+            G.inptr = G.inbuf;
+        }
+        if ((r = read(G.zipfd, (char*)G.inbuf + G.incnt, INBUFSIZ - G.incnt)) <= 0)
+            return FALSE;
+        G.incnt += r;
+    }
+    return TRUE;
+} /* end function stream_peek() */
+
+/*********************************/
+/*  Function stream_entry_end()  */
+/*********************************/
+
+static int stream_entry_end(__G) /* return PK-type error code */
+    __GDEF {
+    /* Called with the input just past the decoded data of a streamed entry:
+     * pass over any data left unread and read its data descriptor, if it
+     * has one, into G.lrec.  The descriptor is the 64-bit form when the
+     * local header had a Zip64 extra field, as the format requires; for
+     * writers that do not keep to that, a 32-bit descriptor must be
+     * followed by a header signature, or it is read as 64-bit.
+     */
+    uch buf[20];
+    uch* p = buf;
+    unsigned need;
+
+    if (!STREAM_SIZELESS && G.csize > 0 && skip_zipf(__G__(zusz_t) G.csize) != PK_OK)
+        goto bad_desc;
+    G.csize = 0;
+    G.stream_data = 0;
+    if ((G.lrec.general_purpose_bit_flag & 8) == 0)
+        return PK_COOL;
+
+    /* optional "PK\7\8" signature, then the CRC */
+    if (readbuf(__G__(char*) buf, 4) < 4)
+        goto bad_desc;
+    if (makelong(buf) == 0x08074b50L && makelong(buf) != G.crc32val && readbuf(__G__(char*) buf, 4) < 4)
+        goto bad_desc;
+    G.lrec.crc32 = makelong(buf);
+
+    need = G.pInfo->zip64 ? 16 : 8;
+    if (readbuf(__G__(char*) buf, need) < need)
+        goto bad_desc;
+    if (!G.pInfo->zip64) {
+        if (readbuf(__G__ G.sig, 4) < 4)
+            memset(G.sig, 0, 4); /* end of input, let the next header read fail */
+        else if (!memcmp(G.sig, local_hdr_sig, 4) || !memcmp(G.sig, central_hdr_sig, 4) || !memcmp(G.sig, end_central_sig, 4) || !memcmp(G.sig, end_central64_sig, 4) ||
+                 !memcmp(G.sig, name_index_sig, 4))
+            G.stream_sig = TRUE;
+        else {
+            /* 64-bit after all: the "signature" is the low half of ucsize */
+            memcpy(buf + 8, G.sig, 4);
+            if (readbuf(__G__(char*) buf + 12, 4) < 4)
+                goto bad_desc;
+            need = 16;
+        }
+        if (need == 8) {
+            G.lrec.csize = makelong(p);
+            G.lrec.ucsize = makelong(p + 4);
+            return PK_COOL;
+        }
+    }
+    G.lrec.csize = makeint64(p);
+    G.lrec.ucsize = makeint64(p + 8);
+    return PK_COOL;
+
+bad_desc:
+    Info(slide, 0x401, ((char*)slide, LoadFarString(StreamBadDesc), FnFilter1(G.filename)));
+    return PK_BADERR;
+} /* end function stream_entry_end() */
+
+/**********************************/
+/*  Function stream_skip_entry()  */
+/**********************************/
+
+static int stream_skip_entry(__G) /* return PK-type error code */
+    __GDEF {
+    /* Pass over the rest of a streamed entry that was not (fully)
+     * extracted.  Data of known size is simply read past.  Without a size
+     * only the decoder can find the end, so an entry that was not started
+     * is decoded as a quiet test; one that failed part way cannot be
+     * resynchronized.
+     */
+    int error, save_tflag, save_qflag;
+
+    if (!STREAM_SIZELESS)
+        return stream_entry_end(__G);
+    if (G.stream_data > 1) {
+        Info(slide, 0x401, ((char*)slide, LoadFarString(StreamLost), FnFilter1(G.filename)));
+        return PK_BADERR;
+    }
+
+    save_tflag = uO.tflag;
+    save_qflag = uO.qflag;
+    uO.tflag = TRUE;
+    uO.qflag = 2;
+    error = extract_or_test_member(__G);
+    uO.tflag = save_tflag;
+    uO.qflag = save_qflag;
+    if (G.stream_data) {
+        Info(slide, 0x401, ((char*)slide, LoadFarString(StreamLost), FnFilter1(G.filename)));
+        return PK_BADERR;
+    }
+    return error;
+} /* end function stream_skip_entry() */
+
+#endif /* !SFX */
+
 #ifndef SFX
 
 /*******************************/
@@ -2192,7 +2691,7 @@ int UZbunzip2(__G) __GDEF
 #ifdef FUNZIP
     while (err != BZ_STREAM_END) {
 #else  /* !FUNZIP */
-    while (G.csize > 0) {
+    while (G.csize > 0 && err != BZ_STREAM_END) {
         Trace((stderr, "first loop:  G.csize = %ld\n", G.csize));
 #endif /* ?FUNZIP */
         while (bstrm.avail_out > 0) {
@@ -2213,7 +2712,8 @@ int UZbunzip2(__G) __GDEF
 #ifdef FUNZIP
             if (err == BZ_STREAM_END) /* "END-of-entry-condition" ? */
 #else                                 /* !FUNZIP */
-            if (G.csize <= 0L) /* "END-of-entry-condition" ? */
+            /* a streamed entry without a size ends where its bzip2 data do */
+            if (G.csize <= 0L || err == BZ_STREAM_END) /* "END-of-entry-condition" ? */
 #endif                                /* ?FUNZIP */
                 break;
 
@@ -2269,7 +2769,7 @@ int UZbunzip2(__G) __GDEF
 #endif
 
     G.inptr = (uch*)bstrm.next_in;
-    G.incnt -= G.inptr - G.inbuf; /* reset for other routines */
+    G.incnt = bstrm.avail_in; /* reset for other routines */
 
 uzbunzip_cleanup_exit:
     err = BZ2_bzDecompressEnd(&bstrm);
@@ -22,7 +22,9 @@
              readbyte()
              fillinbuf()
              seek_zipf()
+             skip_zipf()
              flush()                  (non-VMS)
+             stdout_write()           (non-VMS)
              is_vms_varlen_txt()      (non-VMS, VMS_TEXT_CONV only)
              disk_error()             (non-VMS)
              UzpMessagePrnt()
@@ -81,6 +83,17 @@
    be valid for anything up to 64K (and probably beyond, assuming your
    buffers are that big).
 */
+#ifdef UNIX
+/* output files are looked up from their directory, see unix.c */
+#define OSTAT(path, pbuf) stat_at(__G__ path, pbuf, FALSE)
+#define OLSTAT(path, pbuf) stat_at(__G__ path, pbuf, TRUE)
+#define OFOPEN(path, mode, excl) fopen_at(__G__ path, mode, excl)
+#else
+#define OSTAT SSTAT
+#define OLSTAT lstat
+#define OFOPEN(path, mode, excl) zfopen(path, mode)
+#endif
+
 #ifdef USE_FWRITE
 #define WriteError(buf, len, strm) ((extent)fwrite((char*)(buf), 1, (extent)(len), strm) != (extent)(len))
 #else
@@ -109,9 +122,26 @@
 */
 #define WriteTxtErr(buf, len, strm) WriteError(buf, len, strm)
 
+#ifdef UNIX
+/* --sparse:  zero blocks of at least SPARSE_BLK bytes are skipped with a seek
+   instead of being written, leaving holes in the output file.  A hole at the
+   very end is made real by close_outfile(), which truncates the file to the
+   current position. */
+#ifndef SPARSE_BLK
+#define SPARSE_BLK 4096
+#endif
+#ifdef USE_FWRITE
+#define SeekError(len, strm) (zfseeko(strm, (zoff_t)(len), SEEK_CUR) != 0)
+#else
+#define SeekError(len, strm) (zlseek(fileno(strm), (zoff_t)(len), SEEK_CUR) == (zoff_t)-1)
+#endif
+static int sparse_write OF((__GPRO__ uch * rawbuf, ulg size));
+#endif /* UNIX */
+
 #if (defined(USE_DEFLATE64) && defined(__16BIT__))
 static int partflush OF((__GPRO__ uch * rawbuf, ulg size, int unshrink));
 #endif
+static int stdout_write OF((__GPRO__ uch * buf, ulg size));
 static int disk_error OF((__GPRO));
 
 /****************************/
@@ -199,17 +229,37 @@ int open_input_file(__G) /* return 1 if open failed */
 /* Function open_outfile() */
 /***************************/
 
-int open_outfile(__G) /* return 1 if fail */
+int open_outfile(__G) /* return 1 if fail, OPEN_AGAIN to ask again */
     __GDEF {
+#ifdef UNIX
+    int state; /* of G.filename, as far as the listing of its dir tells */
+#endif
 #ifdef DLL
     if (G.redirect_data)
         return (redirect_outfile(__G) == FALSE);
 #endif
 #if (defined(DOS_FLX_NLM_OS2_W32) || defined(ATH_BEO_THS_UNX))
+#ifdef UNIX
+    /* A name not in the listing of its directory needs no stat(), nor does
+     * a plain file there before its unlink().  Either is then created with
+     * O_EXCL, which catches a listing that has gone out of date.
+     */
+    state = name_state(__G__ G.filename);
+    if (state == NAME_FILE) {
+        if (unlink(G.filename) != 0 && errno != ENOENT) {
+            Info(slide, 0x401, ((char*)slide, LoadFarString(CannotDeleteOldFile), FnFilter1(G.filename), strerror(errno)));
+            return 1;
+        }
+        Trace((stderr, "open_outfile:  %s now deleted\n", FnFilter1(G.filename)));
+    }
+    else if (state == NAME_ABSENT)
+        ;
+    else
+#endif /* UNIX */
 #ifdef SYMLINKS
-    if (SSTAT(G.filename, &G.statbuf) == 0 || lstat(G.filename, &G.statbuf) == 0)
+    if (OSTAT(G.filename, &G.statbuf) == 0 || OLSTAT(G.filename, &G.statbuf) == 0)
 #else
-    if (SSTAT(G.filename, &G.statbuf) == 0)
+    if (OSTAT(G.filename, &G.statbuf) == 0)
 #endif /* ?SYMLINKS */
     {
         Trace((stderr, "open_outfile:  stat(%s) returns 0:  file exists\n", FnFilter1(G.filename)));
@@ -344,20 +394,31 @@ int open_outfile(__G) /* return 1 if fail */
         /* These features require the ability to re-read extracted data from
            the output files. Output files are created with Read&Write access.
          */
-        G.outfile = zfopen(G.filename, FOPWR);
+        G.outfile = OFOPEN(G.filename, FOPWR, state != NAME_UNKNOWN);
 #else
-        G.outfile = zfopen(G.filename, FOPW);
+        G.outfile = OFOPEN(G.filename, FOPW, state != NAME_UNKNOWN);
 #endif
 #if defined(ATH_BE_UNX) || defined(AOS_VS) || defined(QDOS) || defined(TANDEM)
         umask(umask_sav);
 #endif
     }
     if (G.outfile == (FILE*)NULL) {
+#ifdef UNIX
+        if (errno == EEXIST && state != NAME_UNKNOWN) {
+            /* the listing was wrong; where overwriting was asked for
+               anyway, go the long way, else -n or the query decides */
+            name_stale(__G__ G.filename);
+            if (IS_OVERWRT_ALL)
+                return open_outfile(__G);
+            return OPEN_AGAIN;
+        }
+#endif
         Info(slide, 0x401, ((char*)slide, LoadFarString(CannotCreateFile), FnFilter1(G.filename), strerror(errno)));
         return 1;
     }
     Trace((stderr, "open_outfile:  fopen(%s) for writing succeeded\n", FnFilter1(G.filename)));
 #endif /* !TOPS20 */
+    G.sparse_tail = FALSE;
 
 #ifdef USE_FWRITE
 #ifdef _IOFBF /* make output fully buffered (works just about like write()) */
@@ -597,6 +658,36 @@ int seek_zipf(__G__ abs_offset) __GDEF zoff_t abs_offset;
     return (PK_OK);
 } /* end function seek_zipf() */
 
+/************************/
+/* Function skip_zipf() */
+/************************/
+
+int skip_zipf(__G__ len) __GDEF zusz_t len;
+{
+    /*
+     *  Discard the next len bytes of zipfile input by reading past them.
+     *  Used instead of seek_zipf() when the archive is streamed (G.stream),
+     *  since a pipe cannot seek.  Returns PK_EOF if the input ends first.
+     */
+    unsigned n;
+
+    while (len > 0) {
+        if (G.incnt <= 0) {
+            if ((G.incnt = read(G.zipfd, (char*)G.inbuf, INBUFSIZ)) <= 0) {
+                G.incnt = 0;
+                return PK_EOF;
+            }
+            G.cur_zipfile_bufstart += INBUFSIZ;
+            G.inptr = G.inbuf;
+        }
+        n = (unsigned)MIN(len, (zusz_t)G.incnt);
+        G.inptr += n;
+        G.incnt -= n;
+        len -= n;
+    }
+    return PK_OK;
+} /* end function skip_zipf() */
+
 /********************/
 /* Function flush() */ /* returns PK error codes: */
 /********************/ /* if tflag => always 0; PK_DISK if write error */
@@ -687,11 +778,18 @@ int unshrink;
 #endif
         }
         else
+#endif
+#ifdef UNIX
+            if (uO.sparse && !uO.cflag) {
+                if (sparse_write(__G__ rawbuf, size))
+                    return disk_error(__G);
+            }
+            else
 #endif
             if (!uO.cflag && WriteError(rawbuf, size, G.outfile))
             return disk_error(__G);
-        else if (uO.cflag && (*G.message)((zvoid*)&G, rawbuf, size, 0))
-            return PK_OK;
+        else if (uO.cflag && stdout_write(__G__ rawbuf, size))
+            return PK_DISK;
     }
     else { /* textmode:  aflag is true */
         if (unshrink) {
@@ -746,8 +844,8 @@ int unshrink;
                         Trace((stderr, "p - rawbuf = %u   q-transbuf = %u   size = %lu\n", (unsigned)(p - rawbuf), (unsigned)(q - transbuf), size));
                         if (!uO.cflag && WriteError(transbuf, (extent)(q - transbuf), G.outfile))
                             return disk_error(__G);
-                        else if (uO.cflag && (*G.message)((zvoid*)&G, transbuf, (ulg)(q - transbuf), 0))
-                            return PK_OK;
+                        else if (uO.cflag && stdout_write(__G__ transbuf, (ulg)(q - transbuf)))
+                            return PK_DISK;
                         q = transbuf;
                         continue;
                     }
@@ -770,8 +868,8 @@ int unshrink;
 #endif
                 if (!uO.cflag && WriteError(transbuf, (extent)(q - transbuf), G.outfile))
                 return disk_error(__G);
-            else if (uO.cflag && (*G.message)((zvoid*)&G, transbuf, (ulg)(q - transbuf), 0))
-                return PK_OK;
+            else if (uO.cflag && stdout_write(__G__ transbuf, (ulg)(q - transbuf)))
+                return PK_DISK;
         }
     }
 
@@ -779,6 +877,76 @@ int unshrink;
 
 } /* end function flush() [resp. partflush() for 16-bit Deflate64 support] */
 
+#ifdef UNIX
+
+/***************************/
+/* Function sparse_write() */ /* returns nonzero on write or seek error */
+/***************************/
+
+static int sparse_write(__G__ rawbuf, size)
+__GDEF
+uch* rawbuf;
+ulg size;
+{
+    uch* end = rawbuf + (extent)size;
+    uch* data = rawbuf; /* start of bytes not yet written */
+    uch* p;
+    extent hole = 0;    /* length of the zero run ending at p */
+
+    for (p = rawbuf; (extent)(end - p) >= SPARSE_BLK; p += SPARSE_BLK) {
+        if (p[0] != 0 || memcmp(p, p + 1, SPARSE_BLK - 1) != 0) {
+            if (hole) {
+                if (SeekError(hole, G.outfile))
+                    return 1;
+                hole = 0;
+                data = p;
+            }
+            continue;
+        }
+        if (hole == 0) {
+            if (p > data && WriteError(data, p - data, G.outfile))
+                return 1;
+            G.sparse_tail = TRUE;
+        }
+        hole += SPARSE_BLK;
+    }
+    if (hole) {
+        if (SeekError(hole, G.outfile))
+            return 1;
+        data = p;
+    }
+    if (end > data) {
+        if (WriteError(data, end - data, G.outfile))
+            return 1;
+        G.sparse_tail = FALSE;
+    }
+    return 0;
+
+} /* end function sparse_write() */
+
+#endif /* UNIX */
+
+/***************************/
+/* Function stdout_write() */ /* returns PK_DISK on write error */
+/***************************/
+
+static int stdout_write(__G__ buf, size)
+__GDEF
+uch* buf;
+ulg size;
+{
+#ifdef UNIX
+    /* stdout_direct() found nothing else that needs to see the data, so
+       hand it to the pipe or file in whole slide-sized writes */
+    if (G.pipe_out > 0)
+        return WriteError(buf, size, stdout) ? disk_error(__G) : PK_OK;
+#endif
+    /* a failed message write only loses the data, as it always has */
+    (*G.message)((zvoid*)&G, buf, size, 0);
+    return PK_OK;
+
+} /* end function stdout_write() */
+
 /*************************/
 /* Function disk_error() */
 /*************************/
@@ -1366,14 +1534,22 @@ int check_for_newer(__G__ filename) /* return 1 if existing file is newer */
 #ifdef USE_EF_UT_TIME
     iztimes z_utime;
 #endif
+#ifdef UNIX
+    int state = name_state(__G__ filename);
+
+    if (state == NAME_ABSENT) /* not in the listing of its directory */
+        return DOES_NOT_EXIST;
+    if (state == NAME_FILE && !uO.uflag && (IS_OVERWRT_ALL || IS_OVERWRT_NONE))
+        return EXISTS_AND_OLDER; /* its time would change nothing */
+#endif
 
     Trace((stderr, "check_for_newer:  doing stat(%s)\n", FnFilter1(filename)));
-    if (SSTAT(filename, &G.statbuf)) {
+    if (OSTAT(filename, &G.statbuf)) {
         Trace((stderr, "check_for_newer:  stat(%s) returns %d:  file does not exist\n", FnFilter1(filename), SSTAT(filename, &G.statbuf)));
 #ifdef SYMLINKS
         Trace((stderr, "check_for_newer:  doing lstat(%s)\n", FnFilter1(filename)));
         /* GRR OPTION:  could instead do this test ONLY if G.symlnk is true */
-        if (lstat(filename, &G.statbuf) == 0) {
+        if (OLSTAT(filename, &G.statbuf) == 0) {
             Trace((stderr, "check_for_newer:  lstat(%s) returns 0:  symlink does exist\n", FnFilter1(filename)));
             if (QCOND2 && !IS_OVERWRT_ALL)
                 Info(slide, 0, ((char*)slide, LoadFarString(FileIsSymLink), FnFilter1(filename), " with no real file"));
@@ -1386,7 +1562,12 @@ int check_for_newer(__G__ filename) /* return 1 if existing file is newer */
 
 #ifdef SYMLINKS
     /* GRR OPTION:  could instead do this test ONLY if G.symlnk is true */
-    if (lstat(filename, &G.statbuf) == 0 && S_ISLNK(G.statbuf.st_mode)) {
+#ifdef UNIX
+    if (state != NAME_FILE && /* else readdir() said it is no symlink */
+        OLSTAT(filename, &G.statbuf) == 0 && S_ISLNK(G.statbuf.st_mode)) {
+#else
+    if (OLSTAT(filename, &G.statbuf) == 0 && S_ISLNK(G.statbuf.st_mode)) {
+#endif
         Trace((stderr, "check_for_newer:  %s is a symbolic link\n", FnFilter1(filename)));
         if (QCOND2 && !IS_OVERWRT_ALL)
             Info(slide, 0, ((char*)slide, LoadFarString(FileIsSymLink), FnFilter1(filename), ""));
@@ -1431,6 +1612,65 @@ int check_for_newer(__G__ filename) /* return 1 if existing file is newer */
 
 } /* end function check_for_newer() */
 
+/*****************************/
+/* Function same_as_member() */ /* used for --skip-identical */
+/*****************************/
+
+int same_as_member(__G__ filename) /* return 1 if the existing file holds */
+    __GDEF                         /*  what the member would write */
+    char* filename;
+{
+    zusz_t left;
+    ulg crc = CRCVAL_INITIAL;
+    int fd, n;
+
+#ifdef SYMLINKS
+    if (OLSTAT(filename, &G.statbuf) != 0 || !S_ISREG(G.statbuf.st_mode))
+#else
+    if (OSTAT(filename, &G.statbuf) != 0)
+#endif
+        return FALSE;
+    if ((zusz_t)G.statbuf.st_size != G.pInfo->uncompr_size)
+        return FALSE;
+
+    if (uO.skipsame > 1) {
+        time_t existing, archive;
+#ifdef USE_EF_UT_TIME
+        iztimes z_utime;
+
+        if (G.extra_field &&
+#ifdef IZ_CHECK_TZ
+            G.tz_is_valid &&
+#endif
+            (ef_scan_for_izux(G.extra_field, G.lrec.extra_field_length, 0, G.lrec.last_mod_dos_datetime, &z_utime, NULL) & EB_UT_FL_MTIME)) {
+            existing = G.statbuf.st_mtime;
+            archive = z_utime.mtime;
+        }
+        else
+#endif /* USE_EF_UT_TIME */
+        {
+            /* rounded up to 2 seconds, as in check_for_newer() */
+            existing = ((G.statbuf.st_mtime & 1) && (G.statbuf.st_mtime + 1 > G.statbuf.st_mtime)) ? G.statbuf.st_mtime + 1 : G.statbuf.st_mtime;
+            archive = dos_to_unix_time(G.lrec.last_mod_dos_datetime);
+        }
+        if (existing != archive)
+            return FALSE;
+    }
+
+    /* the sizes agree:  read it through the fast CRC, a window at a time */
+    if ((fd = open(filename, O_RDONLY | O_BINARY)) < 0)
+        return FALSE;
+    for (left = G.pInfo->uncompr_size; left > 0; left -= n) {
+        if ((n = read(fd, (char*)slide, (unsigned)MIN(left, (zusz_t)WSIZE))) <= 0)
+            break;
+        crc = crc32(crc, slide, (extent)n);
+    }
+    close(fd);
+    Trace((stderr, "same_as_member:  %s crc %08lx, member %08lx\n", FnFilter1(filename), crc, G.pInfo->crc));
+    return left == 0 && crc == G.pInfo->crc;
+
+} /* end function same_as_member() */
+
 #endif /* !VMS && !OS2 && !CMS_MVS */
 
 /************************/
@@ -1647,8 +1887,11 @@ int option;
 #endif                                 /* ?UNICODE_SUPPORT */
 
             /* translate the Zip entry filename coded in host-dependent "extended
-               ASCII" into the compiler's (system's) internal text code page */
-            Ext_ASCII_TO_Native(G.filename, G.pInfo->hostnum, G.pInfo->hostver, G.pInfo->HasUxAtt, (option == DS_FN_L));
+               ASCII" into the compiler's (system's) internal text code page;
+               a streamed entry has no known host, so its name is kept as is */
+            if (!G.stream) {
+                Ext_ASCII_TO_Native(G.filename, G.pInfo->hostnum, G.pInfo->hostver, G.pInfo->HasUxAtt, (option == DS_FN_L));
+            }
 
             if (G.pInfo->lcflag) /* replace with lowercase filename */
                 STRLOWER(G.filename, G.filename);
@@ -1677,6 +1920,18 @@ int option;
              */
 
         case SKIP:
+            if (G.stream) {
+                if (skip_zipf(__G__(zusz_t) length) != PK_OK)
+                    return PK_EOF;
+                break;
+            }
+            /* the rest of a central header is usually still in the buffer
+             * (always, for a directory loaded by cdl_load()) */
+            if (G.incnt >= 0 && (unsigned)G.incnt >= length) {
+                G.inptr += length;
+                G.incnt -= length;
+                break;
+            }
             /* cur_zipfile_bufstart already takes account of extra_bytes, so don't
              * correct for it twice: */
             seek_zipf(__G__ G.cur_zipfile_bufstart - G.extra_bytes + (G.inptr - G.inbuf) + length);
@@ -1692,9 +1947,7 @@ int option;
                 free(G.extra_field);
             if ((G.extra_field = (uch*)malloc(length)) == (uch*)NULL) {
                 Info(slide, 0x401, ((char*)slide, LoadFarString(ExtraFieldTooLong), length));
-                /* cur_zipfile_bufstart already takes account of extra_bytes,
-                 * so don't correct for it twice: */
-                seek_zipf(__G__ G.cur_zipfile_bufstart - G.extra_bytes + (G.inptr - G.inbuf) + length);
+                do_string(__G__ length, SKIP);
             }
             else {
                 if (readbuf(__G__(char*) G.extra_field, length) == 0)
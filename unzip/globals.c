@@ -32,6 +32,8 @@ char end_central_sig[4] = {0, 0, 0x05, 0x06};
 char end_central64_sig[4] = {0, 0, 0x06, 0x06};
 char end_centloc64_sig[4] = {0, 0, 0x06, 0x07};
 /* extern char extd_local_sig[4] = {0, 0, 0x07, 0x08};  NOT USED YET */
+char name_index_sig[4] = {'I', 'Z', 'n', 'x'};     /* zip -ni name index */
+char name_index_end_sig[4] = {'I', 'Z', 'N', 'X'};
 
 ZCONST char* fnames[2] = {"*", NULL}; /* default filenames vector */
 #endif
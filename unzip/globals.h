@@ -215,6 +215,8 @@ typedef struct Globals {
 
     char** pfnames;
     char** pxnames;
+    specset fnset; /* pfnames and pxnames, hashed by spec_init() */
+    specset xnset;
     char sig[4];
     char answerbuf[10];
     min_info info[DIR_BLKSIZ];
@@ -266,11 +268,24 @@ typedef struct Globals {
     int reported_backslash; /* extract.c static */
     int newfile;
     void** cover; /* used in extract.c for bomb detection */
+    cdload* cdl;  /* cdload.c:  the central directory, if read in one piece */
+    ulg samefiles;    /* extract static: --skip-identical files left alone */
+    zusz_t samebytes; /*  and the bytes they hold */
+    dupkey* dups;     /* cdload.c:  --link-duplicates content groups */
+    ulg dupmask;      /*  (slots - 1) */
+    int noclone;      /* unix.c:  FICLONE failed, --link-duplicates=reflink */
+    ulg linkfiles;    /* extract static: members linked to an earlier copy */
+    zusz_t linkbytes; /*  and the bytes they hold */
 
     int didCRlast; /* fileio static */
+    int sparse_tail; /* fileio static: --sparse output ends in a hole */
+    int pipe_out;    /* -c/-p data:  1 = write() to stdout, -1 = messages */
     ulg numlines;  /* fileio static: number of lines printed */
     int sol;       /* fileio static: at start of line */
     int no_ecrec;  /* process static */
+    int stream;     /* archive is read sequentially from local headers */
+    int stream_sig; /* extract static: G.sig already holds the next signature */
+    int stream_data; /* extract static: 1 = entry data unread, 2 = part read */
 #ifdef SYMLINKS
     int symlnk;
     slinkentry* slink_head; /* pointer to head of symlinks list */
@@ -387,6 +402,8 @@ extern char end_central32_sig[4];
 extern char end_central64_sig[4];
 extern char end_centloc64_sig[4];
 /* extern char extd_local_sig[4];  NOT USED YET */
+extern char name_index_sig[4];
+extern char name_index_end_sig[4];
 
 #ifdef REENTRANT
 #define G (*(Uz_Globs*)pG)
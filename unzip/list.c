@@ -17,6 +17,13 @@
              get_time_stamp()   [optional feature]
              ratio()
              fnprint()
+             ls_num()
+             ls_out()
+             ls_flush()
+
+  The listing is formatted by hand and collected in outbuf, which is sent
+  through G.message in pieces of up to OUTBUFSIZ bytes instead of three
+  messages (and flushes) per entry.
 
   ---------------------------------------------------------------------------*/
 
@@ -26,6 +33,9 @@
 #ifdef TIMESTAMP
 static int fn_is_dir OF((__GPRO));
 #endif
+static char* ls_num OF((char* p, zusz_t n, int width, int pad));
+static void ls_out OF((__GPRO__ ZCONST char* s, extent n));
+static void ls_flush OF((__GPRO));
 
 /* unix-only header strings */
 
@@ -40,11 +50,9 @@ static ZCONST char Far HeadersL1[] = "--------  ------  ------- ---- ----------
 static ZCONST char Far* Headers[][2] = {{HeadersS, HeadersS1}, {HeadersL, HeadersL1}};
 
 static ZCONST char Far CaseConversion[] = "%s (\"^\" ==> case\n%s   conversion)\n";
-static ZCONST char Far LongHdrStats[] = "%s  %-7s%s %4s %02u%c%02u%c%02u %02u:%02u %08lx %c";
 static ZCONST char Far LongFileTrailer[] =
     "--------          -------  ---                       \
      -------\n%s         %s %4s                            %lu file%s\n";
-static ZCONST char Far ShortHdrStats[] = "%s  %02u%c%02u%c%02u %02u:%02u  %c";
 static ZCONST char Far ShortFileTrailer[] =
     "---------                     -------\n%s\
                      %lu file%s\n";
@@ -67,8 +75,12 @@ int list_files(__G) /* return PK-type error code */
 #ifdef USE_EF_UT_TIME
     iztimes z_utime;
     struct tm* t;
+    time_t last_mtime = 0;
+    struct tm last_tm;
+    int have_last = FALSE;
 #endif
     unsigned yr, mo, dy, hh, mm;
+    char line[128], *p, *name;
     unsigned disp_y, disp_m, disp_d; /* explicit output order */
     zusz_t csiz, tot_csize = 0L, tot_ucsize = 0L;
     min_info info;
@@ -83,35 +95,44 @@ int list_files(__G) /* return PK-type error code */
     date_format = DATE_FORMAT;
     dt_sepchar = DATE_SEPCHAR;
 
-    if (uO.qflag < 2) {
+    G.outcnt = 0;
+    if (uO.qflag < 2 && !uO.names) {
         if (uO.L_flag)
             Info(slide, 0, ((char*)slide, LoadFarString(CaseConversion), LoadFarStringSmall(Headers[longhdr][0]), LoadFarStringSmall2(Headers[longhdr][1])));
         else
             Info(slide, 0, ((char*)slide, "%s\n%s\n", LoadFarString(Headers[longhdr][0]), LoadFarStringSmall(Headers[longhdr][1])));
     }
 
+    cdl_load(__G);
     for (j = 1L;; j++) {
-        if (readbuf(__G__ G.sig, 4) == 0)
+        if ((G.cdl != NULL ? cdl_sig(__G) : readbuf(__G__ G.sig, 4)) == 0) {
+            ls_flush(__G);
             return PK_EOF;
+        }
 
         if (memcmp(G.sig, central_hdr_sig, 4)) {
             if (((j - 1) & (ulg)(G.ecrec.have_ecr64 ? MASK_ZUCN64 : MASK_ZUCN16)) == (ulg)G.ecrec.total_entries_central_dir) {
                 break;
             }
             else {
+                ls_flush(__G);
                 Info(slide, 0x401, ((char*)slide, LoadFarString(CentSigMsg), j));
                 Info(slide, 0x401, ((char*)slide, "%s", LoadFarString(ReportMsg)));
                 return PK_BADERR;
             }
         }
 
-        if ((error = process_cdir_file_hdr(__G)) != PK_COOL)
+        if ((error = process_cdir_file_hdr(__G)) != PK_COOL) {
+            ls_flush(__G);
             return error;
+        }
 
         if ((error = do_string(__G__ G.crec.filename_length, DS_FN)) != PK_COOL) {
             error_in_archive = error;
-            if (error > PK_WARN)
+            if (error > PK_WARN) {
+                ls_flush(__G);
                 return error;
+            }
         }
 
         if (G.extra_field != (uch*)NULL) {
@@ -120,33 +141,27 @@ int list_files(__G) /* return PK-type error code */
         }
         if ((error = do_string(__G__ G.crec.extra_field_length, EXTRA_FIELD)) != 0) {
             error_in_archive = error;
-            if (error > PK_WARN)
+            if (error > PK_WARN) {
+                ls_flush(__G);
                 return error;
+            }
         }
 
         if (!G.process_all_files) {
-            unsigned i;
-
-            if (G.filespecs == 0)
-                do_this_file = TRUE;
-            else {
-                do_this_file = FALSE;
-                for (i = 0; i < G.filespecs; i++)
-                    if (match(G.filename, G.pfnames[i], uO.C_flag WISEP)) {
-                        do_this_file = TRUE;
-                        break;
-                    }
-            }
-            if (do_this_file) {
-                for (i = 0; i < G.xfilespecs; i++)
-                    if (match(G.filename, G.pxnames[i], uO.C_flag WISEP)) {
-                        do_this_file = FALSE;
-                        break;
-                    }
-            }
+            do_this_file = G.filespecs == 0 || spec_find(&G.fnset, G.pfnames, G.filespecs, G.filename, uO.C_flag WISEP) >= 0;
+            if (do_this_file && G.xfilespecs > 0)
+                do_this_file = spec_find(&G.xnset, G.pxnames, G.xfilespecs, G.filename, uO.C_flag WISEP) < 0;
         }
 
-        if (G.process_all_files || do_this_file) {
+        if ((G.process_all_files || do_this_file) && uO.names) {
+            /* names only, for scripts (as zipinfo -1) */
+            name = fnfilter(G.filename, slide, (extent)(WSIZE >> 1));
+            ls_out(__G__ name, strlen(name));
+            ls_out(__G__ "\n", 1);
+            ++members;
+            SKIP_(G.crec.file_comment_length)
+        }
+        else if (G.process_all_files || do_this_file) {
 #ifdef USE_EF_UT_TIME
             if (G.extra_field &&
 #ifdef IZ_CHECK_TZ
@@ -154,7 +169,14 @@ int list_files(__G) /* return PK-type error code */
 #endif
                 (ef_scan_for_izux(G.extra_field, G.crec.extra_field_length, 1, G.crec.last_mod_dos_datetime, &z_utime, NULL) & EB_UT_FL_MTIME)) {
                 TIMET_TO_NATIVE(z_utime.mtime)
-                t = localtime(&(z_utime.mtime));
+                /* members of one archive often share their time */
+                if (have_last && z_utime.mtime == last_mtime)
+                    t = &last_tm;
+                else if ((t = localtime(&(z_utime.mtime))) != (struct tm*)NULL) {
+                    last_tm = *t;
+                    last_mtime = z_utime.mtime;
+                    have_last = TRUE;
+                }
             }
             else
                 t = (struct tm*)NULL;
@@ -232,20 +254,62 @@ int list_files(__G) /* return PK-type error code */
                 }
             }
 
-            if (cfactor == 100)
-                snprintf(cfactorstr, sizeof(cfactorstr), LoadFarString(CompFactor100));
-            else
-                snprintf(cfactorstr, sizeof(cfactorstr), LoadFarString(CompFactorStr), sgn, cfactor);
-
-            if (longhdr)
-                Info(slide, 0,
-                     ((char*)slide, LoadFarString(LongHdrStats), FmZofft(G.crec.ucsize, "8", "u"), methbuf, FmZofft(csiz, "8", "u"), cfactorstr, disp_m, dt_sepchar, disp_d, dt_sepchar, disp_y, hh, mm,
-                      G.crec.crc32, (G.pInfo->lcflag ? '^' : ' ')));
-            else
-                Info(slide, 0, ((char*)slide, LoadFarString(ShortHdrStats), FmZofft(G.crec.ucsize, "9", "u"), disp_m, dt_sepchar, disp_d, dt_sepchar, disp_y, hh, mm, (G.pInfo->lcflag ? '^' : ' ')));
-
-            fnprint(__G);
-
+            /* "%8s  %-7s%8s %4s " (-v) or "%9s  ", date, time, (-v) CRC,
+               case conversion flag, name */
+            p = line;
+            if (longhdr) {
+                extent k;
+
+                p = ls_num(p, G.crec.ucsize, 8, ' ');
+                *p++ = ' ', *p++ = ' ';
+                for (k = 0; methbuf[k] != '\0'; k++)
+                    *p++ = methbuf[k];
+                for (; k < 7; k++)
+                    *p++ = ' ';
+                p = ls_num(p, csiz, 8, ' ');
+                *p++ = ' ';
+                if (cfactor == 100)
+                    strcpy(cfactorstr, "100%");
+                else {
+                    char* q = ls_num(cfactorstr + 1, (zusz_t)cfactor, 0, ' ');
+
+                    cfactorstr[0] = sgn, *q++ = '%', *q = '\0';
+                }
+                for (k = strlen(cfactorstr); k < 4; k++)
+                    *p++ = ' ';
+                for (k = 0; cfactorstr[k] != '\0'; k++)
+                    *p++ = cfactorstr[k];
+                *p++ = ' ';
+            }
+            else {
+                p = ls_num(p, G.crec.ucsize, 9, ' ');
+                *p++ = ' ', *p++ = ' ';
+            }
+            p = ls_num(p, disp_m, 2, '0');
+            *p++ = dt_sepchar;
+            p = ls_num(p, disp_d, 2, '0');
+            *p++ = dt_sepchar;
+            p = ls_num(p, disp_y, 2, '0');
+            *p++ = ' ';
+            p = ls_num(p, hh, 2, '0');
+            *p++ = ':';
+            p = ls_num(p, mm, 2, '0');
+            *p++ = ' ';
+            if (longhdr) {
+                int k;
+
+                for (k = 28; k >= 0; k -= 4)
+                    *p++ = "0123456789abcdef"[(G.crec.crc32 >> k) & 0xf];
+            }
+            *p++ = ' ';
+            *p++ = G.pInfo->lcflag ? '^' : ' ';
+            ls_out(__G__ line, (extent)(p - line));
+            name = fnfilter(G.filename, slide, (extent)(WSIZE >> 1));
+            ls_out(__G__ name, strlen(name));
+            ls_out(__G__ "\n", 1);
+
+            if (G.crec.file_comment_length && QCOND)
+                ls_flush(__G); /* do_string() displays it from outbuf */
             if ((error = do_string(__G__ G.crec.file_comment_length, QCOND ? DISPL_8 : SKIP)) != 0) {
                 error_in_archive = error;
                 if (error > PK_WARN)
@@ -260,8 +324,9 @@ int list_files(__G) /* return PK-type error code */
             SKIP_(G.crec.file_comment_length)
         }
     } /* for each central directory entry */
+    ls_flush(__G);
 
-    if (uO.qflag < 2) {
+    if (uO.qflag < 2 && !uO.names) {
         if ((cfactor = ratio(tot_ucsize, tot_csize)) < 0) {
             sgn = '-';
             cfactor = (-cfactor + 5) / 10;
@@ -363,25 +428,9 @@ int get_time_stamp(__GPRO__ time_t* last_modtime, ulg* nmember) /* return PK-typ
         }
 
         if (!G.process_all_files) {
-            unsigned i;
-
-            if (G.filespecs == 0)
-                do_this_file = TRUE;
-            else {
-                do_this_file = FALSE;
-                for (i = 0; i < G.filespecs; i++)
-                    if (match(G.filename, G.pfnames[i], uO.C_flag WISEP)) {
-                        do_this_file = TRUE;
-                        break;
-                    }
-            }
-            if (do_this_file) {
-                for (i = 0; i < G.xfilespecs; i++)
-                    if (match(G.filename, G.pxnames[i], uO.C_flag WISEP)) {
-                        do_this_file = FALSE;
-                        break;
-                    }
-            }
+            do_this_file = G.filespecs == 0 || spec_find(&G.fnset, G.pfnames, G.filespecs, G.filename, uO.C_flag WISEP) >= 0;
+            if (do_this_file && G.xfilespecs > 0)
+                do_this_file = spec_find(&G.xnset, G.pxnames, G.xfilespecs, G.filename, uO.C_flag WISEP) < 0;
         }
 
         if ((G.process_all_files || do_this_file) && !fn_is_dir(__G)) {
@@ -441,6 +490,61 @@ int ratio(zusz_t uc, zusz_t c) {
     }
 }
 
+/***********************/
+/*  Function ls_num()  */
+/***********************/
+
+static char* ls_num(p, n, width, pad) /* return the end of the number */
+char* p;
+zusz_t n;
+int width; /* at least this many characters, */
+int pad;   /* filled with this on the left */
+{
+    char d[24];
+    int i = 0;
+
+    do {
+        d[i++] = (char)('0' + (int)(n % 10));
+        n /= 10;
+    } while (n != 0);
+    while (width-- > i)
+        *p++ = (char)pad;
+    while (i > 0)
+        *p++ = d[--i];
+    return p;
+}
+
+/***********************/
+/*  Function ls_out()  */
+/***********************/
+
+static void ls_out(__G__ s, n) /* add to the listing in outbuf */
+__GDEF
+ZCONST char* s;
+extent n;
+{
+    if (G.outcnt + n > OUTBUFSIZ)
+        ls_flush(__G);
+    if (n > OUTBUFSIZ)
+        (*G.message)((zvoid*)&G, (uch*)s, (ulg)n, 0);
+    else {
+        memcpy(G.outbuf + G.outcnt, s, n);
+        G.outcnt += n;
+    }
+}
+
+/*************************/
+/*  Function ls_flush()  */
+/*************************/
+
+static void ls_flush(__G) /* write out the listing collected in outbuf */
+    __GDEF {
+    if (G.outcnt > 0) {
+        (*G.message)((zvoid*)&G, G.outbuf, G.outcnt, 0);
+        G.outcnt = 0;
+    }
+}
+
 /************************/
 /*  Function fnprint()  */ /* also used by ZipInfo routines */
 /************************/
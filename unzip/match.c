@@ -8,6 +8,12 @@
     \x   — escape to match literal x
 
   Case-insensitive mode uses a safe ToLower on unsigned char values.
+
+  A list of filespecs can be put in a specset, which keeps the literal
+  ones (no wildcards, no escapes) in a hash table, so that looking a name
+  up costs one probe plus a match() per wildcard spec instead of a match()
+  per spec.  The wildcard specs of a set are compiled together by
+  common/glob.c, so that a name is run past all of them in one pass.
 */
 
 #define __MATCH_C
@@ -18,6 +24,8 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "common/glob.h"
+
 /* --- Safe case-folding -------------------------------------------------- */
 
 #ifndef ToLower
@@ -38,6 +46,7 @@
 static int recmatch(ZCONST uch* p, ZCONST uch* s, int ic);
 static char* isshexp(ZCONST char* p);
 static int namecmp(ZCONST char* s1, ZCONST char* s2);
+static unsigned spec_hash(ZCONST char* s, int ic);
 
 /* Public shell: booleanize recmatch() */
 int match(ZCONST char* string, ZCONST char* pattern, int ignore_case)
@@ -222,3 +231,120 @@ int iswild(ZCONST char* p)
     }
     return FALSE;
 }
+
+/* --- Filespec sets ------------------------------------------------------ */
+
+static uch lowered[256]; /* glob.c case map for -C */
+
+/* FNV-1a, folded like namecmp() when ic is set */
+static unsigned spec_hash(ZCONST char* s, int ic)
+{
+    unsigned h = 2166136261U;
+
+    for (; *s; s++)
+        h = (h ^ (unsigned)Case(*s)) * 16777619U;
+    return h;
+}
+
+/* Build set from the n filespecs in names; return nonzero if out of memory,
+   in which case set is left empty and spec_find() tries every spec. */
+int spec_init(specset* set, char** names, unsigned n, int ic __WDLPRO)
+{
+    unsigned i, j, size;
+    globset* g;
+
+    set->slot = set->wild = NULL;
+    set->mask = set->nwild = 0;
+    set->wildset = NULL;
+    if (n == 0)
+        return 0;
+    for (size = 16; size < 2 * n; size <<= 1)
+        ;
+    set->slot = (unsigned*)calloc(size, sizeof(unsigned));
+    set->wild = (unsigned*)malloc(n * sizeof(unsigned));
+    if (set->slot == NULL || set->wild == NULL) {
+        spec_free(set);
+        return 1;
+    }
+    set->mask = size - 1;
+
+    for (i = 0; i < n; i++) {
+        if (iswild(names[i]) || strchr(names[i], '\\') != NULL) {
+            set->wild[set->nwild++] = i;
+            continue;
+        }
+        /* a repeated name keeps its first index, as a scan would find */
+        for (j = spec_hash(names[i], ic) & set->mask; set->slot[j]; j = (j + 1) & set->mask)
+            if ((ic ? namecmp(names[set->slot[j] - 1], names[i]) : strcmp(names[set->slot[j] - 1], names[i])) == 0)
+                break;
+        if (!set->slot[j])
+            set->slot[j] = i + 1;
+    }
+
+    /* without the memory for this, the wildcard specs are tried in turn */
+    if (set->nwild > 0 && (g = (globset*)malloc(sizeof(globset))) != NULL) {
+        if (ic && lowered['A'] == 0)
+            for (i = 0; i < 256; i++)
+                lowered[i] = (uch)ToLower(i);
+        glob_init(g, GLOB_BRACKETS, ic ? lowered : NULL);
+#ifdef WILD_STOP_AT_DIR
+        if (sepc)
+            g->flags |= GLOB_STOPDIR;
+#endif
+        for (i = 0; i < set->nwild; i++)
+            if (glob_add(g, names[set->wild[i]]) < 0)
+                break;
+        if (i < set->nwild || glob_build(g)) {
+            glob_free(g);
+            free(g);
+        }
+        else
+            set->wildset = (zvoid*)g;
+    }
+    return 0;
+}
+
+/* Return the index of the first of the n filespecs in names that matches s,
+   or -1 if none does. */
+int spec_find(specset* set, char** names, unsigned n, ZCONST char* s, int ic __WDLPRO)
+{
+    unsigned i, j, lit = n;
+    int k;
+
+    if (set->slot == NULL) {
+        for (i = 0; i < n; i++)
+            if (match(s, names[i], ic __WDL))
+                return (int)i;
+        return -1;
+    }
+    for (j = spec_hash(s, ic) & set->mask; set->slot[j]; j = (j + 1) & set->mask)
+        if ((ic ? namecmp(names[set->slot[j] - 1], s) : strcmp(names[set->slot[j] - 1], s)) == 0) {
+            lit = set->slot[j] - 1;
+            break;
+        }
+    /* a wildcard spec listed before the literal one takes precedence */
+    if (set->wildset != NULL) {
+        if ((k = glob_match((globset*)set->wildset, s)) >= 0 && set->wild[k] < lit)
+            return (int)set->wild[k];
+        return lit < n ? (int)lit : -1;
+    }
+    for (i = 0; i < set->nwild && set->wild[i] < lit; i++)
+        if (match(s, names[set->wild[i]], ic __WDL))
+            return (int)set->wild[i];
+    return lit < n ? (int)lit : -1;
+}
+
+void spec_free(specset* set)
+{
+    if (set->slot != NULL)
+        free(set->slot);
+    if (set->wild != NULL)
+        free(set->wild);
+    if (set->wildset != NULL) {
+        glob_free((globset*)set->wildset);
+        free(set->wildset);
+    }
+    set->slot = set->wild = NULL;
+    set->wildset = NULL;
+    set->mask = set->nwild = 0;
+}
@@ -0,0 +1,194 @@
+/*
+  Copyright (c) 1990-2009 Info-ZIP.  All rights reserved.
+
+  See the accompanying file LICENSE, version 2009-Jan-02 or later
+  (the contents of which are also included in unzip.h) for terms of use.
+  If, for some reason, all these files are missing, the Info-ZIP license
+  also may be found at:  ftp://ftp.info-zip.org/pub/infozip/license.html
+*/
+/*---------------------------------------------------------------------------
+
+  nameidx.c
+
+  Lookup of named members through the name index that zip -ni writes
+  between the last entry and the central directory:
+
+      "IZnx"                                  start signature
+      n times:  name CRC-32 (4), offset (8)   sorted by CRC, then offset
+      n (4), central directory size (8)
+      "IZNX"                                  end signature
+
+  The offsets are those of central headers from the start of the central
+  directory.  When every filespec is a literal name, the index is binary
+  searched for each one and only the central headers it points at are
+  read, instead of the whole directory.  Each hit is read and its name
+  compared, so CRC collisions cost nothing but a read.  If the index is
+  missing, does not match the end record, or fails to produce a filespec,
+  the caller reads the whole central directory as always, which also
+  covers names that unzip sees differently than zip stored them.
+
+  Contains:  ndx_find()
+             ndx_probe()
+             ndx_offcmp()
+
+  ---------------------------------------------------------------------------*/
+
+#define __NAMEIDX_C /* identifies this source module */
+#define UNZIP_INTERNAL
+#include "unzip.h"
+#include "common/crc32.h"
+
+#ifndef SFX
+
+#define NDX_ENT 12 /* bytes per index entry */
+#define NDX_END 16 /* bytes in the index trailer */
+
+/* More filespecs than this are faster found by reading the directory. */
+#ifndef NDX_MAXSPECS
+#define NDX_MAXSPECS 256
+#endif
+
+static int ndx_probe OF((__GPRO__ zoff_t pos, ulg * crc, zoff_t * off));
+static int ndx_offcmp OF((ZCONST zvoid * a, ZCONST zvoid * b));
+
+/*************************/
+/* Function ndx_probe() */
+/*************************/
+
+static int ndx_probe(__G__ pos, crc, off) /* return PK-type error code */
+__GDEF
+zoff_t pos;  /* abs offset of the index entry */
+ulg* crc;    /* name CRC-32 */
+zoff_t* off; /* central header offset in the directory */
+{
+    uch e[NDX_ENT];
+    int error;
+
+    if ((error = seek_zipf(__G__ pos)) != PK_OK)
+        return error;
+    if (readbuf(__G__(char*) e, NDX_ENT) != NDX_ENT)
+        return PK_EOF;
+    *crc = makelong(e);
+    *off = (zoff_t)makeint64(e + 4);
+    return PK_OK;
+}
+
+/**************************/
+/* Function ndx_offcmp() */
+/**************************/
+
+static int ndx_offcmp(a, b)
+ZCONST zvoid* a;
+ZCONST zvoid* b;
+{
+    zoff_t x = *(ZCONST zoff_t*)a, y = *(ZCONST zoff_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/************************/
+/* Function ndx_find() */
+/************************/
+
+int ndx_find(__G__ poffs, pnum) /* return TRUE if the index found them all */
+__GDEF
+zoff_t** poffs; /* set to the sorted file offsets of the central headers */
+ulg* pnum;      /* set to their number */
+{
+    zoff_t cd = (zoff_t)G.ecrec.offset_start_central_directory;
+    zoff_t start; /* abs offset of the first index entry */
+    zoff_t* offs = NULL;
+    ulg n, num = 0, max = 0;
+    ulg lo, hi, mid, crc, want;
+    zoff_t off;
+    uch t[NDX_END];
+    unsigned i;
+    int found = FALSE;
+
+    *poffs = NULL;
+    *pnum = 0;
+
+    /* only exact names can be hashed; -C folds case */
+    if (G.process_all_files || G.filespecs == 0 || G.filespecs > NDX_MAXSPECS || uO.C_flag)
+        return FALSE;
+    for (i = 0; i < G.filespecs; i++)
+        if (iswild(G.pfnames[i]) || strchr(G.pfnames[i], '\\') != NULL)
+            return FALSE;
+
+    /* the trailer must sit right before the directory and agree with it */
+    if (cd < NDX_END + 4 || seek_zipf(__G__ cd - NDX_END) != PK_OK || readbuf(__G__(char*) t, NDX_END) != NDX_END)
+        goto done;
+    n = makelong(t);
+    if (memcmp(t + 12, name_index_end_sig, 4) != 0 || n != G.ecrec.total_entries_central_dir || n == 0 ||
+        (zusz_t)makeint64(t + 4) != G.ecrec.size_central_directory)
+        goto done;
+    start = cd - NDX_END - (zoff_t)n * NDX_ENT;
+    if (start < 4 || seek_zipf(__G__ start - 4) != PK_OK || readbuf(__G__ G.sig, 4) != 4 || memcmp(G.sig, name_index_sig, 4) != 0)
+        goto done;
+
+    for (i = 0; i < G.filespecs; i++) {
+        int hits = 0;
+
+        want = crc32(CRCVAL_INITIAL, (ZCONST uch*)G.pfnames[i], strlen(G.pfnames[i]));
+
+        /* first entry with a CRC not below want */
+        lo = 0;
+        hi = n;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (ndx_probe(__G__ start + (zoff_t)mid * NDX_ENT, &crc, &off) != PK_OK)
+                goto done;
+            if (crc < want)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        /* read each central header with that CRC and compare its name */
+        for (; lo < n; lo++) {
+            if (ndx_probe(__G__ start + (zoff_t)lo * NDX_ENT, &crc, &off) != PK_OK)
+                goto done;
+            if (crc != want)
+                break;
+            if (off < 0 || (zusz_t)off >= G.ecrec.size_central_directory)
+                goto done; /* stale */
+            G.pInfo = &G.info[0];
+            if (seek_zipf(__G__ cd + off) != PK_OK || readbuf(__G__ G.sig, 4) != 4 || memcmp(G.sig, central_hdr_sig, 4) != 0 ||
+                read_cdir_entry(__G) > PK_WARN)
+                goto done;
+            if (!match(G.filename, G.pfnames[i], 0 WISEP))
+                continue;
+            if (num == max) {
+                zoff_t* more;
+
+                max = max ? 2 * max : 16;
+                if ((more = (zoff_t*)realloc(offs, max * sizeof(zoff_t))) == NULL)
+                    goto done;
+                offs = more;
+            }
+            offs[num++] = G.extra_bytes + cd + off; /* entrylist may change extra_bytes */
+            hits++;
+        }
+        if (hits == 0)
+            goto done; /* not in the index: let the full scan decide */
+    }
+
+    /* central directory order, each header once */
+    qsort((char*)offs, num, sizeof(zoff_t), ndx_offcmp);
+    for (n = 0, lo = 0; lo < num; lo++)
+        if (n == 0 || offs[lo] != offs[n - 1])
+            offs[n++] = offs[lo];
+    *poffs = offs;
+    *pnum = n;
+    found = TRUE;
+
+done:
+    if (!found && offs != NULL)
+        free(offs);
+    /* leave the input at the directory, where the full scan starts */
+    seek_zipf(__G__ cd);
+    return found;
+
+} /* end function ndx_find() */
+
+#endif /* !SFX */
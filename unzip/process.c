@@ -15,14 +15,17 @@
   Contains:  process_zipfiles()
              free_G_buffers()
              do_seekable()
+             do_stream()
              file_size()
              rec_find()
              find_ecrec64()
              find_ecrec()
              process_zip_cmmnt()
              process_cdir_file_hdr()
+             set_host_info()
              get_cdir_ent()
              process_local_file_hdr()
+             process_stream_file_hdr()
              getZip64Data()
              ef_scan_for_izux()
              getRISCOSexfield()
@@ -36,6 +39,9 @@
 #endif
 
 static int do_seekable OF((__GPRO__ int lastchance));
+#ifndef SFX
+static int do_stream OF((__GPRO));
+#endif
 #ifdef DO_SAFECHECK_2GB
 #ifdef USE_STRM_INPUT
 static zoff_t file_size OF((FILE * file));
@@ -47,6 +53,7 @@ static int rec_find OF((__GPRO__ zoff_t, char*, int));
 static int find_ecrec64 OF((__GPRO__));
 static int find_ecrec OF((__GPRO__ zoff_t searchlen));
 static int process_zip_cmmnt OF((__GPRO));
+static void set_host_info OF((__GPRO));
 static int get_cdir_ent OF((__GPRO));
 #ifdef IZ_HAVE_UXUIDGID
 static int read_ux3_value OF((ZCONST uch * dbuf, unsigned uidgid_sz, ulg* p_uidgid));
@@ -73,6 +80,7 @@ static ZCONST char Far FileHadNoZipfileDir[] = "%d file%s had no zipfile directo
 static ZCONST char Far ZipfileWasDir[] = "1 \"zipfile\" was a directory.\n";
 static ZCONST char Far ManyZipfilesWereDir[] = "%d \"zipfiles\" were directories.\n";
 static ZCONST char Far NoZipfileFound[] = "No zipfiles found.\n";
+static ZCONST char Far StreamOnlyExtract[] = "error:  a streamed archive (--stream or \"-\") can only be extracted or tested\n";
 
 /* do_seekable() strings */
 static ZCONST char Far CannotFindZipfileDirMsg[] =
@@ -267,6 +275,15 @@ int process_zipfiles(__G) /* return PK-type error code */
       ---------------------------------------------------------------------------*/
     G.overwrite_mode = (uO.overwrite_none ? OVERWRT_NEVER : (uO.overwrite_all ? OVERWRT_ALWAYS : OVERWRT_QUERY));
 
+    /*---------------------------------------------------------------------------
+        Hash the literal filespecs once for all archives, so that each entry
+        is looked up instead of matched against every one of them.  Without
+        the memory, spec_find() falls back to trying them in turn.
+      ---------------------------------------------------------------------------*/
+
+    spec_init(&G.fnset, G.pfnames, G.filespecs, uO.C_flag WISEP);
+    spec_init(&G.xnset, G.pxnames, G.xfilespecs, uO.C_flag WISEP);
+
     /*---------------------------------------------------------------------------
         Match (possible) wildcard zipfile specification with existing files and
         attempt to process each.  If no hits, try again after appending ".zip"
@@ -310,6 +327,15 @@ int process_zipfiles(__G) /* return PK-type error code */
     NumWinFiles = NumLoseFiles = NumWarnFiles = 0;
     NumMissDirs = NumMissFiles = 0;
 
+    /* "-" is standard input; it and --stream read the zipfile as it comes */
+    if (uO.stream || strcmp(G.wildzipfn, "-") == 0) {
+        G.zipfn = G.wildzipfn;
+        if ((error = do_stream(__G)) > error_in_archive)
+            error_in_archive = error;
+        free_G_buffers(__G);
+        return error_in_archive;
+    }
+
     while ((G.zipfn = do_wild(__G__ G.wildzipfn)) != (char*)NULL) {
         Trace((stderr, "do_wild( %s ) returns %s\n", G.wildzipfn, G.zipfn));
 
@@ -512,6 +538,10 @@ void free_G_buffers(__G) /* releases all memory allocated in global vars */
     }
 #endif
 
+    spec_free(&G.fnset);
+    spec_free(&G.xnset);
+    cdl_free(__G);
+
     /* Free the cover span list and the cover structure. */
     if (G.cover != NULL) {
         free(*(G.cover));
@@ -598,7 +628,7 @@ static int do_seekable(__GPRO__ int lastchance) /* return PK-type error code */
 
 #if ((!defined(WINDLL) && !defined(SFX)) || !defined(NO_ZIPINFO))
 #if (!defined(WINDLL) && !defined(SFX))
-    if ((!uO.zipinfo_mode && !uO.qflag
+    if ((!uO.zipinfo_mode && !uO.qflag && !uO.names
 #ifdef TIMESTAMP
          && !uO.T_flag
 #endif
@@ -795,6 +825,7 @@ static int do_seekable(__GPRO__ int lastchance) /* return PK-type error code */
 #endif                                              /* !SFX */
                 error = extract_or_test_files(__G); /* EXTRACT OR TEST 'EM */
 
+            cdl_free(__G);
             Trace((stderr, "done with extract/list files (error = %d)\n", error));
         }
 
@@ -824,6 +855,76 @@ static int do_seekable(__GPRO__ int lastchance) /* return PK-type error code */
 
 } /* end function do_seekable() */
 
+#ifndef SFX
+/************************/
+/* Function do_stream() */
+/************************/
+
+static int do_stream(__G) /* return PK-type error code */
+    __GDEF {
+    int error, from_stdin;
+
+    /*---------------------------------------------------------------------------
+        Process the zipfile front to back from its local headers, without
+        looking for the central directory first, so that it can be read from a
+        pipe while it is still arriving.  Listing and the other modes that work
+        from the central directory need the whole archive and are refused.
+      ---------------------------------------------------------------------------*/
+
+    if (uO.zipinfo_mode || uO.zflag > 0 || (uO.vflag && !uO.tflag && !uO.cflag)
+#ifdef TIMESTAMP
+        || uO.T_flag
+#endif
+    ) {
+        Info(slide, 0x401, ((char*)slide, LoadFarString(StreamOnlyExtract)));
+        return PK_PARAM;
+    }
+
+    from_stdin = (strcmp(G.zipfn, "-") == 0);
+    if (from_stdin) {
+#ifdef USE_STRM_INPUT
+        G.zipfd = stdin;
+#else
+        G.zipfd = fileno(stdin);
+#endif
+        /* a "replace?" answer would be read from the archive itself */
+        if (G.overwrite_mode == OVERWRT_QUERY)
+            G.overwrite_mode = OVERWRT_NEVER;
+    }
+    else if (open_input_file(__G))
+        return PK_NOZIP;
+
+    G.cur_zipfile_bufstart = 0;
+    G.inptr = G.inbuf;
+    G.incnt = 0;
+    G.extra_bytes = 0;
+    G.stream = TRUE;
+    G.stream_sig = FALSE;
+
+    if (!uO.qflag)
+        Info(slide, 0, ((char*)slide, LoadFarString(LogInitline), G.zipfn));
+
+    error = extract_or_test_files(__G);
+
+    /* read the central directory off a pipe, so that the writer does not
+       get EPIPE for an archive it sent in full */
+    if (from_stdin) {
+#ifdef USE_STRM_INPUT
+        while (fread((char*)G.inbuf, 1, INBUFSIZ, G.zipfd) > 0)
+#else
+        while (read(G.zipfd, (char*)G.inbuf, INBUFSIZ) > 0)
+#endif
+            ;
+    }
+    else
+        CLOSE_INFILE();
+
+    G.stream = FALSE;
+    return error;
+
+} /* end function do_stream() */
+#endif /* !SFX */
+
 #ifdef DO_SAFECHECK_2GB
 /************************/
 /* Function file_size() */
@@ -1426,6 +1527,21 @@ int process_cdir_file_hdr(__G) /* return PK-type error code */
     if ((error = get_cdir_ent(__G)) != 0)
         return error;
 
+    set_host_info(__G);
+    return PK_COOL;
+
+} /* end function process_cdir_file_hdr() */
+
+/****************************/
+/* Function set_host_info() */
+/****************************/
+
+static void set_host_info(__G) __GDEF {
+    /*---------------------------------------------------------------------------
+        Derive the per-entry host and name handling flags in G.pInfo from the
+        header fields in G.crec.
+      ---------------------------------------------------------------------------*/
+
     G.pInfo->hostver = G.crec.version_made_by[0];
     G.pInfo->hostnum = MIN(G.crec.version_made_by[1], NUM_HOSTS);
     /*  extnum = MIN(crec.version_needed_to_extract[1], NUM_HOSTS); */
@@ -1484,9 +1600,7 @@ int process_cdir_file_hdr(__G) /* return PK-type error code */
     G.pInfo->symlink = 0;
 #endif
 
-    return PK_COOL;
-
-} /* end function process_cdir_file_hdr() */
+} /* end function set_host_info() */
 
 /***************************/
 /* Function get_cdir_ent() */
@@ -1559,7 +1673,7 @@ int process_local_file_hdr(__G) /* return PK-type error code */
     G.lrec.filename_length = makeword(&byterec[L_FILENAME_LENGTH]);
     G.lrec.extra_field_length = makeword(&byterec[L_EXTRA_FIELD_LENGTH]);
 
-    if ((G.lrec.general_purpose_bit_flag & 8) != 0) {
+    if ((G.lrec.general_purpose_bit_flag & 8) != 0 && !G.stream) {
         /* can't trust local header, use central directory: */
         G.lrec.crc32 = G.pInfo->crc;
         G.lrec.csize = G.pInfo->compr_size;
@@ -1572,6 +1686,51 @@ int process_local_file_hdr(__G) /* return PK-type error code */
 
 } /* end function process_local_file_hdr() */
 
+#ifndef SFX
+/**************************************/
+/* Function process_stream_file_hdr() */
+/**************************************/
+
+int process_stream_file_hdr(__G) /* return PK-type error code */
+    __GDEF {
+    /*---------------------------------------------------------------------------
+        Streaming: read the next local file header and stand it in for the
+        central directory entry that has not been seen yet.  A local header
+        has no creating host, attributes or comment, so the entry is treated
+        as coming from a FAT host with default attributes, which gives files
+        and directories the usual umask-based permissions (do_string() leaves
+        the name alone rather than converting it from a FAT code page).
+      ---------------------------------------------------------------------------*/
+
+    int error;
+
+    if ((error = process_local_file_hdr(__G)) != PK_COOL)
+        return error;
+
+    G.crec.version_made_by[0] = G.lrec.version_needed_to_extract[0];
+    G.crec.version_made_by[1] = FS_FAT_;
+    G.crec.version_needed_to_extract[0] = G.lrec.version_needed_to_extract[0];
+    G.crec.version_needed_to_extract[1] = G.lrec.version_needed_to_extract[1];
+    G.crec.general_purpose_bit_flag = G.lrec.general_purpose_bit_flag;
+    G.crec.compression_method = G.lrec.compression_method;
+    G.crec.last_mod_dos_datetime = G.lrec.last_mod_dos_datetime;
+    G.crec.crc32 = G.lrec.crc32;
+    G.crec.csize = G.lrec.csize;
+    G.crec.ucsize = G.lrec.ucsize;
+    G.crec.filename_length = G.lrec.filename_length;
+    G.crec.extra_field_length = G.lrec.extra_field_length;
+    G.crec.file_comment_length = 0;
+    G.crec.disk_number_start = 0;
+    G.crec.internal_file_attributes = 0;
+    G.crec.external_file_attributes = 0L;
+    G.crec.relative_offset_local_header = 0;
+
+    set_host_info(__G);
+    return PK_COOL;
+
+} /* end function process_stream_file_hdr() */
+#endif /* !SFX */
+
 /*******************************/
 /* Function getZip64Data() */
 /*******************************/
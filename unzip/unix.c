@@ -17,8 +17,31 @@
              mapattr()
              mapname()
              checkdir()
+             dir_find()
+             dir_remember()
+             dir_of()
+             dir_list()
+             dir_unlist()
+             name_find()
+             name_add()
+             name_state()
+             name_made()
+             name_stale()
+             dir_at()
+             stat_at()
+             fopen_at()
+             dir_sync()
+             dir_done()
              mkdir()
              close_outfile()
+             close_finish()
+             close_report()
+             close_submit()
+             close_wait()
+             close_end()
+             link_dup()
+             dup_seen()
+             stdout_direct()
              defer_dir_attribs()
              set_direc_attribs()
              stamp_file()
@@ -27,9 +50,45 @@
   ---------------------------------------------------------------------------*/
 
 
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE   /* F_SETPIPE_SZ */
+#endif
+
 #define UNZIP_INTERNAL
 #include "unzip.h"
 
+#ifndef PIPE_OUTSIZ
+#  define PIPE_OUTSIZ 0x100000  /* pipe size asked for by stdout_direct() */
+#endif
+#if (defined(AT_FDCWD) && defined(O_DIRECTORY) && !defined(NO_OPENAT))
+#  define USE_OPENAT            /* output names are looked up in their dir */
+#endif
+#if (defined(USE_OPENAT) && defined(UTIME_OMIT) && !defined(NO_FCHOWN) && \
+     !defined(NO_FCHMOD) && !defined(NO_FUTIMENS))
+#  define USE_FUTIMENS          /* times are set through descriptors */
+#endif
+#if (defined(USE_FUTIMENS) && !defined(NO_ASYNC_CLOSE))
+#  define ASYNC_CLOSE           /* --async-close: threads finish the files */
+#  include <pthread.h>
+#  include <signal.h>
+#endif
+#ifndef CLOSEQ
+#  define CLOSEQ 64             /* files handed to the closing threads */
+#endif
+#if (defined(__linux__) && !defined(NO_SYNCFS))
+#  define USE_SYNCFS            /* --durable: one syncfs() per file system */
+#endif
+#if (defined(__linux__) && !defined(NO_FICLONE))
+#  include <sys/ioctl.h>
+#  include <linux/fs.h>         /* FICLONE, --link-duplicates=reflink */
+#endif
+#ifndef CLOSEMIN
+#  define CLOSEMIN 0x40000L     /* smaller files are closed at once */
+#endif
+#ifndef O_CLOEXEC
+#  define O_CLOEXEC 0
+#endif
+
 /* ----- Standard/portable headers we rely on in this block ----- */
 #include <stdio.h>
 #include <stdlib.h>
@@ -113,10 +172,85 @@ typedef struct uxdirattr {      /* hold unix-style directory info until final */
 #endif /* SET_DIR_ATTRIB */
 
 
+typedef struct uxdir {          /* an output directory known to exist */
+    unsigned hash;              /* dir_hash() of path */
+    unsigned len;               /* strlen(path) */
+    int listed;                 /* 1: names holds all that is in it, 0: not
+                                   read yet, -1: not to be relied on */
+    unsigned *slot;             /* 1 + offset in text of each name, or 0 */
+    unsigned mask, nnames;
+    char *text;                 /* per name its NAME_xxx type and itself */
+    unsigned used, size;
+    char path[1];
+} uxdir;
+
+
 /* static int created_dir;       */     /* used in mapname(), checkdir() */
 /* static int renamed_fullpath;  */     /* ditto */
 
 static unsigned filtattr OF((__GPRO__ unsigned perms));
+static unsigned dir_hash OF((unsigned h, ZCONST char *s, ZCONST char *e));
+static uxdir *dir_find OF((__GPRO__ ZCONST char *path, unsigned len,
+                           unsigned h));
+static void dir_remember OF((__GPRO__ unsigned h, int made));
+static uxdir *dir_of OF((__GPRO__ ZCONST char *path, ZCONST char **name));
+static void dir_list OF((__GPRO__ uxdir *d));
+static void dir_unlist OF((uxdir *d));
+static int name_find OF((uxdir *d, ZCONST char *name, unsigned len));
+static void name_add OF((uxdir *d, ZCONST char *name, unsigned len,
+                         int type));
+static void name_made OF((__GPRO__ ZCONST char *path, int type));
+static int dir_sync OF((__GPRO));
+#ifndef USE_SYNCFS
+static int dir_deeper OF((ZCONST zvoid *a, ZCONST zvoid *b));
+#endif
+#ifdef USE_OPENAT
+static int dir_at OF((__GPRO__ ZCONST char *path, ZCONST char **name));
+#endif
+#ifdef USE_FUTIMENS
+static struct timespec *zt_timespec OF((ZCONST ztimbuf *zt,
+                                        struct timespec ts[2]));
+#endif
+
+#define DIR_HASH0 2166136261U   /* FNV-1a offset basis */
+
+#ifdef USE_FUTIMENS
+typedef struct closejob {   /* an output file to finish and close */
+    struct closejob *next;
+    FILE *f;
+    int owner;              /* set uid and gid */
+    uid_t uid;
+    gid_t gid;
+    mode_t mode;
+    int times;              /* set ts */
+    struct timespec ts[2];
+    int sync;               /* --fsync */
+    int durable;            /* --durable: start writing it out */
+    int done;               /* the closing thread is through with it */
+    int eowner, emode, etimes, eclose;  /* errno of what failed, or 0 */
+    char *name;             /* the file, for messages */
+} closejob;
+
+static void close_finish OF((closejob *j));
+static int close_report OF((__GPRO__ closejob *j, int async));
+#endif
+#ifdef ASYNC_CLOSE
+typedef struct closepool {  /* threads that close output files */
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* signalled when a job is queued or to stop */
+    pthread_cond_t done;    /* signalled when a job is finished */
+    closejob *head, *last;  /* jobs not yet reported, in the order queued */
+    closejob *take;         /* the first of them no thread has taken */
+    unsigned njobs;
+    int stop;
+    int nthreads;
+    pthread_t thread[1];
+} closepool;
+
+static void *close_thread OF((void *arg));
+static int close_submit OF((__GPRO__ closejob *j));
+static void close_reap OF((__GPRO__ closepool *c, int all));
+#endif
 
 /*****************************/
 /* Strings reused in unix.c  */
@@ -130,6 +264,12 @@ static ZCONST char CannotSetItemTimestamps[] =
   "warning:  cannot set modif./access times for %s\n          %s\n";
 static ZCONST char CannotSetTimestamps[] =
   " (warning) cannot set modif./access times\n          %s";
+#ifdef USE_FUTIMENS
+static ZCONST char CannotSetItemPerms[] =
+  "warning:  cannot set permissions for %s\n          %s\n";
+static ZCONST char CannotFinishItem[] =
+  "error:  cannot finish writing %s\n          %s\n";
+#endif
 
 /* ------------------------------------------------------------------ */
 /* Very old systems without directory library support (AT&T 3B1, etc) */
@@ -712,10 +852,9 @@ int checkdir(__G__ pathcomp, flag)
         APPEND_DIR: append a directory component; create it if permitted.
       -----------------------------------------------------------------------*/
     if (FUNCTION == APPEND_DIR) {
-        int too_long = FALSE;
-#ifdef SHORT_NAMES
+        int too_long = FALSE, known;
         char *old_end = G.end;
-#endif
+        unsigned h;
 
         Trace((stderr, "appending dir segment [%s]\n", FnFilter1(pathcomp)));
 
@@ -732,7 +871,16 @@ int checkdir(__G__ pathcomp, flag)
         if ((G.end - G.buildpath) > (ptrdiff_t)(FILNAMSIZ - 3))
             too_long = TRUE;
 
-        if (SSTAT(G.buildpath, &G.statbuf)) {   /* path doesn't exist */
+        /* a directory seen earlier in this run is not looked at again, and
+           one below a directory just created cannot exist yet */
+        h = dir_hash(G.dirhash, old_end, G.end);
+        known = !too_long &&
+                dir_find(__G__ G.buildpath, (unsigned)(G.end - G.buildpath), h)
+                != NULL;
+        if (known)
+            ;
+        else if (G.created_dir || (G.namecalls++, SSTAT(G.buildpath, &G.statbuf))) {
+            /* path doesn't exist */
             if (!G.create_dirs) {
                 free(G.buildpath);
                 return MPN_INF_SKIP;            /* nothing to do */
@@ -744,6 +892,7 @@ int checkdir(__G__ pathcomp, flag)
                 free(G.buildpath);
                 return MPN_ERR_TOOLONG;
             }
+            G.namecalls++;
             if (mkdir(G.buildpath, 0777) == -1) {
                 Info(slide, 1, ((char *)slide,
                   "checkdir error:  cannot create %s\n"
@@ -756,6 +905,7 @@ int checkdir(__G__ pathcomp, flag)
                 return MPN_ERR_SKIP;            /* create failed */
             }
             G.created_dir = TRUE;
+            name_made(__G__ G.buildpath, NAME_OTHER);
         } else if (!S_ISDIR(G.statbuf.st_mode)) {
             Info(slide, 1, ((char *)slide,
               "checkdir error:  %s exists but is not directory\n"
@@ -772,8 +922,11 @@ int checkdir(__G__ pathcomp, flag)
             return MPN_ERR_TOOLONG;
         }
 
+        if (!known)
+            dir_remember(__G__ h, G.created_dir);
         *G.end++ = '/';
         *G.end   = '\0';
+        G.dirhash = dir_hash(h, G.end - 1, G.end);
         Trace((stderr, "buildpath now = [%s]\n", FnFilter1(G.buildpath)));
         return MPN_OK;
     }
@@ -843,6 +996,7 @@ int checkdir(__G__ pathcomp, flag)
             *G.buildpath = '\0';
             G.end = G.buildpath;
         }
+        G.dirhash = dir_hash(DIR_HASH0, G.buildpath, G.end);
         Trace((stderr, "[%s]\n", FnFilter1(G.buildpath)));
         return MPN_OK;
     }
@@ -923,6 +1077,8 @@ int checkdir(__G__ pathcomp, flag)
       -----------------------------------------------------------------------*/
     if (FUNCTION == END) {
         Trace((stderr, "freeing rootpath\n"));
+        close_end(__G);
+        dir_done(__G);
         if (G.rootlen > 0) {
             free(G.rootpath);
             G.rootlen = 0;
@@ -933,6 +1089,604 @@ int checkdir(__G__ pathcomp, flag)
     return MPN_INVALID; /* should never reach */
 }
 
+
+
+/* FNV-1a over s..e, continuing from h */
+static unsigned dir_hash(h, s, e)
+    unsigned h;
+    ZCONST char *s, *e;
+{
+    while (s < e)
+        h = (h ^ (uch)*s++) * 16777619U;
+    return h;
+}
+
+
+
+/***********************/
+/* Function dir_find() */
+/***********************/
+
+static uxdir *dir_find(__G__ path, len, h)   /* a directory seen before */
+    __GDEF
+    ZCONST char *path;
+    unsigned len;                            /* of path, which may go on */
+    unsigned h;                              /* its dir_hash() */
+{
+    uxdir *d;
+    unsigned i;
+
+    if (G.dirs == NULL)
+        return (uxdir *)NULL;
+    for (i = h & G.dirmask; (d = G.dirs[i]) != NULL; i = (i + 1) & G.dirmask)
+        if (d->hash == h && d->len == len && memcmp(d->path, path, len) == 0)
+            return d;
+    return (uxdir *)NULL;
+}
+
+
+
+/***************************/
+/* Function dir_remember() */
+/***************************/
+
+static void dir_remember(__G__ h, made)   /* note G.buildpath as a directory */
+    __GDEF
+    unsigned h;
+    int made;                             /* just created, so empty */
+{
+    uxdir *d;
+    unsigned i, len = (unsigned)strlen(G.buildpath);
+
+    /* keep the table at most half full; without memory, just don't cache */
+    if (2 * (G.ndirs + 1) > (G.dirs == NULL ? 0 : G.dirmask + 1)) {
+        unsigned n = G.dirs == NULL ? 256 : 2 * (G.dirmask + 1);
+        uxdir **t = (uxdir **)calloc(n, sizeof(uxdir *));
+
+        if (t == NULL)
+            return;
+        if (G.dirs != NULL) {
+            for (i = 0; i <= G.dirmask; i++)
+                if ((d = G.dirs[i]) != NULL) {
+                    unsigned j = d->hash & (n - 1);
+
+                    while (t[j] != NULL)
+                        j = (j + 1) & (n - 1);
+                    t[j] = d;
+                }
+            free(G.dirs);
+        }
+        G.dirs = t;
+        G.dirmask = n - 1;
+    }
+    if ((d = (uxdir *)malloc(sizeof(uxdir) + len)) == NULL)
+        return;
+    d->hash = h;
+    d->len = len;
+    d->listed = made ? 1 : 0;
+    d->slot = NULL;
+    d->mask = d->nnames = 0;
+    d->text = NULL;
+    d->used = d->size = 0;
+    strcpy(d->path, G.buildpath);
+    for (i = h & G.dirmask; G.dirs[i] != NULL; i = (i + 1) & G.dirmask)
+        ;
+    G.dirs[i] = d;
+    G.ndirs++;
+}
+
+
+
+/*********************/
+/* Function dir_of() */
+/*********************/
+
+static uxdir *dir_of(__G__ path, name)   /* the cached directory of path */
+    __GDEF
+    ZCONST char *path;
+    ZCONST char **name;                  /* set to the last part of path */
+{
+    ZCONST char *p = strrchr(path, '/');
+
+    if (p == NULL || p == path)
+        return (uxdir *)NULL;
+    *name = p + 1;
+    return dir_find(__G__ path, (unsigned)(p - path),
+                    dir_hash(DIR_HASH0, path, p));
+}
+
+
+
+/***********************/
+/* Function dir_list() */
+/***********************/
+
+static void dir_list(__G__ d)   /* read what is in a directory */
+    __GDEF
+    uxdir *d;
+/*
+ * A directory is read once, when a name in it is first looked up, and
+ * the names created in it afterwards are added as they are made.  Then
+ * whether an output file exists needs no stat(), nor any call at all in a
+ * directory this run created.  Only the types readdir() tells are kept;
+ * a file's times are still looked up when they are wanted.
+ */
+{
+    DIR *dp;
+    struct dirent *e;
+
+    d->listed = -1;
+    G.namecalls += 2;           /* open and (at least one) read */
+    if ((dp = opendir(d->path)) == (DIR *)NULL)
+        return;
+    d->listed = 1;
+    while (d->listed > 0 && (e = readdir(dp)) != (struct dirent *)NULL) {
+        int type = NAME_OTHER;
+
+        if (e->d_name[0] == '.' && (e->d_name[1] == '\0' ||
+            (e->d_name[1] == '.' && e->d_name[2] == '\0')))
+            continue;
+#ifdef DT_REG
+        if (e->d_type == DT_REG)
+            type = NAME_FILE;
+#endif
+        name_add(d, e->d_name, (unsigned)strlen(e->d_name), type);
+    }
+    closedir(dp);
+}
+
+
+
+/*************************/
+/* Function dir_unlist() */
+/*************************/
+
+static void dir_unlist(d)   /* stop relying on what was read of d */
+    uxdir *d;
+{
+    if (d->slot != NULL)
+        free(d->slot);
+    if (d->text != NULL)
+        free(d->text);
+    d->slot = NULL;
+    d->text = NULL;
+    d->mask = d->nnames = d->used = d->size = 0;
+    d->listed = -1;
+}
+
+
+
+/************************/
+/* Function name_find() */
+/************************/
+
+static int name_find(d, name, len)   /* returns NAME_xxx type of name in d */
+    uxdir *d;
+    ZCONST char *name;
+    unsigned len;
+{
+    unsigned i;
+    char *t;
+
+    if (d->slot == NULL)
+        return NAME_ABSENT;
+    for (i = dir_hash(DIR_HASH0, name, name + len) & d->mask; d->slot[i] != 0;
+         i = (i + 1) & d->mask)
+    {
+        t = d->text + d->slot[i] - 1;
+        if (memcmp(t + 1, name, len) == 0 && t[len + 1] == '\0')
+            return (uch)t[0];
+    }
+    return NAME_ABSENT;
+}
+
+
+
+/***********************/
+/* Function name_add() */
+/***********************/
+
+static void name_add(d, name, len, type)   /* note name in d's listing */
+    uxdir *d;
+    ZCONST char *name;
+    unsigned len;
+    int type;
+{
+    unsigned i;
+
+    if (2 * (d->nnames + 1) > (d->slot == NULL ? 0 : d->mask + 1)) {
+        unsigned n = d->slot == NULL ? 64 : 2 * (d->mask + 1);
+        unsigned *t = (unsigned *)calloc(n, sizeof(unsigned));
+
+        if (t == NULL) {
+            dir_unlist(d);
+            return;
+        }
+        if (d->slot != NULL) {
+            for (i = 0; i <= d->mask; i++)
+                if (d->slot[i] != 0) {
+                    char *p = d->text + d->slot[i];
+                    unsigned j = dir_hash(DIR_HASH0, p, p + strlen(p)) & (n - 1);
+
+                    while (t[j] != 0)
+                        j = (j + 1) & (n - 1);
+                    t[j] = d->slot[i];
+                }
+            free(d->slot);
+        }
+        d->slot = t;
+        d->mask = n - 1;
+    }
+    if (d->used + len + 2 > d->size) {
+        unsigned n = d->size == 0 ? 4096 : 2 * d->size;
+        char *t;
+
+        while (d->used + len + 2 > n)
+            n *= 2;
+        if ((t = (char *)realloc(d->text, n)) == NULL) {
+            dir_unlist(d);
+            return;
+        }
+        d->text = t;
+        d->size = n;
+    }
+    d->text[d->used] = (char)type;
+    memcpy(d->text + d->used + 1, name, len);
+    d->text[d->used + 1 + len] = '\0';
+    for (i = dir_hash(DIR_HASH0, name, name + len) & d->mask; d->slot[i] != 0;
+         i = (i + 1) & d->mask)
+        ;
+    d->slot[i] = d->used + 1;
+    d->used += len + 2;
+    d->nnames++;
+}
+
+
+
+/*************************/
+/* Function name_state() */
+/*************************/
+
+int name_state(__G__ path)   /* does an output file exist, as far as known? */
+    __GDEF                   /*  (returns NAME_xxx) */
+    ZCONST char *path;
+{
+    ZCONST char *name;
+    uxdir *d;
+
+#ifdef UNIXBACKUP
+    if (uO.B_flag)              /* backups make names not seen here */
+        return NAME_UNKNOWN;
+#endif
+    if ((d = dir_of(__G__ path, &name)) == NULL)
+        return NAME_UNKNOWN;
+    if (d->listed == 0)
+        dir_list(__G__ d);
+    if (d->listed < 0)
+        return NAME_UNKNOWN;
+    return name_find(d, name, (unsigned)strlen(name));
+}
+
+
+
+/************************/
+/* Function name_made() */
+/************************/
+
+static void name_made(__G__ path, type)   /* note a name just created */
+    __GDEF
+    ZCONST char *path;
+    int type;
+{
+    ZCONST char *name;
+    uxdir *d = dir_of(__G__ path, &name);
+    unsigned len;
+
+    if (d == NULL || d->listed <= 0)
+        return;
+    len = (unsigned)strlen(name);
+    if (name_find(d, name, len) == NAME_ABSENT)
+        name_add(d, name, len, type);
+}
+
+
+
+/*************************/
+/* Function name_stale() */
+/*************************/
+
+void name_stale(__G__ path)   /* path's directory is not as it was read */
+    __GDEF
+    ZCONST char *path;
+/*
+ * Some other process has been at it, or the file system ignores case.
+ * Its names are looked up one by one from here on.
+ */
+{
+    ZCONST char *name;
+    uxdir *d = dir_of(__G__ path, &name);
+
+    if (d != NULL)
+        dir_unlist(d);
+}
+
+
+
+#ifdef USE_OPENAT
+
+/*********************/
+/* Function dir_at() */
+/*********************/
+
+static int dir_at(__G__ path, name)   /* returns fd of path's directory */
+    __GDEF
+    ZCONST char *path;
+    ZCONST char **name;               /* set to what is left of path there */
+/*
+ * Files are extracted mostly a directory at a time, so the directory of
+ * the last one is kept open and names in it are looked up from there
+ * rather than walked from the top again.  A trailing '/' (of a directory)
+ * stays with the name.  Returns AT_FDCWD, with *name the whole path, if
+ * the name has no directory or it cannot be opened.
+ */
+{
+    ZCONST char *p = path + strlen(path);
+    int len;
+
+    *name = path;
+    if (p > path && p[-1] == '/')
+        --p;
+    while (p > path && p[-1] != '/')
+        --p;
+    if (p <= path + 1)
+        return AT_FDCWD;
+    len = (int)(p - 1 - path);
+    if (G.outdir == NULL || G.outdirlen != len ||
+        memcmp(G.outdir, path, len) != 0)
+    {
+        if (G.outdir != NULL) {
+            close(G.outdirfd);
+            free(G.outdir);
+        }
+        if ((G.outdir = (char *)malloc(len + 1)) == NULL)
+            return AT_FDCWD;
+        memcpy(G.outdir, path, len);
+        G.outdir[len] = '\0';
+        G.outdirlen = len;
+        G.namecalls++;
+        if ((G.outdirfd = open(G.outdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC))
+            < 0)
+        {
+            free(G.outdir);
+            G.outdir = NULL;
+            return AT_FDCWD;
+        }
+    }
+    *name = p;
+    return G.outdirfd;
+}
+
+#endif /* USE_OPENAT */
+
+
+
+/**********************/
+/* Function stat_at() */
+/**********************/
+
+int stat_at(__G__ path, buf, nofollow)   /* stat() or lstat() an output file */
+    __GDEF
+    ZCONST char *path;
+    z_stat *buf;
+    int nofollow;
+{
+#ifdef USE_OPENAT
+    ZCONST char *name;
+    int fd = dir_at(__G__ path, &name);
+
+    G.namecalls++;
+    return fstatat(fd, name, buf, nofollow ? AT_SYMLINK_NOFOLLOW : 0);
+#else
+    G.namecalls++;
+    return nofollow ? lstat(path, buf) : SSTAT(path, buf);
+#endif
+}
+
+
+
+/***********************/
+/* Function fopen_at() */
+/***********************/
+
+FILE *fopen_at(__G__ path, mode, excl)   /* create an output file */
+    __GDEF
+    ZCONST char *path;
+    ZCONST char *mode;             /* FOPW or FOPWR */
+    int excl;                      /* it should not exist (EEXIST if it does) */
+{
+    int flags = O_CREAT | (excl ? O_EXCL : O_TRUNC) |
+                (strchr(mode, '+') != NULL ? O_RDWR : O_WRONLY);
+    int fd;
+    FILE *f;
+#ifdef USE_OPENAT
+    ZCONST char *name;
+
+    fd = dir_at(__G__ path, &name);
+    G.namecalls++;
+    fd = openat(fd, name, flags, 0666);
+#else
+    G.namecalls++;
+    fd = open(path, flags, 0666);
+#endif
+    if (fd < 0)
+        return (FILE *)NULL;
+    if ((f = fdopen(fd, mode)) == (FILE *)NULL) {
+        close(fd);
+        return (FILE *)NULL;
+    }
+    G.namefiles++;
+    name_made(__G__ path, NAME_FILE);
+    return f;
+}
+
+
+
+/***********************/
+/* Function dir_done() */
+/***********************/
+
+int dir_done(__G)   /* report and forget what is known of the output dirs */
+    __GDEF           /*  (returns PK-type error of --durable) */
+{
+    unsigned i;
+    int r = PK_OK;
+
+    if (uO.durable && (G.namefiles > 0 || G.ndirs > 0))
+        r = dir_sync(__G);
+    if (uO.stats && G.namefiles > 0) {
+        ulg tenths = (G.namecalls * 10 + G.namefiles / 2) / G.namefiles;
+
+        Info(slide, 1, ((char *)slide,
+          "%s:  %lu files created with %lu stat/mkdir/open calls, %lu.%lu per file\n",
+          FnFilter1(G.zipfn), G.namefiles, G.namecalls, tenths / 10, tenths % 10));
+    }
+    G.namecalls = G.namefiles = 0;
+
+    if (G.dirs != NULL) {
+        for (i = 0; i <= G.dirmask; i++)
+            if (G.dirs[i] != NULL) {
+                dir_unlist(G.dirs[i]);
+                free(G.dirs[i]);
+            }
+        free(G.dirs);
+        G.dirs = NULL;
+        G.ndirs = 0;
+    }
+#ifdef USE_OPENAT
+    if (G.outdir != NULL) {
+        close(G.outdirfd);
+        free(G.outdir);
+        G.outdir = NULL;
+    }
+#endif
+    return r;
+}
+
+
+
+/***********************/
+/* Function dir_sync() */
+/***********************/
+
+static int dir_sync(__G)   /* --durable: wait until all is on disk */
+    __GDEF
+/*
+ * Each file had its writeback started when it was closed.  Now one
+ * syncfs() per file system waits for all of it, the directories included.
+ * Without syncfs(), sync() and then an fsync() of each directory, the
+ * deepest first and the extraction root last, so that no directory is on
+ * disk before what is in it.  The time taken is reported with --stats.
+ */
+{
+    char **v;
+    unsigned i, n = 0, calls = 0;
+    int fd, r = PK_OK;
+    struct timespec t0, t1;
+#ifdef USE_SYNCFS
+    dev_t *devs;
+    unsigned ndevs = 0;
+    z_stat st;
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if ((v = (char **)malloc((G.ndirs + 1) * sizeof(char *))) == NULL) {
+        sync();
+        return PK_OK;
+    }
+    if (G.dirs != NULL)
+        for (i = 0; i <= G.dirmask; i++)
+            if (G.dirs[i] != NULL)
+                v[n++] = G.dirs[i]->path;
+#ifdef USE_SYNCFS
+    v[n++] = G.rootlen > 0 ? G.rootpath : ".";
+    if ((devs = (dev_t *)malloc(n * sizeof(dev_t))) == NULL) {
+        free(v);
+        sync();
+        return PK_OK;
+    }
+    for (i = 0; i < n; i++) {
+        unsigned k;
+
+        if (stat(v[i], &st))
+            continue;           /* removed since; nothing of ours in it */
+        for (k = 0; k < ndevs && devs[k] != st.st_dev; k++)
+            ;
+        if (k < ndevs)
+            continue;
+        devs[ndevs++] = st.st_dev;
+        calls++;
+        if ((fd = open(v[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 ||
+            syncfs(fd))
+        {
+            Info(slide, 0x401, ((char *)slide, CannotFinishItem,
+              FnFilter1(v[i]), strerror(errno)));
+            r = PK_DISK;
+        }
+        if (fd >= 0)
+            close(fd);
+    }
+    free(devs);
+#else /* !USE_SYNCFS */
+    sync();
+    qsort((char *)v, n, sizeof(char *), dir_deeper);
+    v[n++] = G.rootlen > 0 ? G.rootpath : ".";
+    for (i = 0; i < n; i++) {
+        calls++;
+        if ((fd = open(v[i], O_RDONLY)) < 0)
+            continue;
+        if (fsync(fd) && errno != EINVAL) {
+            Info(slide, 0x401, ((char *)slide, CannotFinishItem,
+              FnFilter1(v[i]), strerror(errno)));
+            r = PK_DISK;
+        }
+        close(fd);
+    }
+#endif /* ?USE_SYNCFS */
+    free(v);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (uO.stats) {
+        ulg ms = (ulg)(t1.tv_sec - t0.tv_sec) * 1000 +
+                 (ulg)((t1.tv_nsec - t0.tv_nsec + 1000000000L) / 1000000L) -
+                 1000;
+
+        Info(slide, 1, ((char *)slide,
+          "%s:  --durable sync took %lu ms, %u %s calls\n",
+          FnFilter1(G.zipfn), ms, calls,
+#ifdef USE_SYNCFS
+          "syncfs"
+#else
+          "fsync"
+#endif
+          ));
+    }
+    return r;
+}
+
+
+
+#ifndef USE_SYNCFS
+
+/* qsort() order of dir_sync(): reverse, so that a directory comes before
+   its parent */
+static int dir_deeper(a, b)
+    ZCONST zvoid *a, *b;
+{
+    return strcmp(*(char **)b, *(char **)a);
+}
+
+#endif /* !USE_SYNCFS */
+
 #ifdef NO_MKDIR
 
 /********************/
@@ -1035,6 +1789,18 @@ void close_outfile(__G)    /* GRR: change to return PK-style warning level */
 
     have_uidgid_flg = get_extattribs(__G__ &(zt.t3), z_uidgid);
 
+    /* --sparse:  a hole at the end of the file was only seeked over, so
+       the file is still short; extend it to the position reached */
+    if (G.sparse_tail) {
+        zoff_t fsize;
+
+        fflush(G.outfile);
+        if ((fsize = zlseek(fileno(G.outfile), 0, SEEK_CUR)) == (zoff_t)-1 ||
+            ftruncate(fileno(G.outfile), (off_t)fsize))
+            perror("ftruncate (sparse file) error");
+        G.sparse_tail = FALSE;
+    }
+
 /*---------------------------------------------------------------------------
     If symbolic links are supported, allocate storage for a symlink control
     structure, put the uncompressed "data" and other required info in it, and
@@ -1122,6 +1888,43 @@ typedef struct slinkentry slinkentry;  /* do not define the struct here */
     }
 #endif
 
+#ifdef USE_FUTIMENS
+    {
+        closejob cj;
+        int i;
+
+        memset(&cj, 0, sizeof(cj));
+        cj.f = G.outfile;
+        /* if -X option was specified and we have UID/GID info, restore it */
+        cj.owner = have_uidgid_flg
+            /* check that both uid and gid values fit into their data sizes */
+            && ((ulg)(uid_t)(z_uidgid[0]) == z_uidgid[0])
+            && ((ulg)(gid_t)(z_uidgid[1]) == z_uidgid[1]);
+        cj.uid = (uid_t)z_uidgid[0];
+        cj.gid = (gid_t)z_uidgid[1];
+        cj.mode = (mode_t)filtattr(__G__ G.pInfo->file_attr);
+        /* skip restoring time stamps on user's request */
+        if ((cj.times = (uO.D_flag <= 1)) != 0)
+            zt_timespec(&zt.t2, cj.ts);
+        cj.sync = uO.fsync;
+        cj.durable = uO.durable;
+        cj.name = G.filename;
+
+        /* the times go on after the last write */
+        fflush(G.outfile);
+        G.outfile = (FILE *)NULL;
+# ifdef ASYNC_CLOSE
+        /* closing a small file costs less than handing it over */
+        if (uO.closers > 0 && (cj.sync || G.lrec.ucsize >= CLOSEMIN) &&
+            close_submit(__G__ &cj))
+            return;
+# endif
+        close_finish(&cj);
+        if ((i = close_report(__G__ &cj, FALSE)) > G.closeerr)
+            G.closeerr = i;
+    }
+#else /* !USE_FUTIMENS */
+
 #if (defined(NO_FCHOWN))
     fclose(G.outfile);
 #endif
@@ -1191,11 +1994,447 @@ typedef struct slinkentry slinkentry;  /* do not define the struct here */
         perror("chmod (file attributes) error");
 #endif
 #endif /* NO_FCHOWN || NO_FCHMOD */
+#endif /* ?USE_FUTIMENS */
 
 } /* end function close_outfile() */
 
 
 
+#ifdef USE_FUTIMENS
+
+/* ztimbuf to the access and modification times of futimens() */
+static struct timespec *zt_timespec(zt, ts)
+    ZCONST ztimbuf *zt;
+    struct timespec ts[2];
+{
+    /* the UT extra field and the DOS time both hold whole seconds */
+    ts[0].tv_sec = zt->actime;
+    ts[0].tv_nsec = 0;
+    ts[1].tv_sec = zt->modtime;
+    ts[1].tv_nsec = 0;
+    return ts;
+}
+
+
+
+/***************************/
+/* Function close_finish() */
+/***************************/
+
+static void close_finish(j)   /* set the attributes of j and close it */
+    closejob *j;
+/*
+ * Uses nothing but the descriptor and what is in j, so that it can run
+ * in a closing thread; close_report() tells what failed.
+ */
+{
+    int fd = fileno(j->f);
+
+    if (j->owner && fchown(fd, j->uid, j->gid))
+        j->eowner = errno;
+    if (fchmod(fd, j->mode))
+        j->emode = errno;
+    if (j->times && futimens(fd, j->ts))
+        j->etimes = errno;
+    if (j->sync && fsync(fd))
+        j->eclose = errno;
+#ifdef SYNC_FILE_RANGE_WRITE
+    /* only started here; dir_sync() waits for all files at once */
+    else if (j->durable)
+        sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+    if (fclose(j->f) && !j->eclose)
+        j->eclose = errno;
+}
+
+
+
+/***************************/
+/* Function close_report() */
+/***************************/
+
+static int close_report(__G__ j, async)   /* returns PK-type error code */
+    __GDEF
+    closejob *j;
+    int async;   /* reported after later members, so always name the file */
+{
+    if (j->eowner) {
+        if (uO.qflag || async)
+            Info(slide, 0x201, ((char *)slide, CannotSetItemUidGid,
+              (ulg)j->uid, (ulg)j->gid, FnFilter1(j->name),
+              strerror(j->eowner)));
+        else
+            Info(slide, 0x201, ((char *)slide, CannotSetUidGid,
+              (ulg)j->uid, (ulg)j->gid, strerror(j->eowner)));
+    }
+    if (j->emode) {
+        if (async)
+            Info(slide, 0x201, ((char *)slide, CannotSetItemPerms,
+              FnFilter1(j->name), strerror(j->emode)));
+        else {
+            errno = j->emode;
+            perror("fchmod (file attributes) error");
+        }
+    }
+    if (j->etimes) {
+        if (uO.qflag || async)
+            Info(slide, 0x201, ((char *)slide, CannotSetItemTimestamps,
+              FnFilter1(j->name), strerror(j->etimes)));
+        else
+            Info(slide, 0x201, ((char *)slide, CannotSetTimestamps,
+              strerror(j->etimes)));
+    }
+    if (j->eclose) {
+        Info(slide, 0x401, ((char *)slide, CannotFinishItem,
+          FnFilter1(j->name), strerror(j->eclose)));
+        return PK_DISK;
+    }
+    return PK_OK;
+}
+
+#endif /* USE_FUTIMENS */
+
+
+
+#ifdef ASYNC_CLOSE
+
+/* Closing thread: finish queued jobs in order until told to stop. */
+static void *close_thread(arg)
+    void *arg;
+{
+    closepool *c = (closepool *)arg;
+    closejob *j;
+
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        while (c->take == NULL && !c->stop)
+            pthread_cond_wait(&c->work, &c->lock);
+        if ((j = c->take) == NULL)
+            break;
+        c->take = j->next;
+        pthread_mutex_unlock(&c->lock);
+
+        close_finish(j);
+
+        pthread_mutex_lock(&c->lock);
+        j->done = TRUE;
+        pthread_cond_broadcast(&c->done);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+
+
+/***************************/
+/* Function close_submit() */
+/***************************/
+
+static int close_submit(__G__ cj)   /* FALSE: close cj here after all */
+    __GDEF
+    closejob *cj;
+/*
+ * Hands an output file to the closing threads, so that a slow close (with
+ * delayed allocation) or fsync() does not hold up the next member.  The
+ * threads are started with the first file.  Their results are reported
+ * here, by the main thread, in the order the files were queued, when a
+ * later file is queued or by close_wait().
+ */
+{
+    closepool *c = (closepool *)G.closer;
+    closejob *j;
+    int i;
+
+    if (c == NULL) {
+        sigset_t all, old;
+
+        c = (closepool *)malloc(sizeof(closepool) +
+                                (uO.closers - 1) * sizeof(pthread_t));
+        if (c == NULL)
+            return FALSE;
+        memset(c, 0, sizeof(closepool));
+        pthread_mutex_init(&c->lock, NULL);
+        pthread_cond_init(&c->work, NULL);
+        pthread_cond_init(&c->done, NULL);
+        /* signal handlers must run on the main thread */
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        for (i = 0; i < uO.closers; i++)
+            if (pthread_create(&c->thread[i], NULL, close_thread, c) != 0)
+                break;
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        c->nthreads = i;
+        G.closer = (zvoid *)c;
+        if (i == 0) {
+            close_end(__G);
+            uO.closers = 0;
+            return FALSE;
+        }
+    }
+
+    if ((j = (closejob *)malloc(sizeof(closejob) + strlen(cj->name) + 1))
+        == NULL)
+        return FALSE;
+    *j = *cj;
+    j->name = strcpy((char *)(j + 1), cj->name);
+
+    /* keep the number of open files in bounds */
+    close_reap(__G__ c, FALSE);
+    if (c->njobs >= CLOSEQ) {
+        pthread_mutex_lock(&c->lock);
+        while (!c->head->done)
+            pthread_cond_wait(&c->done, &c->lock);
+        pthread_mutex_unlock(&c->lock);
+        close_reap(__G__ c, FALSE);
+    }
+
+    pthread_mutex_lock(&c->lock);
+    if (c->last != NULL)
+        c->last->next = j;
+    else
+        c->head = j;
+    c->last = j;
+    if (c->take == NULL)
+        c->take = j;
+    c->njobs++;
+    pthread_cond_signal(&c->work);
+    pthread_mutex_unlock(&c->lock);
+    return TRUE;
+}
+
+
+
+/* Report and free the finished jobs at the head of the queue, or with
+   all, wait for and report every job. */
+static void close_reap(__G__ c, all)
+    __GDEF
+    closepool *c;
+    int all;
+{
+    closejob *j;
+    int r;
+
+    pthread_mutex_lock(&c->lock);
+    while ((j = c->head) != NULL && (j->done || all)) {
+        if (!j->done) {
+            pthread_cond_wait(&c->done, &c->lock);
+            continue;
+        }
+        if ((c->head = j->next) == NULL)
+            c->last = NULL;
+        c->njobs--;
+        pthread_mutex_unlock(&c->lock);
+
+        if ((r = close_report(__G__ j, TRUE)) > G.closeerr)
+            G.closeerr = r;
+        free(j);
+
+        pthread_mutex_lock(&c->lock);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+#endif /* ASYNC_CLOSE */
+
+
+
+/*************************/
+/* Function close_wait() */
+/*************************/
+
+int close_wait(__G__ all)   /* returns PK-type error of the files closed */
+    __GDEF                  /*  since the last call */
+    int all;                /* wait for all files handed to closing threads */
+{
+    int r;
+
+#ifdef ASYNC_CLOSE
+    if (G.closer != NULL)
+        close_reap(__G__ (closepool *)G.closer, all);
+#endif
+    r = G.closeerr;
+    G.closeerr = PK_OK;
+    return r;
+}
+
+
+
+/************************/
+/* Function close_end() */
+/************************/
+
+void close_end(__G)   /* finish all files and stop the closing threads */
+    __GDEF
+{
+#ifdef ASYNC_CLOSE
+    closepool *c = (closepool *)G.closer;
+    int i;
+
+    if (c == NULL)
+        return;
+    close_reap(__G__ c, TRUE);
+    pthread_mutex_lock(&c->lock);
+    c->stop = TRUE;
+    pthread_cond_broadcast(&c->work);
+    pthread_mutex_unlock(&c->lock);
+    for (i = 0; i < c->nthreads; i++)
+        pthread_join(c->thread[i], NULL);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->work);
+    pthread_cond_destroy(&c->done);
+    free(c);
+    G.closer = NULL;
+#endif
+}
+
+
+
+
+/***********************/
+/* Function link_dup() */
+/***********************/
+
+int link_dup(__G__ d)   /* --link-duplicates:  make G.filename from d->first */
+    __GDEF              /*  (returns PK-type error, or -1 to extract it, */
+    dupkey *d;          /*  or OPEN_AGAIN from open_outfile()) */
+/*
+ * The member holds what was extracted (and its CRC checked) as d->first,
+ * so it is made a hard link to that file, or a copy sharing its blocks
+ * (FICLONE), instead of being decoded again.  A hard link shares the
+ * attributes too, so only a member with the same ones gets one.  Where
+ * that cannot be done (another file system, no reflinks, d->first gone
+ * or replaced since), the member is extracted as usual.  So are symlinks,
+ * made only at the end, and text converted by -a.
+ */
+{
+    z_stat st;
+    iztimes zt;
+    ulg z_uidgid[2];
+    int have_uidgid_flg;
+    int src, r;
+
+    if (d->first == NULL || G.pInfo->textmode)
+        return -1;
+#ifdef SYMLINKS
+    if (G.pInfo->symlink)
+        return -1;
+#endif
+#ifdef UNIXBACKUP
+    if (uO.B_flag)
+        return -1;
+#endif
+    if (uO.linkdups == LINKDUP_HARD) {
+        have_uidgid_flg = get_extattribs(__G__ &zt, z_uidgid);
+        if (d->attr != G.pInfo->file_attr || d->mtime != zt.mtime ||
+            d->atime != zt.atime || d->have_uidgid != have_uidgid_flg ||
+            (have_uidgid_flg && (d->uidgid[0] != z_uidgid[0] ||
+                                 d->uidgid[1] != z_uidgid[1])))
+            return -1;
+        if (lstat(d->first, &st) || st.st_dev != d->dev || st.st_ino != d->ino) {
+            free(d->first);
+            d->first = NULL;
+            return -1;
+        }
+        if (name_state(__G__ G.filename) != NAME_ABSENT)
+            unlink(G.filename);
+        if (link(d->first, G.filename))
+            return -1;
+        name_made(__G__ G.filename, NAME_FILE);
+        return PK_OK;
+    }
+
+#ifdef FICLONE
+    if (G.noclone || (src = open(d->first, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    if (fstat(src, &st) || st.st_dev != d->dev || st.st_ino != d->ino) {
+        close(src);
+        free(d->first);
+        d->first = NULL;
+        return -1;
+    }
+    if ((r = open_outfile(__G)) != 0) {
+        close(src);
+        return (r == OPEN_AGAIN) ? OPEN_AGAIN : PK_DISK;
+    }
+    if (ioctl(fileno(G.outfile), FICLONE, src)) {
+        /* not where the file system cannot do it at all, from now on */
+        G.noclone = errno != EXDEV;
+        close(src);
+        fclose(G.outfile);      /* open_outfile() will make it again */
+        G.outfile = (FILE *)NULL;
+        return -1;
+    }
+    close(src);
+    G.symlnk = FALSE;
+    close_outfile(__G);
+    return PK_OK;
+#else
+    return -1;
+#endif
+}
+
+
+
+/***********************/
+/* Function dup_seen() */
+/***********************/
+
+void dup_seen(__G__ d)   /* G.filename is a good copy of d's content */
+    __GDEF
+    dupkey *d;
+{
+    z_stat st;
+    iztimes zt;
+
+#ifdef SYMLINKS
+    /* a symlink is still its placeholder file here */
+    if (G.pInfo->symlink)
+        return;
+#endif
+    if (d->first != NULL || G.pInfo->textmode ||
+        lstat(G.filename, &st) || !S_ISREG(st.st_mode) ||
+        (d->first = (char *)malloc(strlen(G.filename) + 1)) == NULL)
+        return;
+    strcpy(d->first, G.filename);
+    d->attr = G.pInfo->file_attr;
+    d->have_uidgid = get_extattribs(__G__ &zt, d->uidgid);
+    d->mtime = zt.mtime;
+    d->atime = zt.atime;
+    d->dev = st.st_dev;
+    d->ino = st.st_ino;
+}
+
+
+
+/****************************/
+/* Function stdout_direct() */
+/****************************/
+
+int stdout_direct(__G)    /* returns TRUE if -c/-p data may bypass messages */
+    __GDEF
+{
+    struct stat st;
+
+    /* the "more" pager has to count the lines of the data itself */
+    if (G.M_flag || fstat(1, &st))
+        return FALSE;
+
+#ifdef F_SETPIPE_SZ
+    /* a pipe that holds many slide buffers lets the reader drain one while
+       the next is inflated; the kernel may cap the size, which is fine */
+    if (S_ISFIFO(st.st_mode))
+        fcntl(1, F_SETPIPE_SZ, PIPE_OUTSIZ);
+#endif
+
+    /* messages are flushed as they are printed, so this is the only
+       stdio output that could still be behind the data */
+    fflush(stdout);
+    return TRUE;
+
+} /* end function stdout_direct() */
+
+
+
 #if (defined(SYMLINKS) && defined(SET_SYMLINK_ATTRIBS))
 int set_symlnk_attribs(__G__ slnk_entry)
     __GDEF
@@ -1212,8 +2451,16 @@ int set_symlnk_attribs(__G__ slnk_entry)
             "set_symlnk_attribs:  restoring Unix UID/GID info for\n\
         %s\n",
             FnFilter1(slnk_entry->fname)));
+#  ifdef USE_OPENAT
+          ZCONST char *name;
+          int fd = dir_at(__G__ slnk_entry->fname, &name);
+
+          if (fchownat(fd, name, (uid_t)z_uidgid_p[0], (gid_t)z_uidgid_p[1],
+                       AT_SYMLINK_NOFOLLOW))
+#  else
           if (lchown(slnk_entry->fname,
                      (uid_t)z_uidgid_p[0], (gid_t)z_uidgid_p[1]))
+#  endif
           {
             Info(slide, 0x201, ((char *)slide, CannotSetItemUidGid,
               z_uidgid_p[0], z_uidgid_p[1], FnFilter1(slnk_entry->fname),
@@ -1276,13 +2523,22 @@ int set_direc_attribs(__G__ d)
     direntry *d;
 {
     int errval = PK_OK;
+#ifdef USE_OPENAT
+    /* deepest first, so mostly several in a row from one parent */
+    ZCONST char *name;
+    int fd = dir_at(__G__ d->fn, &name);
+#  define DirChown(d, u, g) fchownat(fd, name, u, g, 0)
+#  define DirChmod(d, m) fchmodat(fd, name, m, 0)
+#else
+#  define DirChown(d, u, g) chown((d)->fn, u, g)
+#  define DirChmod(d, m) chmod((d)->fn, m)
+#endif
 
     if (UxAtt(d)->have_uidgid &&
         /* check that both uid and gid values fit into their data sizes */
         ((ulg)(uid_t)(UxAtt(d)->uidgid[0]) == UxAtt(d)->uidgid[0]) &&
         ((ulg)(gid_t)(UxAtt(d)->uidgid[1]) == UxAtt(d)->uidgid[1]) &&
-        chown(UxAtt(d)->fn, (uid_t)UxAtt(d)->uidgid[0],
-              (gid_t)UxAtt(d)->uidgid[1]))
+        DirChown(d, (uid_t)UxAtt(d)->uidgid[0], (gid_t)UxAtt(d)->uidgid[1]))
     {
         Info(slide, 0x201, ((char *)slide, CannotSetItemUidGid,
           UxAtt(d)->uidgid[0], UxAtt(d)->uidgid[1], FnFilter1(d->fn),
@@ -1293,12 +2549,18 @@ int set_direc_attribs(__G__ d)
 
     /* skip restoring directory time stamps on user's request */
     if (uO.D_flag <= 0) {
+#ifdef USE_FUTIMENS
+        struct timespec ts[2];
+
+        if (utimensat(fd, name, zt_timespec(&UxAtt(d)->u.t2, ts), 0)) {
+#else
         /* convert project ztimbuf to system struct utimbuf then set times */
         struct utimbuf dtp;
         dtp.actime  = UxAtt(d)->u.t2.actime;
         dtp.modtime = UxAtt(d)->u.t2.modtime;
 
         if (utime(d->fn, &dtp)) {
+#endif
             Info(slide, 0x201, ((char *)slide, CannotSetItemTimestamps,
               FnFilter1(d->fn), strerror(errno)));
             if (!errval)
@@ -1307,7 +2569,7 @@ int set_direc_attribs(__G__ d)
     }
 
 #ifndef NO_CHMOD
-    if (chmod(d->fn, UxAtt(d)->perms)) {
+    if (DirChmod(d, UxAtt(d)->perms)) {
         Info(slide, 0x201, ((char *)slide, DirlistChmodFailed,
           FnFilter1(d->fn), strerror(errno)));
         if (!errval)
@@ -172,11 +172,26 @@ typedef struct stat z_stat;
     ZCONST char* wildname;                               \
     char *dirname, matchname[FILNAMSIZ];                 \
     int rootlen, have_dirname, dirnamelen, notfirstcall; \
-    zvoid* wild_dir;
+    zvoid* wild_dir;                                     \
+    struct uxdir** dirs;                                 \
+    unsigned dirmask, ndirs, dirhash;                    \
+    char* outdir;                                        \
+    int outdirfd, outdirlen;                             \
+    ulg namecalls, namefiles;                            \
+    zvoid* closer;                                       \
+    int closeerr;
 
 /* created_dir, and renamed_fullpath are used by both mapname() and    */
 /*    checkdir().                                                      */
 /* rootlen, rootpath, buildpath and end are used by checkdir().        */
+/* dirs, dirmask, ndirs and dirhash are checkdir()'s cache of the      */
+/*    directories known to exist, with what is in them once listed by  */
+/*    name_state(); outdir, outdirfd and outdirlen are the directory   */
+/*    stat_at() and open_at() work in; namecalls and namefiles count   */
+/*    their calls for --stats.                                         */
+/* closer is the pool of --async-close threads, started by the first   */
+/*    close_outfile() that needs it; closeerr is the worst error of    */
+/*    the files closed since close_wait() last looked.                 */
 /* wild_dir, dirname, wildname, matchname[], dirnamelen, have_dirname, */
 /*    and notfirstcall are used by do_wild().                          */
 
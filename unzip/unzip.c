@@ -86,6 +86,7 @@ typedef struct _sign_info {
 #if (defined(REENTRANT) && !defined(NO_EXCEPT_SIGNALS))
 static int setsignalhandler OF((__GPRO__ savsigs_info * *p_savedhandler_chain, int signal_type, void (*newhandler)(int)));
 #endif
+static int long_opt OF((__GPRO__ ZCONST char* name));
 #ifndef SFX
 static void help_extended OF((__GPRO));
 static void show_version_info OF((__GPRO));
@@ -985,6 +986,51 @@ static int setsignalhandler(__GPRO__ savsigs_info** p_savedhandler_chain, int si
 
 #endif /* REENTRANT && !NO_EXCEPT_SIGNALS */
 
+/***********************/
+/* Function long_opt() */
+/***********************/
+
+/* Handle a "--name" option; name is the part after the dashes.  Returns
+ * FALSE if name is not a long option, so that "--q" and the like still
+ * negate single-letter options.
+ */
+static int long_opt(__GPRO__ ZCONST char* name)
+{
+    if (strcmp(name, "sparse") == 0)
+        uO.sparse = TRUE;
+    else if (strcmp(name, "stream") == 0)
+        uO.stream = TRUE;
+    else if (strcmp(name, "stats") == 0)
+        uO.stats = TRUE;
+    else if (strcmp(name, "async-close") == 0)
+        uO.closers = 4;
+    else if (strncmp(name, "async-close=", 12) == 0) {
+        uO.closers = atoi(name + 12);
+        uO.closers = uO.closers < 0 ? 0 : MIN(uO.closers, 64);
+    }
+    else if (strcmp(name, "fsync") == 0)
+        uO.fsync = TRUE;
+    else if (strcmp(name, "durable") == 0)
+        uO.durable = TRUE;
+    else if (strcmp(name, "skip-identical") == 0)
+        uO.skipsame = 1;
+    else if (strcmp(name, "skip-identical=mtime") == 0)
+        uO.skipsame = 2;
+    else if (strcmp(name, "link-duplicates=hard") == 0)
+        uO.linkdups = LINKDUP_HARD;
+    else if (strcmp(name, "link-duplicates=reflink") == 0)
+        uO.linkdups = LINKDUP_CLONE;
+    else if (strcmp(name, "names") == 0) {
+        uO.names = TRUE;
+        if (uO.vflag == 0)
+            uO.vflag = 1; /* a listing */
+    }
+    else
+        return FALSE;
+    return TRUE;
+
+} /* end function long_opt() */
+
 /**********************/
 /* Function uz_opts() */
 /**********************/
@@ -997,8 +1043,11 @@ int uz_opts(__GPRO__ int* pargc, char*** pargv)
     argc = *pargc;
     argv = *pargv;
 
-    while (++argv, (--argc > 0 && *argv != NULL && **argv == '-')) {
+    /* a lone "-" is the zipfile (stdin), not an option */
+    while (++argv, (--argc > 0 && *argv != NULL && **argv == '-' && (*argv)[1] != '\0')) {
         s = *argv + 1;
+        if (*s == '-' && long_opt(__G__ s + 1))
+            continue;
         while ((c = *s++) != 0) { /* "!= 0":  prevent Turbo C warning */
 #ifdef CMS_MVS
             switch (tolower(c))
@@ -1699,6 +1748,33 @@ static void help_extended(__G) __GDEF {
                                   "  -2   [VMS] Force unconditional conversion of names to ODS-compatible names.",
                                   "         Default is to exploit destination file system, preserving cases and",
                                   "         extended name characters on ODS5 and applying ODS2 filtering on ODS2.",
+                                  "  --sparse  [Unix] Leave runs of zero blocks in extracted files as holes",
+                                  "         instead of writing them, so sparse images stay sparse.",
+                                  "  --stream  Read the archive front to back from its local headers instead of",
+                                  "         seeking to the central directory.  Implied when the zipfile is \"-\"",
+                                  "         (standard input), as in \"curl ... | unzip -\".  Extract, test and -p",
+                                  "         only; Unix permissions and symlinks are kept only in the central",
+                                  "         directory and are not restored.",
+                                  "  --names  List only the names of the members, one per line, for scripts",
+                                  "         (as zipinfo -1 did).",
+                                  "  --stats  Report on standard error how the archive was read, such as the",
+                                  "         memory taken by its central directory and the stat, mkdir and open",
+                                  "         calls spent on each extracted file's name.",
+                                  "  --async-close[=N]  Set the attributes of extracted files and close them",
+                                  "         in N background threads (4 by default) while the next members are",
+                                  "         extracted.  Errors are still reported with the file's name.",
+                                  "  --fsync  Flush each extracted file to disk with fsync() before closing",
+                                  "         it (in the --async-close threads, if given).",
+                                  "  --durable  Make sure all that was extracted is on disk before exiting:",
+                                  "         writeback of each file is started when it is closed, and at the",
+                                  "         end one syncfs() per file system waits for all of it.",
+                                  "  --skip-identical[=mtime]  Leave alone an existing file that already has",
+                                  "         the member's size (and modification time) and CRC, instead of",
+                                  "         writing it again.  --stats tells the bytes not written.",
+                                  "  --link-duplicates=hard|reflink  [Unix] Make later members with the same",
+                                  "         content (CRC, sizes and method) as one already extracted hard",
+                                  "         links to it, or copies sharing its blocks, instead of decoding",
+                                  "         them again.",
                                   "",
                                   "",
                                   "Wildcards:",
@@ -377,6 +377,15 @@ typedef struct _UzpOpts {
     int ddotflag; /* -:: don't skip over "../" path elements */
 #endif
     int cflxflag; /* -^: allow control chars in extracted filenames */
+    int sparse;   /* --sparse: leave zero blocks of output files as holes */
+    int stream;   /* --stream: read the archive front to back, no seeks */
+    int stats;    /* --stats: report how the archive was read */
+    int closers;  /* --async-close: threads that finish output files */
+    int fsync;    /* --fsync: fsync() each output file before closing it */
+    int durable;  /* --durable: all output is on disk before unzip exits */
+    int skipsame; /* --skip-identical: 1 = by size and CRC, 2 = and mtime */
+    int linkdups; /* --link-duplicates: LINKDUP_HARD or LINKDUP_CLONE */
+    int names;    /* --names: list member names only, one per line */
 #endif            /* !FUNZIP */
 } UzpOpts;
 
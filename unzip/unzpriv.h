@@ -1200,6 +1200,7 @@ char* plastchar OF((ZCONST char* ptr, extent len));
 #define extract_or_test_files XXxotf  /* necessary? */
 #define extract_or_test_member XXxotm /* necessary? */
 #define check_for_newer XXcfn
+#define same_as_member XXsam
 #define overwrite_all XXoa
 #define process_all_files XXpaf
 #define extra_field XXef
@@ -1274,6 +1275,16 @@ char* plastchar OF((ZCONST char* ptr, extent len));
 #define EXISTS_AND_OLDER 0
 #define EXISTS_AND_NEWER 1
 
+#define LINKDUP_HARD 1  /* uO.linkdups:  --link-duplicates=hard */
+#define LINKDUP_CLONE 2 /*  and =reflink */
+
+#define NAME_UNKNOWN 0 /* return values for name_state() (Unix) */
+#define NAME_ABSENT 1
+#define NAME_FILE 2  /* a plain file */
+#define NAME_OTHER 3 /* a directory, symlink or whatever else */
+#define OPEN_AGAIN (-2) /* open_outfile():  the name exists after all, make */
+                        /*  the overwrite decision again (Unix) */
+
 #define OVERWRT_QUERY 0 /* status values for G.overwrite_mode */
 #define OVERWRT_ALWAYS 1
 #define OVERWRT_NEVER 2
@@ -1621,6 +1632,44 @@ typedef struct slinkentry {  /* info for deferred symlink creation */
 } slinkentry;
 #endif /* SYMLINKS */
 
+typedef struct specset {  /* filespecs with the literal ones hashed */
+    unsigned* slot;        /* index+1 of a literal spec, 0 if empty */
+    unsigned mask;         /* number of slots - 1 */
+    unsigned* wild;        /* indices of the other specs, ascending */
+    unsigned nwild;
+    zvoid* wildset;        /* them compiled by glob_build(), or NULL */
+} specset;
+
+typedef struct cdlent { /* an entry of a loaded central directory */
+    ulg hdr;              /* heap offset of its header, name, extra field and comment */
+} cdlent;
+
+typedef struct dupkey {  /* --link-duplicates:  members of equal content */
+    ulg crc;
+    zusz_t size, csize;
+    unsigned method;
+    char* first;         /* the one extracted and verified, once there is */
+    unsigned attr;       /* what close_outfile() gave it, which a hard link */
+    time_t mtime, atime; /*  shares:  file_attr, times and, with -X, the */
+    int have_uidgid;     /*  owner */
+    ulg uidgid[2];
+    dev_t dev;           /* and its file, to know it is still the same */
+    ino_t ino;
+} dupkey;
+
+typedef struct cdload {  /* the central directory read in one piece */
+    uch* heap;           /* the entries without their signatures */
+    ulg heapsz;
+    cdlent* ent;
+    ulg num;             /* number of entries */
+    ulg next;            /* the one cdl_sig() hands out next */
+    uch endsig[4];       /* what followed the last entry */
+    int endlen;          /* how much of it there was */
+    int in;              /* an entry is the input:  inptr, incnt are saved */
+    uch* inptr;
+    int incnt;
+} cdload;
+
 typedef struct min_info {
     zoff_t offset;
     zusz_t compr_size;   /* compressed size (needed if extended header) */
@@ -1864,6 +1913,7 @@ void free_G_buffers OF((__GPRO));
 /* static int    process_central_comment OF((__GPRO)); */
 int process_cdir_file_hdr OF((__GPRO));
 int process_local_file_hdr OF((__GPRO));
+int process_stream_file_hdr OF((__GPRO));
 int getZip64Data OF((__GPRO__ ZCONST uch * ef_buf, unsigned ef_len));
 #ifdef UNICODE_SUPPORT
 int getUnicodeData OF((__GPRO__ ZCONST uch * ef_buf, unsigned ef_len));
@@ -1911,6 +1961,7 @@ unsigned readbuf OF((__GPRO__ char* buf, register unsigned len));
 int readbyte OF((__GPRO));
 int fillinbuf OF((__GPRO));
 int seek_zipf OF((__GPRO__ zoff_t abs_offset));
+int skip_zipf OF((__GPRO__ zusz_t len));
 #ifdef FUNZIP
 int flush OF((__GPRO__ ulg size)); /* actually funzip.c */
 #else
@@ -1920,6 +1971,7 @@ int flush OF((__GPRO__ uch * buf, ulg size, int unshrink));
 void handler OF((int signal));
 time_t dos_to_unix_time OF((ulg dos_datetime));
 int check_for_newer OF((__GPRO__ char* filename)); /* os2,vmcms,vms */
+int same_as_member OF((__GPRO__ char* filename));
 int do_string OF((__GPRO__ unsigned int length, int option));
 ush makeword OF((ZCONST uch * b));
 ulg makelong OF((ZCONST uch * sig));
@@ -1968,6 +2020,7 @@ int Far zfstrcmp OF((const char Far* s1, const char Far* s2));
   ---------------------------------------------------------------------------*/
 
 int extract_or_test_files OF((__GPRO));
+int read_cdir_entry OF((__GPRO));
 /* static int   store_info          OF((void)); */
 /* static int   extract_or_test_member   OF((__GPRO)); */
 /* static int   TestExtraField   OF((__GPRO__ uch *ef, unsigned ef_len)); */
@@ -1980,6 +2033,26 @@ int memextract OF((__GPRO__ uch * tgt, ulg tgtsize, ZCONST uch* src, ulg srcsize
 int memflush OF((__GPRO__ ZCONST uch * rawbuf, ulg size));
 char* fnfilter OF((ZCONST char* raw, uch* space, extent size));
 
+/*---------------------------------------------------------------------------
+    Functions in nameidx.c:
+  ---------------------------------------------------------------------------*/
+
+#ifndef SFX
+int ndx_find OF((__GPRO__ zoff_t * *poffs, ulg* pnum));
+#endif
+
+/*---------------------------------------------------------------------------
+    Functions in cdload.c:
+  ---------------------------------------------------------------------------*/
+
+int cdl_load OF((__GPRO));
+unsigned cdl_sig OF((__GPRO));
+void cdl_done OF((__GPRO));
+void cdl_free OF((__GPRO));
+void cdl_dups OF((__GPRO));
+dupkey* cdl_dup OF((__GPRO));
+void cdl_dups_free OF((__GPRO));
+
 /*---------------------------------------------------------------------------
     Decompression functions:
   ---------------------------------------------------------------------------*/
@@ -2092,6 +2165,10 @@ void mksargs OF((int* argcp, char*** argvp)); /* envargs.c */
 
 int match OF((ZCONST char* s, ZCONST char* p, int ic __WDLPRO)); /* match.c */
 int iswild OF((ZCONST char* p));                                 /* match.c */
+int spec_init OF((specset* set, char** names, unsigned n, int ic __WDLPRO)); /* match.c */
+int spec_find OF((specset* set, char** names, unsigned n, ZCONST char* s, int ic __WDLPRO));
+/* match.c */
+void spec_free OF((specset* set)); /* match.c */
 
 /* declarations of public CRC-32 functions have been moved into crc32.h
    (free_crc_table(), get_crc_table(), crc32())                      crc32.c */
@@ -2108,6 +2185,18 @@ char* GetLoadPath OF((__GPRO));                       /* local */
 int screensize OF((int* tt_rows, int* tt_cols)); /* local */
 #endif /* MORE && (ATH_BEO_UNX || QDOS || VMS) */
 void close_outfile OF((__GPRO)); /* local */
+#ifdef UNIX
+int stdout_direct OF((__GPRO));                                          /* local */
+int stat_at OF((__GPRO__ ZCONST char* path, z_stat* buf, int nofollow)); /* local */
+FILE* fopen_at OF((__GPRO__ ZCONST char* path, ZCONST char* mode, int excl)); /* local */
+int name_state OF((__GPRO__ ZCONST char* path));                         /* local */
+void name_stale OF((__GPRO__ ZCONST char* path));                        /* local */
+int dir_done OF((__GPRO));                                               /* local */
+int close_wait OF((__GPRO__ int all));                                   /* local */
+void close_end OF((__GPRO));                                             /* local */
+int link_dup OF((__GPRO__ dupkey* d));                                   /* local */
+void dup_seen OF((__GPRO__ dupkey* d));                                  /* local */
+#endif
 #ifdef SET_SYMLINK_ATTRIBS
 int set_symlnk_attribs OF((__GPRO__ slinkentry * slnk_entry)); /* local */
 #endif
@@ -271,6 +271,25 @@ local void check_match(start, match, length)
 #  define check_match(start, match, length)
 #endif
 
+/* MAX_MATCH zeros at strstart, and the one before it, in a hole of a
+ * sparse input file.  They are coded as one distance-1 match without
+ * searching or updating the hash chains; the hash is restarted after it the
+ * same way deflate_fast() does after a long match.  Zeros in the data of a
+ * file are compressed as usual, so only archives of sparse files change.
+ */
+#ifdef HUFFMAN_ONLY
+#  define ZERO_RUN() 0
+#else
+#  define ZERO_RUN() \
+   (input_holes && strstart != 0 && lookahead >= MAX_MATCH && \
+    window[strstart] == 0 && in_hole(lookahead + 1, MAX_MATCH + 1))
+#endif
+
+#define SKIP_ZERO_RUN(flush) \
+   ((flush) = ct_tally(1, MAX_MATCH - MIN_MATCH), \
+    strstart += MAX_MATCH, lookahead -= MAX_MATCH, \
+    ins_h = window[strstart], UPDATE_HASH(ins_h, window[strstart + 1]))
+
 #define FLUSH_BLOCK(eof) \
    flush_block(block_start >= 0L ? (char*)&window[(unsigned)block_start] : \
                 (char*)NULL, (ulg)strstart - (ulg)block_start, (eof))
@@ -327,6 +346,12 @@ local uzoff_t HOT deflate_fast()
 
     prev_length = MIN_MATCH - 1;
     while (lookahead != 0) {
+        if (UNLIKELY(ZERO_RUN())) {
+            SKIP_ZERO_RUN(flush);
+            if (flush) FLUSH_BLOCK(0), block_start = strstart;
+            if (lookahead < MIN_LOOKAHEAD) fill_window();
+            continue;
+        }
 #ifndef DEFL_UNDETERM
         if (lookahead >= MIN_MATCH)
 #endif
@@ -397,6 +422,13 @@ uzoff_t HOT deflate()
     if (level <= 3) return deflate_fast();
 
     while (lookahead != 0) {
+        /* only between matches, when no lazy match is pending */
+        if (!match_available && UNLIKELY(ZERO_RUN())) {
+            SKIP_ZERO_RUN(flush);
+            if (flush) FLUSH_BLOCK(0), block_start = strstart;
+            if (lookahead < MIN_LOOKAHEAD) fill_window();
+            continue;
+        }
 #ifndef DEFL_UNDETERM
         if (lookahead >= MIN_MATCH)
 #endif
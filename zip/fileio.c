@@ -3,8 +3,13 @@
  */
 #define __FILEIO_C
 
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE   /* O_TMPFILE, linkat() flags, copy_file_range() */
+#endif
+
 #include "zip.h"
 #include "common/crc32.h"
+#include "common/glob.h"
 
 
 
@@ -20,6 +25,11 @@ time_t mktime OF((struct tm *));
 extern int errno;
 #endif
 
+/* anonymous temp archive and kernel-side copies (Linux 3.11+/glibc 2.27+) */
+#if (defined(UNIX) && defined(O_TMPFILE) && !defined(NO_TMPFILE))
+#  define USE_TMPFILE
+#endif
+
 /* -----------------------
    For long option support
    ----------------------- */
@@ -57,8 +67,12 @@ local int ucs4_string_to_utf8 OF((ZCONST ulg *ucs4, char *utf8buf,
 
 #ifndef UTIL    /* the companion #endif is a bit of ways down ... */
 
-local int fqcmp  OF((ZCONST zvoid *, ZCONST zvoid *));
-local int fqcmpz OF((ZCONST zvoid *, ZCONST zvoid *));
+local int fdcopy OF((int, int));
+local char *filter_tail OF((char *, int));
+local void filter_build OF((int));
+#ifdef USE_TMPFILE
+local int link_tempzip OF((char *));
+#endif
 
 
 /* Local module level variables. */
@@ -116,39 +130,20 @@ struct flist far *f;    /* entry to delete */
   *(f->lst) = t;                        /* point last to next, */
   if (t != NULL)
     t->lst = f->lst;                    /* and next to last */
-  if (f->name != NULL)                  /* free memory used */
-    free((zvoid *)(f->name));
-  if (f->zname != NULL)
-    free((zvoid *)(f->zname));
-  if (f->iname != NULL)
-    free((zvoid *)(f->iname));
-  if (f->oname != NULL)
-    free((zvoid *)(f->oname));
+  if (fnxt == &f->nxt)
+    fnxt = f->lst;                      /* f was the tail, append after last */
+  arena_free((zvoid *)(f->name));       /* free memory used */
+  arena_free((zvoid *)(f->zname));
+  arena_free((zvoid *)(f->iname));
+  arena_free((zvoid *)(f->oname));
 #ifdef UNICODE_SUPPORT
-  if (f->uname)
-    free((zvoid *)f->uname);
+  arena_free((zvoid *)f->uname);
 #endif
-  farfree((zvoid far *)f);
+  arena_free((zvoid *)f);
   fcount--;                             /* decrement count */
   return t;                             /* return pointer to next */
 }
 
-local int fqcmp(a, b)
-  ZCONST zvoid *a, *b;          /* pointers to pointers to found entries */
-/* Used by qsort() to compare entries in the found list by name. */
-{
-  return strcmp((*(struct flist far **)a)->name,
-                (*(struct flist far **)b)->name);
-}
-
-local int fqcmpz(a, b)
-  ZCONST zvoid *a, *b;          /* pointers to pointers to found entries */
-/* Used by qsort() to compare entries in the found list by iname. */
-{
-  return strcmp((*(struct flist far **)a)->iname,
-                (*(struct flist far **)b)->iname);
-}
-
 char *last(p, c)
   char *p;                /* sequence of path components */
   int c;                  /* path components separator character */
@@ -336,66 +331,319 @@ int proc_archive_name(n, caseflag)
 
 
 int check_dup()
-/* Sort the found list and remove duplicates.
-   Return an error code in the ZE_ class. */
+/* Remove duplicates from the found list, keeping the first of each name,
+   and check that the internal names are unique.  Both are one pass over
+   the list with an open-addressed table.  Return an error code in the ZE_
+   class. */
 {
   struct flist far *f;          /* steps through found linked list */
-  extent j, k;                  /* indices for s */
-  struct flist far **s;         /* sorted table */
-  struct flist far **nodup;     /* sorted table without duplicates */
-
-  /* sort found list, remove duplicates */
-  if (fcount)
-  {
-    extent fl_size = fcount * sizeof(struct flist far *);
-    if ((fl_size / sizeof(struct flist far *)) != fcount ||
-        (s = (struct flist far **)malloc(fl_size)) == NULL)
+  struct flist far **t;         /* hash table of the entries seen */
+  extent n;                     /* number of slots in t */
+  extent h;                     /* slot in t */
+
+  if (fcount == 0)
+    return ZE_OK;
+  /* at most half full, so a miss ends at an empty slot soon */
+  for (n = 16; n < fcount * 2; n <<= 1)
+    if (n > (extent)-1 / (4 * sizeof(struct flist far *)))
       return ZE_MEM;
-    for (j = 0, f = found; f != NULL; f = f->nxt)
-      s[j++] = f;
-    /* Check names as given (f->name) */
-    qsort((char *)s, fcount, sizeof(struct flist far *), fqcmp);
-    for (k = j = fcount - 1; j > 0; j--)
-      if (strcmp(s[j - 1]->name, s[j]->name) == 0)
-        /* remove duplicate entry from list */
-        fexpel(s[j]);           /* fexpel() changes fcount */
-      else
-        /* copy valid entry into destination position */
-        s[k--] = s[j];
-    s[k] = s[0];                /* First entry is always valid */
-    nodup = &s[k];              /* Valid entries are at end of array s */
-
-    /* sort only valid items and check for unique internal names (f->iname) */
-    qsort((char *)nodup, fcount, sizeof(struct flist far *), fqcmpz);
-    for (j = 1; j < fcount; j++)
-      if (strcmp(nodup[j - 1]->iname, nodup[j]->iname) == 0)
-      {
-        char tempbuf[FNMAX+4081];
+  if ((t = (struct flist far **)calloc(n, sizeof(struct flist far *))) == NULL)
+    return ZE_MEM;
+
+  /* Check names as given (f->name) */
+  for (f = found; f != NULL; ) {
+    for (h = (extent)namehash(f->name, 1) & (n - 1); t[h] != NULL;
+         h = (h + 1) & (n - 1))
+      if (strcmp(t[h]->name, f->name) == 0)
+        break;
+    if (t[h] != NULL)
+      /* remove duplicate entry from list */
+      f = fexpel(f);            /* fexpel() changes fcount */
+    else {
+      t[h] = f;
+      f = f->nxt;
+    }
+  }
 
-        sprintf(errbuf, "  first full name: %s\n", nodup[j - 1]->name);
-        sprintf(tempbuf, " second full name: %s\n", nodup[j]->name);
-        strcat(errbuf, "                     ");
-        strcat(errbuf, tempbuf);
+  /* check the remaining entries for unique internal names (f->iname) */
+  memset((char *)t, 0, n * sizeof(struct flist far *));
+  for (f = found; f != NULL; f = f->nxt) {
+    for (h = (extent)namehash(f->iname, 1) & (n - 1); t[h] != NULL;
+         h = (h + 1) & (n - 1))
+      if (strcmp(t[h]->iname, f->iname) == 0)
+        break;
+    if (t[h] != NULL)
+    {
+      char tempbuf[FNMAX+4081];
+
+      sprintf(errbuf, "  first full name: %s\n", t[h]->name);
+      sprintf(tempbuf, " second full name: %s\n", f->name);
+      strcat(errbuf, "                     ");
+      strcat(errbuf, tempbuf);
 #ifdef EBCDIC
-        strtoebc(nodup[j]->iname, nodup[j]->iname);
+      strtoebc(f->iname, f->iname);
 #endif
-        sprintf(tempbuf, "name in zip file repeated: %s", nodup[j]->iname);
-        strcat(errbuf, "                     ");
-        strcat(errbuf, tempbuf);
-        if (pathput == 0) {
-          strcat(errbuf, "\n                     this may be a result of using -j");
-        }
+      sprintf(tempbuf, "name in zip file repeated: %s", f->iname);
+      strcat(errbuf, "                     ");
+      strcat(errbuf, tempbuf);
+      if (pathput == 0) {
+        strcat(errbuf, "\n                     this may be a result of using -j");
+      }
 #ifdef EBCDIC
-        strtoasc(nodup[j]->iname, nodup[j]->iname);
+      strtoasc(f->iname, f->iname);
 #endif
-        zipwarn(errbuf, "");
-        return ZE_PARMS;
+      zipwarn(errbuf, "");
+      free((zvoid *)t);
+      return ZE_PARMS;
+    }
+    t[h] = f;
+  }
+  free((zvoid *)t);
+  return ZE_OK;
+}
+
+/* The entries added with --stream-add, open-addressed on name and on
+   iname, for the checks check_dup() makes of the found list. */
+local struct zlist far **seen_name = NULL;
+local struct zlist far **seen_iname = NULL;
+local extent seen_n = 0;        /* slots in each */
+local extent seen_count = 0;    /* entries in each */
+
+int dup_found(f, seen)
+  struct flist far *f;          /* entry just found */
+  int *seen;                    /* set if f is a duplicate to drop */
+/* Check f as check_dup() would against the entries dup_add() has been
+   given.  Return ZE_PARMS if another name has f's internal name, else
+   ZE_OK. */
+{
+  struct zlist far *z;
+  extent h;
+
+  *seen = 0;
+  if (seen_count == 0)
+    return ZE_OK;
+  for (h = (extent)namehash(f->name, 1) & (seen_n - 1);
+       (z = seen_name[h]) != NULL; h = (h + 1) & (seen_n - 1))
+    if (strcmp(z->name, f->name) == 0) {
+      *seen = 1;
+      return ZE_OK;
+    }
+  for (h = (extent)namehash(f->iname, 1) & (seen_n - 1);
+       (z = seen_iname[h]) != NULL; h = (h + 1) & (seen_n - 1))
+    if (strcmp(z->iname, f->iname) == 0) {
+      sprintf(errbuf, "  first full name: %s\n", z->name);
+      strcat(errbuf, "                      second full name: ");
+      strcat(errbuf, f->name);
+      strcat(errbuf, "\n                     name in zip file repeated: ");
+      strcat(errbuf, f->iname);
+      if (pathput == 0)
+        strcat(errbuf, "\n                     this may be a result of using -j");
+      zipwarn(errbuf, "");
+      return ZE_PARMS;
+    }
+  return ZE_OK;
+}
+
+int dup_add(z)
+  struct zlist far *z;          /* entry made from what dup_found() passed */
+/* Remember z for dup_found().  Return ZE_MEM or ZE_OK. */
+{
+  struct zlist far **a, **b;
+  extent n, h, i;
+
+  if (2 * (seen_count + 1) > seen_n) {
+    /* at most half full, as in check_dup() */
+    n = seen_n ? 2 * seen_n : 1024;
+    if (n > (extent)-1 / (4 * sizeof(struct zlist far *)))
+      return ZE_MEM;
+    if ((a = (struct zlist far **)calloc(n, sizeof(struct zlist far *))) == NULL)
+      return ZE_MEM;
+    if ((b = (struct zlist far **)calloc(n, sizeof(struct zlist far *))) == NULL) {
+      free((zvoid *)a);
+      return ZE_MEM;
+    }
+    for (i = 0; i < seen_n; i++) {
+      if (seen_name[i] != NULL) {
+        for (h = (extent)namehash(seen_name[i]->name, 1) & (n - 1); a[h] != NULL;
+             h = (h + 1) & (n - 1))
+          ;
+        a[h] = seen_name[i];
+      }
+      if (seen_iname[i] != NULL) {
+        for (h = (extent)namehash(seen_iname[i]->iname, 1) & (n - 1); b[h] != NULL;
+             h = (h + 1) & (n - 1))
+          ;
+        b[h] = seen_iname[i];
       }
-    free((zvoid *)s);
+    }
+    if (seen_n) {
+      free((zvoid *)seen_name);
+      free((zvoid *)seen_iname);
+    }
+    seen_name = a;
+    seen_iname = b;
+    seen_n = n;
   }
+  for (h = (extent)namehash(z->name, 1) & (seen_n - 1); seen_name[h] != NULL;
+       h = (h + 1) & (seen_n - 1))
+    ;
+  seen_name[h] = z;
+  for (h = (extent)namehash(z->iname, 1) & (seen_n - 1); seen_iname[h] != NULL;
+       h = (h + 1) & (seen_n - 1))
+    ;
+  seen_iname[h] = z;
+  seen_count++;
   return ZE_OK;
 }
 
+/* Forget what dup_add() was given. */
+void dup_free()
+{
+  if (seen_name != NULL)
+    free((zvoid *)seen_name);
+  if (seen_iname != NULL)
+    free((zvoid *)seen_iname);
+  seen_name = seen_iname = NULL;
+  seen_n = seen_count = 0;
+}
+
+/* The -x, -i and -R patterns compiled by glob.c, built on first use for
+   each case flag.  The -R patterns are matched against the end of the
+   name, so they are grouped by how many components they have. */
+local struct filtsets {
+  struct plist *built;          /* patterns they were built from, or NULL */
+  unsigned count;               /* pcount then */
+  int failed;                   /* no memory: filter() tries each pattern */
+  globset x, i;                 /* -x and -i patterns */
+  unsigned nR;                  /* number of -R groups */
+  int *Rslashes;                /* slashes in the patterns of each group */
+  globset *R;                   /* the -R patterns of each group */
+} fsets[2];
+#ifdef USE_CASE_MAP
+local uch filter_fold[256];     /* case_map() as a table for glob.c */
+#endif
+
+/* Return the part of name with as many path components as a pattern with
+   the given number of slashes has, or all of name if it has no more. */
+local char *filter_tail(name, slashes)
+  char *name;
+  int slashes;
+{
+  char *q;
+
+  /* The name may have M path components (M-1 slashes) */
+  for (q = name; (q = MBSCHR(q, '/')) != NULL; MB_NEXTCHAR(q))
+    slashes--;
+  /* Now, "slashes" contains the difference "N-M" between the number
+     of path components in the pattern (N) and in the name (M).
+   */
+  if (slashes < 0)
+    /* We found "M > N"
+        --> skip the first (M-N) path components of the name.
+     */
+    for (q = name; (q = MBSCHR(q, '/')) != NULL; MB_NEXTCHAR(q))
+      if (++slashes == 0)
+        return q + 1;   /* q points at '/', mblen("/") is 1 */
+  return name;
+}
+
+/* Compile the patterns into fsets[casesensitive != 0]. */
+local void filter_build(casesensitive)
+  int casesensitive;
+{
+  struct filtsets *fs = &fsets[casesensitive != 0];
+  ZCONST uch *fold = NULL;
+  int flags, slashes;
+  unsigned n, g;
+  char *q;
+  globset *set;
+
+  if (fs->built != NULL) {
+    glob_free(&fs->x);
+    glob_free(&fs->i);
+    for (g = 0; g < fs->nR; g++)
+      glob_free(&fs->R[g]);
+    free(fs->R);
+    free(fs->Rslashes);
+  }
+  memset(fs, 0, sizeof(struct filtsets));
+  fs->built = patterns;
+  fs->count = pcount;
+
+#ifdef USE_CASE_MAP
+  if (!casesensitive) {
+    for (n = 0; n < 256; n++)
+      filter_fold[n] = (uch)case_map(n);
+    fold = filter_fold;
+  }
+#endif
+  flags = (wild_stop_at_dir ? GLOB_STOPDIR : 0) | (allow_regex ? GLOB_BRACKETS : 0) |
+          (no_wild ? GLOB_NOWILD : 0);
+  glob_init(&fs->x, flags, fold);
+  glob_init(&fs->i, flags, fold);
+  if (Rcount &&
+      ((fs->R = (globset *)malloc(Rcount * sizeof(globset))) == NULL ||
+       (fs->Rslashes = (int *)malloc(Rcount * sizeof(int))) == NULL)) {
+    fs->failed = 1;
+    return;
+  }
+
+  for (n = 0; n < pcount; n++) {
+    if (!patterns[n].zname[0])        /* it can happen... */
+      continue;
+    switch (patterns[n].select) {
+      case 'x':
+        set = &fs->x;
+        break;
+      case 'R':
+        /* With -R patterns, if the pattern has N path components (that is,
+           N-1 slashes), then we test only the last N components of name.
+         */
+        slashes = 0;
+        for (q = patterns[n].zname; (q = MBSCHR(q, '/')) != NULL; MB_NEXTCHAR(q))
+          slashes++;
+        for (g = 0; g < fs->nR && fs->Rslashes[g] != slashes; g++)
+          ;
+        if (g == fs->nR) {
+          fs->Rslashes[g] = slashes;
+          glob_init(&fs->R[fs->nR++], flags, fold);
+        }
+        set = &fs->R[g];
+        break;
+      default:
+        set = &fs->i;
+        break;
+    }
+    if (glob_add(set, patterns[n].zname) < 0) {
+      fs->failed = 1;
+      return;
+    }
+  }
+  fs->failed = glob_build(&fs->x) || glob_build(&fs->i);
+  for (g = 0; g < fs->nR && !fs->failed; g++)
+    fs->failed = glob_build(&fs->R[g]);
+}
+
+/* Release what filter() compiled. */
+void filter_free()
+{
+  int k;
+  unsigned g;
+
+  for (k = 0; k < 2; k++)
+    if (fsets[k].built != NULL) {
+      glob_free(&fsets[k].x);
+      glob_free(&fsets[k].i);
+      for (g = 0; g < fsets[k].nR; g++)
+        glob_free(&fsets[k].R[g]);
+      if (fsets[k].R != NULL)
+        free(fsets[k].R);
+      if (fsets[k].Rslashes != NULL)
+        free(fsets[k].Rslashes);
+      memset(&fsets[k], 0, sizeof(struct filtsets));
+    }
+}
+
 int filter(name, casesensitive)
   char *name;
   int casesensitive;
@@ -410,11 +658,14 @@ int filter(name, casesensitive)
        icount                   number of -i patterns
        Rcount                   number of -R patterns
      These data are set up by the command line parsing code.
+     The patterns are compiled (see glob.c) on the first call, so that
+     each list is matched in one pass over the name.
    */
 {
    unsigned int n;
    int slashes;
    char *p, *q;
+   struct filtsets *fs = &fsets[casesensitive != 0];
    /* without -i patterns, every name matches the "-i select rules" */
    int imatch = (icount == 0);
    /* without -R patterns, every name matches the "-R select rules" */
@@ -422,6 +673,18 @@ int filter(name, casesensitive)
 
    if (pcount == 0) return TRUE;
 
+   if (fs->built != patterns || fs->count != pcount)
+      filter_build(casesensitive);
+   if (!fs->failed) {
+      if (glob_match(&fs->x, name) >= 0)
+         return FALSE;
+      if (!imatch && glob_match(&fs->i, name) < 0)
+         return FALSE;
+      for (n = 0; !Rmatch && n < fs->nR; n++)
+         Rmatch = glob_match(&fs->R[n], filter_tail(name, fs->Rslashes[n])) >= 0;
+      return Rmatch;
+   }
+
    for (n = 0; n < pcount; n++) {
       if (!patterns[n].zname[0])        /* it can happen... */
          continue;
@@ -431,27 +694,10 @@ int filter(name, casesensitive)
          if (Rmatch)
             /* one -R match is sufficient, skip this pattern */
             continue;
-         /* With -R patterns, if the pattern has N path components (that is,
-            N-1 slashes), then we test only the last N components of name.
-          */
          slashes = 0;
          for (q = patterns[n].zname; (q = MBSCHR(q, '/')) != NULL; MB_NEXTCHAR(q))
             slashes++;
-         /* The name may have M path components (M-1 slashes) */
-         for (q = p; (q = MBSCHR(q, '/')) != NULL; MB_NEXTCHAR(q))
-            slashes--;
-         /* Now, "slashes" contains the difference "N-M" between the number
-            of path components in the pattern (N) and in the name (M).
-          */
-         if (slashes < 0)
-            /* We found "M > N"
-                --> skip the first (M-N) path components of the name.
-             */
-            for (q = p; (q = MBSCHR(q, '/')) != NULL; MB_NEXTCHAR(q))
-               if (++slashes == 0) {
-                  p = q + 1;    /* q points at '/', mblen("/") is 1 */
-                  break;
-               }
+         p = filter_tail(name, slashes);
          break;
        case 'i':
          if (imatch)
@@ -477,6 +723,37 @@ int filter(name, casesensitive)
    return imatch && Rmatch;
 }
 
+/* Build the patterns for filter() if need be, and return TRUE if
+   filter_prune() can tell anything from them. */
+int filter_ready(casesensitive)
+  int casesensitive;
+{
+  struct filtsets *fs = &fsets[casesensitive != 0];
+
+  if (pcount == 0)
+    return FALSE;
+  if (fs->built != patterns || fs->count != pcount)
+    filter_build(casesensitive);
+  return !fs->failed && (fs->x.npats || icount);
+}
+
+int filter_prune(name, casesensitive)
+  ZCONST char *name;
+  int casesensitive;
+  /* Return TRUE if filter() excludes every name that begins with name,
+     the name it would get for a directory, and is longer:  a -x pattern
+     matches them all, or there are -i patterns and none can match one.
+     The -R patterns match the end of a name and never exclude a whole
+     directory.  Call filter_ready() first.  This changes nothing, so
+     the reader threads of walk.c can call it while newname() runs. */
+{
+  struct filtsets *fs = &fsets[casesensitive != 0];
+
+  if (glob_prefix(&fs->x, name, GLOB_ALL) >= 0)
+    return TRUE;
+  return icount && glob_prefix(&fs->i, name, GLOB_SOME) < 0;
+}
+
 
 #ifdef UNICODE_SUPPORT
 #endif
@@ -496,6 +773,7 @@ int newname(name, isdir, casesensitive)
   int undosm_owned = 0;   /* true when undosm needs explicit free */
   struct flist far *f;    /* where in found, or new found entry */
   struct zlist far *z;    /* where in zfiles (if found) */
+  struct zinfo info;      /* the file, if stat()ed */
   int dosflag;
   int ret = ZE_OK;
 
@@ -504,7 +782,7 @@ int newname(name, isdir, casesensitive)
    * After 5 seconds output Scanning files...
    * then a dot every 2 seconds
    */
-  if (noisy) {
+  if (noisy && !stream_add) {
     /* If find files then output message after delay */
     if (scan_count == 0) {
       time_t current = time(NULL);
@@ -610,18 +888,16 @@ int newname(name, isdir, casesensitive)
         goto cleanup;
       }
       strcpy(new_name, name);
-      if (z->name != NULL)
-        free((zvoid *)z->name);
+      arena_free((zvoid *)z->name);
       z->name = new_name;
     }
-    if (z->oname != NULL)
-      free((zvoid *)z->oname);
+    arena_free((zvoid *)z->oname);
     z->oname = oname;
     oname = NULL;
     z->dosflag = dosflag;
 
 #ifdef FORCE_NEWNAME
-    free((zvoid *)(z->iname));
+    arena_free((zvoid *)(z->iname));
     z->iname = iname;
     iname = NULL;
 #else
@@ -646,23 +922,29 @@ int newname(name, isdir, casesensitive)
   /* Check that we are not adding the zip file to itself. This
    * catches cases like "zip -m foo ../dir/foo.zip".
    */
+  /* What stat() says of the name is kept with the entry (see fileinfo());
+   * procname() may have asked already.  A link that -y stores as a link
+   * is not the zip file, wherever it leads.
+   */
+  info.mode = 0;
+  if (name_info != NULL)
+    info = *name_info;
 #ifndef CMS_MVS
   {
-    z_stat statb;      /* now use structure z_stat and function zstat globally 7/24/04 EG */
-
     if (zipstate == -1)
        zipstate = strcmp(zipfile, "-") != 0 &&
                    zstat(zipfile, &zipstatb) == 0;
 
-    if (zipstate == 1 && (statb = zipstatb, zstat(name, &statb) == 0
-      && zipstatb.st_mode  == statb.st_mode
-      && zipstatb.st_ino   == statb.st_ino
-      && zipstatb.st_dev   == statb.st_dev
-      && zipstatb.st_uid   == statb.st_uid
-      && zipstatb.st_gid   == statb.st_gid
-      && zipstatb.st_size  == statb.st_size
-      && zipstatb.st_mtime == statb.st_mtime
-      && zipstatb.st_ctime == statb.st_ctime)) {
+    if (zipstate == 1 && strcmp(name, "-") != 0 &&
+        fileinfo(name, &info, NULL, NULL, NULL) != 0
+      && (ulg)zipstatb.st_mode  == info.mode
+      && (uzoff_t)zipstatb.st_ino == info.ino
+      && (uzoff_t)zipstatb.st_dev == info.dev
+      && (ulg)zipstatb.st_uid   == info.uid
+      && (ulg)zipstatb.st_gid   == info.gid
+      && (zoff_t)zipstatb.st_size == info.size
+      && zipstatb.st_mtime == info.mtime
+      && zipstatb.st_ctime == info.ctime) {
       /* Don't compare a_time since we are reading the file */
          if (verbose)
            fprintf(mesg, "file matches zip file -- skipping\n");
@@ -672,27 +954,42 @@ int newname(name, isdir, casesensitive)
   }
 #endif  /* CMS_MVS */
 
-  if ((f = (struct flist far *)farmalloc(sizeof(struct flist))) == NULL ||
+  /* The names go to the arena and the temporaries are freed below.  Names
+     that are the same, as they usually are, share one copy, except that
+     name and iname are kept apart as trash() cuts them both in place. */
+  if ((f = (struct flist far *)arena_alloc(sizeof(struct flist), 1)) == NULL ||
       fcount + 1 < fcount ||
-      (f->name = malloc(strlen(name) + 1 + PAD)) == NULL)
+      (f->name = (char *)arena_alloc(strlen(name) + 1 + PAD, 0)) == NULL)
   {
-    if (f != NULL)
-      farfree((zvoid far *)f);
     ret = ZE_MEM;
     goto cleanup;
   }
   strcpy(f->name, name);
-  f->iname = iname;
+  if ((f->iname = arena_strdup(iname, NULL)) == NULL ||
+      (f->zname = arena_strdup(zname, PAD ? NULL : f->name)) == NULL ||
+      (f->oname = arena_strdup(oname, f->zname)) == NULL)
+  {
+    ret = ZE_MEM;
+    goto cleanup;
+  }
 #ifdef UNICODE_SUPPORT
   /* Unicode */
-  f->uname = local_to_utf8_string(iname);
+  {
+    char *uname = local_to_utf8_string(iname);
+
+    f->uname = NULL;
+    if (uname != NULL) {
+      f->uname = arena_strdup(uname, f->iname);
+      free(uname);
+      if (f->uname == NULL) {
+        ret = ZE_MEM;
+        goto cleanup;
+      }
+    }
+  }
 #endif
-  iname = NULL;
-  f->zname = zname;
-  zname = NULL;
-  f->oname = oname;
-  oname = NULL;
   f->dosflag = dosflag;
+  f->info = info;
 
   *fnxt = f;
   f->lst = fnxt;
@@ -702,7 +999,8 @@ int newname(name, isdir, casesensitive)
   if (name == label)
     label = f->name;
 
-  ret = ZE_OK;
+  /* with --stream-add it is zipped now, see zip.c */
+  ret = stream_add ? stream_found(f) : ZE_OK;
 
 cleanup:
   if (undosm_tmp != NULL) {
@@ -852,6 +1150,15 @@ char *d, *s;            /* destination and source file names */
 #endif
   int d_exists;
 
+#ifdef USE_TMPFILE
+  /* anonymous temp file from open_tempzip(), give it d's name */
+  if (tempzip_fd != -1)
+    return link_tempzip(d);
+#endif
+  /* brand-new archive was written in place */
+  if (strcmp(d, s) == 0)
+    return ZE_OK;
+
 #if defined(VMS) || defined(CMS_MVS)
   /* stat() is broken on VMS remote files (accessed through Decnet).
    * This patch allows creation of remote zip files, but is not sufficient
@@ -870,12 +1177,11 @@ char *d, *s;            /* destination and source file names */
 # endif
         )
        copy = 1;
-    else if (unlink(d))
-       return ZE_CREAT;                 /* Can't erase zip file--give up */
   }
 #endif /* ?(VMS || CMS_MVS) */
 #ifndef CMS_MVS
   if (!copy) {
+      /* rename() replaces d atomically, no need to unlink it first */
       if (rename(s, d)) {               /* Just move s on top of d */
           copy = 1;                     /* failed ? */
 #if !defined(CMS_MVS) && !defined(RISCOS) && !defined(QDOS)
@@ -896,27 +1202,23 @@ char *d, *s;            /* destination and source file names */
 #endif /* !CMS_MVS */
 
   if (copy) {
-    FILE *f, *g;        /* source and destination files */
+    int f, g;           /* source and destination descriptors */
     int r;              /* temporary variable */
 
-
-    /* Use zfopen for almost all opens where fopen is used.  For
-       most OS that support large files we use the 64-bit file
-       environment and zfopen maps to fopen, but this allows
-       tweeking ports that don't do that.  7/24/04 */
-    if ((f = zfopen(s, FOPR)) == NULL) {
+    if ((f = open(s, O_RDONLY)) == -1) {
       fprintf(mesg," replace: can't open %s\n", s);
       return ZE_TEMP;
     }
-    if ((g = zfopen(d, FOPW)) == NULL)
+    /* O_TRUNC on the existing d keeps its links and inode */
+    if ((g = open(d, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1)
     {
-      fclose(f);
+      close(f);
       return ZE_CREAT;
     }
 
-    r = fcopy(f, g, (ulg)-1L);
-    fclose(f);
-    if (fclose(g) || r != ZE_OK)
+    r = fdcopy(f, g);
+    close(f);
+    if (close(g) || r != ZE_OK)
     {
       unlink(d);
       return r ? (r == ZE_TEMP ? ZE_WRITE : r) : ZE_WRITE;
@@ -927,6 +1229,248 @@ char *d, *s;            /* destination and source file names */
 }
 
 
+/* fdcopy
+ *
+ * Copy all of descriptor f, from its start, to the current position of
+ * descriptor g.  Return an error code in the ZE_ class.  copy_file_range()
+ * keeps the data in the kernel (and lets file systems that can share
+ * extents skip the copy), read()/write() is the fallback where it is not
+ * available or not allowed between these two files.
+ */
+local int fdcopy(f, g)
+  int f, g;             /* source and destination descriptors */
+{
+  char *b;              /* malloc'ed buffer for copying */
+  ssize_t k;            /* bytes read */
+  ssize_t r;            /* result of write() */
+  extent w;             /* bytes of b written */
+  zoff_t m;             /* bytes copied so far */
+
+  m = 0;
+#ifdef USE_TMPFILE
+  for (;;) {
+    loff_t in = (loff_t)m;
+
+    if ((k = copy_file_range(f, &in, g, NULL, 0x40000000, 0)) <= 0)
+      break;
+    m += k;
+  }
+  if (k == 0)
+    return ZE_OK;
+  if (m != 0 || (errno != EXDEV && errno != ENOSYS && errno != EINVAL &&
+                 errno != EOPNOTSUPP && errno != EBADF)) {
+    fprintf(mesg," fdcopy: write error\n");
+    return ZE_TEMP;
+  }
+#endif /* USE_TMPFILE */
+
+  if ((b = malloc(CBSZ)) == NULL)
+    return ZE_MEM;
+  while ((k = pread(f, b, CBSZ, (off_t)m)) > 0)
+  {
+    for (w = 0; w < (extent)k; w += (extent)r)
+    {
+      if ((r = write(g, b + w, (extent)k - w)) <= 0)
+      {
+        free((zvoid *)b);
+        fprintf(mesg," fdcopy: write error\n");
+        return ZE_TEMP;
+      }
+    }
+    m += k;
+  }
+  free((zvoid *)b);
+  return k ? ZE_READ : ZE_OK;
+}
+
+
+#ifdef USE_TMPFILE
+/* link_tempzip
+ *
+ * Give the anonymous temp archive tempzip_fd the name d.  A new d is
+ * linked directly.  Otherwise the temp file is first given a name next to
+ * d, by linking it or else by copying it to a new file, and that is
+ * renamed over d, so readers see either the old or the new archive.  Like
+ * replace(), an existing d that is a symbolic link or has other hard links
+ * is overwritten in place from that copy instead.  On failure tempzip is
+ * set to the name the new archive was left under, or tempzip_fd is left
+ * open if it could not be given one, and d is unchanged.  Return an error
+ * code in the ZE_ class.
+ */
+local int link_tempzip(d)
+  char *d;              /* destination file name */
+{
+  z_stat t;             /* results of lstat() */
+  char fdpath[32];      /* /proc/self/fd/n */
+  char *l;              /* name next to d holding the new archive */
+  char *p;
+  int e;                /* d exists */
+  int f;                /* source descriptor for copying */
+  int g;                /* destination descriptor for copying */
+  int i;
+  int r;
+
+  sprintf(fdpath, "/proc/self/fd/%d", tempzip_fd);
+  if ((e = (LSTAT(d, &t) == 0)) == 0) {
+    /* linkat() fails if d has appeared meanwhile, so nothing is lost */
+    if (linkat(AT_FDCWD, fdpath, AT_FDCWD, d, AT_SYMLINK_FOLLOW) == 0 ||
+        linkat(tempzip_fd, "", AT_FDCWD, d, AT_EMPTY_PATH) == 0) {
+      close(tempzip_fd);
+      tempzip_fd = -1;
+      return ZE_OK;
+    }
+  }
+
+  /* name the new archive: link it, or with no /proc and no privilege to
+     link by descriptor copy it, the kernel does that with copy_file_range() */
+  if ((l = malloc(strlen(d) + 16)) == NULL)
+    return ZE_MEM;
+  strcpy(l, d);
+  p = l + strlen(l);
+  while (p > l && p[-1] != '/')
+    p--;
+  r = ZE_CREAT;
+  for (i = 0; i < 100; i++) {
+    sprintf(p, "zi%06lx", ((ulg)getpid() * 131 + (ulg)i) & 0xffffffL);
+    if (linkat(AT_FDCWD, fdpath, AT_FDCWD, l, AT_SYMLINK_FOLLOW) == 0 ||
+        linkat(tempzip_fd, "", AT_FDCWD, l, AT_EMPTY_PATH) == 0) {
+      r = ZE_OK;
+      break;
+    }
+    if (errno == EEXIST)
+      continue;
+    if ((g = open(l, O_WRONLY | O_CREAT | O_EXCL, 0666)) == -1) {
+      if (errno == EEXIST)
+        continue;
+      break;
+    }
+    r = fdcopy(tempzip_fd, g);
+    if (close(g) && r == ZE_OK)
+      r = ZE_TEMP;
+    if (r != ZE_OK)
+      unlink(l);
+    break;
+  }
+  if (r != ZE_OK) {
+    free(l);
+    return r == ZE_TEMP ? ZE_WRITE : r;
+  }
+  close(tempzip_fd);
+  tempzip_fd = -1;
+
+  if (!e || (t.st_nlink == 1 && (t.st_mode & S_IFMT) != S_IFLNK)) {
+    if (rename(l, d) == 0) {
+      free(l);
+      return ZE_OK;
+    }
+    r = ZE_CREAT;
+  }
+  else if ((f = open(l, O_RDONLY)) == -1)
+    r = ZE_OPEN;
+  else {
+    /* d must keep its inode, the copy at l survives a failure here */
+    if ((g = open(d, O_WRONLY | O_TRUNC)) == -1)
+      r = ZE_CREAT;
+    else {
+      r = fdcopy(f, g);
+      if (close(g) && r == ZE_OK)
+        r = ZE_WRITE;
+      if (r == ZE_TEMP)
+        r = ZE_WRITE;
+    }
+    close(f);
+    if (r == ZE_OK) {
+      unlink(l);
+      free(l);
+      return ZE_OK;
+    }
+  }
+  free(tempzip);
+  tempzip = l;
+  return r;
+}
+#endif /* USE_TMPFILE */
+
+
+/* open_tempzip
+ *
+ * Create the output file that will become archive dest, set tempzip to
+ * its malloc'ed name and return a descriptor for it.  how is a mix of:
+ *   TZ_NEW    dest is a brand-new archive, write it under its own name
+ *             (ziperr() removes it on failure, replace() has nothing to do)
+ *   TZ_NAMED  the temp file must have a name, e.g. for unzip -T
+ * Otherwise an anonymous O_TMPFILE is made in dest's directory, so it is
+ * on dest's file system whatever -b says and replace() never copies it.
+ * Where that is not supported a mkstemp() file is made under tempath (-b)
+ * or in dest's directory as before.  Does not return on failure.
+ */
+int open_tempzip(dest, how)
+  char *dest;           /* archive the output will replace */
+  int how;              /* TZ_ flags */
+{
+  int fd;               /* output descriptor */
+  char *dir;            /* directory part of dest */
+  int i;
+
+  if ((how & TZ_NEW) && split_method <= 0) {
+    if ((tempzip = malloc(strlen(dest) + 1)) == NULL) {
+      ZIPERR(ZE_MEM, "allocating temp filename");
+    }
+    strcpy(tempzip, dest);
+    if ((fd = open(dest, O_RDWR | O_CREAT | O_EXCL, 0666)) != -1)
+      return fd;
+    free(tempzip);
+    tempzip = NULL;
+  }
+
+  /* create path by stripping name, the temp name is only for messages */
+  if ((dir = malloc(strlen(dest) + 12)) == NULL) {
+    ZIPERR(ZE_MEM, "allocating temp filename");
+  }
+  strcpy(dir, dest);
+  for (i = strlen(dir); i > 0; i--) {
+    if (dir[i - 1] == '/')
+      break;
+  }
+  dir[i] = '\0';
+
+#ifdef USE_TMPFILE
+  /* splits are renamed by name in close_split() */
+  if (!(how & TZ_NAMED) && split_method <= 0) {
+    if ((fd = open(i ? dir : ".", O_TMPFILE | O_RDWR, 0600)) != -1) {
+      if ((tempzip_fd = dup(fd)) == -1) {
+        ZIPERR(ZE_TEMP, dest);
+      }
+      strcat(dir, "ziXXXXXX");
+      tempzip = dir;
+      return fd;
+    }
+  }
+#endif /* USE_TMPFILE */
+
+  if (tempath != NULL)
+  {
+    /* if -b used to set temp file dir use that for split temp */
+    if ((tempzip = malloc(strlen(tempath) + 12)) == NULL) {
+      ZIPERR(ZE_MEM, "allocating temp filename");
+    }
+    strcpy(tempzip, tempath);
+    if (lastchar(tempzip) != '/')
+      strcat(tempzip, "/");
+    free(dir);
+  }
+  else
+    tempzip = dir;
+  strcat(tempzip, "ziXXXXXX");
+
+  /* use mkstemp to avoid race condition and compiler warning */
+  if ((fd = mkstemp(tempzip)) == EOF) {
+    ZIPERR(ZE_TEMP, tempzip);
+  }
+  return fd;
+}
+
+
 int getfileattr(f)
 char *f;                /* file path */
 /* Return the file attributes for file f or 0 if failure */
@@ -1055,46 +1599,6 @@ char *tempname(zip)
 # endif /* CMS_MVS */
 }
 
-int fcopy(f, g, n)
-  FILE *f, *g;            /* source and destination files */
-  /* now use uzoff_t for all file sizes 5/14/05 CS */
-  uzoff_t n;               /* number of bytes to copy or -1 for all */
-/* Copy n bytes from file *f to file *g, or until EOF if (zoff_t)n == -1.
-   Return an error code in the ZE_ class. */
-{
-  char *b;              /* malloc'ed buffer for copying */
-  extent k;             /* result of fread() */
-  uzoff_t m;            /* bytes copied so far */
-
-  if ((b = malloc(CBSZ)) == NULL)
-    return ZE_MEM;
-  m = 0;
-  while (n == (uzoff_t)(-1L) || m < n)
-  {
-    if ((k = fread(b, 1, n == (uzoff_t)(-1) ?
-                   CBSZ : (n - m < CBSZ ? (extent)(n - m) : CBSZ), f)) == 0)
-    {
-      if (ferror(f))
-      {
-        free((zvoid *)b);
-        return ZE_READ;
-      }
-      else
-        break;
-    }
-    if (fwrite(b, 1, k, g) != k)
-    {
-      free((zvoid *)b);
-      fprintf(mesg," fcopy: write error\n");
-      return ZE_TEMP;
-    }
-    m += k;
-  }
-  free((zvoid *)b);
-  return ZE_OK;
-}
-
-
 /* from zipfile.c */
 
 #ifdef THEOS
@@ -1128,8 +1632,8 @@ int bfcopy(n)
 
    If fix == 1 calculate CRC of input entry and verify matches.
 
-   If fix == 2 and this entry using data descriptor keep a sliding
-   window in the buffer for looking for signature.
+   If fix == 2 and this entry using data descriptor look for its
+   signature in each buffer read.
 
    Return an error code in the ZE_ class. */
 {
@@ -1141,8 +1645,6 @@ int bfcopy(n)
   zoff_t des_start = 0;
   char *split_path;
   extent kk;
-  int i;
-  char sbuf[4];         /* buffer for sliding signature window for fix = 2 */
   int des = 0;          /* this entry has data descriptor to find */
 
   if ((b = malloc(CBSZ)) == NULL)
@@ -1155,8 +1657,6 @@ int bfcopy(n)
 
   if (fix == 2 && n == (uzoff_t) -2) {
     data_start = zftello(in_file);
-    for (kk = 0; kk < 4; kk++)
-      sbuf[kk] = 0;
     des = 1;
   }
 
@@ -1209,27 +1709,16 @@ int bfcopy(n)
            b[3] != '\010')) {
         /* buffer is not start of data descriptor */
 
-        for (kk = 0; kk < k; kk++) {
-          /* add byte to end of sbuf */
-          for (i = 0; i < 3; i++)
-            sbuf[i] = sbuf[i + 1];
-          sbuf[3] = b[kk];
-
-          /* see if this is signature */
-          if (
-              (sbuf[0] == 0x50 /*'P' except EBCDIC*/ &&
-               sbuf[1] == 0x4b /*'K' except EBCDIC*/ &&
-               sbuf[2] == '\07' &&
-               sbuf[3] == '\010')) {
-            kk -= 3;
-            if (zfseeko(in_file, bytes_this_split + kk, SEEK_SET) != 0) {
-              /* seek error */
-              ZIPERR(ZE_READ, "seek failed reading descriptor");
-            }
-            des_start = zftello(in_file);
-            k = kk;
-            break;
+        /* Stop before the signature (or a start of one at the end of a
+           full buffer, which may go on in the next) and go back to it. */
+        kk = memsig(b, k, "PK\07\010");
+        if (kk + 4 <= k || (kk < k && k == brd)) {
+          if (zfseeko(in_file, des_start + kk, SEEK_SET) != 0) {
+            /* seek error */
+            ZIPERR(ZE_READ, "seek failed reading descriptor");
           }
+          des_start = zftello(in_file);
+          k = kk;
         }
       }
       else
@@ -2238,7 +2727,8 @@ size_t bfwrite(buffer, size, count, mode)
           if ((yd = mkstemp(tempzip)) == EOF) {
             ZIPERR(ZE_TEMP, tempzip);
           }
-          if ((y = fdopen(yd, FOPW_TMP)) == NULL) {
+          if ((y = wb_open(yd, FOPW_TMP)) == NULL &&
+              (y = fdopen(yd, FOPW_TMP)) == NULL) {
             ZIPERR(ZE_TEMP, tempzip);
           }
         }
@@ -88,10 +88,17 @@ int noisy = 1;                /* 0=quiet operation */
 int extra_fields = 1;         /* 0=create minimum, 1=don't copy old, 2=keep old */
 int use_descriptors = 0;      /* 1=use data descriptors 12/29/04 */
 int zip_to_stdout = 0;        /* output zipfile to stdout 12/30/04 */
+int stream_add = 0;           /* 1=newname() zips each new name (--stream-add) */
 int allow_empty_archive = 0;  /* if no files, create empty archive anyway 12/28/05 */
 int copy_only = 0;            /* 1=copying archive entries only */
 int allow_fifo = 0;           /* 1=allow reading Unix FIFOs, waiting if pipe open */
+int write_behind = 1;         /* 1=write output archive from a background thread */
+struct zinfo *name_info = NULL; /* stat() of the name given to newname(), if taken */
+int walk_threads = -1;        /* threads reading directories for -r, -1 = auto */
+int sort_dirs = 1;            /* 1=return each directory's names sorted */
+int name_index = -1;          /* 1=write a name index (-ni), -1=keep the archive's */
 int show_files = 0;           /* show files to operate on and exit (=2 log only) */
+int show_what_doing = 0;      /* 1=show what zip is doing (-sd) */
 
 int output_seekable = 1;      /* 1 = output seekable 3/13/05 EG */
 
@@ -138,6 +145,7 @@ uzoff_t tempzn;               /* Count of bytes written to output zip files */
 /* 10/28/05 */
 char *tempzip = NULL;         /* name of temp file */
 FILE *y = NULL;               /* output file now global so can change in splits */
+int tempzip_fd = -1;          /* O_TMPFILE output kept open for replace() */
 FILE *in_file = NULL;         /* current input file for splits */
 char *in_path = NULL;         /* base name of input archive file */
 char *in_split_path = NULL;   /* in split path */
@@ -196,10 +204,12 @@ extent zcount;                    /* Number of files in zip file */
 int zipfile_exists = 0;           /* 1 if zipfile exists */
 ush zcomlen;                      /* Length of zip file comment */
 char *zcomment = NULL;            /* Zip file comment (not zero-terminated) */
-struct zlist far **zsort;         /* List of files sorted by name */
+uzoff_t cd_bulk_size = 0;         /* Central directory bytes read in one piece */
+struct zlist far **zhash = NULL;  /* Table of files hashed by zname */
 #ifdef UNICODE_SUPPORT
-  struct zlist far **zusort;      /* List of files sorted by zuname */
+  struct zlist far **zuhash = NULL; /* Table of files hashed by zuname */
 #endif
+extent zhmask;                    /* Size of the tables - 1 */
 
 /* Files to operate on that are not in zip file */
 struct flist far *found = NULL;   /* List of names found */
@@ -335,6 +335,7 @@ typedef struct ztimbuf {
 
 #ifndef Z_UINT4_DEFINED
 #  if !defined(NO_LIMITS_H)
+#    include <limits.h>
 #    if (defined(UINT_MAX) && (UINT_MAX == 0xffffffffUL))
        typedef unsigned int     z_uint4;
 #      define Z_UINT4_DEFINED
@@ -28,20 +28,38 @@ local ulg label_mode = 0;
 local time_t label_utim = 0;
 
 /* Local functions */
-local char *readd OF((DIR *));
+local int procfile OF((char *, unsigned, int));
+local void setinfo OF((struct zinfo *, z_stat *));
 
 
-
-
-local char *readd(d)
-DIR *d;                 /* directory stream to read from */
-/* Return a pointer to the next name in the directory stream d, or NULL if
-   no more entries or an error occurs. */
+local int procfile(n, m, caseflag)
+char *n;                /* name of an existing file that is not a directory */
+unsigned m;             /* its S_IFMT type */
+int caseflag;           /* true to force case-sensitive match */
+/* Add or remove the name of a file, link or FIFO found by procname() or
+   while walking a directory.  Return an error code in the ZE_ class. */
 {
-  struct dirent *e;
-
-  e = readdir(d);
-  return e == NULL ? (char *) NULL : e->d_name;
+  if (S_ISREG(m) || S_ISLNK(m))
+  {
+    /* add or remove name of file */
+    return newname(n, 0, caseflag);
+  }
+  else if (S_ISFIFO(m))
+  {
+    if (allow_fifo) {
+      /* FIFO (Named Pipe) - handle as normal file */
+      /* add or remove name of FIFO */
+      /* zip will stop if FIFO is open and wait for pipe to be fed and closed */
+      if (noisy) zipwarn("Reading FIFO (Named Pipe): ", n);
+      return newname(n, 0, caseflag);
+    } else {
+      zipwarn("ignoring FIFO (Named Pipe) - use -FI to read: ", n);
+      return ZE_OK;
+    }
+  } /* S_IFIFO */
+  else
+    zipwarn("ignoring special file: ", n);
+  return ZE_OK;
 }
 
 int procname(n, caseflag)
@@ -51,11 +69,13 @@ int caseflag;           /* true to force case-sensitive match */
    an error code in the ZE_ class. */
 {
   char *a;              /* path and name for recursion */
-  DIR *d;               /* directory stream from opendir() */
-  char *e;              /* pointer to name from readd() */
+  walk *w;              /* walk through the directory, see walk.c */
+  unsigned t;           /* type of a name from walk_next() */
   int m;                /* matched flag */
   char *p;              /* path for recursion */
+  char *f;              /* p as filter() sees it, for pruning */
   z_stat s;             /* result of stat() */
+  struct zinfo i;       /* the same, for newname() */
   struct zlist far *z;  /* steps through zfiles list */
 
   if (strcmp(n, "-") == 0)   /* if compressing stdin */
@@ -79,73 +99,82 @@ int caseflag;           /* true to force case-sensitive match */
     return m ? ZE_MISS : ZE_OK;
   }
 
-  /* Live name--use if file, recurse if directory */
-  if (S_ISREG(s.st_mode) || S_ISLNK(s.st_mode))
-  {
-    /* add or remove name of file */
-    if ((m = newname(n, 0, caseflag)) != ZE_OK)
+  /* Live name--use if file, recurse if directory.  newname() takes the
+     stat() from name_info instead of asking again. */
+  setinfo(&i, &s);
+  if (!S_ISDIR(s.st_mode)) {
+    name_info = &i;
+    m = procfile(n, (unsigned)(s.st_mode & S_IFMT), caseflag);
+    name_info = NULL;
+    return m;
+  }
+
+  /* Add trailing / to the directory name */
+  if ((p = malloc(strlen(n)+2)) == NULL)
+    return ZE_MEM;
+  if (strcmp(n, ".") == 0) {
+    *p = '\0';  /* avoid "./" prefix and do not create zip entry */
+  } else {
+    strcpy(p, n);
+    a = p + strlen(p);
+    if (a[-1] != '/')
+      strcpy(a, "/");
+    name_info = &i;
+    m = dirnames ? newname(p, 1, caseflag) : ZE_OK;
+    name_info = NULL;
+    if (m != ZE_OK) {
+      free((zvoid *)p);
       return m;
+    }
   }
-  else if (S_ISDIR(s.st_mode))
+  /* recurse into directory:  the names below it come from walk_next() in
+     the order this function used to visit them, subdirectories (ending
+     in '/') just before their contents */
+  if (recurse)
   {
-    /* Add trailing / to the directory name */
-    if ((p = malloc(strlen(n)+2)) == NULL)
-      return ZE_MEM;
-    if (strcmp(n, ".") == 0) {
-      *p = '\0';  /* avoid "./" prefix and do not create zip entry */
-    } else {
-      strcpy(p, n);
-      a = p + strlen(p);
-      if (a[-1] != '/')
-        strcpy(a, "/");
-      if (dirnames && (m = newname(p, 1, caseflag)) != ZE_OK) {
+    /* With -x or -i patterns, directories whose every name they exclude
+       are not read.  The names below p reach filter() with p stripped
+       as ex2in() strips it, which a UNC name would upset. */
+    f = NULL;
+    if (strncmp(p, "//", 2) && filter_ready(caseflag)) {
+      for (f = p; *f == '/'; f++)
+        ;
+      while (*f == '.' && f[1] == '/')
+        f += 2;
+      if (filter_prune(f, caseflag)) {
+        if (show_what_doing)
+          fprintf(mesg, "sd: Not reading %s: the patterns exclude all in it\n", n);
         free((zvoid *)p);
-        return m;
+        return ZE_OK;
       }
     }
-    /* recurse into directory */
-    if (recurse && (d = opendir(n)) != NULL)
-    {
-      while ((e = readd(d)) != NULL) {
-        if (strcmp(e, ".") && strcmp(e, ".."))
-        {
-          if ((a = malloc(strlen(p) + strlen(e) + 1)) == NULL)
-          {
-            closedir(d);
-            free((zvoid *)p);
-            return ZE_MEM;
-          }
-          strcat(strcpy(a, p), e);
-          if ((m = procname(a, caseflag)) != ZE_OK)   /* recurse on name */
-          {
-            if (m == ZE_MISS)
-              zipwarn("name not matched: ", a);
-            else
-              ziperr(m, a);
-          }
-          free((zvoid *)a);
-        }
+    if ((w = walk_start(n, p, f, caseflag)) == NULL) {
+      free((zvoid *)p);
+      return ZE_MEM;
+    }
+    while ((a = walk_next(w, &t)) != NULL) {
+      if ((t & WALK_PRUNED) && show_what_doing)
+        fprintf(mesg, "sd: Not reading %s: the patterns exclude all in it\n", a);
+      if (S_ISDIR(t))
+        m = dirnames ? newname(a, 1, caseflag) : ZE_OK;
+      else if (t == 0)
+        m = procname(a, caseflag);      /* type unknown, look again */
+      else
+        m = procfile(a, t, caseflag);
+      if (m != ZE_OK)
+      {
+        if (m == ZE_MISS)
+          zipwarn("name not matched: ", a);
+        else
+          ziperr(m, a);
       }
-      closedir(d);
     }
-    free((zvoid *)p);
-  } /* (s.st_mode & S_IFDIR) */
-  else if ((s.st_mode & S_IFIFO) == S_IFIFO)
-  {
-    if (allow_fifo) {
-      /* FIFO (Named Pipe) - handle as normal file */
-      /* add or remove name of FIFO */
-      /* zip will stop if FIFO is open and wait for pipe to be fed and closed */
-      if (noisy) zipwarn("Reading FIFO (Named Pipe): ", n);
-      if ((m = newname(n, 0, caseflag)) != ZE_OK)
-        return m;
-    } else {
-      zipwarn("ignoring FIFO (Named Pipe) - use -FI to read: ", n);
-      return ZE_OK;
+    if ((m = walk_end(w)) != ZE_OK) {
+      free((zvoid *)p);
+      return m;
     }
-  } /* S_IFIFO */
-  else
-    zipwarn("ignoring special file: ", n);
+  }
+  free((zvoid *)p);
   return ZE_OK;
 }
 
@@ -232,6 +261,22 @@ ulg d;                  /* dos-style time to change it to */
 
 }
 
+local void setinfo(i, s)
+  struct zinfo *i;
+  z_stat *s;
+{
+  i->mode = (ulg)s->st_mode;
+  i->nlink = (ulg)s->st_nlink;
+  i->uid = (ulg)s->st_uid;
+  i->gid = (ulg)s->st_gid;
+  i->dev = (uzoff_t)s->st_dev;
+  i->ino = (uzoff_t)s->st_ino;
+  i->size = (zoff_t)s->st_size;
+  i->atime = s->st_atime;
+  i->mtime = s->st_mtime;
+  i->ctime = s->st_ctime;
+}
+
 ulg filetime(f, a, n, t)
   char *f;                /* name of file to get info on */
   ulg *a;                 /* return value: file attributes */
@@ -248,8 +293,21 @@ ulg filetime(f, a, n, t)
    times are stored there as UNIX time_t values.
    If f is "-", use standard input as the file. If f is a device, return
    a file size of -1 */
+{
+  return fileinfo(f, (struct zinfo *)NULL, a, n, t);
+}
+
+ulg fileinfo(f, i, a, n, t)
+  char *f;                /* name of file to get info on */
+  struct zinfo *i;        /* what is known of it, or NULL */
+  ulg *a;                 /* return value: file attributes */
+  zoff_t *n;              /* return value: file size */
+  iztimes *t;             /* return value: access, modific. and creation times */
+/* As filetime(), but f is stat()ed only if *i has not been filled in
+   yet, and then the result is kept in *i for the next call. */
 {
   z_stat s;         /* results of stat() */
+  struct zinfo o;   /* when i is NULL */
   /* converted to pointer from using FNMAX - 11/8/04 EG */
   char *name;
   int len = strlen(f);
@@ -263,47 +321,72 @@ ulg filetime(f, a, n, t)
       t->atime = t->mtime = t->ctime = label_utim;
     return label_time;
   }
-  if ((name = malloc(len + 1)) == NULL) {
-    ZIPERR(ZE_MEM, "filetime");
+  if (i == NULL) {
+    o.mode = 0;
+    i = &o;
   }
-  strcpy(name, f);
-  if (name[len - 1] == '/')
-    name[len - 1] = '\0';
-  /* not all systems allow stat'ing a file with / appended */
-  if (strcmp(f, "-") == 0) {
-    if (zfstat(fileno(stdin), &s) != 0) {
+  if (i->mode == 0) {
+    if ((name = malloc(len + 1)) == NULL) {
+      ZIPERR(ZE_MEM, "filetime");
+    }
+    strcpy(name, f);
+    if (name[len - 1] == '/')
+      name[len - 1] = '\0';
+    /* not all systems allow stat'ing a file with / appended */
+    if (strcmp(f, "-") == 0) {
+      if (zfstat(fileno(stdin), &s) != 0) {
+        free(name);
+        error("fstat(stdin)");
+      }
+    }
+    else if (LSSTAT(name, &s) != 0) {
+      /* Accept about any file kind including directories
+       * (stored with trailing / with -r option)
+       */
       free(name);
-      error("fstat(stdin)");
+      return 0;
     }
-  }
-  else if (LSSTAT(name, &s) != 0) {
-    /* Accept about any file kind including directories
-     * (stored with trailing / with -r option)
-     */
     free(name);
-    return 0;
+    setinfo(i, &s);
   }
-  free(name);
 
   if (a != NULL) {
-    *a = ((ulg)s.st_mode << 16) | !(s.st_mode & S_IWRITE);
-    if ((s.st_mode & S_IFMT) == S_IFDIR) {
+    *a = (i->mode << 16) | !(i->mode & S_IWRITE);
+    if ((i->mode & S_IFMT) == S_IFDIR) {
       *a |= MSDOS_DIR_ATTR;
     }
   }
   if (n != NULL)
-    *n = (s.st_mode & S_IFMT) == S_IFREG ? s.st_size : -1L;
+    *n = (i->mode & S_IFMT) == S_IFREG ? i->size : -1L;
   if (t != NULL) {
-    t->atime = s.st_atime;
-    t->mtime = s.st_mtime;
+    t->atime = i->atime;
+    t->mtime = i->mtime;
     t->ctime = t->mtime;   /* best guess, (s.st_ctime: last status change!!) */
   }
-  return unix2dostime(&s.st_mtime);
+  return unix2dostime(&i->mtime);
+}
+
+int fdinfo(fd, i)
+  int fd;                 /* the file, opened */
+  struct zinfo *i;        /* what was known of it by name */
+/* Bring *i up to date from the open file.  Return true if that changed
+   it:  the name now leads to another file, or the file was written to
+   after *i was taken. */
+{
+  z_stat s;
+  struct zinfo o;
+
+  if (zfstat(fd, &s) != 0)
+    return 0;
+  o = *i;
+  setinfo(i, &s);
+  return o.mode != i->mode || o.dev != i->dev || o.ino != i->ino ||
+         o.size != i->size || o.mtime != i->mtime || o.ctime != i->ctime;
 }
 
 
 
-int set_new_unix_extra_field(struct zlist far *z, z_stat *s)
+int set_new_unix_extra_field(struct zlist far *z, struct zinfo *s)
   /* New unix extra field. Currently only UIDs and GIDs are stored. */
 {
   size_t uid_size;
@@ -317,8 +400,8 @@ int set_new_unix_extra_field(struct zlist far *z, z_stat *s)
   size_t b;
   size_t i;
 
-  uid_size = sizeof(s->st_uid);
-  gid_size = sizeof(s->st_gid);
+  uid_size = sizeof(uid_t);
+  gid_size = sizeof(gid_t);
 
   /* New extra field layout:
      tag       (2 bytes) = 'u''x'
@@ -353,9 +436,9 @@ int set_new_unix_extra_field(struct zlist far *z, z_stat *s)
   if (z->ext  && z->extra)  memcpy(extra,  z->extra,  (size_t)z->ext);
   if (z->cext && z->cextra) memcpy(cextra, z->cextra, (size_t)z->cext);
 
-  free(z->extra);
+  arena_free(z->extra);
   z->extra = extra;
-  free(z->cextra);
+  arena_free(z->cextra);
   z->cextra = cextra;
 
   /* Local header extra field: 'ux' + size (LE) + version. */
@@ -368,7 +451,7 @@ int set_new_unix_extra_field(struct zlist far *z, z_stat *s)
   /* UID */
   z->extra[z->ext + 5] = (char)uid_size;
   b = (size_t)z->ext + 6;
-  id = (unsigned long)(s->st_uid);
+  id = (unsigned long)(s->uid);
   for (i = 0; i < uid_size; ++i) {
     z->extra[b++] = (char)(id & 0xFF);
     id >>= 8;
@@ -376,7 +459,7 @@ int set_new_unix_extra_field(struct zlist far *z, z_stat *s)
 
   /* GID */
   z->extra[b++] = (char)gid_size;
-  id = (unsigned long)(s->st_gid);
+  id = (unsigned long)(s->gid);
   for (i = 0; i < gid_size; ++i) {
     z->extra[b++] = (char)(id & 0xFF);
     id >>= 8;
@@ -398,25 +481,12 @@ int set_extra_field(z, z_utim)
      in central header */
 {
   (void)z_utim;
-  z_stat s;
-  char *name;
-  int len = strlen(z->name);
+  struct zinfo *s = &z->info;
 
   /* For the full sized UT local field including the UID/GID fields, we
-   * have to stat the file again. */
-
-  if ((name = malloc(len + 1)) == NULL) {
-    ZIPERR(ZE_MEM, "set_extra_field");
-  }
-  strcpy(name, z->name);
-  if (name[len - 1] == '/')
-    name[len - 1] = '\0';
-  /* not all systems allow stat'ing a file with / appended */
-  if (LSSTAT(name, &s)) {
-    free(name);
+   * need what stat() said, which zipup() has kept in z->info. */
+  if (fileinfo(z->name, s, NULL, NULL, NULL) == 0)
     return ZE_OPEN;
-  }
-  free(name);
 
 #define EB_L_UT_SIZE    (EB_HEADSIZE + EB_UT_LEN(2))
 #define EB_C_UT_SIZE    (EB_HEADSIZE + EB_UT_LEN(1))
@@ -436,7 +506,7 @@ int set_extra_field(z, z_utim)
   /* The following expression is a compile-time constant and should (hopefully)
      get optimized away by any sufficiently intelligent compiler!
    */
-# define UIDGID_ARE_16B  (sizeof(s.st_uid) == 2 && sizeof(s.st_gid) == 2)
+# define UIDGID_ARE_16B  (sizeof(uid_t) == 2 && sizeof(gid_t) == 2)
 
 # define EB_L_UX2_SIZE   (EB_HEADSIZE + EB_UX2_MINLEN)
 # define EB_C_UX2_SIZE   EB_HEADSIZE
@@ -453,14 +523,14 @@ int set_extra_field(z, z_utim)
   z->extra[2]  = (char)EB_UT_LEN(2);    /* length of data part of local e.f. */
   z->extra[3]  = 0;
   z->extra[4]  = EB_UT_FL_MTIME | EB_UT_FL_ATIME;    /* st_ctime != creation */
-  z->extra[5]  = (char)(s.st_mtime);
-  z->extra[6]  = (char)(s.st_mtime >> 8);
-  z->extra[7]  = (char)(s.st_mtime >> 16);
-  z->extra[8]  = (char)(s.st_mtime >> 24);
-  z->extra[9]  = (char)(s.st_atime);
-  z->extra[10] = (char)(s.st_atime >> 8);
-  z->extra[11] = (char)(s.st_atime >> 16);
-  z->extra[12] = (char)(s.st_atime >> 24);
+  z->extra[5]  = (char)(s->mtime);
+  z->extra[6]  = (char)(s->mtime >> 8);
+  z->extra[7]  = (char)(s->mtime >> 16);
+  z->extra[8]  = (char)(s->mtime >> 24);
+  z->extra[9]  = (char)(s->atime);
+  z->extra[10] = (char)(s->atime >> 8);
+  z->extra[11] = (char)(s->atime >> 16);
+  z->extra[12] = (char)(s->atime >> 24);
 
   /* Only store the UID and GID in the old Ux extra field if the runtime
      system provides them in 16-bit wide variables.  */
@@ -469,10 +539,10 @@ int set_extra_field(z, z_utim)
     z->extra[14] = 'x';
     z->extra[15] = (char)EB_UX2_MINLEN; /* length of data part of local e.f. */
     z->extra[16] = 0;
-    z->extra[17] = (char)(s.st_uid);
-    z->extra[18] = (char)(s.st_uid >> 8);
-    z->extra[19] = (char)(s.st_gid);
-    z->extra[20] = (char)(s.st_gid >> 8);
+    z->extra[17] = (char)(s->uid);
+    z->extra[18] = (char)(s->uid >> 8);
+    z->extra[19] = (char)(s->gid);
+    z->extra[20] = (char)(s->gid >> 8);
   }
 
   z->ext = EF_L_UNIX_SIZE;
@@ -487,7 +557,7 @@ int set_extra_field(z, z_utim)
   z->cext = EF_C_UNIX_SIZE;
 
   /* new unix extra field */
-  set_new_unix_extra_field(z, &s);
+  set_new_unix_extra_field(z, s);
 
   return ZE_OK;
 }
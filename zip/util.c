@@ -16,6 +16,9 @@
 #include "zip.h"
 #include "ebcdic.h"
 #include <ctype.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
 
 
 #ifdef NO_MKTIME
@@ -355,6 +358,165 @@ int namecmp(string1, string2)
   }
 }
 
+ulg namehash(s, cs)
+  ZCONST char *s;
+  int cs;               /* true: hash for strcmp(), false: for namecmp() */
+/* Return a hash of the string s (FNV-1a) such that strings that compare
+ * equal with strcmp() resp. namecmp() hash equal.
+ */
+{
+  ulg h = 2166136261UL;
+
+  for (; *s; s++)
+    h = ((h ^ (uch)(cs ? *s : case_map(*s))) * 16777619UL) & 0xffffffffUL;
+  return h;
+}
+
+
+extent memsig(b, n, sig)
+  ZCONST char *b;       /* bytes to search */
+  extent n;             /* how many */
+  ZCONST char *sig;     /* signature to find, or NULL for any "PK" signature */
+/* Return the offset in b of the first signature: sig, or with sig NULL
+ * "PK" followed by two bytes below 16.  A start of one that runs into the
+ * end of b counts as well, so that the caller can read on from there;
+ * only a return value up to n - 4 is a whole signature.  Return n if
+ * there is neither.  "PK" pairs are looked for 16 at a time where SSE2
+ * is available, else memchr() finds the 'P's.
+ */
+{
+  extent i = 0;
+  ZCONST char *q;
+#ifdef __SSE2__
+  __m128i P = _mm_set1_epi8(0x50);      /* 'P' except EBCDIC */
+  __m128i K = _mm_set1_epi8(0x4b);      /* 'K' except EBCDIC */
+  int m;
+#endif
+
+  while (i < n) {
+#ifdef __SSE2__
+    for (; i + 17 <= n; i += 16) {
+      m = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(_mm_loadu_si128((ZCONST __m128i *)(b + i)), P),
+            _mm_cmpeq_epi8(_mm_loadu_si128((ZCONST __m128i *)(b + i + 1)), K)));
+      if (m) {
+        i += __builtin_ctz(m);
+        break;
+      }
+    }
+#endif
+    if ((q = (ZCONST char *)memchr(b + i, 0x50, n - i)) == NULL)
+      return n;
+    i = (extent)(q - b);
+    if ((i + 1 >= n || b[i + 1] == 0x4b) &&
+        (i + 2 >= n || (sig ? b[i + 2] == sig[2] : (uch)b[i + 2] < 16)) &&
+        (i + 3 >= n || (sig ? b[i + 3] == sig[3] : (uch)b[i + 3] < 16)))
+      return i;
+    i++;
+  }
+  return n;
+}
+
+
+/* The names, extra fields, comments and list nodes of the zfiles and found
+ * entries are carved out of a few large blocks instead of being malloc'd
+ * one by one, which for millions of entries costs more than the data in
+ * allocator overhead.  Such memory is only given back all at once, by
+ * arena_release() in freeup(); arena_free() ignores it and free()s any
+ * other pointer, so a field can be replaced with malloc'd data as always.
+ */
+struct arena_blk {
+  struct arena_blk *prev;       /* block filled before this one */
+  extent size;                  /* bytes after the header */
+  extent used;
+};
+/* keep the data after the header aligned for any field type */
+#define ARENA_HDR ((sizeof(struct arena_blk) + 15) & ~(extent)15)
+#define ARENA_MIN 0x10000       /* size of the first block */
+
+local struct arena_blk *arena = NULL;   /* block being filled */
+local uzoff_t arena_total = 0;          /* bytes handed out */
+
+zvoid *arena_alloc(n, align)
+  extent n;             /* bytes wanted */
+  int align;            /* true for a structure, false for a string */
+/* Return n bytes from the arena, or NULL if out of memory. */
+{
+  struct arena_blk *b = arena;
+  extent at;
+  extent size;
+
+  at = b == NULL ? 0 : align ? (b->used + 15) & ~(extent)15 : b->used;
+  if (b == NULL || n > b->size - at) {
+    /* each block doubles the last, so there are few to look through */
+    size = b == NULL ? ARENA_MIN : b->size * 2;
+    while (size < n)
+      size *= 2;
+    if (size + ARENA_HDR < size ||
+        (b = (struct arena_blk *)malloc(ARENA_HDR + size)) == NULL)
+      return NULL;
+    b->prev = arena;
+    b->size = size;
+    b->used = 0;
+    arena = b;
+    at = 0;
+  }
+  b->used = at + n;
+  arena_total += n;
+  return (zvoid *)((char *)b + ARENA_HDR + at);
+}
+
+char *arena_strdup(s, same)
+  ZCONST char *s;       /* string to copy */
+  char *same;           /* string of the same entry that may equal s, or NULL */
+/* Return same if it holds s already, else a copy of s in the arena, or NULL
+   if out of memory.  Only strings that are not changed in place may be
+   shared like this. */
+{
+  char *p;
+  extent n;
+
+  if (same != NULL && strcmp(same, s) == 0)
+    return same;
+  n = strlen(s) + 1;
+  if ((p = (char *)arena_alloc(n, 0)) != NULL)
+    memcpy(p, s, n);
+  return p;
+}
+
+void arena_free(p)
+  zvoid *p;
+/* free(p), unless p is in the arena */
+{
+  struct arena_blk *b;
+
+  if (p == NULL)
+    return;
+  for (b = arena; b != NULL; b = b->prev)
+    if ((char *)p >= (char *)b + ARENA_HDR &&
+        (char *)p < (char *)b + ARENA_HDR + b->size)
+      return;
+  free(p);
+}
+
+void arena_release()
+/* Free all arena memory. */
+{
+  struct arena_blk *b;
+
+  while ((b = arena) != NULL) {
+    arena = b->prev;
+    free((zvoid *)b);
+  }
+  arena_total = 0;
+}
+
+uzoff_t arena_bytes()
+/* Return the number of bytes handed out since the last arena_release(). */
+{
+  return arena_total;
+}
+
 #ifdef EBCDIC
 char *strtoasc(char *str1, ZCONST char *str2)
 {
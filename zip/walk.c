@@ -0,0 +1,722 @@
+/*
+  walk.c - Zip 3
+
+  Copyright (c) 1990-2008 Info-ZIP.  All rights reserved.
+
+  See the accompanying file LICENSE, version 2007-Mar-4 or later
+  (the contents of which are also included in zip.h) for terms of use.
+  If, for some reason, all these files are missing, the Info-ZIP license
+  also may be found at:  ftp://ftp.info-zip.org/pub/infozip/license.html
+*/
+/*---------------------------------------------------------------------------
+
+  walk.c
+
+  Directory traversal for zip -r.  procname() used to recurse through a
+  tree one opendir() at a time, building each path with malloc() and
+  stat()ing every name to learn whether it is a directory.  On a large
+  tree (and on network file systems above all) the walk then takes
+  longer than compressing what it finds.
+
+  Here a directory is read once, by whichever thread gets to it first,
+  into a listing of its names and their types.  The type comes from
+  d_type where the file system provides it; only symbolic links (when
+  they are followed), and names whose type is not reported, are stat()ed.
+  Each subdirectory is opened with openat() relative to its parent, which
+  stays open until its last subdirectory has been opened, so no path is
+  ever looked up from the top again.  (Past WALKFDS open directories the
+  parent is closed and its subdirectories are opened by full path.)
+
+  Reader threads each keep a deque of directories to read.  A reader
+  takes the newest directory from its own deque, which keeps it going
+  depth first in the order the names are returned, and when that is
+  empty takes the oldest one from another reader's deque, which is the
+  biggest piece of the tree left.  They read at most WALKAHEAD entries
+  ahead of the caller.
+
+  The caller gets the names from walk_next() one at a time in the same
+  order as the recursive procname() gave them:  a directory is returned
+  with a trailing '/' just before its contents.  Every listing is sorted
+  by name (or left in readdir() order with --readdir-order), so the order
+  never depends on which thread read what.  If the caller needs a
+  directory that no reader has started yet, it reads it itself.  Without
+  threads (-wt 0, or NO_WALK_THREADS) that is how the whole tree is read.
+
+  With -x or -i patterns, each subdirectory is put to filter_prune() as
+  the name filter() would get for it before it is queued.  If no name
+  below it can be included, it is returned with WALK_PRUNED and never
+  read, so an excluded tree costs one name however big it is.
+
+  Contains:  walk_start()
+             walk_next()
+             walk_end()
+
+  ---------------------------------------------------------------------------*/
+
+#define __WALK_C        /* identifies this source module */
+
+#include "zip.h"
+
+#if defined(UNIX) && !defined(UTIL)
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef NO_WALK_THREADS
+#  include <pthread.h>
+#  include <signal.h>
+#endif
+
+#ifndef WALKAHEAD
+#  define WALKAHEAD 0x40000L    /* entries read ahead of the caller */
+#endif
+#ifndef WALKFDS
+#  define WALKFDS 256           /* directories kept open for their subdirectories */
+#endif
+#ifndef WALKMAX
+#  define WALKMAX 64            /* most reader threads */
+#endif
+#ifndef O_DIRECTORY
+#  define O_DIRECTORY 0
+#endif
+#ifndef O_CLOEXEC
+#  define O_CLOEXEC 0
+#endif
+
+#define W_NEW  0                /* not read yet */
+#define W_BUSY 1                /* being read */
+#define W_DONE 2                /* listing complete */
+
+struct went {                   /* one name in a directory */
+  union {
+    extent off;                 /* offset in the heap while reading */
+    char *s;                    /* then the name itself */
+  } name;
+  unsigned mode;                /* S_IFMT bits, 0 if unknown */
+  struct wdir *dir;             /* subdirectory, until returned */
+};
+
+struct wdir {                   /* one directory */
+  struct wdir *up;              /* parent, NULL for the top */
+  char *name;                   /* name in the parent, or path of the top */
+  DIR *d;                       /* open while subdirectories are to be opened */
+  unsigned subs;                /* subdirectories not opened yet */
+  int state;                    /* W_NEW, W_BUSY, W_DONE */
+  int ready;                    /* caller has seen W_DONE */
+  int err;                      /* ZE_MEM if the listing is incomplete */
+  char *heap;                   /* the names, end to end */
+  struct went *ent;
+  extent nent;
+  extent pos;                   /* next entry to return */
+  extent plen;                  /* length of the path before the names */
+  int q;                        /* deque it waits in, or -1 */
+  ulg qi;                       /* and its position there */
+};
+
+struct wqueue {                 /* a reader's deque */
+  struct wdir **slot;
+  ulg lo, hi;                   /* oldest and one past newest, not wrapped */
+  ulg cap;                      /* slots, a power of 2 */
+#ifndef NO_WALK_THREADS
+  struct walk *w;
+  int i;                        /* number of this reader */
+  pthread_t thread;
+#endif
+};
+
+struct walk {
+  struct wdir *top;
+  struct wdir *cur;             /* directory whose names are being returned */
+  char *path;                   /* last name returned */
+  extent pathsz;
+  int err;
+  int nq;                       /* reader threads */
+  unsigned rr;                  /* deque for what the caller reads */
+  long ahead;                   /* entries read and not returned yet */
+  int nfds;                     /* directories held open */
+  int stop;
+  ZCONST char *f;               /* filter() name of the top, NULL not to prune */
+  int cs;                       /* and the case flag for it */
+  struct wqueue *q;
+#ifndef NO_WALK_THREADS
+  pthread_mutex_t lock;
+  pthread_cond_t work;          /* signalled when directories are queued */
+  pthread_cond_t done;          /* signalled when a directory has been read */
+#endif
+};
+
+#ifdef NO_WALK_THREADS
+#  define WLOCK(w)
+#  define WUNLOCK(w)
+#else
+#  define WLOCK(w)   pthread_mutex_lock(&(w)->lock)
+#  define WUNLOCK(w) pthread_mutex_unlock(&(w)->lock)
+#endif
+
+local unsigned wmode OF((int, struct dirent *));
+local int wcmp OF((ZCONST zvoid *, ZCONST zvoid *));
+local DIR *wopen OF((struct walk *, struct wdir *));
+local char *wfname OF((struct walk *, struct wdir *, extent, extent *));
+local int wpush OF((struct wqueue *, struct wdir *, int));
+local void wread OF((struct walk *, struct wdir *, struct wqueue *));
+local void wready OF((struct walk *, struct wdir *));
+local void wfree OF((struct walk *, struct wdir *));
+#ifndef NO_WALK_THREADS
+local struct wdir *wtake OF((struct walk *, struct wqueue *));
+local void *wreader OF((void *));
+local void wthreads OF((struct walk *));
+#endif
+
+
+/* Type of a directory entry, from d_type if possible. */
+local unsigned wmode(fd, e)
+  int fd;
+  struct dirent *e;
+{
+  struct stat s;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+  switch (e->d_type) {
+    case DT_REG:  return S_IFREG;
+    case DT_DIR:  return S_IFDIR;
+    case DT_FIFO: return S_IFIFO;
+    case DT_CHR:  return S_IFCHR;
+    case DT_BLK:  return S_IFBLK;
+#  ifdef DT_SOCK
+    case DT_SOCK: return S_IFSOCK;
+#  endif
+    case DT_LNK:
+      if (linkput)
+        return S_IFLNK;
+      break;            /* the type of what it points to */
+  }
+#endif
+  if (fstatat(fd, e->d_name, &s, linkput ? AT_SYMLINK_NOFOLLOW : 0))
+    return 0;
+  return (unsigned)(s.st_mode & S_IFMT);
+}
+
+
+local int wcmp(a, b)
+  ZCONST zvoid *a;
+  ZCONST zvoid *b;
+{
+  return strcmp(((ZCONST struct went *)a)->name.s,
+                ((ZCONST struct went *)b)->name.s);
+}
+
+
+/* Open directory n, relative to its parent while that is open. */
+local DIR *wopen(w, n)
+  struct walk *w;
+  struct wdir *n;
+{
+  struct wdir *u;
+  DIR *d;
+  char *p;
+  extent len;
+  int fd;
+
+  if (n->up == NULL)
+    fd = open(n->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  else if (n->up->d != NULL)
+    fd = openat(dirfd(n->up->d), n->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  else {
+    /* the names of n and its parents stay put until n has been read */
+    for (len = 0, u = n; u != NULL; u = u->up)
+      len += strlen(u->name) + 1;
+    if ((p = malloc(len)) == NULL)
+      fd = -1;
+    else {
+      p[len - 1] = '\0';
+      for (u = n; u != NULL; u = u->up) {
+        len -= strlen(u->name) + 1;
+        memcpy(p + len, u->name, strlen(u->name));
+        if (len)
+          p[len - 1] = '/';
+      }
+      fd = open(p, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      free(p);
+    }
+  }
+
+  if (n->up != NULL) {
+    WLOCK(w);
+    if (n->up->d != NULL && --n->up->subs == 0) {
+      closedir(n->up->d);
+      n->up->d = NULL;
+      w->nfds--;
+    }
+    WUNLOCK(w);
+  }
+  if (fd < 0)
+    return NULL;
+  if ((d = fdopendir(fd)) == NULL)
+    close(fd);
+  return d;
+}
+
+
+/* Return the filter() name of directory n, with room for more bytes
+   after it, and its length in *len, or NULL if out of memory. */
+local char *wfname(w, n, more, len)
+  struct walk *w;
+  struct wdir *n;
+  extent more;
+  extent *len;
+{
+  struct wdir *u;
+  extent k, l;
+  char *f;
+
+  for (l = strlen(w->f), u = n; u->up != NULL; u = u->up)
+    l += strlen(u->name) + 1;
+  if ((f = malloc(l + more)) == NULL)
+    return NULL;
+  *len = l;
+  for (u = n; u->up != NULL; u = u->up) {
+    k = strlen(u->name);
+    l -= k + 1;
+    memcpy(f + l, u->name, k);
+    f[l + k] = '/';
+  }
+  memcpy(f, w->f, l);
+  return f;
+}
+
+
+/* Add n to the newest end of deque q.  Return 0 if out of memory. */
+local int wpush(q, n, i)
+  struct wqueue *q;
+  struct wdir *n;
+  int i;                /* number of q */
+{
+  struct wdir **s;
+  ulg k;
+
+  if (q->hi - q->lo == q->cap) {
+    k = q->cap ? q->cap * 2 : 64;
+    if ((s = (struct wdir **)malloc(k * sizeof(struct wdir *))) == NULL)
+      return 0;
+    for (; q->lo < q->hi; q->lo++)
+      s[q->lo & (k - 1)] = q->slot[q->lo & (q->cap - 1)];
+    q->lo -= q->cap;
+    if (q->slot != NULL)
+      free(q->slot);
+    q->slot = s;
+    q->cap = k;
+  }
+  n->q = i;
+  n->qi = q->hi;
+  q->slot[q->hi++ & (q->cap - 1)] = n;
+  return 1;
+}
+
+
+/* Read directory n into its listing.  The subdirectories go to q. */
+local void wread(w, n, q)
+  struct walk *w;
+  struct wdir *n;
+  struct wqueue *q;     /* NULL to leave them for the caller */
+{
+  DIR *d;
+  struct dirent *e;
+  struct wdir *s;
+  struct went *t;
+  char *h, *f = NULL;
+  extent hlen = 0, hmax = 0, emax = 0, len, flen = 0, i;
+  unsigned subs = 0;
+
+  if ((d = wopen(w, n)) == NULL)
+    return;
+  while ((e = readdir(d)) != NULL) {
+    if (e->d_name[0] == '.' && (e->d_name[1] == '\0' ||
+        (e->d_name[1] == '.' && e->d_name[2] == '\0')))
+      continue;
+    len = strlen(e->d_name) + 1;
+    if (hlen + len > hmax) {
+      hmax = hmax ? hmax * 2 : 1024;
+      if (hmax < hlen + len)
+        hmax = hlen + len;
+      if ((h = (char *)realloc(n->heap, hmax)) == NULL)
+        break;
+      n->heap = h;
+    }
+    if (n->nent == emax) {
+      emax = emax ? emax * 2 : 32;
+      if ((t = (struct went *)realloc(n->ent, emax * sizeof(struct went))) == NULL)
+        break;
+      n->ent = t;
+    }
+    memcpy(n->heap + hlen, e->d_name, len);
+    t = &n->ent[n->nent++];
+    t->name.off = hlen;
+    t->mode = wmode(dirfd(d), e);
+    t->dir = NULL;
+    hlen += len;
+    if (S_ISDIR(t->mode))
+      subs++;
+  }
+  if (e != NULL)
+    n->err = ZE_MEM;
+
+  for (i = 0; i < n->nent; i++)
+    n->ent[i].name.s = n->heap + n->ent[i].name.off;
+  if (sort_dirs && n->nent > 1)
+    qsort(n->ent, n->nent, sizeof(struct went), wcmp);
+  if (w->f != NULL && subs) {
+    for (len = 0, i = 0; i < n->nent; i++)
+      if (S_ISDIR(n->ent[i].mode) && strlen(n->ent[i].name.s) > len)
+        len = strlen(n->ent[i].name.s);
+    f = wfname(w, n, len + 2, &flen);
+  }
+  for (subs = 0, i = 0; i < n->nent; i++)
+    if (S_ISDIR(n->ent[i].mode)) {
+      if (f != NULL) {
+        len = strlen(n->ent[i].name.s);
+        memcpy(f + flen, n->ent[i].name.s, len);
+        strcpy(f + flen + len, "/");
+        if (filter_prune(f, w->cs)) {
+          n->ent[i].mode |= WALK_PRUNED;
+          continue;
+        }
+      }
+      if ((s = (struct wdir *)calloc(1, sizeof(struct wdir))) == NULL) {
+        n->err = ZE_MEM;
+        subs = 0;
+        break;
+      }
+      s->up = n;
+      s->name = n->ent[i].name.s;
+      s->q = -1;
+      n->ent[i].dir = s;
+      subs++;
+    }
+  if (f != NULL)
+    free(f);
+
+  WLOCK(w);
+  /* keep it open for openat() while its subdirectories are read */
+  if (subs && w->nfds < WALKFDS) {
+    n->d = d;
+    n->subs = subs;
+    w->nfds++;
+    d = NULL;
+  }
+  /* queued newest last, so that the first is taken first */
+  for (i = n->nent; q != NULL && i-- > 0; )
+    if (n->ent[i].dir != NULL && !wpush(q, n->ent[i].dir, (int)(q - w->q)))
+      n->err = ZE_MEM;
+#ifndef NO_WALK_THREADS
+  if (q != NULL && subs)
+    pthread_cond_broadcast(&w->work);
+#endif
+  WUNLOCK(w);
+  if (d != NULL)
+    closedir(d);
+}
+
+
+/* Wait until directory n is read, reading it here if nobody has started. */
+local void wready(w, n)
+  struct walk *w;
+  struct wdir *n;
+{
+  struct wqueue *q;
+
+  WLOCK(w);
+  if (n->state == W_NEW) {
+    n->state = W_BUSY;
+    if (n->q >= 0)
+      w->q[n->q].slot[n->qi & (w->q[n->q].cap - 1)] = NULL;
+    n->q = -1;
+    q = w->nq ? &w->q[w->rr++ % w->nq] : NULL;
+    WUNLOCK(w);
+    wread(w, n, q);
+    WLOCK(w);
+    n->state = W_DONE;
+    w->ahead += (long)n->nent;
+  }
+#ifndef NO_WALK_THREADS
+  while (n->state != W_DONE)
+    pthread_cond_wait(&w->done, &w->lock);
+#endif
+  WUNLOCK(w);
+  n->ready = 1;
+}
+
+
+/* Free n and everything below it that has not been returned. */
+local void wfree(w, n)
+  struct walk *w;
+  struct wdir *n;
+{
+  extent i;
+
+  for (i = 0; i < n->nent; i++)
+    if (n->ent[i].dir != NULL)
+      wfree(w, n->ent[i].dir);
+  if (n->d != NULL) {
+    closedir(n->d);
+    w->nfds--;
+  }
+  if (n->heap != NULL)
+    free(n->heap);
+  if (n->ent != NULL)
+    free(n->ent);
+  free(n);
+}
+
+
+#ifndef NO_WALK_THREADS
+
+/* Next directory for reader q:  its own newest, or another's oldest. */
+local struct wdir *wtake(w, q)
+  struct walk *w;
+  struct wqueue *q;
+{
+  struct wqueue *o;
+  struct wdir *n;
+  int i;
+
+  while (q->hi > q->lo)
+    if ((n = q->slot[--q->hi & (q->cap - 1)]) != NULL)
+      return n;
+  for (i = 1; i < w->nq; i++) {
+    o = &w->q[(q->i + i) % w->nq];
+    while (o->hi > o->lo)
+      if ((n = o->slot[o->lo++ & (o->cap - 1)]) != NULL)
+        return n;
+  }
+  return NULL;
+}
+
+
+/* Reader thread:  read directories until the walk ends. */
+local void *wreader(arg)
+  void *arg;
+{
+  struct wqueue *q = (struct wqueue *)arg;
+  struct walk *w = q->w;
+  struct wdir *n = NULL;
+
+  pthread_mutex_lock(&w->lock);
+  for (;;) {
+    while (!w->stop && (w->ahead >= WALKAHEAD || (n = wtake(w, q)) == NULL))
+      pthread_cond_wait(&w->work, &w->lock);
+    if (w->stop)
+      break;
+    n->state = W_BUSY;
+    n->q = -1;
+    pthread_mutex_unlock(&w->lock);
+    wread(w, n, q);
+    pthread_mutex_lock(&w->lock);
+    n->state = W_DONE;
+    w->ahead += (long)n->nent;
+    pthread_cond_signal(&w->done);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+
+/* Start the readers and give them the subdirectories of the top. */
+local void wthreads(w)
+  struct walk *w;
+{
+  sigset_t all, old;
+  extent i;
+  int k;
+
+  k = walk_threads;
+  if (k < 0) {
+    k = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (k > 8)
+      k = 8;
+  }
+  if (k > WALKMAX)
+    k = WALKMAX;
+  if (k <= 0 || (w->q = (struct wqueue *)calloc(k, sizeof(struct wqueue))) == NULL)
+    return;
+
+  /* signals stay with the main thread; the readers wait for the lock
+     until they have been counted and given work */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  pthread_mutex_lock(&w->lock);
+  for (w->nq = 0; w->nq < k; w->nq++) {
+    w->q[w->nq].w = w;
+    w->q[w->nq].i = w->nq;
+    if (pthread_create(&w->q[w->nq].thread, NULL, wreader, &w->q[w->nq]))
+      break;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (w->nq == 0) {
+    pthread_mutex_unlock(&w->lock);
+    free(w->q);
+    w->q = NULL;
+    return;
+  }
+
+  for (i = w->top->nent; i-- > 0; )
+    if (w->top->ent[i].dir != NULL) {
+      if (!wpush(&w->q[w->rr % w->nq], w->top->ent[i].dir, (int)(w->rr % w->nq)))
+        break;
+      w->rr++;
+    }
+  pthread_cond_broadcast(&w->work);
+  pthread_mutex_unlock(&w->lock);
+}
+
+#endif /* !NO_WALK_THREADS */
+
+
+/* Start walking the tree below directory n.  The names returned begin
+   with prefix p.  Return NULL if out of memory. */
+walk *walk_start(n, p, f, cs)
+  char *n;              /* directory, as it can be opened */
+  ZCONST char *p;       /* the name it is known by, with a trailing '/' */
+  ZCONST char *f;       /* the name filter() knows it by, NULL not to prune */
+  int cs;               /* case flag for filter() */
+{
+  walk *w;
+#ifndef NO_WALK_THREADS
+  extent i;
+#endif
+
+  if ((w = (walk *)calloc(1, sizeof(walk))) == NULL)
+    return NULL;
+  w->pathsz = strlen(p) + 256;
+  if ((w->top = (struct wdir *)calloc(1, sizeof(struct wdir))) == NULL ||
+      (w->path = malloc(w->pathsz)) == NULL) {
+    if (w->top != NULL)
+      free(w->top);
+    free(w);
+    return NULL;
+  }
+  strcpy(w->path, p);
+  w->top->name = n;
+  w->top->plen = strlen(p);
+  w->top->q = -1;
+  w->cur = w->top;
+  w->f = f;
+  w->cs = cs;
+#ifndef NO_WALK_THREADS
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->work, NULL);
+  pthread_cond_init(&w->done, NULL);
+#endif
+
+  /* the top is read here; the threads start only if there is more */
+  wready(w, w->top);
+#ifndef NO_WALK_THREADS
+  for (i = 0; i < w->top->nent && w->top->ent[i].dir == NULL; i++)
+    ;
+  if (i < w->top->nent && walk_threads)
+    wthreads(w);
+#endif
+  return w;
+}
+
+
+/* Return the next name below the top, or NULL at the end.  The name is
+   good until the next call.  *m is set to its S_IFMT type, or to 0 if
+   that is not known, plus WALK_PRUNED for a directory whose contents
+   filter_prune() has left out. */
+char *walk_next(w, m)
+  walk *w;
+  unsigned *m;
+{
+  struct wdir *n;
+  struct went *e;
+  extent len;
+  char *p;
+
+  while ((n = w->cur) != NULL) {
+    if (!n->ready)
+      wready(w, n);
+    if (n->err) {
+      w->err = n->err;
+      return NULL;
+    }
+    if (n->pos == n->nent) {
+      /* all returned:  let the readers move on */
+      WLOCK(w);
+      w->ahead -= (long)n->nent;
+#ifndef NO_WALK_THREADS
+      if (w->nq && w->ahead < WALKAHEAD && w->ahead + (long)n->nent >= WALKAHEAD)
+        pthread_cond_broadcast(&w->work);
+#endif
+      w->cur = n->up;
+      if (n->up != NULL)
+        n->up->ent[n->up->pos - 1].dir = NULL;
+      else
+        w->top = NULL;
+      wfree(w, n);
+      WUNLOCK(w);
+      continue;
+    }
+
+    e = &n->ent[n->pos++];
+    len = strlen(e->name.s);
+    if (n->plen + len + 2 > w->pathsz) {
+      if ((p = realloc(w->path, n->plen + len + 256)) == NULL) {
+        w->err = ZE_MEM;
+        return NULL;
+      }
+      w->path = p;
+      w->pathsz = n->plen + len + 256;
+    }
+    memcpy(w->path + n->plen, e->name.s, len + 1);
+    if (S_ISDIR(e->mode))
+      strcpy(w->path + n->plen + len, "/");
+    if (e->dir != NULL) {
+      /* its contents follow */
+      e->dir->plen = n->plen + len + 1;
+      w->cur = e->dir;
+    }
+    *m = e->mode;
+    return w->path;
+  }
+  return NULL;
+}
+
+
+/* Stop the walk and free it.  Return ZE_MEM if a listing could not be
+   stored, else ZE_OK. */
+int walk_end(w)
+  walk *w;
+{
+  int r = w->err;
+#ifndef NO_WALK_THREADS
+  int i;
+
+  if (w->nq) {
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_broadcast(&w->work);
+    pthread_mutex_unlock(&w->lock);
+    for (i = 0; i < w->nq; i++)
+      pthread_join(w->q[i].thread, NULL);
+  }
+#endif
+  if (w->top != NULL)
+    wfree(w, w->top);
+#ifndef NO_WALK_THREADS
+  for (i = 0; i < w->nq; i++)
+    if (w->q[i].slot != NULL)
+      free(w->q[i].slot);
+  if (w->q != NULL)
+    free(w->q);
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->work);
+  pthread_cond_destroy(&w->done);
+#endif
+  free(w->path);
+  free(w);
+  return r;
+}
+
+#endif /* UNIX && !UTIL */
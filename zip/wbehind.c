@@ -0,0 +1,385 @@
+/*
+  wbehind.c - Zip 3
+
+  Copyright (c) 1990-2008 Info-ZIP.  All rights reserved.
+
+  See the accompanying file LICENSE, version 2007-Mar-4 or later
+  (the contents of which are also included in zip.h) for terms of use.
+  If, for some reason, all these files are missing, the Info-ZIP license
+  also may be found at:  ftp://ftp.info-zip.org/pub/infozip/license.html
+*/
+/*---------------------------------------------------------------------------
+
+  wbehind.c
+
+  Write-behind for the output archive.  The archive is still written
+  through the stdio stream y, so bfwrite(), the seek-back local header
+  rewrite in zipup() and the split code are unchanged, but the stream is
+  backed by a ring of large buffers that a writer thread empties while
+  the compressor fills the next one.
+
+  Every buffer remembers the file offset it starts at.  On a seekable
+  output the writer uses pwrite(), so a seek only closes the current
+  buffer and starts a new one at the new offset; the ring is never
+  drained just to rewrite a local header.  Buffers are written in the
+  order they were filled, so a later rewrite always lands on top of the
+  data it replaces.  Pipes (and O_APPEND descriptors, which cannot be
+  rewritten in place) are written sequentially and report ESPIPE on
+  seeks, exactly like a plain stdio stream on a pipe.  A pipe is grown
+  to hold a whole buffer where the system allows it, so that the writer
+  hands over one buffer per write() and a reader that keeps up never
+  makes it wait for room.
+
+  A failed write is remembered and returned by the next write, seek or
+  the final fclose(), so ferror(y) and the fclose(y) checks in zip.c
+  still see it.
+
+  Contains:  wb_open()
+
+  ---------------------------------------------------------------------------*/
+
+#define __WBEHIND_C     /* identifies this source module */
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE   /* for fopencookie() */
+#endif
+
+#include "zip.h"
+
+#ifndef NO_WRITE_BEHIND
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef WBSZ
+#  define WBSZ 0x100000L  /* size of one write-behind buffer */
+#endif
+#ifndef WBCNT
+#  define WBCNT 8         /* number of buffers in the ring */
+#endif
+
+struct wbuf {
+  char *buf;              /* WBSZ bytes */
+  size_t len;             /* bytes filled */
+  zoff_t off;             /* file offset of buf[0] */
+};
+
+struct wbstream {
+  int fd;                 /* output descriptor, closed with the stream */
+  int seekable;           /* 1 = use pwrite() at each buffer's offset */
+  zoff_t pos;             /* logical file position seen by stdio */
+  struct wbuf ring[WBCNT];
+  unsigned head;          /* buffer being filled (owned by producer) */
+  unsigned tail;          /* next buffer to write (owned by writer) */
+  unsigned queued;        /* buffers handed to the writer */
+  int err;                /* errno of first failed write, 0 if none */
+  int stop;               /* set by close to end the writer */
+  pthread_mutex_t lock;
+  pthread_cond_t ready;   /* signalled when a buffer is queued */
+  pthread_cond_t done;    /* signalled when a buffer has been written */
+  pthread_t thread;
+};
+
+local void *wb_writer OF((void *));
+local int wb_submit OF((struct wbstream *));
+local int wb_drain OF((struct wbstream *));
+local ssize_t wb_write OF((void *, const char *, size_t));
+local int wb_seek OF((void *, off64_t *, int));
+local int wb_close OF((void *));
+local void wb_stop OF((struct wbstream *));
+local void wb_free OF((struct wbstream *));
+
+
+/* Writer thread: write queued buffers in order until told to stop. */
+local void *wb_writer(arg)
+  void *arg;
+{
+  struct wbstream *w = (struct wbstream *)arg;
+  struct wbuf *b;
+  size_t n;
+  ssize_t r;
+  int err = 0;
+
+  pthread_mutex_lock(&w->lock);
+  for (;;) {
+    while (w->queued == 0 && !w->stop)
+      pthread_cond_wait(&w->ready, &w->lock);
+    if (w->queued == 0)
+      break;
+    b = &w->ring[w->tail];
+    pthread_mutex_unlock(&w->lock);
+
+    for (n = 0; n < b->len && !err; n += (size_t)r) {
+      if (w->seekable)
+        r = pwrite(w->fd, b->buf + n, b->len - n, (off_t)(b->off + n));
+      else
+        r = write(w->fd, b->buf + n, b->len - n);
+      if (r < 0) {
+        if (errno == EINTR) {
+          r = 0;
+          continue;
+        }
+        err = errno;
+      } else if (r == 0) {
+        err = ENOSPC;
+      }
+    }
+
+    pthread_mutex_lock(&w->lock);
+    if (err && !w->err)
+      w->err = err;
+    b->len = 0;
+    w->tail = (w->tail + 1) % WBCNT;
+    w->queued--;
+    pthread_cond_signal(&w->done);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+
+/* Hand the buffer being filled to the writer and wait for a free one. */
+local int wb_submit(w)
+  struct wbstream *w;
+{
+  if (w->ring[w->head].len == 0)
+    return 0;
+  pthread_mutex_lock(&w->lock);
+  w->queued++;
+  w->head = (w->head + 1) % WBCNT;
+  pthread_cond_signal(&w->ready);
+  while (w->queued == WBCNT)
+    pthread_cond_wait(&w->done, &w->lock);
+  pthread_mutex_unlock(&w->lock);
+  w->ring[w->head].off = w->pos;
+  return 0;
+}
+
+
+/* Wait until everything handed to the stream is on the descriptor. */
+local int wb_drain(w)
+  struct wbstream *w;
+{
+  wb_submit(w);
+  pthread_mutex_lock(&w->lock);
+  while (w->queued)
+    pthread_cond_wait(&w->done, &w->lock);
+  pthread_mutex_unlock(&w->lock);
+  if (w->err) {
+    errno = w->err;
+    return -1;
+  }
+  return 0;
+}
+
+
+local ssize_t wb_write(cookie, buf, size)
+  void *cookie;
+  const char *buf;
+  size_t size;
+{
+  struct wbstream *w = (struct wbstream *)cookie;
+  struct wbuf *b;
+  size_t left = size;
+  size_t n;
+
+  if (w->err) {
+    errno = w->err;
+    return 0;           /* stdio wants 0, not -1, for a failed write */
+  }
+  while (left) {
+    b = &w->ring[w->head];
+    if (b->len == 0)
+      b->off = w->pos;
+    n = WBSZ - b->len;
+    if (n > left)
+      n = left;
+    memcpy(b->buf + b->len, buf, n);
+    b->len += n;
+    w->pos += n;
+    buf += n;
+    left -= n;
+    if (b->len == WBSZ)
+      wb_submit(w);
+  }
+  return (ssize_t)size;
+}
+
+
+local int wb_seek(cookie, offset, whence)
+  void *cookie;
+  off64_t *offset;
+  int whence;
+{
+  struct wbstream *w = (struct wbstream *)cookie;
+  zoff_t to;
+  off_t end;
+
+  if (!w->seekable) {
+    errno = ESPIPE;
+    return -1;
+  }
+  if (w->err) {
+    errno = w->err;
+    return -1;
+  }
+  switch (whence) {
+    case SEEK_SET:
+      to = (zoff_t)*offset;
+      break;
+    case SEEK_CUR:
+      to = w->pos + (zoff_t)*offset;
+      break;
+    case SEEK_END:
+      /* only the descriptor knows the end, so catch it up first */
+      if (wb_drain(w) || (end = lseek(w->fd, 0, SEEK_END)) == (off_t)-1)
+        return -1;
+      to = (zoff_t)end + (zoff_t)*offset;
+      break;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+  if (to < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (to != w->pos) {
+    /* the filled part stays queued at its own offset */
+    wb_submit(w);
+    w->pos = to;
+    w->ring[w->head].off = to;
+  }
+  *offset = (off64_t)to;
+  return 0;
+}
+
+
+local int wb_close(cookie)
+  void *cookie;
+{
+  struct wbstream *w = (struct wbstream *)cookie;
+  int r;
+  int e;
+
+  r = wb_drain(w);
+  e = errno;
+  wb_stop(w);
+  if (close(w->fd) && r == 0) {
+    r = -1;
+    e = errno;
+  }
+  wb_free(w);
+  errno = e;
+  return r;
+}
+
+
+/* End the writer thread once the ring is empty. */
+local void wb_stop(w)
+  struct wbstream *w;
+{
+  pthread_mutex_lock(&w->lock);
+  w->stop = 1;
+  pthread_cond_signal(&w->ready);
+  pthread_mutex_unlock(&w->lock);
+  pthread_join(w->thread, NULL);
+}
+
+
+local void wb_free(w)
+  struct wbstream *w;
+{
+  int i;
+
+  for (i = 0; i < WBCNT; i++)
+    if (w->ring[i].buf != NULL)
+      free(w->ring[i].buf);
+  pthread_cond_destroy(&w->done);
+  pthread_cond_destroy(&w->ready);
+  pthread_mutex_destroy(&w->lock);
+  free(w);
+}
+
+
+/* wb_open
+ *
+ * Return a stdio stream that writes fd through the write-behind ring, or
+ * NULL if write-behind is turned off (-wb-) or cannot be set up, in which
+ * case fd is left open and the caller opens it the usual way.  Closing the
+ * stream closes fd.
+ */
+FILE *wb_open(fd, mode)
+  int fd;
+  ZCONST char *mode;
+{
+  struct wbstream *w;
+  cookie_io_functions_t io;
+  sigset_t all, old;
+  FILE *f;
+  off_t here;
+#ifdef F_SETPIPE_SZ
+  struct stat st;
+#endif
+  int fl;
+  int i;
+
+#ifdef F_SETPIPE_SZ
+  /* zip - | ...: done even with -wb-, as stdio's writes also block less */
+  if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+    fcntl(fd, F_SETPIPE_SZ, (int)WBSZ);
+#endif
+
+  /* -sp asks for the next disk when a write comes up short, so it needs
+     every write to finish before bfwrite() returns */
+  if (!write_behind || split_method == 2)
+    return NULL;
+  if ((w = (struct wbstream *)calloc(1, sizeof(struct wbstream))) == NULL)
+    return NULL;
+  for (i = 0; i < WBCNT; i++) {
+    if ((w->ring[i].buf = (char *)malloc(WBSZ)) == NULL) {
+      for (; i >= 0; i--)
+        if (w->ring[i].buf != NULL)
+          free(w->ring[i].buf);
+      free(w);
+      return NULL;
+    }
+  }
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->ready, NULL);
+  pthread_cond_init(&w->done, NULL);
+
+  w->fd = fd;
+  here = lseek(fd, 0, SEEK_CUR);
+  fl = fcntl(fd, F_GETFL);
+  w->seekable = here != (off_t)-1 && fl != -1 && !(fl & O_APPEND);
+  w->pos = here == (off_t)-1 ? 0 : (zoff_t)here;
+  w->ring[0].off = w->pos;
+
+  /* signal handlers (ziperr() on ^C) must run on the main thread */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  i = pthread_create(&w->thread, NULL, wb_writer, w);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (i != 0) {
+    wb_free(w);
+    return NULL;
+  }
+
+  io.read = NULL;
+  io.write = wb_write;
+  io.seek = wb_seek;
+  io.close = wb_close;
+  if ((f = fopencookie(w, mode, io)) == NULL) {
+    wb_stop(w);
+    wb_free(w);
+    return NULL;
+  }
+  return f;
+}
+
+#endif /* !NO_WRITE_BEHIND */
@@ -99,6 +99,7 @@ static inline void zip_write_stream(FILE* stream, const char* text, size_t len,
 #define FRESHEN 3
 #define ARCHIVE 4
 local int action = ADD; /* one of ADD, UPDATE, FRESHEN, DELETE, or ARCHIVE */
+local int bad_open_is_error = 0; /* if read fails, 0=warning, 1=error */
 local int comadd = 0;   /* 1=add comments for new files */
 local int zipedit = 0;  /* 1=edit zip comment and all file comments */
 local int latest = 0;   /* 1=set zip file time to time of latest file */
@@ -152,6 +153,14 @@ local long add_name OF((char *filearg));
 local int DisplayRunningStats OF((void));
 local int BlankRunningStats OF((void));
 
+/* adding the found list, and with --stream-add each name as it is found */
+local void scan_name OF((char *n));
+local void scan_names OF((int stdin_names));
+local int zipup_found OF((struct flist far *f, struct zlist far **zp));
+local struct zlist far **ztail; /* where the next new entry goes */
+local z_stat stream_out;        /* the output, not to be added to itself */
+local int stream_bad = 0;       /* a name found could not be read */
+
 local void version_info OF((void));
 local void zipstdout OF((void));
 local int check_unzip_version OF((char *unzippath));
@@ -176,8 +185,8 @@ struct filelist_struct *filelist = NULL;  /* start of list */
 struct filelist_struct *lastfile = NULL;  /* last file in list */
 
 local void freeup()
-/* Free all allocations in the 'found' list, the 'zfiles' list and
-   the 'patterns' list. */
+/* Free all allocations in the 'found' list, the 'zfiles' list (with the
+   arena their entries were taken from) and the 'patterns' list. */
 {
   struct flist far *f;  /* steps through found list */
   struct zlist far *z;  /* pointer to next entry in zfiles list */
@@ -188,31 +197,33 @@ local void freeup()
   {
     z = zfiles->nxt;
     if (zfiles->zname && zfiles->zname != zfiles->name)
-      free((zvoid *)(zfiles->zname));
+      arena_free((zvoid *)(zfiles->zname));
     if (zfiles->name)
-      free((zvoid *)(zfiles->name));
+      arena_free((zvoid *)(zfiles->name));
     if (zfiles->iname)
-      free((zvoid *)(zfiles->iname));
+      arena_free((zvoid *)(zfiles->iname));
     if (zfiles->cext && zfiles->cextra && zfiles->cextra != zfiles->extra)
-      free((zvoid *)(zfiles->cextra));
+      arena_free((zvoid *)(zfiles->cextra));
     if (zfiles->ext && zfiles->extra)
-      free((zvoid *)(zfiles->extra));
+      arena_free((zvoid *)(zfiles->extra));
     if (zfiles->com && zfiles->comment)
-      free((zvoid *)(zfiles->comment));
+      arena_free((zvoid *)(zfiles->comment));
     if (zfiles->oname)
-      free((zvoid *)(zfiles->oname));
+      arena_free((zvoid *)(zfiles->oname));
 #ifdef UNICODE_SUPPORT
     if (zfiles->uname)
-      free((zvoid *)(zfiles->uname));
+      arena_free((zvoid *)(zfiles->uname));
     if (zfiles->zuname)
-      free((zvoid *)(zfiles->zuname));
+      arena_free((zvoid *)(zfiles->zuname));
     if (zfiles->ouname)
-      free((zvoid *)(zfiles->ouname));
+      arena_free((zvoid *)(zfiles->ouname));
 #endif
-    farfree((zvoid far *)zfiles);
+    arena_free((zvoid *)zfiles);
     zfiles = z;
     zcount--;
   }
+  /* what the lists left in the arena goes in one piece */
+  arena_release();
 
   if (patterns != NULL) {
     while (pcount-- > 0) {
@@ -222,6 +233,8 @@ local void freeup()
     free((zvoid *)patterns);
     patterns = NULL;
   }
+  filter_free();
+  zhash_free();
 
   /* close logfile */
   if (logfile) {
@@ -712,6 +725,7 @@ local void help_extended()
 "  -x pattern pattern ...   exclude files that match a pattern",
 "  Patterns are paths with optional wildcards and match paths as stored in",
 "  archive.  Exclude and include lists end at next option, @, or end of line.",
+"  With -r, directories whose contents the patterns exclude are not read.",
 "    zip -x pattern pattern @ zipfile path path ...",
 "",
 "Case matching:",
@@ -736,6 +750,12 @@ local void help_extended()
 "  Use -i and -x with either to include or exclude paths",
 "  Path root in archive starts at current dir, so if /a/b/c/file and",
 "   current dir is /a/b, 'zip -r archive .' puts c/file in archive",
+"  Each directory's names are taken in sorted order; --readdir-order keeps",
+"   the order the system lists them in",
+"  -wt n     read directories with n threads (default: one per CPU, up to 8;",
+"             0 reads them in the main thread)",
+"  --stream-add  zip new files as they are found, not once all are found",
+"             (new archives only); names from -@ are read while zipping",
 "",
 "Date filtering:",
 "  -t date   exclude before (include files modified on this date and later)",
@@ -826,6 +846,14 @@ local void help_extended()
 "  from stopping unexpectedly on unfed pipe, use -FI to enable:",
 "    zip -FI archive fifo",
 "",
+"  The archive is written by a background thread so compression and output",
+"  I/O overlap (also to pipes).  Use -wb- to write it from the main thread.",
+"",
+"  -ni writes an index of member names ahead of the central directory, so",
+"  that unzip can find named members of a huge archive without reading the",
+"  whole directory.  Other unzips ignore it.  Updates keep an existing index",
+"  unless -ni- is given.",
+"",
 "Dots, counts:",
 "  -db       display running count of bytes processed and bytes to go",
 "              (uncompressed size, except delete and copy show stored size)",
@@ -1645,6 +1673,304 @@ local int BlankRunningStats()
   return 0;
 }
 
+
+/* Add found entry f to the zip file, taking its names for a new zfiles
+   entry after ztail.  Return ZE_OK, or ZE_OPEN or ZE_MISS if it could not
+   be read; other errors end zip.  *zp is set to the new entry, or to NULL
+   if there is none. */
+local int zipup_found(f, zp)
+  struct flist far *f;
+  struct zlist far **zp;
+{
+  struct zlist far *z;  /* the entry made of f */
+  uzoff_t len;
+  int r;
+
+  /* add a new zfiles entry and set the name */
+  if ((z = (struct zlist far *)arena_alloc(sizeof(struct zlist), 1)) == NULL) {
+    ZIPERR(ZE_MEM, "was adding files to zip file");
+  }
+  z->nxt = NULL;
+  z->name = f->name;
+  f->name = NULL;
+#ifdef UNICODE_SUPPORT
+  z->uname = NULL;          /* UTF-8 name for extra field */
+  z->zuname = NULL;         /* externalized UTF-8 name for matching */
+  z->ouname = NULL;         /* display version of UTF-8 name with OEM */
+
+#if 0
+  /* New AppNote bit 11 allowing storing UTF-8 in path */
+  if (utf8_force && f->uname) {
+    if (f->iname)
+      arena_free(f->iname);
+    if ((f->iname = malloc(strlen(f->uname) + 1)) == NULL)
+      ZIPERR(ZE_MEM, "Unicode bit 11");
+    strcpy(f->iname, f->uname);
+  }
+#endif
+
+  /* Only set z->uname if have a non-ASCII Unicode name */
+  /* The Unicode path extra field is created if z->uname is not NULL,
+     unless on a UTF-8 system, then instead of creating the extra field
+     set bit 11 in the General Purpose Bit Flag */
+  {
+    int is_ascii = 0;
+
+    is_ascii = is_ascii_string(f->uname);
+
+    if (z->uname == NULL) {
+      if (!is_ascii)
+        z->uname = f->uname;
+      else
+        arena_free(f->uname);
+    } else {
+      arena_free(f->uname);
+    }
+  }
+  f->uname = NULL;
+
+#endif
+  z->iname = f->iname;
+  f->iname = NULL;
+  z->zname = f->zname;
+  f->zname = NULL;
+  z->oname = f->oname;
+  f->oname = NULL;
+  z->ext = z->cext = z->com = 0;
+  z->extra = z->cextra = NULL;
+  z->mark = 1;
+  z->dosflag = f->dosflag;
+  z->info = f->info;
+  /* zip it up */
+  DisplayRunningStats();
+  if (noisy)
+  {
+    fprintf(mesg, "  adding: %s", z->oname);
+    mesg_line_started = 1;
+    fflush(mesg);
+  }
+  if (logall)
+  {
+    fprintf(logfile, "  adding: %s", z->oname);
+    logfile_line_started = 1;
+    fflush(logfile);
+  }
+  /* initial scan */
+  len = f->usize;
+  if ((r = zipup(z)) != ZE_OK  && r != ZE_OPEN && r != ZE_MISS)
+  {
+    zipmessage_nl("", 1);
+    /*
+    if (noisy)
+    {
+#if (!defined(MACOS) && !defined(WINDLL))
+      putc('\n', mesg);
+      fflush(mesg);
+#else
+      fprintf(stdout, "\n");
+#endif
+      mesg_line_started = 0;
+      fflush(mesg);
+    }
+    if (logall) {
+      fprintf(logfile, "\n");
+      logfile_line_started = 0;
+      fflush(logfile);
+    }
+    */
+    sprintf(errbuf, "was zipping %s", z->oname);
+    ZIPERR(r, errbuf);
+  }
+  if (r == ZE_OPEN || r == ZE_MISS)
+  {
+    zipmessage_nl("", 1);
+    /*
+    if (noisy)
+    {
+#if (!defined(MACOS) && !defined(WINDLL))
+      putc('\n', mesg);
+      fflush(mesg);
+#else
+      fprintf(stdout, "\n");
+#endif
+      mesg_line_started = 0;
+      fflush(mesg);
+    }
+    if (logall) {
+      fprintf(logfile, "\n");
+      logfile_line_started = 0;
+      fflush(logfile);
+    }
+    */
+    if (r == ZE_OPEN) {
+      perror("zip warning");
+      if (logfile)
+        fprintf(logfile, "zip warning: %s\n", strerror(errno));
+      zipwarn("could not open for reading: ", z->oname);
+      if (bad_open_is_error) {
+        sprintf(errbuf, "was zipping %s", z->name);
+        ZIPERR(r, errbuf);
+      }
+    } else {
+      zipwarn("file and directory with the same name: ", z->oname);
+    }
+    files_so_far++;
+    bytes_so_far += len;
+    bad_files_so_far++;
+    bad_bytes_so_far += len;
+    if (stream_add) {
+      /* stream_found() still checks later names against this one */
+      *zp = z;
+      return r;
+    }
+    arena_free((zvoid *)(z->name));
+    arena_free((zvoid *)(z->iname));
+    arena_free((zvoid *)(z->zname));
+    arena_free(z->oname);
+#ifdef UNICODE_SUPPORT
+    if (z->uname)
+      arena_free(z->uname);
+#endif
+    arena_free((zvoid *)z);
+    *zp = NULL;
+    return r;
+  }
+  else
+  {
+    files_so_far++;
+    /* current size of file (just before reading) */
+    good_bytes_so_far += z->len;
+    /* size of file on initial scan */
+    bytes_so_far += len;
+    *ztail = z;
+    ztail = &z->nxt;
+    zcount++;
+  }
+  *zp = z;
+  return ZE_OK;
+}
+
+
+/* stream_found
+ *
+ * With --stream-add, newname() hands each name it adds to the found list
+ * here.  The checks that main() makes of the whole list before zipping
+ * anything (duplicates, names that vanished, -t and -tt, the zip file
+ * itself) are made of this one entry, and it is zipped at once and taken
+ * off the list.  Return an error code in the ZE_ class.
+ */
+int stream_found(f)
+  struct flist far *f;
+{
+  struct zlist far *z;
+  uzoff_t usize;
+  ulg tf = 0;
+  int seen, r;
+
+  if ((r = dup_found(f, &seen)) != ZE_OK) {
+    ZIPERR(r, "cannot repeat names in zip file");
+  }
+  if (!seen)
+    tf = fileinfo(f->name, &f->info, (ulg *)NULL, (zoff_t *)&usize, NULL);
+  if (tf == 0 || tf < before || (after && tf >= after) ||
+      (namecmp(f->zname, zipfile) == 0 && !zip_to_stdout) ||
+      (stream_out.st_mode && (uzoff_t)stream_out.st_dev == f->info.dev &&
+       (uzoff_t)stream_out.st_ino == f->info.ino)) {
+    fexpel(f);
+    return ZE_OK;
+  }
+  files_total++;
+  f->usize = 0;
+  if (usize != (uzoff_t) -1 && usize != (uzoff_t) -2) {
+    bytes_total += usize;
+    f->usize = usize;
+  }
+  if (zipup_found(f, &z) != ZE_OK)
+    stream_bad = 1;
+  fexpel(f);
+  if (z != NULL && (r = dup_add(z)) != ZE_OK) {
+    ZIPERR(r, "was adding files to zip file");
+  }
+  return ZE_OK;
+}
+
+/* Find what name n on the command line (or read with -@) stands for:  the
+   files, or with -U the archive entries. */
+local void scan_name(n)
+  char *n;
+{
+  int r;
+
+  if (action == ARCHIVE) {
+    /* find in archive */
+    if ((r = proc_archive_name(n, filter_match_case)) != ZE_OK) {
+      if (r == ZE_MISS)
+        zipwarn("not in archive: ", n);
+      else {
+        ZIPERR(r, n);
+      }
+    }
+  }
+  /* try find matching files on OS first then try find entries in archive */
+  else if ((r = PROCNAME(n)) != ZE_OK) {
+    if (r == ZE_MISS) {
+      zipwarn("name not matched: ", n);
+      if (bad_open_is_error) {
+        ZIPERR(ZE_OPEN, n);
+      }
+    } else {
+      ZIPERR(r, n);
+    }
+  }
+}
+
+
+/* Scan the names given:  those to read from stdin first if -@ left them
+   for now, then the file arguments, and with -R the current directory. */
+local void scan_names(stdin_names)
+  int stdin_names;
+{
+  struct filelist_struct *filearg;
+  char *pp;
+  int r;
+
+  if ((filelist || stdin_names) && show_what_doing) {
+    fprintf(mesg, action == ARCHIVE ? "sd: Scanning archive entries\n" :
+                                      "sd: Scanning files\n");
+    fflush(mesg);
+  }
+  if (stdin_names)
+    while ((pp = getnam(stdin)) != NULL) {
+      scan_name(pp);
+      free(pp);
+    }
+  while (filelist) {
+    scan_name(filelist->name);
+    free(filelist->name);
+    filearg = filelist;
+    filelist = filelist->next;
+    free(filearg);
+  }
+
+  /* recurse from current directory for -R */
+  if (recurse == 2) {
+    if ((r = PROCNAME(".")) != ZE_OK)
+    {
+      if (r == ZE_MISS) {
+        if (bad_open_is_error) {
+          zipwarn("name not matched: ", "current directory for -R");
+          ZIPERR(ZE_OPEN, "-R");
+        } else {
+          zipwarn("name not matched: ", "current directory for -R");
+        }
+      } else {
+        ZIPERR(r, "-R");
+      }
+    }
+  }
+}
+
+
 #if CRYPT
 int encr_passwd(modeflag, pwbuf, size, zfn)
 int modeflag;
@@ -1795,6 +2121,11 @@ int set_filetype(out_path)
 #ifdef UNICODE_TEST
 #define o_sC            0x146
 #endif
+#define o_wb            0x147
+#define o_ni            0x148
+#define o_wt            0x149
+#define o_ro            0x14a
+#define o_sa            0x14b
 
 
 /* the below is mainly from the old main command line
@@ -1859,6 +2190,7 @@ struct option_struct far options[] = {
     {"mm", "",            o_NO_VALUE,       o_NOT_NEGATABLE, o_mm, "not used"},
     {"MM", "must-match",  o_NO_VALUE,       o_NOT_NEGATABLE, o_MM, "error if in file not matched/not readable"},
     {"n",  "suffixes",    o_REQUIRED_VALUE, o_NOT_NEGATABLE, 'n',  "suffixes to not compress: .gz:.zip"},
+    {"ni", "name-index",  o_NO_VALUE,       o_NEGATABLE,     o_ni, "write a name index for fast member lookup"},
     {"nw", "no-wild",     o_NO_VALUE,       o_NOT_NEGATABLE, o_nw, "no wildcards during add or update"},
     {"o",  "latest-time", o_NO_VALUE,       o_NOT_NEGATABLE, 'o',  "use latest entry time as archive time"},
     {"O",  "output-file", o_REQUIRED_VALUE, o_NOT_NEGATABLE, 'O',  "set out zipfile different than in zipfile"},
@@ -1869,6 +2201,7 @@ struct option_struct far options[] = {
 #endif
     {"q",  "quiet",       o_NO_VALUE,       o_NOT_NEGATABLE, 'q',  "quiet"},
     {"r",  "recurse-paths", o_NO_VALUE,     o_NOT_NEGATABLE, 'r',  "recurse down listed paths"},
+    {"",   "readdir-order", o_NO_VALUE,     o_NOT_NEGATABLE, o_ro, "recurse in directory order, not sorted"},
     {"R",  "recurse-patterns", o_NO_VALUE,  o_NOT_NEGATABLE, 'R',  "recurse current dir and match patterns"},
     {"RE", "regex",       o_NO_VALUE,       o_NOT_NEGATABLE, o_RE, "allow [list] matching (regex)"},
     {"s",  "split-size",  o_REQUIRED_VALUE, o_NOT_NEGATABLE, 's',  "do splits, set split size (-s=0 no splits)"},
@@ -1882,6 +2215,7 @@ struct option_struct far options[] = {
     {"sd", "show-debug",  o_NO_VALUE,       o_NOT_NEGATABLE, o_sd, "show debug"},
     {"sf", "show-files",  o_NO_VALUE,       o_NEGATABLE,     o_sf, "show files to operate on and exit"},
     {"so", "show-options",o_NO_VALUE,       o_NOT_NEGATABLE, o_so, "show options"},
+    {"",   "stream-add",  o_NO_VALUE,       o_NOT_NEGATABLE, o_sa, "zip new files as they are found"},
 #ifdef UNICODE_SUPPORT
     {"su", "show-unicode", o_NO_VALUE,      o_NEGATABLE,     o_su, "as -sf but also show escaped Unicode"},
     {"sU", "show-just-unicode", o_NO_VALUE, o_NEGATABLE,     o_sU, "as -sf but only show escaped Unicode"},
@@ -1898,6 +2232,12 @@ struct option_struct far options[] = {
     {"v",  "verbose",     o_NO_VALUE,       o_NOT_NEGATABLE, 'v',  "display additional information"},
     {"",   "version",     o_NO_VALUE,       o_NOT_NEGATABLE, o_ve, "(if no other args) show version information"},
     {"ws", "wild-stop-dirs", o_NO_VALUE,    o_NOT_NEGATABLE, o_ws,  "* stops at /, ** includes any /"},
+#ifdef UNIX
+    {"wt", "walk-threads", o_REQUIRED_VALUE, o_NOT_NEGATABLE, o_wt, "threads reading directories for -r"},
+#endif
+#ifndef NO_WRITE_BEHIND
+    {"wb", "write-behind", o_NO_VALUE,      o_NEGATABLE,     o_wb, "write archive from a background thread"},
+#endif
     {"x",  "exclude",     o_VALUE_LIST,     o_NOT_NEGATABLE, 'x',  "exclude files matching patterns"},
 /*    {"X",  "no-extra",    o_NO_VALUE,       o_NOT_NEGATABLE, 'X',  "no extra"},
 */
@@ -1952,7 +2292,6 @@ char **argv;            /* command line tokens */
   struct zlist far * far *w;    /* pointer to last link in zfiles list */
   FILE *x /*, *y */;    /* input and output zip files (y global) */
   struct zlist far *z;  /* steps through zfiles linked list */
-  int bad_open_is_error = 0; /* if read fails, 0=warning, 1=error */
 #if 0
   /* does not seem used */
 #endif
@@ -1961,8 +2300,8 @@ char **argv;            /* command line tokens */
 #endif /* !VMS && !CMS_MVS */
   FILE *comment_stream; /* set to stderr if anything is read from stdin */
   int all_current;      /* used by File Sync to determine if all entries are current */
-
-  struct filelist_struct *filearg;
+  int stream_want = 0;  /* --stream-add given */
+  int stdin_names = 0;  /* -@ names left to read while zipping */
 
 /* used by get_option */
   unsigned long option; /* option ID returned by get_option */
@@ -1975,7 +2314,6 @@ char **argv;            /* command line tokens */
   int optnum = 0;       /* index in table */
 
   int show_options = 0; /* show options */
-  int show_what_doing = 0; /* show what doing */
   int show_args = 0;    /* show command line */
   int seen_doubledash = 0; /* seen -- argument */
   int key_needed = 0;   /* prompt for encryption key */
@@ -2248,6 +2586,10 @@ char **argv;            /* command line tokens */
 #endif
   filter_match_case = 1;      /* default is to match case when matching archive entries */
   allow_fifo = 0;             /* 1=allow reading Unix FIFOs, waiting if pipe open */
+  write_behind = 1;           /* 1=write output archive from a background thread */
+  walk_threads = -1;          /* threads reading directories, -1 = auto */
+  sort_dirs = 1;              /* 1=return each directory's names sorted */
+  name_index = -1;            /* 1=write a name index, -1=keep the archive's */
 
 #if !defined(MACOS) && !defined(USE_ZIPMAIN)
   retcode = setjmp(zipdll_error_return);
@@ -2835,6 +3177,38 @@ char **argv;            /* command line tokens */
         case o_ws:  /* Wildcards do not include directory boundaries in matches */
           wild_stop_at_dir = 1;
           break;
+        case o_ni:  /* Write a name index before the central directory */
+          if (negated)
+            name_index = 0;
+          else
+            name_index = 1;
+          break;
+#ifdef UNIX
+        case o_wt:  /* Threads reading directories while recursing */
+          if (value[0] < '0' || value[0] > '9' ||
+              (walk_threads = atoi(value)) > 64) {
+            sprintf(errbuf, "option -wt (--walk-threads) takes 0 to 64:  '%s'",
+                    value);
+            free(value);
+            ZIPERR(ZE_PARMS, errbuf);
+          }
+          free(value);
+          break;
+#endif
+        case o_ro:  /* Recurse in the order directories are listed */
+          sort_dirs = 0;
+          break;
+        case o_sa:  /* Zip new files as they are found */
+          stream_want = 1;
+          break;
+#ifndef NO_WRITE_BEHIND
+        case o_wb:  /* Write output archive from a background thread */
+          if (negated)
+            write_behind = 0;
+          else
+            write_behind = 1;
+          break;
+#endif
 
         case 'i':   /* Include only the following files */
           /* if nothing matches include list then still create an empty archive */
@@ -2992,6 +3366,12 @@ char **argv;            /* command line tokens */
                   ZIPERR(ZE_PARMS, "can't use - and -@ together");
                 }
                 */
+                if (stream_want && recurse != 2) {
+                  /* read them as the files are zipped */
+                  stdin_names = 1;
+                  kk = 4;
+                }
+                else
                 while ((pp = getnam(stdin)) != NULL)
                 {
                   kk = 4;
@@ -3301,7 +3681,8 @@ char **argv;            /* command line tokens */
   }
 
   if (action != ARCHIVE && (recurse == 2 || pcount) && first_listarg == 0 &&
-      !filelist && (kk < 3 || (action != UPDATE && action != FRESHEN))) {
+      !filelist && !stdin_names &&
+      (kk < 3 || (action != UPDATE && action != FRESHEN))) {
     ZIPERR(ZE_PARMS, "nothing to select from");
   }
 
@@ -3453,39 +3834,10 @@ char **argv;            /* command line tokens */
 #if defined(UNIX) && !defined(NO_MKSTEMP)
     {
       int yd;
-      int i;
-
-      /* use mkstemp to avoid race condition and compiler warning */
-
-      if (tempath != NULL)
-      {
-        /* if -b used to set temp file dir use that for split temp */
-        if ((tempzip = malloc(strlen(tempath) + 12)) == NULL) {
-          ZIPERR(ZE_MEM, "allocating temp filename");
-        }
-        strcpy(tempzip, tempath);
-        if (lastchar(tempzip) != '/')
-          strcat(tempzip, "/");
-      }
-      else
-      {
-        /* create path by stripping name and appending template */
-        if ((tempzip = malloc(strlen(zipfile) + 12)) == NULL) {
-        ZIPERR(ZE_MEM, "allocating temp filename");
-        }
-        strcpy(tempzip, zipfile);
-        for(i = strlen(tempzip); i > 0; i--) {
-          if (tempzip[i - 1] == '/')
-            break;
-        }
-        tempzip[i] = '\0';
-      }
-      strcat(tempzip, "ziXXXXXX");
 
-      if ((yd = mkstemp(tempzip)) == EOF) {
-        ZIPERR(ZE_TEMP, tempzip);
-      }
-      if ((y = fdopen(yd, FOPW_TMP)) == NULL) {
+      yd = open_tempzip(out_path, test ? TZ_NAMED : 0);
+      if ((y = wb_open(yd, FOPW_TMP)) == NULL &&
+          (y = fdopen(yd, FOPW_TMP)) == NULL) {
         ZIPERR(ZE_TEMP, tempzip);
       }
     }
@@ -3547,8 +3899,10 @@ char **argv;            /* command line tokens */
       ZIPERR(r, tempzip);
     }
     if (fclose(y)) {
+      y = NULL;                 /* closed even so, ziperr() must not again */
       ZIPERR(d ? ZE_WRITE : ZE_TEMP, tempzip);
     }
+    y = NULL;
     if (in_file != NULL) {
       fclose(in_file);
       in_file = NULL;
@@ -3560,7 +3914,12 @@ char **argv;            /* command line tokens */
       diag("replacing old zip file with new zip file");
       if ((r = replace(out_path, tempzip)) != ZE_OK)
       {
-        zipwarn("new zip file left as: ", tempzip);
+        /* anonymous temp file that could not be given a name */
+        if (tempzip_fd != -1)
+          zipwarn("new zip file could not be saved, old one left as: ",
+                  out_path);
+        else
+          zipwarn("new zip file left as: ", tempzip);
         free((zvoid *)tempzip);
         tempzip = NULL;
         ZIPERR(r, "was replacing the original zip file");
@@ -3596,8 +3955,19 @@ char **argv;            /* command line tokens */
 
 
   /* read zipfile if exists */
-  if ((r = readzipfile()) != ZE_OK) {
-    ZIPERR(r, zipfile);
+  {
+    clock_t read_start = clock();
+
+    if ((r = readzipfile()) != ZE_OK) {
+      ZIPERR(r, zipfile);
+    }
+    if (show_what_doing && zcount) {
+      fprintf(mesg, "sd: Read %s entries in %.3f s (%s bytes of central directory in one read)\n",
+              zip_fzofft(zcount, NULL, "u"),
+              (double)(clock() - read_start) / CLOCKS_PER_SEC,
+              zip_fuzofft(cd_bulk_size, NULL, "u"));
+      fflush(mesg);
+    }
   }
 
 #ifndef UTIL
@@ -3645,75 +4015,22 @@ char **argv;            /* command line tokens */
     }
   }
 
-  /* Scan for new files */
-
-  /* Process file arguments from command line */
-  if (filelist) {
-    if (action == ARCHIVE) {
-      /* find in archive */
-      if (show_what_doing) {
-        fprintf(mesg, "sd: Scanning archive entries\n");
-        fflush(mesg);
-      }
-      for (; filelist; ) {
-        if ((r = proc_archive_name(filelist->name, filter_match_case)) != ZE_OK) {
-          if (r == ZE_MISS) {
-            char *n = NULL;
-            n = filelist->name;
-            zipwarn("not in archive: ", n);
-          }
-          else {
-            ZIPERR(r, filelist->name);
-          }
-        }
-        free(filelist->name);
-        filearg = filelist;
-        filelist = filelist->next;
-        free(filearg);
-      }
-    } else {
-      /* try find matching files on OS first then try find entries in archive */
-      if (show_what_doing) {
-        fprintf(mesg, "sd: Scanning files\n");
-        fflush(mesg);
-      }
-      for (; filelist; ) {
-        if ((r = PROCNAME(filelist->name)) != ZE_OK) {
-          if (r == ZE_MISS) {
-            if (bad_open_is_error) {
-              zipwarn("name not matched: ", filelist->name);
-              ZIPERR(ZE_OPEN, filelist->name);
-            } else {
-              zipwarn("name not matched: ", filelist->name);
-            }
-          } else {
-            ZIPERR(r, filelist->name);
-          }
-        }
-        free(filelist->name);
-        filearg = filelist;
-        filelist = filelist->next;
-        free(filearg);
-      }
+  /* With --stream-add a new archive is written as the names are found:
+     the scan is left until the output is open, and newname() hands each
+     new name to stream_found().  Anything that needs the whole list first,
+     or an archive to update, means finding them all first as usual. */
+  if (stream_want && (zfiles != NULL || zipbeg != 0 || action != ADD ||
+                      show_files || diff_mode || filesync || split_method)) {
+    if (show_what_doing) {
+      fprintf(mesg, "sd: Finding all names first (--stream-add needs a new archive)\n");
+      fflush(mesg);
     }
+    stream_want = 0;
   }
 
-  /* recurse from current directory for -R */
-  if (recurse == 2) {
-    if ((r = PROCNAME(".")) != ZE_OK)
-    {
-      if (r == ZE_MISS) {
-        if (bad_open_is_error) {
-          zipwarn("name not matched: ", "current directory for -R");
-          ZIPERR(ZE_OPEN, "-R");
-        } else {
-          zipwarn("name not matched: ", "current directory for -R");
-        }
-      } else {
-        ZIPERR(r, "-R");
-      }
-    }
-  }
+  /* Scan for new files */
+  if (!stream_want)
+    scan_names(stdin_names);
 
 
   if (show_what_doing) {
@@ -3741,8 +4058,7 @@ char **argv;            /* command line tokens */
     }
   }
 
-  if (zcount)
-    free((zvoid *)zsort);
+  zhash_free();
 
 
 /*
@@ -3871,9 +4187,9 @@ char **argv;            /* command line tokens */
 
 
 #ifdef USE_EF_UT_TIME
-        tf = filetime(z->name, (ulg *)NULL, (zoff_t *)&usize, &f_utim);
+        tf = fileinfo(z->name, &z->info, (ulg *)NULL, (zoff_t *)&usize, &f_utim);
 #else /* !USE_EF_UT_TIME */
-        tf = filetime(z->name, (ulg *)NULL, (zoff_t *)&usize, NULL);
+        tf = fileinfo(z->name, &z->info, (ulg *)NULL, (zoff_t *)&usize, NULL);
 #endif /* ?USE_EF_UT_TIME */
         if (tf == 0)
           /* entry that is not on OS */
@@ -3935,6 +4251,8 @@ char **argv;            /* command line tokens */
   /* Remove entries from found list that do not exist or are too old */
   if (show_what_doing) {
     fprintf(mesg, "sd: fcount = %u\n", (unsigned)fcount);
+    fprintf(mesg, "sd: Entry names and lists: %s bytes in the arena\n",
+            zip_fuzofft(arena_bytes(), NULL, "u"));
     fflush(mesg);
   }
 
@@ -3979,7 +4297,7 @@ char **argv;            /* command line tokens */
     }
     tf = 0;
     if (action != DELETE && action != FRESHEN) {
-      tf = filetime(f->name, (ulg *)NULL, (zoff_t *)&usize, NULL);
+      tf = fileinfo(f->name, &f->info, (ulg *)NULL, (zoff_t *)&usize, NULL);
     }
 
     if (action == DELETE || action == FRESHEN ||
@@ -4178,7 +4496,7 @@ char **argv;            /* command line tokens */
   }
 
   /* Make sure there's something left to do */
-  if (k == 0 && found == NULL && !diff_mode &&
+  if (k == 0 && found == NULL && !diff_mode && !stream_want &&
       !(zfiles == NULL && allow_empty_archive) &&
       !(zfiles != NULL &&
         (latest || fix || adjust || junk_sfx || comadd || zipedit))) {
@@ -4267,7 +4585,9 @@ char **argv;            /* command line tokens */
   tempzn = 0;
   if (strcmp(zipfile, "-") == 0)
   {
-    y = stdout;
+    fflush(stdout);
+    if ((y = wb_open(fileno(stdout), FOPW)) == NULL)
+      y = stdout;
     /* tempzip must be malloced so a later free won't barf */
     tempzip = malloc(4);
     if (tempzip == NULL) {
@@ -4320,39 +4640,13 @@ char **argv;            /* command line tokens */
 #if defined(UNIX) && !defined(NO_MKSTEMP)
     {
       int yd;
-      int i;
-
-      /* use mkstemp to avoid race condition and compiler warning */
-
-      if (tempath != NULL)
-      {
-        /* if -b used to set temp file dir use that for split temp */
-        if ((tempzip = malloc(strlen(tempath) + 12)) == NULL) {
-          ZIPERR(ZE_MEM, "allocating temp filename");
-        }
-        strcpy(tempzip, tempath);
-        if (lastchar(tempzip) != '/')
-          strcat(tempzip, "/");
-      }
-      else
-      {
-        /* create path by stripping name and appending template */
-        if ((tempzip = malloc(strlen(zipfile) + 12)) == NULL) {
-        ZIPERR(ZE_MEM, "allocating temp filename");
-        }
-        strcpy(tempzip, zipfile);
-        for(i = strlen(tempzip); i > 0; i--) {
-          if (tempzip[i - 1] == '/')
-            break;
-        }
-        tempzip[i] = '\0';
-      }
-      strcat(tempzip, "ziXXXXXX");
 
-      if ((yd = mkstemp(tempzip)) == EOF) {
-        ZIPERR(ZE_TEMP, tempzip);
-      }
-      if ((y = fdopen(yd, FOPW_TMP)) == NULL) {
+      yd = open_tempzip(out_path, (test ? TZ_NAMED : 0) |
+                           (zfiles == NULL && zipbeg == 0 ? TZ_NEW : 0));
+      if (stream_want && zfstat(yd, &stream_out) != 0)
+        stream_out.st_mode = 0;
+      if ((y = wb_open(yd, FOPW_TMP)) == NULL &&
+          (y = fdopen(yd, FOPW_TMP)) == NULL) {
         ZIPERR(ZE_TEMP, tempzip);
       }
     }
@@ -4722,22 +5016,22 @@ char **argv;            /* command line tokens */
         if (r != ZE_OK && fix == 1) {
           /* remove bad entry from list */
           v = z->nxt;                     /* delete entry from list */
-          free((zvoid *)(z->iname));
-          free((zvoid *)(z->zname));
+          arena_free((zvoid *)(z->iname));
+          arena_free((zvoid *)(z->zname));
           if (z->name != z->zname && z->name != NULL)
-            free((zvoid *)(z->name));
-          free(z->oname);
+            arena_free((zvoid *)(z->name));
+          arena_free(z->oname);
 #ifdef UNICODE_SUPPORT
-          if (z->uname) free(z->uname);
+          if (z->uname) arena_free(z->uname);
 #endif /* def UNICODE_SUPPORT */
           if (z->ext)
             /* don't have local extra until zipcopy reads it */
-            if (z->extra) free((zvoid *)(z->extra));
+            if (z->extra) arena_free((zvoid *)(z->extra));
           if (z->cext && z->cextra != z->extra)
-            free((zvoid *)(z->cextra));
+            arena_free((zvoid *)(z->cextra));
           if (z->com)
-            free((zvoid *)(z->comment));
-          farfree((zvoid far *)z);
+            arena_free((zvoid *)(z->comment));
+          arena_free((zvoid *)z);
           *w = v;
           zcount--;
         } else {
@@ -4775,22 +5069,22 @@ char **argv;            /* command line tokens */
         bytes_so_far += z->siz;
 
         v = z->nxt;                     /* delete entry from list */
-        free((zvoid *)(z->iname));
-        free((zvoid *)(z->zname));
+        arena_free((zvoid *)(z->iname));
+        arena_free((zvoid *)(z->zname));
         if (z->name != z->zname && z->name != NULL)
-          free((zvoid *)(z->name));
-        free(z->oname);
+          arena_free((zvoid *)(z->name));
+        arena_free(z->oname);
 #ifdef UNICODE_SUPPORT
-        if (z->uname) free(z->uname);
+        if (z->uname) arena_free(z->uname);
 #endif /* def UNICODE_SUPPORT */
         if (z->ext)
           /* don't have local extra until zipcopy reads it */
-          if (z->extra) free((zvoid *)(z->extra));
+          if (z->extra) arena_free((zvoid *)(z->extra));
         if (z->cext && z->cextra != z->extra)
-          free((zvoid *)(z->cextra));
+          arena_free((zvoid *)(z->cextra));
         if (z->com)
-          free((zvoid *)(z->comment));
-        farfree((zvoid far *)z);
+          arena_free((zvoid *)(z->comment));
+        arena_free((zvoid *)z);
         *w = v;
         zcount--;
       }
@@ -4799,22 +5093,22 @@ char **argv;            /* command line tokens */
     {
       if (action == ARCHIVE) {
         v = z->nxt;                     /* delete entry from list */
-        free((zvoid *)(z->iname));
-        free((zvoid *)(z->zname));
+        arena_free((zvoid *)(z->iname));
+        arena_free((zvoid *)(z->zname));
         if (z->name != z->zname && z->name != NULL)
-          free((zvoid *)(z->name));
-        free(z->oname);
+          arena_free((zvoid *)(z->name));
+        arena_free(z->oname);
 #ifdef UNICODE_SUPPORT
-        if (z->uname) free(z->uname);
+        if (z->uname) arena_free(z->uname);
 #endif /* def UNICODE_SUPPORT */
         if (z->ext)
           /* don't have local extra until zipcopy reads it */
-          if (z->extra) free((zvoid *)(z->extra));
+          if (z->extra) arena_free((zvoid *)(z->extra));
         if (z->cext && z->cextra != z->extra)
-          free((zvoid *)(z->cextra));
+          arena_free((zvoid *)(z->cextra));
         if (z->com)
-          free((zvoid *)(z->comment));
-        farfree((zvoid far *)z);
+          arena_free((zvoid *)(z->comment));
+        arena_free((zvoid *)z);
         *w = v;
         zcount--;
       }
@@ -4867,161 +5161,20 @@ char **argv;            /* command line tokens */
   }
   diag("zipping up new entries, if any");
   Trace((stderr, "zip diagnostic: fcount=%u\n", (unsigned)fcount));
+  ztail = w;
   for (f = found; f != NULL; f = fexpel(f))
-  {
-    uzoff_t len;
-    /* add a new zfiles entry and set the name */
-    if ((z = (struct zlist far *)farmalloc(sizeof(struct zlist))) == NULL) {
-      ZIPERR(ZE_MEM, "was adding files to zip file");
-    }
-    z->nxt = NULL;
-    z->name = f->name;
-    f->name = NULL;
-#ifdef UNICODE_SUPPORT
-    z->uname = NULL;          /* UTF-8 name for extra field */
-    z->zuname = NULL;         /* externalized UTF-8 name for matching */
-    z->ouname = NULL;         /* display version of UTF-8 name with OEM */
-
-#if 0
-    /* New AppNote bit 11 allowing storing UTF-8 in path */
-    if (utf8_force && f->uname) {
-      if (f->iname)
-        free(f->iname);
-      if ((f->iname = malloc(strlen(f->uname) + 1)) == NULL)
-        ZIPERR(ZE_MEM, "Unicode bit 11");
-      strcpy(f->iname, f->uname);
-    }
-#endif
-
-    /* Only set z->uname if have a non-ASCII Unicode name */
-    /* The Unicode path extra field is created if z->uname is not NULL,
-       unless on a UTF-8 system, then instead of creating the extra field
-       set bit 11 in the General Purpose Bit Flag */
-    {
-      int is_ascii = 0;
-
-      is_ascii = is_ascii_string(f->uname);
-
-      if (z->uname == NULL) {
-        if (!is_ascii)
-          z->uname = f->uname;
-        else
-          free(f->uname);
-      } else {
-        free(f->uname);
-      }
-    }
-    f->uname = NULL;
-
-#endif
-    z->iname = f->iname;
-    f->iname = NULL;
-    z->zname = f->zname;
-    f->zname = NULL;
-    z->oname = f->oname;
-    f->oname = NULL;
-    z->ext = z->cext = z->com = 0;
-    z->extra = z->cextra = NULL;
-    z->mark = 1;
-    z->dosflag = f->dosflag;
-    /* zip it up */
-    DisplayRunningStats();
-    if (noisy)
-    {
-      fprintf(mesg, "  adding: %s", z->oname);
-      mesg_line_started = 1;
-      fflush(mesg);
-    }
-    if (logall)
-    {
-      fprintf(logfile, "  adding: %s", z->oname);
-      logfile_line_started = 1;
-      fflush(logfile);
-    }
-    /* initial scan */
-    len = f->usize;
-    if ((r = zipup(z)) != ZE_OK  && r != ZE_OPEN && r != ZE_MISS)
-    {
-      zipmessage_nl("", 1);
-      /*
-      if (noisy)
-      {
-#if (!defined(MACOS) && !defined(WINDLL))
-        putc('\n', mesg);
-        fflush(mesg);
-#else
-        fprintf(stdout, "\n");
-#endif
-        mesg_line_started = 0;
-        fflush(mesg);
-      }
-      if (logall) {
-        fprintf(logfile, "\n");
-        logfile_line_started = 0;
-        fflush(logfile);
-      }
-      */
-      sprintf(errbuf, "was zipping %s", z->oname);
-      ZIPERR(r, errbuf);
-    }
-    if (r == ZE_OPEN || r == ZE_MISS)
-    {
+    if (zipup_found(f, &z) != ZE_OK)
       o = 1;
-      zipmessage_nl("", 1);
-      /*
-      if (noisy)
-      {
-#if (!defined(MACOS) && !defined(WINDLL))
-        putc('\n', mesg);
-        fflush(mesg);
-#else
-        fprintf(stdout, "\n");
-#endif
-        mesg_line_started = 0;
-        fflush(mesg);
-      }
-      if (logall) {
-        fprintf(logfile, "\n");
-        logfile_line_started = 0;
-        fflush(logfile);
-      }
-      */
-      if (r == ZE_OPEN) {
-        perror("zip warning");
-        if (logfile)
-          fprintf(logfile, "zip warning: %s\n", strerror(errno));
-        zipwarn("could not open for reading: ", z->oname);
-        if (bad_open_is_error) {
-          sprintf(errbuf, "was zipping %s", z->name);
-          ZIPERR(r, errbuf);
-        }
-      } else {
-        zipwarn("file and directory with the same name: ", z->oname);
-      }
-      files_so_far++;
-      bytes_so_far += len;
-      bad_files_so_far++;
-      bad_bytes_so_far += len;
-      free((zvoid *)(z->name));
-      free((zvoid *)(z->iname));
-      free((zvoid *)(z->zname));
-      free(z->oname);
-#ifdef UNICODE_SUPPORT
-      if (z->uname)
-        free(z->uname);
-#endif
-      farfree((zvoid far *)z);
-    }
-    else
-    {
-      files_so_far++;
-      /* current size of file (just before reading) */
-      good_bytes_so_far += z->len;
-      /* size of file on initial scan */
-      bytes_so_far += len;
-      *w = z;
-      w = &z->nxt;
-      zcount++;
+  if (stream_want) {
+    /* find the names now, zipping each as it is found */
+    stream_add = 1;
+    scan_names(stdin_names);
+    stream_add = 0;
+    dup_free();
+    if (stream_bad)
+      o = 1;
+    if (zcount == 0 && !allow_empty_archive) {
+      ZIPERR(ZE_NONE, zipfile);
     }
   }
   if (key != NULL)
@@ -5153,6 +5306,12 @@ char **argv;            /* command line tokens */
     fprintf(mesg, "sd: Writing central directory\n");
     fflush(mesg);
   }
+  if (name_index > 0 && !split_method) {
+    diag("writing name index");
+    if ((r = putindex(!(diff_mode || filesync))) != ZE_OK) {
+      ZIPERR(r, tempzip);
+    }
+  }
   diag("writing central directory");
   k = 0;                        /* keep count for end header */
   c = tempzn;                   /* get start of central */
@@ -5197,6 +5356,7 @@ char **argv;            /* command line tokens */
   tempzf = NULL;
   */
   if (fclose(y)) {
+    y = NULL;                   /* closed even so, ziperr() must not again */
     ZIPERR(d ? ZE_WRITE : ZE_TEMP, tempzip);
   }
   y = NULL;
@@ -5232,7 +5392,12 @@ char **argv;            /* command line tokens */
     }
     if ((r = replace(out_path, tempzip)) != ZE_OK)
     {
-      zipwarn("new zip file left as: ", tempzip);
+      /* anonymous temp file that could not be given a name */
+      if (tempzip_fd != -1)
+        zipwarn("new zip file could not be saved, old one left as: ",
+                out_path);
+      else
+        zipwarn("new zip file left as: ", tempzip);
       free((zvoid *)tempzip);
       tempzip = NULL;
       ZIPERR(r, "was replacing the original zip file");
@@ -132,6 +132,18 @@ typedef struct iztimes {
    time_t ctime;                /* new creation time (!= Unix st.ctime) */
 } iztimes;
 
+/* What stat() said of a file on disk.  It is taken once, by whichever
+   of newname(), the scan in zip.c and zipup() needs it first, and kept
+   with the entry; see fileinfo(). */
+struct zinfo {
+  ulg mode;                     /* st_mode, 0 until it has been taken */
+  ulg nlink;
+  ulg uid, gid;
+  uzoff_t dev, ino;
+  zoff_t size;
+  time_t atime, mtime, ctime;
+};
+
 /* Lengths of headers after signatures in bytes */
 #define LOCHEAD 26
 #define CENHEAD 42
@@ -173,6 +185,7 @@ struct zlist {
   int trash;                    /* Marker for files to delete */
   int current;                  /* Marker for files that are current to what is on OS (filesync) */
   int dosflag;                  /* Set to force MSDOS file attributes */
+  struct zinfo info;            /* File on disk, if looked at */
   struct zlist far *nxt;        /* Pointer to next header in list */
 };
 struct flist {
@@ -185,6 +198,7 @@ struct flist {
 #endif
   int dosflag;                  /* Set to force MSDOS file attributes */
   uzoff_t usize;                /* usize from initial scan */
+  struct zinfo info;            /* File on disk, if looked at */
   struct flist far *far *lst;   /* Pointer to link pointing here */
   struct flist far *nxt;        /* Link to next name */
 };
@@ -383,6 +397,7 @@ extern int use_descriptors;     /* use data descriptors (extended headings) */
 extern int allow_empty_archive; /* if no files, create empty archive anyway */
 extern int copy_only;           /* 1 = copy archive with no changes */
 extern int zip_to_stdout;       /* output to stdout */
+extern int stream_add;          /* newname() zips each new name (--stream-add) */
 extern int output_seekable;     /* 1 = output seekable 3/13/05 EG */
 #ifdef ZIP64_SUPPORT            /* zip64 globals 10/4/03 E. Gordon */
  extern int force_zip64;        /* force use of zip64 when streaming from stdin */
@@ -390,10 +405,17 @@ extern int output_seekable;     /* 1 = output seekable 3/13/05 EG */
  extern int zip64_archive;      /* at least 1 entry needs zip64 */
 #endif
 extern int allow_fifo;          /* Allow reading Unix FIFOs, waiting if pipe open */
+extern int write_behind;        /* write output archive from a background thread */
+extern struct zinfo *name_info; /* stat() of the name given to newname() */
+extern int walk_threads;        /* threads reading directories for -r, -1 = auto */
+extern int sort_dirs;           /* return each directory's names sorted */
+extern int name_index;          /* 1=write a name index, 0=don't, -1=as before */
 extern int show_files;          /* show files to operate on and exit (=2 log only) */
+extern int show_what_doing;     /* -sd: show what zip is doing */
 
 extern char *tempzip;           /* temp file name */
 extern FILE *y;                 /* output file now global for splits */
+extern int tempzip_fd;          /* O_TMPFILE output kept open for replace() */
 
 #ifdef UNICODE_SUPPORT
   extern int utf8_force;         /* 1=store UTF-8 as standard per AppNote bit 11 */
@@ -472,11 +494,13 @@ extern extent zcount;           /* Number of files in zip file */
 extern int zipfile_exists;      /* 1 if zipfile exists */
 extern ush zcomlen;             /* Length of zip file comment */
 extern char *zcomment;          /* Zip file comment (not zero-terminated) */
+extern uzoff_t cd_bulk_size;    /* Central directory bytes read in one piece */
 extern struct flist far **fsort;/* List of files sorted by name */
-extern struct zlist far **zsort;/* List of files sorted by name */
+extern struct zlist far **zhash;/* Table of files hashed by zname */
 #ifdef UNICODE_SUPPORT
-extern struct zlist far **zusort;/* List of files sorted by zuname */
+extern struct zlist far **zuhash;/* Table of files hashed by zuname */
 #endif
+extern extent zhmask;           /* Size of the tables - 1 */
 extern struct flist far *found; /* List of names found */
 extern struct flist far *far *fnxt;     /* Where to put next in found list */
 extern extent fcount;           /* Count of names in found list */
@@ -545,6 +569,7 @@ void ziperr OF((int, ZCONST char *));
 #  define error(msg)    ziperr(ZE_LOGIC, msg)
 #else
    void error OF((ZCONST char *));
+   int stream_found OF((struct flist far *));
 #  ifdef VMSCLI
      void help OF((void));
 #  endif
@@ -563,6 +588,8 @@ void ziperr OF((int, ZCONST char *));
      void flush_outbuf OF((char *, unsigned *));
      int seekable OF((void));
      extern unsigned (*read_buf) OF((char *, unsigned int));
+     extern int input_holes;
+     int in_hole OF((unsigned, unsigned));
 #  endif /* !USE_ZLIB */
 #  ifdef ZP_NEED_MEMCOMPR
      ulg memcompress OF((char *, ulg, char *, ulg));
@@ -582,9 +609,12 @@ void ziperr OF((int, ZCONST char *));
 #endif /* !UTIL */
 char *ziptyp OF((char *));
 int readzipfile OF((void));
+int zhash_build OF((void));
+void zhash_free OF((void));
 int putlocal OF((struct zlist far *, int));
 int putextended OF((struct zlist far *));
 int putcentral OF((struct zlist far *));
+int putindex OF((int));
 /* zip64 support 09/05/2003 R.Nausedat */
 int putend OF((uzoff_t, uzoff_t, uzoff_t, extent, char *));
 /* moved seekable to separate function 3/14/05 EG */
@@ -608,7 +638,13 @@ char *copy_nondup_extra_fields OF((char *, unsigned, char *, unsigned, unsigned
    wchar_t *msnamew OF((wchar_t *));
 # endif
    int check_dup OF((void));
+   int dup_found OF((struct flist far *, int *));
+   int dup_add OF((struct zlist far *));
+   void dup_free OF((void));
    int filter OF((char *, int));
+   int filter_ready OF((int));
+   int filter_prune OF((ZCONST char *, int));
+   void filter_free OF((void));
    int newname OF((char *, int, int));
 # ifdef UNICODE_SUPPORT
 # endif
@@ -648,7 +684,26 @@ int set_filetype OF((char *));
 
 int bfcopy OF((uzoff_t));
 
-int fcopy OF((FILE *, FILE *, uzoff_t));
+/* open_tempzip() flags */
+#define TZ_NEW   1      /* brand-new archive, may be written in place */
+#define TZ_NAMED 2      /* output needs a name, no O_TMPFILE */
+int open_tempzip OF((char *, int));
+
+        /* in wbehind.c */
+#ifdef NO_WRITE_BEHIND
+#  define wb_open(fd, mode) ((FILE *)NULL)
+#else
+   FILE *wb_open OF((int, ZCONST char *));
+#endif
+
+        /* in walk.c */
+#ifdef UNIX
+   typedef struct walk walk;
+   walk *walk_start OF((char *, ZCONST char *, ZCONST char *, int));
+#  define WALK_PRUNED 0x40000000  /* walk_next(): directory left unread */
+   char *walk_next OF((walk *, unsigned *));
+   int walk_end OF((walk *));
+#endif
 
 #ifdef ZMEM
    char *memset OF((char *, int, unsigned int));
@@ -667,6 +722,8 @@ int fcopy OF((FILE *, FILE *, uzoff_t));
    void stamp OF((char *, ulg));
 
    ulg filetime OF((char *, ulg *, zoff_t *, iztimes *));
+   ulg fileinfo OF((char *, struct zinfo *, ulg *, zoff_t *, iztimes *));
+   int fdinfo OF((int, struct zinfo *));
    /* Windows Unicode */
 # ifdef UNICODE_SUPPORT
 # endif
@@ -703,6 +760,13 @@ int abbrevmatch OF((char *, char *, int, int));
 
 void init_upper    OF((void));
 int  namecmp       OF((ZCONST char *string1, ZCONST char *string2));
+ulg  namehash      OF((ZCONST char *s, int cs));
+extent memsig      OF((ZCONST char *b, extent n, ZCONST char *sig));
+zvoid *arena_alloc OF((extent n, int align));
+char *arena_strdup OF((ZCONST char *s, char *same));
+void arena_free    OF((zvoid *p));
+void arena_release OF((void));
+uzoff_t arena_bytes OF((void));
 
 #ifdef EBCDIC
   char *strtoasc     OF((char *str1, ZCONST char *str2));
@@ -62,6 +62,24 @@
 #define ENDSIG     0x06054b50L
 #define EXTLOCSIG  0x08074b50L
 
+/* Name index (-ni), written between the last entry and the central
+   directory:
+
+     "IZnx"                                  start signature
+     n times:  name CRC-32 (4), offset (8)   sorted by CRC, then offset
+     n (4), central directory size (8)
+     "IZNX"                                  end signature
+
+   The CRC is of the name bytes as stored in the central header, and the
+   offset is that of the central header from the start of the central
+   directory.  Readers that go by the central directory never look at the
+   block.  unzip finds it from the end signature right before the central
+   directory and only trusts it if n and the size match the end record. */
+#define NDXSIG     0x786e5a49L  /* "IZnx" */
+#define NDXENDSIG  0x584e5a49L  /* "IZNX" */
+#define NDXENT     12           /* bytes per index entry */
+#define NDXEND     16           /* bytes in the index trailer */
+
 /* Offsets of values in headers */
 /* local header */
 #define LOCVER  0               /* version needed to extract */
@@ -187,28 +205,26 @@ local void append_string_to_mem OF((char *, int, char**, extent *, extent *));
 
 /* Local functions */
 
+local void sigw_free OF((void));
 local int find_next_signature OF((FILE *f));
 local int find_signature OF((FILE *, ZCONST char *));
 local int is_signature OF((ZCONST char *, ZCONST char *));
 local int at_signature OF((FILE *, ZCONST char *));
-
-local int zqcmp OF((ZCONST zvoid *, ZCONST zvoid *));
-#ifdef UNICODE_SUPPORT
-local int zuqcmp OF((ZCONST zvoid *, ZCONST zvoid *));
-#endif
+local void cdb_free OF((void));
+local void cdb_load OF((FILE *, uzoff_t));
+local int cdb_drop OF((FILE *));
+local int cdb_next_signature OF((FILE *));
+local int cdb_read OF((char *, extent, FILE *));
+local zoff_t cdb_tell OF((FILE *));
+
+local int ndxcmp OF((ZCONST zvoid *, ZCONST zvoid *));
+local int cenprep OF((struct zlist far *, extent *));
 #if 0
  local int scanzipf_reg OF((FILE *f));
 #endif
 local int scanzipf_regnew OF((void));
 #ifndef UTIL
  local int rqcmp OF((ZCONST zvoid *, ZCONST zvoid *));
- local int zbcmp OF((ZCONST zvoid *, ZCONST zvoid far *));
-# ifdef UNICODE_SUPPORT
- local int zubcmp OF((ZCONST zvoid *, ZCONST zvoid far *));
-#  if 0
- local int zuebcmp OF((ZCONST zvoid *, ZCONST zvoid far *));
-#  endif
-# endif /* UNICODE_SUPPORT */
  local void zipoddities OF((struct zlist far *));
 # if 0
   local int scanzipf_fix OF((FILE *f));
@@ -228,35 +244,79 @@ local int scanzipf_regnew OF((void));
 /* Local data */
 
 
-local int zqcmp(a, b)
-ZCONST zvoid *a, *b;          /* pointers to pointers to zip entries */
-/* Used by qsort() to compare entries in the zfile list.
- * Compares the internal names z->iname */
+struct ndxent {
+  ulg crc;                      /* CRC-32 of the stored name */
+  uzoff_t off;                  /* central header offset in the directory */
+};
+
+local int ndxcmp(a, b)
+ZCONST zvoid *a, *b;          /* pointers to name index entries */
+/* Used by qsort() to order the name index by CRC, then offset. */
 {
-  char *aname = (*(struct zlist far **)a)->iname;
-  char *bname = (*(struct zlist far **)b)->iname;
+  ZCONST struct ndxent *x = (ZCONST struct ndxent *)a;
+  ZCONST struct ndxent *y = (ZCONST struct ndxent *)b;
 
-  return namecmp(aname, bname);
+  if (x->crc != y->crc)
+    return x->crc < y->crc ? -1 : 1;
+  if (x->off != y->off)
+    return x->off < y->off ? -1 : 1;
+  return 0;
 }
 
-#ifdef UNICODE_SUPPORT
-local int zuqcmp(a, b)
-ZCONST zvoid *a, *b;          /* pointers to pointers to zip entries */
-/* Used by qsort() to compare entries in the zfile list.
- * Compares the internal names z->zuname */
+
+int zhash_build()
+/* Enter the zfiles entries into open-addressed tables keyed by zname (and
+   zuname) as namecmp() compares them, for zsearch().  Return an error code
+   in the ZE_ class. */
 {
-  char *aname = (*(struct zlist far **)a)->iname;
-  char *bname = (*(struct zlist far **)b)->iname;
-
-  /* zuname could be NULL */
-  if ((*(struct zlist far **)a)->zuname)
-    aname = (*(struct zlist far **)a)->zuname;
-  if ((*(struct zlist far **)b)->zuname)
-    bname = (*(struct zlist far **)b)->zuname;
-  return namecmp(aname, bname);
-}
+  struct zlist far *z;  /* pointer into zfiles linked list */
+  extent n;             /* number of slots */
+  extent h;             /* slot in the tables */
+
+  zhash_free();
+  if (zcount == 0)
+    return ZE_OK;
+  /* at most half full, so a miss ends at an empty slot soon */
+  for (n = 16; n < zcount * 2; n <<= 1)
+    if (n > (extent)-1 / (4 * sizeof(struct zlist far *)))
+      return ZE_MEM;
+  if ((zhash = (struct zlist far **)calloc(n, sizeof(struct zlist far *)))
+      == NULL)
+    return ZE_MEM;
+#ifdef UNICODE_SUPPORT
+  if ((zuhash = (struct zlist far **)calloc(n, sizeof(struct zlist far *)))
+      == NULL) {
+    zhash_free();
+    return ZE_MEM;
+  }
+#endif
+  zhmask = n - 1;
+  for (z = zfiles; z != NULL; z = z->nxt) {
+    for (h = (extent)namehash(z->zname, 0) & zhmask; zhash[h] != NULL;
+         h = (h + 1) & zhmask)
+      ;
+    zhash[h] = z;
+#ifdef UNICODE_SUPPORT
+    for (h = (extent)namehash(z->zuname ? z->zuname : z->zname, 0) & zhmask;
+         zuhash[h] != NULL; h = (h + 1) & zhmask)
+      ;
+    zuhash[h] = z;
 #endif
+  }
+  return ZE_OK;
+}
 
+void zhash_free()
+{
+  if (zhash != NULL)
+    free((zvoid *)zhash);
+  zhash = NULL;
+#ifdef UNICODE_SUPPORT
+  if (zuhash != NULL)
+    free((zvoid *)zuhash);
+  zuhash = NULL;
+#endif
+}
 
 #ifndef UTIL
 
@@ -270,72 +330,28 @@ ZCONST zvoid *a, *b;          /* pointers to pointers to zip entries */
 }
 
 
-local int zbcmp(n, z)
-ZCONST zvoid *n;        /* string to search for */
-ZCONST zvoid far *z;    /* pointer to a pointer to a zip entry */
-/* Used by search() to compare a target to an entry in the zfile list. */
-{
-  return namecmp((char *)n, ((struct zlist far *)z)->zname);
-}
-
-#ifdef UNICODE_SUPPORT
-/* search unicode paths */
-local int zubcmp(n, z)
-ZCONST zvoid *n;        /* string to search for */
-ZCONST zvoid far *z;    /* pointer to a pointer to a zip entry */
-/* Used by search() to compare a target to an entry in the zfile list. */
-{
-  char *zuname = ((struct zlist far *)z)->zuname;
-
-  /* zuname is NULL if no UTF-8 name */
-  if (zuname == NULL)
-    zuname = ((struct zlist far *)z)->zname;
-
-  return namecmp((char *)n, zuname);
-}
-
-#if 0
-/* search escaped unicode paths */
-local int zuebcmp(n, z)
-ZCONST zvoid *n;        /* string to search for */
-ZCONST zvoid far *z;    /* pointer to a pointer to a zip entry */
-/* Used by search() to compare a target to an entry in the zfile list. */
-{
-  char *zuname = ((struct zlist far *)z)->zuname;
-  char *zuename;
-  int k;
-
-  /* zuname is NULL if no UTF-8 name */
-  if (zuname == NULL)
-    zuname = ((struct zlist far *)z)->zname;
-  zuename = local_to_escape_string(zuname);
-  k = namecmp((char *)n, zuename);
-  free(zuename);
-
-  return k;
-}
-#endif
-#endif
-
-
 struct zlist far *zsearch(n)
   ZCONST char *n;      /* name to find */
 /* Return a pointer to the entry in zfile with the name n, or NULL if
-   not found. */
+   not found.  With several, the first in zfiles is returned. */
 {
-  zvoid far **p;        /* result of search() */
+  extent h;             /* slot in zhash[] */
+  struct zlist far *z;
 
-  if (zcount) {
-    if ((p = search(n, (ZCONST zvoid far **)zsort, zcount, zbcmp)) != NULL)
-      return *(struct zlist far **)p;
+  if (zhash == NULL)
+    return NULL;
+  for (h = (extent)namehash(n, 0) & zhmask; (z = zhash[h]) != NULL;
+       h = (h + 1) & zhmask)
+    if (namecmp(n, z->zname) == 0)
+      return z;
 #ifdef UNICODE_SUPPORT
-    else if (unicode_mismatch != 3 && fix != 2 &&
-        (p = search(n, (ZCONST zvoid far **)zusort, zcount, zubcmp)) != NULL)
-      return *(struct zlist far **)p;
+  /* search the local conversions of the UTF-8 names */
+  if (zuhash != NULL && unicode_mismatch != 3 && fix != 2)
+    for (h = (extent)namehash(n, 0) & zhmask; (z = zuhash[h]) != NULL;
+         h = (h + 1) & zhmask)
+      if (namecmp(n, z->zuname ? z->zuname : z->zname) == 0)
+        return z;
 #endif
-    else
-      return NULL;
-  }
   return NULL;
 }
 
@@ -1105,7 +1121,7 @@ local int add_central_zip64_extra_field(pZipListEntry)
       }
       /* move the old extra field */
       memmove(pExtraFieldPtr, pZipListEntry->cextra, pZipListEntry->cext);
-      free(pZipListEntry->cextra);
+      arena_free(pZipListEntry->cextra);
       pZipListEntry->cextra = pExtraFieldPtr;
       pExtraFieldPtr += pZipListEntry->cext;
       pZipListEntry->cext += efsize;
@@ -1132,7 +1148,7 @@ local int add_central_zip64_extra_field(pZipListEntry)
           if ((pExtraFieldPtr = (char *) malloc(efsize)) == NULL) {
             return ZE_MEM;
           }
-          free(pZipListEntry->cextra);
+          arena_free(pZipListEntry->cextra);
           pZipListEntry->cextra = pExtraFieldPtr;
           pZipListEntry->cext = efsize;
         }
@@ -1151,7 +1167,7 @@ local int add_central_zip64_extra_field(pZipListEntry)
         pZipListEntry->cext -= oldefsize;
         pExtraFieldPtr = pTemp + pZipListEntry->cext;
         pZipListEntry->cext += efsize;
-        free(pZipListEntry->cextra);
+        arena_free(pZipListEntry->cextra);
         pZipListEntry->cextra = pTemp;
       }
     }
@@ -1219,7 +1235,7 @@ local int remove_local_extra_field(pZEntry, tag)
     memcpy( pTemp, pOldTemp, usTemp);
     /* replace extra fields */
     pZEntry->ext = newEFSize;
-    free(pZEntry->extra);
+    arena_free(pZEntry->extra);
     pZEntry->extra = pExtra;
     return 1;
   } else {
@@ -1264,7 +1280,7 @@ local int remove_central_extra_field(pZEntry, tag)
     memcpy( pTemp, pOldTemp, usTemp);
     /* replace extra fields */
     pZEntry->cext = newEFSize;
-    free(pZEntry->cextra);
+    arena_free(pZEntry->cextra);
     pZEntry->cextra = pExtra;
     return 1;
   } else {
@@ -1314,7 +1330,7 @@ local int add_local_zip64_extra_field(pZEntry)
         ziperr( ZE_MEM, "Zip64 Extra Field" );
       /* move old extra field and update pointer and length */
       memmove( pZ64Extra, pZEntry->extra, pZEntry->ext);
-      free( pZEntry->extra );
+      arena_free(pZEntry->extra);
       pZEntry->extra = pZ64Extra;
       pZ64Extra += pZEntry->ext;
       pZEntry->ext += Z64LocalLen;
@@ -1349,7 +1365,7 @@ local int add_local_zip64_extra_field(pZEntry)
         memcpy( pTemp, pOldTemp, usTemp);
         /* replace extra fields */
         pZEntry->ext = newEFSize;
-        free(pZEntry->extra);
+        arena_free(pZEntry->extra);
         pZEntry->extra = pZ64Extra;
         pZ64Extra = pTemp + usTemp;
       }
@@ -1411,7 +1427,7 @@ local int add_Unicode_Path_local_extra_field(pZEntry)
         ziperr( ZE_MEM, "UTF-8 Path Extra Field" );
       /* move old extra field and update pointer and length */
       memmove( pUExtra, pZEntry->extra, pZEntry->ext);
-      free( pZEntry->extra );
+      arena_free(pZEntry->extra);
       pZEntry->extra = pUExtra;
       pUExtra += pZEntry->ext;
       pZEntry->ext += ULocalLen;
@@ -1446,7 +1462,7 @@ local int add_Unicode_Path_local_extra_field(pZEntry)
         memcpy( pTemp, pOldTemp, usTemp);
         /* replace extra fields */
         pZEntry->ext = newEFSize;
-        free(pZEntry->extra);
+        arena_free(pZEntry->extra);
         pZEntry->extra = pUExtra;
         pUExtra = pTemp + usTemp;
       }
@@ -1523,7 +1539,7 @@ local int add_Unicode_Path_cen_extra_field(pZEntry)
         ziperr( ZE_MEM, "UTF-8 Path Extra Field" );
       /* move old extra field and update pointer and length */
       memmove( pUExtra, pZEntry->cextra, pZEntry->cext);
-      free( pZEntry->cextra );
+      arena_free(pZEntry->cextra);
       pZEntry->cextra = pUExtra;
       pUExtra += pZEntry->cext;
       pZEntry->cext += UCenLen;
@@ -1558,7 +1574,7 @@ local int add_Unicode_Path_cen_extra_field(pZEntry)
         memcpy( pTemp, pOldTemp, usTemp);
         /* replace extra fields */
         pZEntry->cext = newEFSize;
-        free(pZEntry->cextra);
+        arena_free(pZEntry->cextra);
         pZEntry->cextra = pUExtra;
         pUExtra = pTemp + usTemp;
       }
@@ -1787,7 +1803,7 @@ local int scanzipf_fix(f)
   FILE *f;                      /* zip file */
 /*
    The name of the zip file is pointed to by the global "zipfile".  The globals
-   zipbeg, cenbeg, zfiles, zcount, zcomlen, zcomment, and zsort are filled in.
+   zipbeg, cenbeg, zfiles, zcount, zcomlen, zcomment, and zhash are filled in.
    Return an error code in the ZE_ class.
 */
 {
@@ -1852,7 +1868,7 @@ local int scanzipf_fix(f)
           zcount + 1 < zcount)
         return ZE_MEM;
       if (fread(b, LOCHEAD, 1, f) != 1) {
-          farfree((zvoid far *)z);
+          arena_free((zvoid *)z);
           break;
       }
 
@@ -1874,6 +1890,7 @@ local int scanzipf_fix(f)
       z->atx = dosify ? a & 0xff : a;     /* Attributes from filetime() */
       z->mark = 0;
       z->trash = 0;
+      z->info.mode = 0;
 
       /* attention: this one breaks the VC optimizer (Release Build) */
       /* may be fixed - 11/1/03 EG */
@@ -2265,7 +2282,7 @@ local int scanzipf_reg(f)
   FILE *f;                      /* zip file */
 /*
    The name of the zip file is pointed to by the global "zipfile".  The globals
-   zipbeg, cenbeg, zfiles, zcount, zcomlen, zcomment, and zsort are filled in.
+   zipbeg, cenbeg, zfiles, zcount, zcomlen, zcomment, and zhash are filled in.
    Return an error code in the ZE_ class.
 */
 {
@@ -2586,7 +2603,7 @@ printf("start of central directory cenbeg %ld\n", cenbeg);
         sprintf(errbuf, "%lu", (ulg)zcount + 1);
         zipwarn("zero-length name for entry #", errbuf);
 #ifndef DEBUG
-        farfree((zvoid far *)z);
+        arena_free((zvoid *)z);
         return ZE_FORM;
 #endif
       }
@@ -2681,12 +2698,12 @@ printf("start of central directory cenbeg %ld\n", cenbeg);
             return ZE_MEM;
           if (fread(z->extra, z->ext, 1, f) != 1)
           {
-            free((zvoid *)(z->extra));
+            arena_free((zvoid *)(z->extra));
             return ferror(f) ? ZE_READ : ZE_EOF;
           }
           if (z->ext == z->cext && memcmp(z->extra, z->cextra, z->ext) == 0)
           {
-            free((zvoid *)(z->extra));
+            arena_free((zvoid *)(z->extra));
             z->extra = z->cextra;
           }
         }
@@ -2770,6 +2787,7 @@ printf("start of central directory cenbeg %ld\n", cenbeg);
         /* Clear actions */
         z->mark = 0;
         z->trash = 0;
+        z->info.mode = 0;
 #ifdef UNICODE_SUPPORT
         if (unicode_mismatch != 3) {
           read_Unicode_Path_entry(z);
@@ -2877,73 +2895,190 @@ char *copy_sig(copyto, copyfrom)
 #endif /* currently unused */
 
 
+/* find_next_signature() reads f in large blocks into this window and
+ * searches them with memsig() rather than going through stdio a byte at
+ * a time.  On a hit f is put right after the signature, where the caller
+ * reads the header; the next call finds that offset still in the window
+ * and goes on from there.  The files are only read, so the window stays
+ * valid for as long as the same file (by device and inode, as splits are
+ * closed and opened as the scan goes) is scanned.
+ */
+#define SIGWIN 0x100000         /* bytes per read */
+
+local struct {
+  char *buf;
+  FILE *f;              /* the file the window is of */
+  dev_t dev;
+  ino_t ino;
+  zoff_t start;         /* file offset of buf[0] */
+  extent len;           /* bytes in buf */
+} sigw;
+
+local void sigw_free()
+{
+  if (sigw.buf != NULL)
+    free(sigw.buf);
+  sigw.buf = NULL;
+  sigw.f = NULL;
+}
+
 local int find_next_signature(f)
   FILE *f;
 {
-  int m;
-  /*
   zoff_t here;
-  */
+  extent at, i, n;
+  z_stat st;
 
-  /* look for P K ? ? signature */
+  if ((here = zftello(f)) < 0)
+    return 0;
+  if (sigw.buf == NULL && (sigw.buf = malloc(SIGWIN)) == NULL)
+    ZIPERR(ZE_MEM, "scanning for signatures");
+  if (zfstat(fileno(f), &st) != 0)
+    sigw.f = NULL;
+  if (sigw.f != f || st.st_dev != sigw.dev || st.st_ino != sigw.ino ||
+      here < sigw.start || here > sigw.start + (zoff_t)sigw.len) {
+    /* the window starts empty at here */
+    sigw.f = f;
+    sigw.dev = st.st_dev;
+    sigw.ino = st.st_ino;
+    sigw.start = here;
+    sigw.len = 0;
+  }
+  at = (extent)(here - sigw.start);
+
+  for (;;) {
+    i = at + memsig(sigw.buf + at, sigw.len - at, NULL);
+    if (i + 4 <= sigw.len) {
+      /* found possible signature */
+      memcpy(sigbuf, sigw.buf + i, 4);
+      if (zfseeko(f, sigw.start + (zoff_t)(i + 4), SEEK_SET) != 0)
+        return 0;
+      return 1;
+    }
+
+    /* keep what may start a signature and read on after the window */
+    if (i > 0) {
+      memmove(sigw.buf, sigw.buf + i, sigw.len - i);
+      sigw.start += (zoff_t)i;
+      sigw.len -= i;
+    }
+    if (zftello(f) != sigw.start + (zoff_t)sigw.len &&
+        zfseeko(f, sigw.start + (zoff_t)sigw.len, SEEK_SET) != 0)
+      return 0;
+    if ((n = fread(sigw.buf + sigw.len, 1, SIGWIN - sigw.len, f)) == 0)
+      /* found nothing; at EOF unless error */
+      return 0;
+    at = 0;
+    sigw.len += n;
+  }
+}
 
-  m = getc(f);
 
-  /*
-  here = zftello(f);
-  */
+/* The central directory, read in one piece by scanzipf_regnew() so its
+ * headers are parsed from memory rather than with a getc() scan and a
+ * few fread()s each.  Whatever the buffer cannot serve (a gap to skip
+ * with -F, the end records after it) is read from the file at the same
+ * offset, so the result is the same either way.
+ */
+local struct {
+  char *buf;            /* the directory, or NULL to use the file */
+  extent len;           /* bytes in buf */
+  extent pos;           /* next byte to parse */
+  zoff_t start;         /* file offset of buf[0] */
+} cdb;
+
+local void cdb_free()
+{
+  if (cdb.buf != NULL)
+    free(cdb.buf);
+  cdb.buf = NULL;
+}
 
-  while (m != EOF)
-  {
-    if (m == 0x50 /*'P' except EBCDIC*/) {
-      /* found a P */
-      sigbuf[0] = (char) m;
+/* cdb_load
+ *
+ * Read size bytes of f from its current offset into the buffer.  If that
+ * fails, f is left where it was and the scan reads from the file.
+ */
+local void cdb_load(f, size)
+  FILE *f;
+  uzoff_t size;
+{
+  zoff_t end;
 
-      if ((m = getc(f)) == EOF)
-        break;
-      if (m != 0x4b /*'K' except EBCDIC*/) {
-        /* not a signature */
-        ungetc(m, f);
-      } else {
-        /* found P K */
-        sigbuf[1] = (char) m;
+  cdb_free();
+  if (size == 0 || (uzoff_t)(extent)size != size ||
+      (cdb.start = zftello(f)) < 0)
+    return;
+  /* a damaged end record should not cost a huge allocation */
+  end = zfseeko(f, 0, SEEK_END) == 0 ? zftello(f) : -1;
+  if (zfseeko(f, cdb.start, SEEK_SET) || end < cdb.start ||
+      (uzoff_t)(end - cdb.start) < size)
+    return;
+  if ((cdb.buf = malloc((extent)size)) == NULL)
+    return;
+  if (fread(cdb.buf, 1, (extent)size, f) != (extent)size) {
+    cdb_free();
+    zfseeko(f, cdb.start, SEEK_SET);
+    return;
+  }
+  cdb.len = (extent)size;
+  cdb.pos = 0;
+  cd_bulk_size += size;
+}
 
-        if ((m = getc(f)) == EOF)
-          break;
-        if (m == 0x50 /*'P' except EBCDIC*/) {
-          /* not a signature but maybe start of new one */
-          ungetc(m, f);
-          continue;
-        } else if (m >= 16) {
-          /* last 2 chars expect < 16 for signature */
-          continue;
-        }
-        sigbuf[2] = (char) m;
+/* Go back to reading f, at the offset parsed up to. */
+local int cdb_drop(f)
+  FILE *f;
+{
+  zoff_t at = cdb.start + (zoff_t)cdb.pos;
 
-        if ((m = getc(f)) == EOF)
-          break;
-        if (m == 0x50 /*'P' except EBCDIC*/) {
-          /* not a signature but maybe start of new one */
-          ungetc(m, f);
-          continue;
-        } else if (m >= 16) {
-          /* last 2 chars expect < 16 */
-          continue;
-        }
-        sigbuf[3] = (char) m;
+  cdb_free();
+  return zfseeko(f, at, SEEK_SET);
+}
 
-        /* found possible signature */
-        return 1;
-      }
+/* find_next_signature() for the buffer: the next header must start right
+   at the current position, otherwise the file is scanned from there. */
+local int cdb_next_signature(f)
+  FILE *f;
+{
+  char *p;
+
+  if (cdb.buf != NULL) {
+    p = cdb.buf + cdb.pos;
+    if (cdb.len - cdb.pos >= 4 && p[0] == 0x50 && p[1] == 0x4b &&
+        (uch)p[2] < 16 && (uch)p[3] < 16) {
+      memcpy(sigbuf, p, 4);
+      cdb.pos += 4;
+      return 1;
     }
-    m = getc(f);
+    if (cdb_drop(f))
+      return 0;
   }
-  if (ferror(f)) {
-    return 0;
+  return find_next_signature(f);
+}
+
+/* fread(b, n, 1, f) from the buffer while it lasts */
+local int cdb_read(b, n, f)
+  char *b;
+  extent n;
+  FILE *f;
+{
+  if (cdb.buf != NULL) {
+    if (cdb.len - cdb.pos >= n) {
+      memcpy(b, cdb.buf + cdb.pos, n);
+      cdb.pos += n;
+      return 1;
+    }
+    if (cdb_drop(f))
+      return 0;
   }
+  return (int)fread(b, n, 1, f);
+}
 
-  /* found nothing */
-  return 0;
+local zoff_t cdb_tell(f)
+  FILE *f;
+{
+  return cdb.buf != NULL ? cdb.start + (zoff_t)cdb.pos : zftello(f);
 }
 
 /* find_signature
@@ -3112,7 +3247,7 @@ local int scanzipf_fixnew()
    This is old:
 
    The name of the zip file is pointed to by the global "zipfile".  The globals
-   zipbeg, cenbeg, zfiles, zcount, zcomlen, zcomment, and zsort are filled in.
+   zipbeg, cenbeg, zfiles, zcount, zcomlen, zcomment, and zhash are filled in.
    Return an error code in the ZE_ class.
 */
 {
@@ -3133,6 +3268,7 @@ local int scanzipf_fixnew()
       free(split_path); \
       split_path = NULL; \
     } \
+    cdb_free(); \
     return (code); \
   } while (0)
   ulg     eocdr_disk;
@@ -3531,6 +3667,7 @@ local int scanzipf_fixnew()
         z->atx = 0;
         z->off = 0;
         z->dosflag = 0;
+        z->info.mode = 0;
 
         /* Initialize all fields pointing to malloced data to NULL */
         z->zname = z->name = z->iname = z->extra = z->cextra = z->comment = NULL;
@@ -3573,26 +3710,12 @@ local int scanzipf_fixnew()
         /* Central directory header */
 
 
-        /* sort the zlist */
+        /* index the zlist */
         if (in_central_directory == 0) {
           zipmessage("Central Directory found...", "");
-          /* If one or more files, sort by name */
-          if (zcount)
-          {
-            struct zlist far * far *x;    /* pointer into zsort array */
-            struct zlist far *z;          /* pointer into zfiles linked list */
-            int i = 0;
-            extent zl_size = zcount * sizeof(struct zlist far *);
-
-            if (zl_size / sizeof(struct zlist far *) != zcount ||
-                (x = zsort = (struct zlist far **)malloc(zl_size)) == NULL)
-              return ZE_MEM;
-            for (z = zfiles; z != NULL; z = z->nxt)
-              x[i++] = z;
-            qsort((char *)zsort, zcount, sizeof(struct zlist far *), zqcmp);
-
-            /* Skip Unicode searching */
-          }
+          /* If one or more files, index them by name */
+          if (zhash_build() != ZE_OK)
+            return ZE_MEM;
         }
 
         if (verbose) {
@@ -3901,7 +4024,7 @@ local int scanzipf_regnew()
    This is old but more or less still applies:
 
    The name of the zip file is pointed to by the global "zipfile".  The globals
-   zipbeg, cenbeg, zfiles, zcount, zcomlen, zcomment, and zsort are filled in.
+   zipbeg, cenbeg, zfiles, zcount, zcomlen, zcomment, and zhash are filled in.
    Return an error code in the ZE_ class.
 */
 {
@@ -4497,6 +4620,7 @@ local int scanzipf_regnew()
     version_needed = SH(scbuf + 10);
     in_cd_start_disk = LG(scbuf + 16);
     cd_total_entries = LLG(scbuf + 28);
+    cd_total_size = LLG(scbuf + 36);
     in_cd_start_offset = LLG(scbuf + 44) + adjust_offset;
 
     if (version_needed > 46) {
@@ -4603,12 +4727,22 @@ local int scanzipf_regnew()
     } else {
       /* seek to the first CD entry */
       if (first_CD) {
+        /* keep a name index the archive already has unless told otherwise */
+        if (name_index < 0 && total_disks == 1 &&
+            in_cd_start_offset >= NDXEND &&
+            zfseeko(in_file, in_cd_start_offset - NDXEND, SEEK_SET) == 0 &&
+            fread(scbuf, NDXEND, 1, in_file) == 1 &&
+            LG(scbuf + 12) == NDXENDSIG)
+          name_index = 1;
         if (zfseeko(in_file, in_cd_start_offset, SEEK_SET) != 0) {
           fclose(in_file);
           in_file = NULL;
           zipwarn("unable to seek in input file ", split_path);
           RETURN_SC(ZE_READ);
         }
+        /* the whole directory is on this disk: read it at once */
+        if (current_in_disk == total_disks - 1)
+          cdb_load(in_file, cd_total_size);
         first_CD = 0;
         x = &zfiles;                        /* first link */
       }
@@ -4616,8 +4750,8 @@ local int scanzipf_regnew()
 
     /* Main loop */
     /* Look for next signature and process it */
-    while (find_next_signature(in_file)) {
-      current_in_offset = zftello(in_file);
+    while (cdb_next_signature(in_file)) {
+      current_in_offset = cdb_tell(in_file);
 
       if (is_signature(sigbuf, "PK\05\06")) {
         /* End Of Central Directory Record */
@@ -4696,7 +4830,7 @@ local int scanzipf_regnew()
         file comment (variable size)
        */
 
-      if (fread(scbuf, CENHEAD, 1, in_file) != 1) {
+      if (cdb_read(scbuf, CENHEAD, in_file) != 1) {
         zipwarn("reading central directory: ", strerror(errno));
         if (fix == 1) {
           zipwarn("bad archive - error reading central directory", "");
@@ -4707,7 +4841,8 @@ local int scanzipf_regnew()
         }
       }
 
-      if ((z = (struct zlist far *)farmalloc(sizeof(struct zlist))) == NULL) {
+      /* the entry and its strings live in the arena (see util.c) */
+      if ((z = (struct zlist far *)arena_alloc(sizeof(struct zlist), 1)) == NULL) {
         zipwarn("reading central directory", "");
         RETURN_SC(ZE_MEM);
       }
@@ -4749,13 +4884,13 @@ local int scanzipf_regnew()
         RETURN_SC(ZE_FORM);
 #endif
       }
-      if ((z->iname = malloc(z->nam+1)) ==  NULL ||
-          (z->cext && (z->cextra = malloc(z->cext)) == NULL) ||
-          (z->com && (z->comment = malloc(z->com)) == NULL))
+      if ((z->iname = (char *)arena_alloc(z->nam+1, 0)) ==  NULL ||
+          (z->cext && (z->cextra = (char *)arena_alloc(z->cext, 0)) == NULL) ||
+          (z->com && (z->comment = (char *)arena_alloc(z->com, 0)) == NULL))
         RETURN_SC(ZE_MEM);
-      if (fread(z->iname, z->nam, 1, in_file) != 1 ||
-          (z->cext && fread(z->cextra, z->cext, 1, in_file) != 1) ||
-          (z->com && fread(z->comment, z->com, 1, in_file) != 1)) {
+      if (cdb_read(z->iname, z->nam, in_file) != 1 ||
+          (z->cext && cdb_read(z->cextra, z->cext, in_file) != 1) ||
+          (z->com && cdb_read(z->comment, z->com, in_file) != 1)) {
         if (fix == 1) {
           zipwarn("error reading entry:  ", strerror(errno));
           zipwarn("skipping this entry...", "");
@@ -4769,16 +4904,16 @@ local int scanzipf_regnew()
         if (z->flg & UTF8_BIT) {
           char *iname;
           /* path is UTF-8 */
-          if ((z->uname = malloc(strlen(z->iname) + 1)) == NULL) {
-            zipwarn("could not allocate memory: scanzipf_reg", "");
-            RETURN_SC(ZE_MEM);
-          }
-          strcpy(z->uname, z->iname);
+          z->uname = z->iname;
           /* Create a local name.  If UTF-8 system this should also be UTF-8 */
           iname = utf8_to_local_string(z->uname);
           if (iname) {
-            free(z->iname);
-            z->iname = iname;
+            z->iname = arena_strdup(iname, z->uname);
+            free(iname);
+            if (z->iname == NULL) {
+              zipwarn("could not allocate memory: scanzipf_reg", "");
+              RETURN_SC(ZE_MEM);
+            }
           }
           else
             zipwarn("illegal UTF-8 name: ", z->uname);
@@ -4822,16 +4957,32 @@ local int scanzipf_regnew()
       /* Clear actions */
       z->mark = 0;
       z->trash = 0;
+      z->info.mode = 0;
 #if defined(UNICODE_SUPPORT) && !defined(UTIL)
-      z->zname = in2ex(z->iname);       /* convert to external name */
-      if (z->zname == NULL)
-        RETURN_SC(ZE_MEM);
-      if ((z->name = malloc(strlen(z->zname) + 1)) == NULL) {
-        zipwarn("could not allocate memory: scanzipf_reg", "");
-        RETURN_SC(ZE_MEM);
+      /* The conversions return malloc'd strings, which are copied to the
+         arena.  name may share zname, as it does without Unicode support;
+         the display names are shared when they are the same. */
+      {
+        char *t;
+
+        if ((t = in2ex(z->iname)) == NULL)     /* convert to external name */
+          RETURN_SC(ZE_MEM);
+        z->zname = arena_strdup(t, NULL);
+        free(t);
+        if (z->zname == NULL) {
+          zipwarn("could not allocate memory: scanzipf_reg", "");
+          RETURN_SC(ZE_MEM);
+        }
+        z->name = z->zname;
+        if ((t = local_to_display_string(z->iname)) != NULL) {
+          z->oname = arena_strdup(t, z->zname);
+          free(t);
+          if (z->oname == NULL) {
+            zipwarn("could not allocate memory: scanzipf_reg", "");
+            RETURN_SC(ZE_MEM);
+          }
+        }
       }
-      strcpy(z->name, z->zname);
-      z->oname = local_to_display_string(z->iname);
 
 
       if (unicode_mismatch != 3) {
@@ -4857,7 +5008,7 @@ local int scanzipf_regnew()
 
 # ifdef EBCDIC
           /* z->zname is used for printing and must be coded in native charset */
-          if ((z->zuname = malloc(strlen(name) + 1)) == NULL) {
+          if ((z->zuname = (char *)arena_alloc(strlen(name) + 1, 0)) == NULL) {
             zipwarn("could not allocate memory: scanzipf_reg", "");
             free(name);
             RETURN_SC(ZE_MEM);
@@ -4866,12 +5017,11 @@ local int scanzipf_regnew()
           free(name);
           name = NULL;
 # else /* !EBCDIC */
-          if ((z->zuname = malloc(strlen(name) + 1)) == NULL) {
+          if ((z->zuname = arena_strdup(name, z->zname)) == NULL) {
             zipwarn("could not allocate memory: scanzipf_reg", "");
             free(name);
             RETURN_SC(ZE_MEM);
           }
-          strcpy(z->zuname, name);
           /* For output to terminal */
           if (unicode_escape_all) {
             char *ouname;
@@ -4879,21 +5029,17 @@ local int scanzipf_regnew()
             ouname = utf8_to_escape_string(z->uname);
             if (ouname)
               z->ouname = ouname;
-            else {
-              if ((z->ouname = malloc(strlen(name) + 1)) == NULL) {
-                zipwarn("could not allocate memory: scanzipf_reg", "");
-                free(name);
-                RETURN_SC(ZE_MEM);
-              }
-              strcpy(z->ouname, name);
+            else if ((z->ouname = arena_strdup(name, z->zuname)) == NULL) {
+              zipwarn("could not allocate memory: scanzipf_reg", "");
+              free(name);
+              RETURN_SC(ZE_MEM);
             }
           } else {
-            if ((z->ouname = malloc(strlen(name) + 1)) == NULL) {
+            if ((z->ouname = arena_strdup(name, z->zuname)) == NULL) {
               zipwarn("could not allocate memory: scanzipf_reg", "");
               free(name);
               RETURN_SC(ZE_MEM);
             }
-            strcpy(z->ouname, name);
           }
           free(name);
           name = NULL;
@@ -4908,7 +5054,7 @@ local int scanzipf_regnew()
       z->name = z->iname;
 #  ifdef EBCDIC
 /* z->zname is used for printing and must be coded in native charset */
-      if ((z->zname = malloc(z->nam+1)) ==  NULL) {
+      if ((z->zname = (char *)arena_alloc(z->nam+1, 0)) ==  NULL) {
         zipwarn("could not allocate memory: scanzipf_reg", "");
         RETURN_SC(ZE_MEM);
       }
@@ -4917,16 +5063,21 @@ local int scanzipf_regnew()
       z->zname = z->iname;
 #  endif
 # else /* !UTIL */
-      z->zname = in2ex(z->iname);       /* convert to external name */
-      if (z->zname == NULL)
-        RETURN_SC(ZE_MEM);
+      {
+        char *t;
+
+        if ((t = in2ex(z->iname)) == NULL)     /* convert to external name */
+          RETURN_SC(ZE_MEM);
+        z->zname = arena_strdup(t, NULL);
+        free(t);
+        if (z->zname == NULL) {
+          zipwarn("could not allocate memory: scanzipf_reg", "");
+          RETURN_SC(ZE_MEM);
+        }
+      }
       z->name = z->zname;
 # endif /* ?UTIL */
-      if ((z->oname = malloc(strlen(z->zname) + 1)) == NULL) {
-        zipwarn("could not allocate memory: scanzipf_reg", "");
-        RETURN_SC(ZE_MEM);
-      }
-      strcpy(z->oname, z->zname);
+      z->oname = z->zname;              /* display name, not changed */
 #endif /* ?(UNICODE_SUPPORT && !UTIL) */
 
 #ifndef UTIL
@@ -4942,6 +5093,7 @@ local int scanzipf_regnew()
     } /* while reading file */
 
     /* close disk and do next disk */
+    cdb_free();
     fclose(in_file);
     in_file = NULL;
     free(split_path);
@@ -5100,32 +5252,13 @@ int readzipfile()
 # endif
   }
 
+  sigw_free();
+
   if (fix != 2 && readable)
   {
-    /* If one or more files, sort by name */
-    if (zcount)
-    {
-      struct zlist far * far *x;    /* pointer into zsort array */
-      struct zlist far *z;          /* pointer into zfiles linked list */
-      extent zl_size = zcount * sizeof(struct zlist far *);
-
-      if (zl_size / sizeof(struct zlist far *) != zcount ||
-          (x = zsort = (struct zlist far **)malloc(zl_size)) == NULL)
-        return ZE_MEM;
-      for (z = zfiles; z != NULL; z = z->nxt)
-        *x++ = z;
-      qsort((char *)zsort, zcount, sizeof(struct zlist far *), zqcmp);
-
-#ifdef UNICODE_SUPPORT
-      /* sort by zuname (local conversion of UTF-8 name) */
-      if (zl_size / sizeof(struct zlist far *) != zcount ||
-          (x = zusort = (struct zlist far **)malloc(zl_size)) == NULL)
-        return ZE_MEM;
-      for (z = zfiles; z != NULL; z = z->nxt)
-        *x++ = z;
-      qsort((char *)zusort, zcount, sizeof(struct zlist far *), zuqcmp);
-#endif
-    }
+    /* If one or more files, index them by name */
+    if (zhash_build() != ZE_OK)
+      return ZE_MEM;
   }
 
   /* ------------------------ */
@@ -5457,6 +5590,53 @@ int putextended(z)
   return ZE_OK;
 }
 
+local int cenprep(z, len)
+  struct zlist far *z;    /* zip entry to settle the central header of */
+  extent *len;            /* set to the size of that header */
+/* Set the UTF-8 flag or add the Unicode Path and Zip64 extra fields that
+   the central header of *z needs, and set *len to the number of bytes
+   putcentral() will write for it.  A second call for the same entry
+   changes nothing, so putindex() can size the central directory before it
+   is written.  Return an error code in the ZE_ class. */
+{
+  ush nam = z->nam;       /* size of name to write to header */
+#ifdef ZIP64_SUPPORT        /* zip64 support 09/02/2003 R.Nausedat */
+  int iRes;
+#endif
+
+#ifdef UNICODE_SUPPORT
+  if (z->uname) {
+    if (utf8_force) {
+      z->flg |= UTF8_BIT;
+    }
+    if (z->flg & UTF8_BIT) {
+      /* If this flag is set, then restore UTF-8 as path name */
+      nam = strlen(z->uname);
+    } else {
+      add_Unicode_Path_cen_extra_field(z);
+    }
+  } else {
+    /* clear UTF-8 bit as not needed */
+    z->flg &= ~UTF8_BIT;
+    z->lflg &= ~UTF8_BIT;
+  }
+#endif
+
+#ifdef ZIP64_SUPPORT        /* zip64 support 09/02/2003 R.Nausedat */
+  if (z->siz > ZIP_UWORD32_MAX || z->len > ZIP_UWORD32_MAX ||
+      z->off > ZIP_UWORD32_MAX || z->dsk > ZIP_UWORD16_MAX || (force_zip64 == 1))
+  {
+    iRes = add_central_zip64_extra_field(z);
+    if( iRes != ZE_OK )
+      return iRes;
+  }
+#endif
+
+  *len = 4 + CENHEAD + nam + z->cext + z->com;
+  return ZE_OK;
+}
+
+
 int putcentral(z)
   struct zlist far *z;    /* zip entry to write central header for */
 /* Write a central header described by *z to file *f.  Return an error code
@@ -5484,41 +5664,22 @@ int putcentral(z)
 #ifdef UNICODE_SUPPORT
   int use_uname = 0;    /* write uname to header */
 #endif
+  extent len;           /* size of the whole header */
+  int r;
 
-#ifdef ZIP64_SUPPORT        /* zip64 support 09/02/2003 R.Nausedat */
-  int iRes;
-#endif
-
+  if ((r = cenprep(z, &len)) != ZE_OK)
+    return r;
 #ifdef UNICODE_SUPPORT
-  if (z->uname) {
-    if (utf8_force) {
-      z->flg |= UTF8_BIT;
-    }
-    if (z->flg & UTF8_BIT) {
-      /* If this flag is set, then restore UTF-8 as path name */
-      use_uname = 1;
-      nam = strlen(z->uname);
-    } else {
-      add_Unicode_Path_cen_extra_field(z);
-    }
-  } else {
-    /* clear UTF-8 bit as not needed */
-    z->flg &= ~UTF8_BIT;
-    z->lflg &= ~UTF8_BIT;
+  if (z->uname && (z->flg & UTF8_BIT)) {
+    /* If this flag is set, then restore UTF-8 as path name */
+    use_uname = 1;
+    nam = strlen(z->uname);
   }
 #endif
 
   off = z->off;
 
 #ifdef ZIP64_SUPPORT        /* zip64 support 09/02/2003 R.Nausedat */
-  if (z->siz > ZIP_UWORD32_MAX || z->len > ZIP_UWORD32_MAX ||
-      z->off > ZIP_UWORD32_MAX || z->dsk > ZIP_UWORD16_MAX || (force_zip64 == 1))
-  {
-    iRes = add_central_zip64_extra_field(z);
-    if( iRes != ZE_OK )
-      return iRes;
-  }
-
   append_ulong_to_mem(CENSIG, &block, &offset, &blocksize);     /* central file header signature */
   append_ushort_to_mem(z->vem, &block, &offset, &blocksize);    /* version made by */
   append_ushort_to_mem(z->ver, &block, &offset, &blocksize);    /* version needed to extract */
@@ -5622,6 +5783,71 @@ int putcentral(z)
 }
 
 
+int putindex(all)
+  int all;                /* 0 = only marked entries go in the directory */
+/* Write the name index for the central directory about to be written at
+   tempzn, and advance tempzn past it.  Return an error code in the ZE_
+   class. */
+{
+  struct zlist far *z;
+  struct ndxent *ndx;
+  extent n = 0;             /* entries in the index */
+  extent i;
+  extent len;               /* size of one central header */
+  uzoff_t cd = 0;           /* size of the central directory so far */
+  char buf[NDXEND];
+  int r;
+
+  for (z = zfiles; z != NULL; z = z->nxt)
+    if (all || z->mark)
+      n++;
+  if (n == 0 || n > 0xffffffffL)
+    return ZE_OK;
+  if ((ndx = (struct ndxent *)malloc(n * sizeof(struct ndxent))) == NULL)
+    return ZE_MEM;
+
+  i = 0;
+  for (z = zfiles; z != NULL; z = z->nxt) {
+    if (!(all || z->mark))
+      continue;
+    if ((r = cenprep(z, &len)) != ZE_OK) {
+      free(ndx);
+      return r;
+    }
+#ifdef UNICODE_SUPPORT
+    if (z->uname && (z->flg & UTF8_BIT))
+      ndx[i].crc = crc32(CRCVAL_INITIAL, (uch *)z->uname, strlen(z->uname));
+    else
+#endif
+      ndx[i].crc = crc32(CRCVAL_INITIAL, (uch *)z->iname, z->nam);
+    ndx[i++].off = cd;
+    cd += len;
+  }
+  qsort((char *)ndx, n, sizeof(struct ndxent), ndxcmp);
+
+  write_ulong_to_mem(NDXSIG, buf);
+  r = bfwrite(buf, 1, 4, BFWRITE_HEADER) != 4;
+  for (i = 0; i < n && !r; i++) {
+    write_ulong_to_mem(ndx[i].crc, buf);
+    write_ulong_to_mem((ulg)ndx[i].off, buf + 4);
+    write_ulong_to_mem((ulg)((ndx[i].off >> 16) >> 16), buf + 8);
+    r = bfwrite(buf, 1, NDXENT, BFWRITE_HEADER) != NDXENT;
+  }
+  free(ndx);
+  if (r)
+    return ZE_TEMP;
+  write_ulong_to_mem((ulg)n, buf);
+  write_ulong_to_mem((ulg)cd, buf + 4);
+  write_ulong_to_mem((ulg)((cd >> 16) >> 16), buf + 8);
+  write_ulong_to_mem(NDXENDSIG, buf + 12);
+  if (bfwrite(buf, 1, NDXEND, BFWRITE_HEADER) != NDXEND)
+    return ZE_TEMP;
+
+  tempzn += 4 + (uzoff_t)n * NDXENT + NDXEND;
+  return ZE_OK;
+}
+
+
 /* Write the end of central directory data to file y.  Return an error code
    in the ZE_ class. */
 
@@ -13,6 +13,10 @@
  */
 #define __ZIPUP_C
 
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE   /* SEEK_DATA, SEEK_HOLE */
+#endif
+
 /* Found that for at least unix port zip.h has to be first or ctype.h will
    define off_t and when using 64-bit file environment off_t in other files
    is 8 bytes while off_t here is 4 bytes, and this makes the zlist struct
@@ -95,6 +99,9 @@
 /* Local functions */
    local int suffixes OF((char *, char *));
 local unsigned file_read OF((char *buf, unsigned size));
+#ifdef SEEK_HOLE
+  local void find_hole OF((zoff_t from));
+#endif
 #ifdef USE_ZLIB
   local int zl_deflate_init OF((int pack_level));
 #else /* !USE_ZLIB */
@@ -124,6 +131,8 @@ local zoff_t bzfilecompress OF((struct zlist far *z_entry, int *cmpr_method));
 
   unsigned (*read_buf) OF((char *buf, unsigned size)) = file_read;
   /* Current input function. Set to mem_read for in-memory compression */
+  int input_holes = 0;
+  /* The file being read has holes, see in_hole() */
 #endif /* !USE_ZLIB */
 
 
@@ -169,6 +178,17 @@ local ftype ifile;              /* file to compress */
 #else /* !DEBUG */
     local zoff_t isize;         /* input file size. global only for debugging */
 #endif /* ?DEBUG */
+#ifdef SEEK_HOLE
+  /* Next hole in ifile and where the data after it starts, found with
+   * SEEK_HOLE/SEEK_DATA so file_read() can hand back the zeros of a
+   * sparse file without reading them.  hole_at is -1 if there is none.
+   */
+  local zoff_t hole_at = -1;
+  local zoff_t hole_end;
+  /* The hole before that one, which deflate may not be through with yet */
+  local zoff_t hole_was_at = -1;
+  local zoff_t hole_was_end;
+#endif /* SEEK_HOLE */
   /* If file_read detects binary it sets this flag - 12/16/04 EG */
   local int file_binary = 0;        /* first buf */
   local int file_binary_final = 0;  /* for bzip2 for entire file.  assume text until find binary */
@@ -330,7 +350,8 @@ struct zlist far *z;    /* zip entry to compress */
   file_binary = -1;      /* not set, set after first read */
   file_binary_final = 0; /* not set, set after first read */
 
-  tim = filetime(z->name, &a, &q, &f_utim);
+  /* what the scan found, without asking again; checked once it is open */
+  tim = fileinfo(z->name, &z->info, &a, &q, &f_utim);
   if (tim == 0 || q == (zoff_t) -3)
     return ZE_OPEN;
 
@@ -390,10 +411,10 @@ struct zlist far *z;    /* zip entry to compress */
     }
   }
   if (z->ext) {
-    free((zvoid *)(z->extra));
+    arena_free((zvoid *)(z->extra));
   }
   if (z->cext && z->extra != z->cextra) {
-    free((zvoid *)(z->cextra));
+    arena_free((zvoid *)(z->cextra));
   }
   z->extra = z->cextra = NULL;
   z->ext = z->cext = 0;
@@ -426,6 +447,12 @@ struct zlist far *z;    /* zip entry to compress */
   }
 #endif
 
+#ifdef SEEK_HOLE
+  hole_at = hole_was_at = -1;
+#endif
+#ifndef USE_ZLIB
+  input_holes = 0;
+#endif
   /* Open file to zip up unless it is stdin */
   if (strcmp(z->name, "-") == 0)
   {
@@ -483,6 +510,30 @@ struct zlist far *z;    /* zip entry to compress */
 #endif /* CMS_MVS */
       if ((ifile = zopen(z->name, fhow)) == fbad)
         return ZE_OPEN;
+      if (fdinfo(ifile, &z->info)) {
+        /* changed since the scan:  describe the file as it is now */
+        tim = fileinfo(z->name, &z->info, &a, &q, &f_utim);
+        uq = ((uzoff_t) q > (uzoff_t) -3) ? 0 : (uzoff_t) q;
+        z->len = uq;
+        if (extra_fields) {
+          if (z->extra != NULL)
+            arena_free((zvoid *)(z->extra));
+          if (z->cextra != NULL && z->cextra != z->extra)
+            arena_free((zvoid *)(z->cextra));
+          z->extra = z->cextra = NULL;
+          z->ext = z->cext = 0;
+          set_extra_field(z, &f_utim);
+        }
+      }
+#ifdef SEEK_HOLE
+      /* a file smaller than the window is not worth probing for holes */
+      if (!translate_eol && q > (zoff_t)WSIZE) {
+        find_hole((zoff_t)0);
+# ifndef USE_ZLIB
+        input_holes = hole_at >= 0;
+# endif
+      }
+#endif
     }
 
     z->tim = tim;
@@ -548,11 +599,11 @@ struct zlist far *z;    /* zip entry to compress */
     /* step through old extra fields and copy over any not already
        in new extra fields */
     p = copy_nondup_extra_fields(tempextra, tempext, z->extra, z->ext, &len);
-    free(z->extra);
+    arena_free(z->extra);
     z->ext = len;
     z->extra = p;
     p = copy_nondup_extra_fields(tempcextra, tempcext, z->cextra, z->cext, &len);
-    free(z->cextra);
+    arena_free(z->cextra);
     z->cext = len;
     z->cextra = p;
 
@@ -903,7 +954,7 @@ struct zlist far *z;    /* zip entry to compress */
   /* Free the local extra field which is no longer needed */
   if (z->ext) {
     if (z->extra != z->cextra) {
-      free((zvoid *)(z->extra));
+      arena_free((zvoid *)(z->extra));
       z->extra = NULL;
     }
     z->ext = 0;
@@ -961,6 +1012,9 @@ local unsigned file_read(buf, size)
   unsigned len;
   char *b;
   zoff_t isize_prev;    /* Previous isize.  Used for overflow check. */
+#if defined(SEEK_HOLE) && !defined(USE_ZLIB)
+  int zeros = 0;        /* buf is a hole:  checksum it without reading it */
+#endif
 
 #if defined(MMAP) || defined(BIG_MEM)
   if (remain == 0L) {
@@ -978,7 +1032,26 @@ local unsigned file_read(buf, size)
   } else
 #endif /* MMAP || BIG_MEM */
   if (translate_eol == 0) {
+#ifdef SEEK_HOLE
+    if (hole_at >= 0 && isize >= hole_at) {
+      /* inside a hole: the data is all zeros, so don't read it */
+      len = hole_end - isize < (zoff_t)size ? (unsigned)(hole_end - isize)
+                                            : size;
+      memset(buf, 0, len);
+# ifndef USE_ZLIB
+      zeros = 1;
+# endif
+      if (isize + len == hole_end)
+        find_hole(hole_end);
+    } else {
+      /* stop at the next hole so the read doesn't pull in its zeros */
+      if (hole_at >= 0 && hole_at - isize < (zoff_t)size)
+        size = (unsigned)(hole_at - isize);
+      len = zread(ifile, buf, size);
+    }
+#else /* !SEEK_HOLE */
     len = zread(ifile, buf, size);
+#endif /* ?SEEK_HOLE */
     if (len == (unsigned)EOF || len == 0) return len;
 #ifdef OS390
     b = buf;
@@ -1082,6 +1155,11 @@ local unsigned file_read(buf, size)
       }
     }
   }
+#if defined(SEEK_HOLE) && !defined(USE_ZLIB)
+  if (zeros)
+    crc = crc32_zeros(crc, (zoff_t)len);
+  else
+#endif
   crc = crc32(crc, (uch *) buf, len);
   /* 2005-05-23 SMS.
      Increment file size.  A small-file program reading a large file may
@@ -1097,6 +1175,58 @@ local unsigned file_read(buf, size)
 }
 
 
+#ifdef SEEK_HOLE
+local void find_hole(from)
+  zoff_t from;          /* file offset to look from */
+/* Set hole_at and hole_end to the next hole in ifile at or after from and
+ * leave the file positioned at from.  The implied hole at end of file
+ * doesn't count.  If the file system can't tell, there are no holes.
+ */
+{
+  off_t end;
+  off_t h;
+  off_t d;
+
+  if (hole_at >= 0) {
+    hole_was_at = hole_at;
+    hole_was_end = hole_end;
+  }
+  hole_at = -1;
+  if ((end = lseek(ifile, 0, SEEK_END)) != (off_t)-1 &&
+      (h = lseek(ifile, (off_t)from, SEEK_HOLE)) != (off_t)-1 && h < end) {
+    d = lseek(ifile, h, SEEK_DATA);
+    hole_at = (zoff_t)h;
+    hole_end = (zoff_t)(d == (off_t)-1 ? end : d);  /* ENXIO: to the end */
+  }
+  if (lseek(ifile, (off_t)from, SEEK_SET) == (off_t)-1)
+    ZIPERR(ZE_READ, "error seeking input file");
+}
+#endif /* SEEK_HOLE */
+
+
+#ifndef USE_ZLIB
+int in_hole(back, len)
+  unsigned back;        /* bytes before the end of what file_read() gave */
+  unsigned len;         /* length of the span */
+/* Return true if the len bytes that start back bytes before the end of the
+ * input read so far lie in one hole of the file, so deflate can code them
+ * without looking at them.  Only the hole being read and the one before it
+ * are known; spans in older ones are compressed as usual.
+ */
+{
+#ifdef SEEK_HOLE
+  zoff_t from = isize - (zoff_t)back;
+  zoff_t to = from + (zoff_t)len;
+
+  return (hole_at >= 0 && from >= hole_at && to <= hole_end) ||
+         (hole_was_at >= 0 && from >= hole_was_at && to <= hole_was_end);
+#else
+  return 0;
+#endif
+}
+#endif /* !USE_ZLIB */
+
+
 #ifdef USE_ZLIB
 
 local int zl_deflate_init(pack_level)
@@ -1438,6 +1568,7 @@ ulg memcompress(tgt, tgtsize, src, srcsize)
         error("zlib deflateReset failed");
 #else /* !USE_ZLIB */
     read_buf  = mem_read;
+    input_holes = 0;
     in_buf    = src;
     in_size   = (unsigned)srcsize;
     in_offset = 0;